@@ -0,0 +1,252 @@
+// IPC latency/throughput benchmark. Runs the ipc class over an in-process socketpair: a worker
+// thread echoes every request with a response of the same size while the client keeps a fixed
+// number of workloads in flight. Results are printed as JSON so runs can be diffed.
+//
+// Usage: ipc_bench [--messages=N] [--output=FILE]
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <nlohmann/json.hpp>
+#include "ipc.hpp"
+
+namespace {
+using bench_clock = std::chrono::steady_clock;
+
+const size_t PAYLOAD_SIZES[] = {100, 64 * 1024, 1024 * 1024};
+const size_t CONCURRENCY_LEVELS[] = {1, 4, 16, 64};
+
+// Swallows everything written to it. Stateless, so the benchmark threads can log concurrently.
+class null_buffer : public std::streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
+    std::streamsize xsputn(const char*, std::streamsize count) override {
+        return count;
+    }
+};
+
+struct run_result {
+    size_t payload_bytes = 0;
+    size_t concurrency = 0;
+    size_t messages = 0;
+    double seconds = 0.0;
+    std::vector<double> latencies_us;
+    std::string error;
+};
+
+// Roughly the same amount of data per run, so large payloads do not take minutes
+size_t default_message_count(size_t payload_bytes) {
+    if (payload_bytes <= 1024) {
+        return 20000;
+    }
+    if (payload_bytes <= 64 * 1024) {
+        return 2000;
+    }
+    return 100;
+}
+
+double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+// Echoes each request back with a completed response carrying a payload of the same size
+void run_echo_worker(int socket_fd, const std::string& response) {
+    ipc worker;
+    worker.set_socket(socket_fd);
+    while (true) {
+        auto [workload_id, workload, params, timeout_ms] = worker.receive_workload_request();
+        if (workload_id == 0) {
+            break;
+        }
+        if (!worker.send_workload_response(workload_id, workload_status::completed, response)) {
+            break;
+        }
+    }
+}
+
+bool run_benchmark(size_t payload_bytes, size_t concurrency, size_t messages, run_result& result) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+        result.error = std::string("socketpair failed: ") + strerror(errno);
+        return false;
+    }
+
+    // The JSON encoding adds a few bytes of quoting; the payload itself is the requested size
+    nlohmann::json params = {{"data", std::string(payload_bytes, 'x')}};
+    std::string response = nlohmann::json(std::string(payload_bytes, 'y')).dump();
+    std::thread worker_thread(run_echo_worker, fds[1], response);
+
+    ipc client;
+    client.set_socket(fds[0]);
+
+    std::mutex mutex;
+    std::condition_variable window_condition;
+    size_t in_flight = 0;
+    bool reader_done = false;
+    // The echo worker answers in order, so responses match send times first in, first out
+    std::deque<bench_clock::time_point> sent_at;
+    result.latencies_us.clear();
+    result.latencies_us.reserve(messages);
+
+    // Responses are read on their own thread, like the client's reader, so a full socket buffer
+    // in one direction never stalls the other
+    std::thread reader_thread([&]() {
+        for (size_t received = 0; received < messages; received++) {
+            auto [workload_id, status, message] = client.receive_workload_response();
+            bench_clock::time_point now = bench_clock::now();
+            if (workload_id == 0) {
+                break;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!sent_at.empty()) {
+                result.latencies_us.push_back(
+                    std::chrono::duration<double, std::micro>(now - sent_at.front()).count());
+                sent_at.pop_front();
+            }
+            in_flight--;
+            window_condition.notify_one();
+        }
+
+        // Wake the sender if the connection dropped while it waits for a free slot
+        std::lock_guard<std::mutex> lock(mutex);
+        reader_done = true;
+        window_condition.notify_one();
+    });
+
+    bench_clock::time_point start = bench_clock::now();
+    bool ok = true;
+    for (size_t sent = 0; sent < messages; sent++) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            window_condition.wait(lock,
+                                  [&]() { return in_flight < concurrency || reader_done; });
+            if (reader_done) {
+                break;
+            }
+            in_flight++;
+            sent_at.push_back(bench_clock::now());
+        }
+
+        if (client.send_workload_request(workload_type::get_vm_status, params) == 0) {
+            result.error = "Failed to send request";
+            ok = false;
+            break;
+        }
+    }
+
+    // The reader still expects the responses to requests that were never sent; shutting the
+    // socket down ends its blocking receive
+    if (!ok) {
+        shutdown(fds[0], SHUT_RDWR);
+    }
+    reader_thread.join();
+    result.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    // Closing the client end makes the echo worker's next receive fail
+    client.close_worker_socket();
+    worker_thread.join();
+
+    result.payload_bytes = payload_bytes;
+    result.concurrency = concurrency;
+    result.messages = result.latencies_us.size();
+    if (ok && result.messages != messages) {
+        result.error = "Connection lost after " + std::to_string(result.messages) + " responses";
+        ok = false;
+    }
+    return ok;
+}
+
+nlohmann::json to_json(run_result& result) {
+    std::sort(result.latencies_us.begin(), result.latencies_us.end());
+    double rate = result.seconds > 0.0 ? static_cast<double>(result.messages) / result.seconds
+                                       : 0.0;
+    return {{"payload_bytes", result.payload_bytes},
+            {"concurrency", result.concurrency},
+            {"messages", result.messages},
+            {"seconds", result.seconds},
+            {"messages_per_second", rate},
+            {"megabytes_per_second",
+             rate * static_cast<double>(result.payload_bytes) / (1024.0 * 1024.0)},
+            {"latency_us",
+             {{"p50", percentile(result.latencies_us, 0.50)},
+              {"p90", percentile(result.latencies_us, 0.90)},
+              {"p99", percentile(result.latencies_us, 0.99)},
+              {"max", result.latencies_us.empty() ? 0.0 : result.latencies_us.back()}}}};
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t message_override = 0;
+    std::string output_path;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--messages=", 0) == 0) {
+            message_override = std::strtoull(arg.c_str() + strlen("--messages="), nullptr, 10);
+        } else if (arg.rfind("--output=", 0) == 0) {
+            output_path = arg.substr(strlen("--output="));
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--messages=N] [--output=FILE]" << std::endl;
+            return 1;
+        }
+    }
+
+    // The ipc class logs every frame; that formatting is part of what gets measured, but the
+    // output itself would drown the results
+    null_buffer discarded;
+    std::streambuf* original_cout = std::cout.rdbuf(&discarded);
+    std::streambuf* original_cerr = std::cerr.rdbuf(&discarded);
+    std::ostream progress(original_cerr);
+
+    nlohmann::json results = nlohmann::json::array();
+    bool ok = true;
+    for (size_t payload_bytes : PAYLOAD_SIZES) {
+        for (size_t concurrency : CONCURRENCY_LEVELS) {
+            size_t messages =
+                message_override > 0 ? message_override : default_message_count(payload_bytes);
+            run_result result;
+            if (!run_benchmark(payload_bytes, concurrency, messages, result)) {
+                progress << "[Bench] Run failed (payload " << payload_bytes << " B, concurrency "
+                         << concurrency << "): " << result.error << std::endl;
+                ok = false;
+            }
+            results.push_back(to_json(result));
+            progress << "[Bench] Payload " << payload_bytes << " B, concurrency " << concurrency
+                     << ": " << results.back()["messages_per_second"].get<double>() << " msg/s"
+                     << std::endl;
+        }
+    }
+
+    std::cout.rdbuf(original_cout);
+    std::cerr.rdbuf(original_cerr);
+
+    nlohmann::json report = {{"benchmark", "ipc"},
+                             {"protocol", IPC_PROTOCOL_VERSION},
+                             {"results", results}};
+    if (output_path.empty()) {
+        std::cout << report.dump(2) << std::endl;
+    } else {
+        std::ofstream output(output_path);
+        output << report.dump(2) << std::endl;
+    }
+    return ok ? 0 : 1;
+}
@@ -1,9 +1,11 @@
 #include "application.hpp"
 
 #include <cerrno>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <string>
+#include <vector>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -12,6 +14,16 @@
 #include <gtk/gtk.h>
 
 constexpr const char* SOCKET_PATH = "/tmp/lsw.sock";
+// Listening socket of the optional long-lived worker (see client/systemd)
+constexpr const char* DAEMON_SOCKET_PATH = "/run/lsw/worker.sock";
+
+// Generous, since pkexec may be waiting for the user to authenticate
+constexpr int WORKER_CONNECT_TIMEOUT_MS = 120000;
+constexpr int WORKER_ACCEPT_POLL_MS = 250;
+constexpr int WORKER_HELLO_TIMEOUT_MS = 5000;
+
+// Telemetry is drained once per display frame rather than once per record
+constexpr guint TELEMETRY_FRAME_MS = 16;
 
 // Forward declaration for the resource function
 extern "C" GResource* resources_get_resource(void);
@@ -33,53 +45,153 @@ application::~application() {
 
 int application::run(int argc, char** argv) {
     if (argc > 1 && std::string(argv[1]) == "--worker") {
-        return run_worker_mode();
+        return run_worker_mode(argc, argv);
     } else {
         return run_client_mode(argv[0]);
     }
     return 0;
 }
 
-int application::run_worker_mode() {
-    m_worker.emplace();
-    return m_worker->run(SOCKET_PATH);
+int application::run_worker_mode(int argc, char** argv) {
+    // Options after --worker: --daemon, --socket=PATH, --interactive-threads=N, --bulk-threads=N
+    worker_options options;
+    bool daemon = false;
+    std::string socket_path;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t* target = nullptr;
+        std::string value;
+        if (arg == "--daemon") {
+            daemon = true;
+            continue;
+        } else if (arg.rfind("--socket=", 0) == 0) {
+            socket_path = arg.substr(arg.find('=') + 1);
+            continue;
+        } else if (arg.rfind("--interactive-threads=", 0) == 0) {
+            target = &options.interactive_threads;
+            value = arg.substr(arg.find('=') + 1);
+        } else if (arg.rfind("--bulk-threads=", 0) == 0) {
+            target = &options.bulk_threads;
+            value = arg.substr(arg.find('=') + 1);
+        } else {
+            std::cerr << "[Worker] Ignoring unknown argument: " << arg << std::endl;
+            continue;
+        }
+
+        char* end = nullptr;
+        unsigned long count = std::strtoul(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0' || count == 0) {
+            std::cerr << "[Worker] Invalid thread count: " << arg << std::endl;
+            continue;
+        }
+        *target = count;
+    }
+
+    m_worker.emplace(options);
+    if (daemon) {
+        return m_worker->run_daemon(socket_path.empty() ? DAEMON_SOCKET_PATH : socket_path);
+    }
+    return m_worker->run(socket_path.empty() ? SOCKET_PATH : socket_path);
 }
 
 int application::run_client_mode(const char* app_path) {
+    // Prefer a worker daemon that is already running; fall back to a per-session worker
+    if (!connect_to_daemon() && !start_session_worker(app_path)) {
+        return 1;
+    }
+
+    std::optional<nlohmann::json> hello = m_ipc.receive_hello(WORKER_HELLO_TIMEOUT_MS);
+    if (!hello) {
+        std::cerr << "[Client] Worker did not complete the handshake" << std::endl;
+        return 1;
+    }
+
+    m_running_workloads = hello->value("running_workloads", nlohmann::json::array());
+    std::cout << "[Client] Worker ready (PID: " << hello->value("pid", 0)
+              << (hello->value("daemon", false) ? ", daemon" : "") << ")" << std::endl;
+    if (!m_running_workloads.empty()) {
+        std::cout << "[Client] Worker is still running " << m_running_workloads.size()
+                  << " workload(s) from a previous session" << std::endl;
+    }
+
+    // The worker offers its telemetry ring (memfd + eventfd) right after the hello
+    std::vector<int> telemetry_fds = m_ipc.receive_fds(2);
+    if (telemetry_fds.size() == 2 && m_telemetry.attach(telemetry_fds[0], telemetry_fds[1])) {
+        setup_telemetry_monitoring();
+    } else {
+        for (int fd : telemetry_fds) {
+            close(fd);
+        }
+        std::cout << "[Client] Telemetry ring not available, using socket messages only"
+                  << std::endl;
+    }
+
+    // Setup IPC monitoring for the GTK main loop
+    setup_ipc_monitoring();
+
+    return g_application_run(G_APPLICATION(m_app), 0, nullptr);
+}
+
+bool application::connect_to_daemon() {
+    if (access(DAEMON_SOCKET_PATH, F_OK) != 0) {
+        return false;
+    }
+
+    if (!m_ipc.connect_to_server(DAEMON_SOCKET_PATH)) {
+        std::cout << "[Client] Worker daemon not reachable, starting a session worker"
+                  << std::endl;
+        return false;
+    }
+
+    std::cout << "[Client] Attached to worker daemon" << std::endl;
+    return true;
+}
+
+bool application::start_session_worker(const char* app_path) {
     if (!m_ipc.create_server_socket(SOCKET_PATH)) {
         std::cerr << "[Client] Failed to create server socket" << std::endl;
-        return 1;
+        return false;
     }
     if (!m_ipc.listen_for_connections(1)) {
         std::cerr << "[Client] Failed to listen for connections" << std::endl;
-        return 1;
+        return false;
     }
-    if (!launch_worker(app_path)) {
+
+    pid_t worker_pid = launch_worker(app_path);
+    if (worker_pid == -1) {
         std::cerr << "[Client] Failed to launch worker process" << std::endl;
-        return 1;
+        return false;
     }
 
-    // Give the worker a moment to connect
+    // Accept as soon as the worker connects, but notice if pkexec gives up first (e.g. the user
+    // dismissed the authentication dialog)
     std::cout << "[Client] Waiting for worker to connect..." << std::endl;
-    sleep(1);
+    int worker_fd = -1;
+    int waited_ms = 0;
+    while (worker_fd == -1 && waited_ms < WORKER_CONNECT_TIMEOUT_MS) {
+        worker_fd = m_ipc.accept_connection(WORKER_ACCEPT_POLL_MS);
+        waited_ms += WORKER_ACCEPT_POLL_MS;
+
+        int status = 0;
+        if (worker_fd == -1 && waitpid(worker_pid, &status, WNOHANG) == worker_pid) {
+            std::cerr << "[Client] Worker exited before connecting" << std::endl;
+            return false;
+        }
+    }
 
-    int worker_fd = m_ipc.accept_connection();
     if (worker_fd == -1) {
         std::cerr << "[Client] Failed to accept worker connection" << std::endl;
-        return 1;
+        return false;
     }
     std::cout << "[Client] Worker connected" << std::endl;
 
     // Switch IPC to use the worker connection instead of server socket
+    m_ipc.close_server_socket();
     m_ipc.set_socket(worker_fd);
-
-    // Setup IPC monitoring for the GTK main loop
-    setup_ipc_monitoring();
-
-    return g_application_run(G_APPLICATION(m_app), 0, nullptr);
+    return true;
 }
 
-bool application::launch_worker(const char* app_path) {
+pid_t application::launch_worker(const char* app_path) {
     std::cout << "[Client] Starting worker in root mode" << std::endl;
 
     // Use fork and exec to launch worker in background
@@ -92,11 +204,11 @@ bool application::launch_worker(const char* app_path) {
     } else if (pid > 0) {
         // Parent process - worker launched successfully
         std::cout << "[Client] Worker started (PID: " << pid << ")" << std::endl;
-        return true;
+        return pid;
     } else {
         // Fork failed
         std::cerr << "[Client] Failed to fork worker process: " << strerror(errno) << std::endl;
-        return false;
+        return -1;
     }
 }
 
@@ -125,35 +237,60 @@ void application::setup_ipc_monitoring() {
         return;
     }
 
-    // Create a GIOChannel for the socket
-    GIOChannel* channel = g_io_channel_unix_new(socket_fd);
-    g_io_channel_set_encoding(channel, nullptr, nullptr);
-    g_io_channel_set_buffered(channel, false);
-
-    // Add the socket to the main loop for monitoring
-    g_io_add_watch(channel, G_IO_IN, on_ipc_data_available, nullptr);
+    bool started = m_ipc_reader.start(
+        socket_fd,
+        [this](std::vector<workload_event>& events) {
+            // Delegate response handling to IPC class
+            for (const auto& event : events) {
+                m_ipc.handle_workload_event(event);
+            }
+        },
+        [this]() {
+            std::cout << "[Client] IPC connection closed or error occurred" << std::endl;
+            m_ipc.fail_pending_workloads("Lost connection to worker");
+        });
+    if (!started) {
+        std::cerr << "[Client] Failed to start IPC reader" << std::endl;
+        return;
+    }
 
     std::cout << "[Client] IPC monitoring setup complete" << std::endl;
 }
 
-gboolean application::on_ipc_data_available(GIOChannel* source, GIOCondition condition,
-                                            gpointer user_data) {
+void application::setup_telemetry_monitoring() {
+    g_unix_fd_add(m_telemetry.get_event_fd(), G_IO_IN, on_telemetry_signal, nullptr);
+
+    // A daemon's ring outlives clients; records left by a previous session will not signal us
+    if (m_telemetry.arm()) {
+        m_telemetry_frame_source = g_timeout_add(TELEMETRY_FRAME_MS, on_telemetry_frame, nullptr);
+    }
+    std::cout << "[Client] Telemetry monitoring setup complete" << std::endl;
+}
+
+gboolean application::on_telemetry_signal(gint fd, GIOCondition condition, gpointer user_data) {
     application& self = application::instance();
 
-    if (condition & G_IO_IN) {
-        // Data is available on the socket
-        auto [workload_id, status, message] = self.m_ipc.receive_workload_response();
+    self.m_telemetry.acknowledge();
 
-        if (status != static_cast<workload_status>(-1)) {
-            // Delegate response handling to IPC class
-            self.m_ipc.handle_workload_response(workload_id, status, message);
-        }
+    // Start reading at frame rate until the ring goes quiet again
+    if (self.m_telemetry_frame_source == 0) {
+        self.m_telemetry_frame_source =
+            g_timeout_add(TELEMETRY_FRAME_MS, on_telemetry_frame, nullptr);
     }
 
-    if (condition & (G_IO_HUP | G_IO_ERR)) {
-        std::cout << "[Client] IPC connection closed or error occurred" << std::endl;
-        return G_SOURCE_REMOVE; // Stop monitoring
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean application::on_telemetry_frame(gpointer user_data) {
+    application& self = application::instance();
+
+    size_t count = self.m_telemetry.drain(
+        [&self](const telemetry_record& record) { self.m_ipc.handle_telemetry(record); });
+    if (count > 0 || self.m_telemetry.arm()) {
+        return G_SOURCE_CONTINUE;
     }
 
-    return G_SOURCE_CONTINUE; // Continue monitoring
+    // Idle: the producer will signal the eventfd on its next push
+    self.m_telemetry_frame_source = 0;
+    return G_SOURCE_REMOVE;
 }
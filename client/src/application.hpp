@@ -1,6 +1,7 @@
 #pragma once
 
 #include <optional>
+#include <sys/types.h>
 #include <glib.h>
 #include <gtk-4.0/gtk/gtk.h>
 #include <libadwaita-1/adwaita.h>
@@ -8,6 +9,8 @@
 #include "autounattend_manager.hpp"
 #include "installer_window.hpp"
 #include "ipc.hpp"
+#include "ipc_reader.hpp"
+#include "telemetry_ring.hpp"
 #include "vm_manager.hpp"
 #include "worker.hpp"
 
@@ -37,6 +40,13 @@ public:
         return m_autounattend_manager;
     }
 
+    // Workloads a worker daemon was already running when this client attached, as reported in
+    // its hello ({workload_id, type} objects, worker-side IDs). Use ipc::attach_workload to
+    // follow one.
+    const nlohmann::json& get_running_workloads() const {
+        return m_running_workloads;
+    }
+
     // Remove copy/move constructors
     application(const application&) = delete;
     application& operator=(const application&) = delete;
@@ -50,18 +60,27 @@ private:
     installer_window m_installer_window;
     AdwApplication* m_app = nullptr;
     ipc m_ipc;
+    ipc_reader m_ipc_reader;
+    telemetry_ring m_telemetry;
+    guint m_telemetry_frame_source = 0;
     std::optional<worker> m_worker;
+    nlohmann::json m_running_workloads = nlohmann::json::array();
     vm_manager m_vm_manager;
     autounattend_manager m_autounattend_manager;
 
-    int run_worker_mode();
+    int run_worker_mode(int argc, char** argv);
     int run_client_mode(const char* app_path);
-    bool launch_worker(const char* app_path);
+    bool connect_to_daemon();
+    bool start_session_worker(const char* app_path);
+    pid_t launch_worker(const char* app_path);
 
     // IPC monitoring
     void setup_ipc_monitoring();
-    static gboolean on_ipc_data_available(GIOChannel* source, GIOCondition condition,
-                                          gpointer user_data);
+
+    // Telemetry ring monitoring
+    void setup_telemetry_monitoring();
+    static gboolean on_telemetry_signal(gint fd, GIOCondition condition, gpointer user_data);
+    static gboolean on_telemetry_frame(gpointer user_data);
 
     static void on_activate(AdwApplication* app, gpointer user_data);
     static void on_startup(AdwApplication* app, gpointer user_data);
@@ -35,8 +35,8 @@ bool autounattend_manager::validate_configuration(const configuration& config) c
         return false;
     }
 
-    // Validate Windows edition index (should be between 1-10 for most Windows editions)
-    if (config.windows_edition_index < 1 || config.windows_edition_index > 10) {
+    // Validate Windows edition index (image indexes start at 1; media may carry any number)
+    if (config.windows_edition_index < 1) {
         return false;
     }
 
@@ -63,6 +63,20 @@ bool autounattend_manager::validate_configuration(const configuration& config) c
     return true;
 }
 
+namespace {
+std::string driver_paths_component(const std::string& component, const std::string& path) {
+    return "\n\t\t<component name=\"" + component +
+           "\" processorArchitecture=\"amd64\" publicKeyToken=\"31bf3856ad364e35\" "
+           "language=\"neutral\" versionScope=\"nonSxS\">\n"
+           "\t\t\t<DriverPaths>\n"
+           "\t\t\t\t<PathAndCredentials wcm:action=\"add\" wcm:keyValue=\"1\">\n"
+           "\t\t\t\t\t<Path>" + path + "</Path>\n"
+           "\t\t\t\t</PathAndCredentials>\n"
+           "\t\t\t</DriverPaths>\n"
+           "\t\t</component>";
+}
+} // namespace
+
 std::string autounattend_manager::replace_placeholders(const std::string& template_content,
                                                        const configuration& config) const {
     std::string result = template_content;
@@ -107,5 +121,41 @@ std::string autounattend_manager::replace_placeholders(const std::string& templa
         pos += config.password.length();
     }
 
+    // Driver paths: PnpCustomizationsWinPE loads them for Setup itself, PnpCustomizationsNonWinPE
+    // stages them into the installed system
+    std::string winpe_drivers;
+    std::string offline_drivers;
+    if (!config.driver_path.empty()) {
+        winpe_drivers = driver_paths_component("Microsoft-Windows-PnpCustomizationsWinPE",
+                                               config.driver_path);
+        offline_drivers = driver_paths_component("Microsoft-Windows-PnpCustomizationsNonWinPE",
+                                                 config.driver_path) +
+                          "\n\t";
+    }
+    pos = result.find("WINPE_DRIVER_PATHS_PLACEHOLDER");
+    if (pos != std::string::npos) {
+        result.replace(pos, 30, winpe_drivers);
+    }
+    pos = result.find("OFFLINE_DRIVER_PATHS_PLACEHOLDER");
+    if (pos != std::string::npos) {
+        result.replace(pos, 32, offline_drivers);
+    }
+
+    // After FirstLogon.ps1, so the golden image carries its customizations. Clones get their
+    // own computer name and account from the autounattend ISO they boot with.
+    std::string generalize_command;
+    if (config.generalize) {
+        generalize_command =
+            "\n\t\t\t\t<SynchronousCommand wcm:action=\"add\">\n"
+            "\t\t\t\t\t<Order>2</Order>\n"
+            "\t\t\t\t\t<CommandLine>C:\\Windows\\System32\\Sysprep\\sysprep.exe /generalize /oobe "
+            "/shutdown /quiet</CommandLine>\n"
+            "\t\t\t\t</SynchronousCommand>";
+    }
+    pos = result.find("GENERALIZE_COMMAND_PLACEHOLDER");
+    if (pos != std::string::npos) {
+        result.replace(pos, 30, generalize_command);
+    }
+
     return result;
 }
\ No newline at end of file
@@ -6,11 +6,17 @@ class autounattend_manager {
 public:
     struct configuration {
         std::string product_key;
-        int windows_edition_index;
+        int windows_edition_index = 1; // /IMAGE/INDEX within install.wim
         std::string computer_name;
         std::string username;
         std::string display_name;
         std::string password;
+        // Folder of drivers for Setup to load in Windows PE and stage into the installed
+        // system, e.g. slim_media::WINPE_DRIVER_PATH; empty for none
+        std::string driver_path;
+        // Run sysprep /generalize after the first logon and shut down, leaving a disk to use as
+        // a golden image for linked clones
+        bool generalize = false;
     };
 
     autounattend_manager() = default;
@@ -0,0 +1,89 @@
+#include "install_progress.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+namespace {
+// Bytes written by the end of each phase, as multiples of the edition's expanded size
+struct phase {
+    double end;
+    const char* name;
+};
+constexpr phase PHASES[] = {
+    {0.02, "Starting Windows Setup"},
+    {1.00, "Copying Windows files"},
+    {1.30, "Installing features and drivers"},
+    {1.45, "Preparing devices"},
+    {1.60, "Finishing setup"},
+};
+constexpr double EXPECTED_WRITES = 1.60;
+
+// Weight of the newest write rate sample; at one sample every few seconds this remembers about
+// a minute
+constexpr double RATE_SMOOTHING = 0.1;
+
+// Below this write rate the guest is either idle or busy with something other than the disk
+constexpr double STALLED_WRITE_RATE = 1024.0 * 1024.0;
+constexpr double BUSY_CPU_PERCENT = 50.0;
+constexpr double BUSY_NET_RATE = 1024.0 * 1024.0; // downloading updates
+} // namespace
+
+install_progress::install_progress(uint64_t image_bytes, bool already_applied)
+    : m_image_bytes(static_cast<double>(std::max<uint64_t>(image_bytes, 1))),
+      m_credited_bytes(already_applied ? m_image_bytes * PHASES[1].end : 0.0),
+      m_start(clock::now()), m_last_update(m_start) {}
+
+install_progress::estimate install_progress::update(const nlohmann::json& stats) {
+    auto now = clock::now();
+    // Counters run from the start of the QEMU process, which survives Setup's guest reboots
+    double written = stats.value("disk_write_bytes", 0.0);
+    double write_rate = stats.value("disk_write_rate", 0.0);
+    double cpu_percent = stats.value("cpu_percent", 0.0);
+    double net_rate = stats.value("net_rx_rate", 0.0);
+    m_smoothed_rate += RATE_SMOOTHING * (write_rate - m_smoothed_rate);
+
+    double done = (m_credited_bytes + written) / m_image_bytes;
+    estimate result;
+    result.phase = PHASES[std::size(PHASES) - 1].name;
+    for (const phase& entry : PHASES) {
+        if (done < entry.end) {
+            result.phase = entry.name;
+            break;
+        }
+    }
+
+    // Setup may write more than expected; hold at 99% rather than claim it is done
+    m_percent = std::max(m_percent, std::min(99.0, done / EXPECTED_WRITES * 100.0));
+    result.percent = m_percent;
+    result.write_rate = m_smoothed_rate;
+
+    double remaining = std::max(0.0, (EXPECTED_WRITES - done) * m_image_bytes);
+    double elapsed = std::chrono::duration<double>(now - m_start).count();
+    double average_rate = elapsed > 0.0 ? written / elapsed : 0.0;
+    bool busy = cpu_percent >= BUSY_CPU_PERCENT || net_rate >= BUSY_NET_RATE;
+    if (m_smoothed_rate < STALLED_WRITE_RATE && busy && m_eta_seconds >= 0.0) {
+        // Working without writing (e.g. installing features): keep counting down instead of
+        // letting the stalled rate push the estimate out
+        m_eta_seconds = std::max(
+            0.0, m_eta_seconds - std::chrono::duration<double>(now - m_last_update).count());
+    } else {
+        // The recent rate follows phase changes, the average keeps bursts from dominating
+        double pace = (m_smoothed_rate + average_rate) / 2.0;
+        m_eta_seconds = pace > 0.0 ? remaining / pace : -1.0;
+    }
+    m_last_update = now;
+    result.eta_seconds = m_eta_seconds;
+    return result;
+}
+
+std::string install_progress::describe(const estimate& progress) {
+    std::string text =
+        progress.phase + " (" + std::to_string(static_cast<int>(progress.percent)) + "%";
+    if (progress.eta_seconds >= 0.0) {
+        int minutes = static_cast<int>(std::ceil(progress.eta_seconds / 60.0));
+        text += minutes <= 1 ? ", about a minute left"
+                             : ", about " + std::to_string(minutes) + " minutes left";
+    }
+    return text + ")";
+}
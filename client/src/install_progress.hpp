@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <nlohmann/json.hpp>
+
+// Estimates how far Windows Setup has got from the guest's I/O while it runs. Applying the
+// install image writes about the edition's expanded size (total_bytes in the WIM metadata);
+// installing features and drivers, specialize and OOBE write roughly another 60% of it. Phases
+// are boundaries on bytes written, scaled by that size, so the estimate fits every edition.
+class install_progress {
+public:
+    struct estimate {
+        double percent = 0.0; // stays below 100 until Setup shuts the VM down
+        std::string phase;
+        double eta_seconds = -1.0; // -1 while unknown
+        double write_rate = 0.0;   // bytes/s, smoothed
+    };
+
+    // image_bytes: expanded size of the edition being installed. already_applied: the image
+    // was applied from the host (offline apply), so the first boot starts after the copy phase.
+    install_progress(uint64_t image_bytes, bool already_applied);
+
+    // Feed a "stats" event from vm_event_monitor for the installing VM
+    estimate update(const nlohmann::json& stats);
+
+    // "Copying Windows files (34%, about 12 minutes left)"
+    static std::string describe(const estimate& progress);
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    double m_image_bytes;
+    double m_credited_bytes; // counted as written before the VM started
+    clock::time_point m_start;
+    clock::time_point m_last_update;
+    double m_smoothed_rate = 0.0;
+    double m_percent = 0.0;
+    double m_eta_seconds = -1.0;
+};
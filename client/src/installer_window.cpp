@@ -1,6 +1,7 @@
 #include "gio/gio.h"
 #include "installer_window.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <ctime>
 #include <iostream>
@@ -62,6 +63,7 @@ bool installer_window::load(GtkApplication* app) {
     m_admin_password_entry =
         ADW_PASSWORD_ENTRY_ROW(gtk_builder_get_object(builder, "admin_password_entry"));
     m_install_button = GTK_BUTTON(gtk_builder_get_object(builder, "install_button"));
+    m_install_progress = GTK_PROGRESS_BAR(gtk_builder_get_object(builder, "install_progress"));
     m_hardware_accel_check =
         GTK_CHECK_BUTTON(gtk_builder_get_object(builder, "hardware_accel_check"));
 
@@ -106,9 +108,31 @@ void installer_window::show() {
     gtk_window_present(m_window);
     m_current_page = 0;
     update_navigation_state();
+
+    // A worker daemon may still be installing from an earlier session; follow that instead
+    for (const auto& running : application::instance().get_running_workloads()) {
+        if (running.value("type", -1) == static_cast<int>(workload_type::install_vm)) {
+            attach_running_installation(running.value("workload_id", uint64_t(0)));
+            return;
+        }
+    }
     perform_page_action(m_current_page);
 }
 
+bool installer_window::scroll_to_page(int page) {
+    GtkWidget* target = gtk_widget_get_first_child(GTK_WIDGET(m_carousel));
+    for (int i = 0; i < page && target != nullptr; ++i) {
+        target = gtk_widget_get_next_sibling(target);
+    }
+    if (target == nullptr) {
+        return false;
+    }
+
+    adw_carousel_scroll_to(ADW_CAROUSEL(m_carousel), target, 1);
+    m_current_page = page;
+    return true;
+}
+
 bool installer_window::is_page_valid(int page) const {
     if (page < 0 || page >= static_cast<int>(m_page_config.size())) {
         return false;
@@ -149,14 +173,7 @@ void installer_window::on_next_button_clicked(GtkButton* button, gpointer user_d
         return;
     }
 
-    GtkWidget* target = gtk_widget_get_first_child(GTK_WIDGET(self->m_carousel));
-    for (int i = 0; i < next_index && target != nullptr; ++i) {
-        target = gtk_widget_get_next_sibling(target);
-    }
-
-    if (target != nullptr) {
-        adw_carousel_scroll_to(ADW_CAROUSEL(self->m_carousel), target, 1);
-        self->m_current_page = next_index;
+    if (self->scroll_to_page(next_index)) {
         self->perform_page_action(self->m_current_page);
         self->update_navigation_state();
     }
@@ -247,16 +264,64 @@ void installer_window::start_wim_scan_async() {
     show_download_progress(m_data.use_download);
     if (m_loading_label && GTK_IS_LABEL(m_loading_label)) {
         gtk_label_set_text(m_loading_label,
-                           m_data.use_download ? "Downloading ISO..." : "Scanning Windows ISO...");
+                           m_data.use_download ? "Downloading ISO..." : "Verifying ISO...");
     }
 
     if (m_data.use_download) {
         start_iso_download();
     } else {
-        wim_scan_thread(this);
+        start_iso_verification();
     }
 }
 
+void installer_window::start_iso_verification() {
+    // A user-supplied ISO may be damaged; find out now rather than deep into Setup
+    nlohmann::json params = {{"iso_path", m_data.iso_path}};
+
+    application::instance().get_ipc().execute_workload(
+        workload_type::verify_iso, params,
+        [this](const nlohmann::json& result) {
+            if (!m_window || !GTK_IS_WINDOW(m_window)) {
+                return;
+            }
+
+            if (!result.value("valid", false)) {
+                std::string message = "The selected ISO is corrupt: " +
+                                      result.value("detail", "integrity check failed");
+                if (m_loading_label && GTK_IS_LABEL(m_loading_label)) {
+                    gtk_label_set_text(m_loading_label, message.c_str());
+                }
+                update_navigation_state();
+                return;
+            }
+
+            if (m_loading_label && GTK_IS_LABEL(m_loading_label)) {
+                gtk_label_set_text(m_loading_label, "Scanning Windows ISO...");
+            }
+            wim_scan_thread(this);
+        },
+        [this](const std::string& error) {
+            if (!m_window || !GTK_IS_WINDOW(m_window)) {
+                return;
+            }
+
+            if (m_loading_label && GTK_IS_LABEL(m_loading_label)) {
+                gtk_label_set_text(m_loading_label, ("ISO verification failed: " + error).c_str());
+            }
+            update_navigation_state();
+        },
+        [this](const std::string& progress) {
+            if (!m_window || !GTK_IS_WINDOW(m_window)) {
+                return;
+            }
+
+            // Progress messages carry the throughput
+            if (m_loading_label && GTK_IS_LABEL(m_loading_label)) {
+                gtk_label_set_text(m_loading_label, progress.c_str());
+            }
+        });
+}
+
 void installer_window::wim_scan_thread(installer_window* self) {
     // Execute WIM scan workload
     nlohmann::json params = {{"iso_path", self->m_data.iso_path}};
@@ -278,11 +343,7 @@ void installer_window::wim_scan_thread(installer_window* self) {
             }
 
             // Populate the Windows editions dropdown
-            std::vector<std::string> editions;
-            for (const auto& version : result["windows_versions"]) {
-                editions.push_back(version.get<std::string>());
-            }
-            self->populate_windows_editions(editions);
+            self->apply_scan_result(result);
 
             // Update navigation state using page properties
             self->update_navigation_state();
@@ -516,6 +577,8 @@ void installer_window::start_iso_download() {
     m_data.iso_path = m_data.download_path + "/" + filename;
     opts.output_file_path = m_data.iso_path;
 
+    start_remote_scan(download_url);
+
     // Start download
     m_downloader->download(
         download_url, opts,
@@ -582,6 +645,36 @@ void installer_window::on_download_complete(bool success, const std::string& err
     }
 }
 
+void installer_window::apply_scan_result(const nlohmann::json& result) {
+    std::vector<std::string> editions;
+    for (const auto& version : result["windows_versions"]) {
+        editions.push_back(version.get<std::string>());
+    }
+    m_data.edition_image_indexes.clear();
+    for (const auto& image : result.value("images", nlohmann::json::array())) {
+        m_data.edition_image_indexes.push_back(image.value("index", 0u));
+    }
+    populate_windows_editions(editions);
+}
+
+void installer_window::start_remote_scan(const std::string& url) {
+    // The editions are known after a few megabytes; no need to wait for the whole download
+    nlohmann::json params = {{"iso_url", url}};
+
+    application::instance().get_ipc().execute_workload(
+        workload_type::scan_wim_versions, params,
+        [this](const nlohmann::json& result) {
+            if (!m_window || !GTK_IS_WINDOW(m_window)) {
+                return;
+            }
+            apply_scan_result(result);
+        },
+        [](const std::string& error) {
+            // Not fatal: the editions are read again once the download completes
+            std::cerr << "[Installer] Remote edition scan failed: " << error << std::endl;
+        });
+}
+
 void installer_window::populate_windows_editions(const std::vector<std::string>& editions) {
     if (!m_windows_edition_combo || !ADW_IS_COMBO_ROW(m_windows_edition_combo)) {
         return;
@@ -623,6 +716,18 @@ std::string installer_window::get_selected_windows_edition() const {
     return ""; // Default fallback
 }
 
+uint32_t installer_window::get_selected_image_index() const {
+    if (!m_windows_edition_combo || !ADW_IS_COMBO_ROW(m_windows_edition_combo)) {
+        return 0; // Let the worker resolve it from the edition name
+    }
+
+    guint selected = adw_combo_row_get_selected(m_windows_edition_combo);
+    if (selected < m_data.edition_image_indexes.size()) {
+        return m_data.edition_image_indexes[selected];
+    }
+    return 0;
+}
+
 void installer_window::on_install_button_clicked(GtkButton* button, gpointer user_data) {
     installer_window* self = static_cast<installer_window*>(user_data);
     self->start_vm_installation();
@@ -639,6 +744,7 @@ void installer_window::start_vm_installation() {
     nlohmann::json params = {{"vm_name", "LSWVM"},
                              {"iso_path", m_data.iso_path},
                              {"windows_edition", get_selected_windows_edition()},
+                             {"image_index", get_selected_image_index()},
                              {"admin_username", m_data.admin_username},
                              {"admin_password", m_data.admin_password},
                              {"memory_gb", m_data.memory_gb},
@@ -646,40 +752,110 @@ void installer_window::start_vm_installation() {
                              {"disk_gb", m_data.disk_gb},
                              {"hardware_acceleration", m_data.hardware_acceleration}};
 
-    application::instance().get_ipc().execute_workload(
-        workload_type::install_vm, params,
-        [this](const nlohmann::json& result) {
-            // VM installation completed successfully
-            if (!m_window || !GTK_IS_WINDOW(m_window)) {
-                return;
-            }
+    if (m_install_progress && GTK_IS_PROGRESS_BAR(m_install_progress)) {
+        gtk_progress_bar_set_fraction(m_install_progress, 0.0);
+        gtk_progress_bar_set_text(m_install_progress, nullptr);
+        gtk_widget_set_visible(GTK_WIDGET(m_install_progress), true);
+    }
 
-            append_progress_message("VM installation completed successfully!");
-            append_progress_message("VM Name: " + result.value("vm_name", "Unknown"));
-            append_progress_message("Status: " + result.value("status", "Unknown"));
+    application::instance().get_ipc().execute_workload(workload_type::install_vm, params,
+                                                       make_install_callbacks());
+}
 
-            // Re-enable the install button
-            gtk_widget_set_sensitive(GTK_WIDGET(m_install_button), true);
-        },
-        [this](const std::string& error) {
-            // VM installation failed
-            if (!m_window || !GTK_IS_WINDOW(m_window)) {
-                return;
-            }
+void installer_window::attach_running_installation(uint64_t worker_workload_id) {
+    std::cout << "[Installer] Following running installation (worker ID: "
+              << worker_workload_id << ")" << std::endl;
 
-            append_progress_message("VM installation failed: " + error);
+    // Straight to the last page, where the installation reports its progress
+    scroll_to_page(static_cast<int>(m_page_config.size()) - 1);
+    update_navigation_state();
+    gtk_widget_set_sensitive(GTK_WIDGET(m_install_button), false);
+    if (m_install_progress && GTK_IS_PROGRESS_BAR(m_install_progress)) {
+        gtk_progress_bar_set_fraction(m_install_progress, 0.0);
+        gtk_progress_bar_set_text(m_install_progress, nullptr);
+        gtk_widget_set_visible(GTK_WIDGET(m_install_progress), true);
+    }
+
+    ipc::workload_callbacks callbacks = make_install_callbacks();
+    ipc::workload_progress_callback on_progress = std::move(callbacks.on_progress);
+    callbacks.on_progress = [on_progress](const std::string& progress) {
+        // The worker confirms the attach with an event; everything after it is the installation
+        nlohmann::json event = nlohmann::json::parse(progress, nullptr, false);
+        if (event.is_object() && event.value("event", "") == "attached") {
+            on_progress("Resumed following the installation started earlier");
+            return;
+        }
+        on_progress(progress);
+    };
+    application::instance().get_ipc().attach_workload(worker_workload_id, std::move(callbacks));
+}
 
-            // Re-enable the install button
-            gtk_widget_set_sensitive(GTK_WIDGET(m_install_button), true);
-        },
-        [this](const std::string& progress) {
-            // VM installation progress update
-            if (!m_window || !GTK_IS_WINDOW(m_window)) {
-                return;
-            }
+ipc::workload_callbacks installer_window::make_install_callbacks() {
+    ipc::workload_callbacks callbacks;
+    callbacks.on_complete = [this](const nlohmann::json& result) {
+        // VM installation completed successfully
+        if (!m_window || !GTK_IS_WINDOW(m_window)) {
+            return;
+        }
 
-            append_progress_message(progress);
-        });
+        append_progress_message("VM installation completed successfully!");
+        append_progress_message("VM Name: " + result.value("vm_name", "Unknown"));
+        append_progress_message("Status: " + result.value("status", "Unknown"));
+        if (m_install_progress && GTK_IS_PROGRESS_BAR(m_install_progress)) {
+            gtk_progress_bar_set_fraction(m_install_progress, 1.0);
+            gtk_progress_bar_set_text(m_install_progress, nullptr);
+        }
+
+        // Re-enable the install button
+        gtk_widget_set_sensitive(GTK_WIDGET(m_install_button), true);
+    };
+    callbacks.on_error = [this](const std::string& error) {
+        // VM installation failed
+        if (!m_window || !GTK_IS_WINDOW(m_window)) {
+            return;
+        }
+
+        append_progress_message("VM installation failed: " + error);
+        if (m_install_progress && GTK_IS_PROGRESS_BAR(m_install_progress)) {
+            gtk_widget_set_visible(GTK_WIDGET(m_install_progress), false);
+        }
+
+        // Re-enable the install button
+        gtk_widget_set_sensitive(GTK_WIDGET(m_install_button), true);
+    };
+    callbacks.on_progress = [this](const std::string& progress) {
+        // VM installation progress update
+        if (!m_window || !GTK_IS_WINDOW(m_window)) {
+            return;
+        }
+
+        append_progress_message(progress);
+    };
+    callbacks.on_telemetry = [this](const telemetry_record& record) {
+        on_install_telemetry(record);
+    };
+    return callbacks;
+}
+
+void installer_window::on_install_telemetry(const telemetry_record& record) {
+    if (record.kind != telemetry_kind::progress || record.values[1] <= 0) {
+        return;
+    }
+    if (!m_install_progress || !GTK_IS_PROGRESS_BAR(m_install_progress)) {
+        return;
+    }
+
+    double fraction = std::clamp(record.values[0] / record.values[1], 0.0, 1.0);
+    gtk_progress_bar_set_fraction(m_install_progress, fraction);
+
+    // values[3] is the ETA in seconds, negative while unknown
+    std::string text = std::to_string(static_cast<int>(fraction * 100)) + "%";
+    if (record.values[3] >= 0) {
+        int minutes = static_cast<int>(record.values[3] / 60.0 + 0.5);
+        text += minutes > 0 ? ", about " + std::to_string(minutes) + " min left"
+                            : ", less than a minute left";
+    }
+    gtk_progress_bar_set_text(m_install_progress, text.c_str());
 }
 
 void installer_window::collect_vm_settings() {
@@ -1,12 +1,17 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 #include <adwaita.h>
 #include <gtk-4.0/gtk/gtk.h>
+#include <nlohmann/json.hpp>
 #include "net/microsoft_interface.hpp"
+#include "ipc.hpp"
 #include "net/multipart_transfer.hpp"
+#include "telemetry_ring.hpp"
 
 struct installer_window_data {
     std::string iso_path;
@@ -20,6 +25,9 @@ struct installer_window_data {
     std::string admin_username = "lsw";
     std::string admin_password;
     bool hardware_acceleration = true;
+
+    // install.wim image index for each entry of the edition picker, in picker order
+    std::vector<uint32_t> edition_image_indexes;
 };
 
 // Forward declaration
@@ -81,6 +89,7 @@ private:
     AdwEntryRow* m_admin_username_entry = nullptr;
     AdwPasswordEntryRow* m_admin_password_entry = nullptr;
     GtkButton* m_install_button = nullptr;
+    GtkProgressBar* m_install_progress = nullptr;
     GtkCheckButton* m_hardware_accel_check = nullptr;
     finish_callback_t m_finish_callback;
     installer_window_data m_data;
@@ -98,17 +107,30 @@ private:
     int get_total_pages() const;
     void start_wim_scan_async();
     void wim_scan_thread(installer_window* self);
+    void start_iso_verification();
     void perform_page_action(int page);
     void append_progress_message(const std::string& message);
     void update_iso_source_ui();
     void show_download_progress(bool show);
     void show_banned_state(bool show);
     void populate_windows_editions(const std::vector<std::string>& editions);
+    // Fill the edition picker from a scan_wim_versions result
+    void apply_scan_result(const nlohmann::json& result);
+    void start_remote_scan(const std::string& url);
     std::string get_selected_windows_edition() const;
+    uint32_t get_selected_image_index() const;
     void start_iso_download();
     void on_download_progress(const multipart_transfer::progress_info& info);
     void on_download_complete(bool success, const std::string& error);
     void start_vm_installation();
+    // Show the progress of an install_vm an earlier session left running on the worker daemon
+    void attach_running_installation(uint64_t worker_workload_id);
+    // Shared by a new installation and one attached to
+    ipc::workload_callbacks make_install_callbacks();
+    // Scroll the carousel to page and make it current; false if there is no such page
+    bool scroll_to_page(int page);
+    // Progress telemetry of the install_vm workload
+    void on_install_telemetry(const telemetry_record& record);
     void collect_vm_settings();
 
     static void on_next_button_clicked(GtkButton* button, gpointer user_data);
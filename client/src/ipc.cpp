@@ -1,10 +1,99 @@
 #include "ipc.hpp"
 
+#include <algorithm>
+#include <cerrno>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
+#include <poll.h>
 #include <unistd.h>
 
+namespace {
+// Stream sockets may transfer fewer bytes than requested; loop until the whole buffer is done.
+// A closed peer is reported as a failure with errno set to ECONNRESET.
+bool send_all(int fd, const void* data, size_t length) {
+    const char* cursor = static_cast<const char*>(data);
+    while (length > 0) {
+        ssize_t sent = send(fd, cursor, length, MSG_NOSIGNAL);
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // The client reads with a non-blocking socket; wait for buffer space instead
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                pollfd pfd{fd, POLLOUT, 0};
+                if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+                    return false;
+                }
+                continue;
+            }
+            return false;
+        }
+        cursor += sent;
+        length -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool recv_all(int fd, void* data, size_t length) {
+    char* cursor = static_cast<char*>(data);
+    while (length > 0) {
+        ssize_t received = recv(fd, cursor, length, 0);
+        if (received == 0) {
+            errno = ECONNRESET;
+            return false;
+        }
+        if (received == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        cursor += received;
+        length -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+// Reads whose result depends only on their parameters, so identical requests can share one
+bool is_read_workload(workload_type workload) {
+    switch (workload) {
+    case workload_type::check_installed_apps:
+    case workload_type::scan_wim_versions:
+    case workload_type::get_vm_status:
+    case workload_type::search_iso_library:
+    case workload_type::verify_iso:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Workloads that may change what a read returns
+bool invalidates_reads(workload_type workload) {
+    switch (workload) {
+    case workload_type::install_vm:
+    case workload_type::start_vm:
+    case workload_type::stop_vm:
+    case workload_type::remove_vm:
+    case workload_type::batch:
+    case workload_type::index_iso_library:
+    case workload_type::create_golden_image:
+    case workload_type::flatten_vm:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// JSON objects are ordered maps, so equal parameters always dump to the same string
+std::string make_request_key(workload_type workload, const nlohmann::json& params,
+                             std::chrono::milliseconds timeout) {
+    return std::to_string(static_cast<int>(workload)) + ":" + std::to_string(timeout.count()) +
+           ":" + params.dump();
+}
+} // namespace
+
 ipc::ipc() = default;
 
 ipc::~ipc() {
@@ -58,12 +147,23 @@ bool ipc::listen_for_connections(int backlog) {
     return true;
 }
 
-int ipc::accept_connection() {
+int ipc::accept_connection(int timeout_ms) {
     if (m_socket_fd == -1 || !m_is_server) {
         std::cerr << "[IPC] Socket not initialized as server" << std::endl;
         return -1;
     }
 
+    if (timeout_ms >= 0) {
+        pollfd pfd{m_socket_fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, timeout_ms);
+        if (ready <= 0) {
+            if (ready == 0) {
+                errno = ETIMEDOUT;
+            }
+            return -1;
+        }
+    }
+
     sockaddr_un addr;
     socklen_t addr_len = sizeof(addr);
     int client_fd = accept(m_socket_fd, (sockaddr*)&addr, &addr_len);
@@ -92,6 +192,21 @@ void ipc::close_server_socket() {
     std::cout << "[IPC] Server socket closed" << std::endl;
 }
 
+bool ipc::adopt_server_socket(int socket_fd) {
+    int accepting = 0;
+    socklen_t length = sizeof(accepting);
+    if (getsockopt(socket_fd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &length) == -1 ||
+        !accepting) {
+        std::cerr << "[IPC] Inherited descriptor is not a listening socket" << std::endl;
+        return false;
+    }
+
+    m_socket_fd = socket_fd;
+    m_is_server = true;
+    std::cout << "[IPC] Adopted listening socket (FD: " << socket_fd << ")" << std::endl;
+    return true;
+}
+
 bool ipc::connect_to_server(const std::string& socket_path) {
     m_socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (m_socket_fd == -1) {
@@ -136,7 +251,17 @@ int ipc::get_socket_fd() const {
     return m_socket_fd;
 }
 
+int ipc::release_socket() {
+    std::lock_guard<std::mutex> lock(m_send_mutex);
+    int socket_fd = m_socket_fd;
+    m_socket_fd = -1;
+    m_socket_path.clear();
+    return socket_fd;
+}
+
 void ipc::set_socket(int socket_fd) {
+    // Worker threads may be sending on the old connection
+    std::lock_guard<std::mutex> lock(m_send_mutex);
     if (m_socket_fd != -1 && m_socket_fd != socket_fd) {
         // Close the current socket if it's different from the new one
         close(m_socket_fd);
@@ -147,6 +272,7 @@ void ipc::set_socket(int socket_fd) {
 }
 
 bool ipc::send_message(const std::string& message) {
+    std::lock_guard<std::mutex> lock(m_send_mutex);
     if (m_socket_fd == -1) {
         std::cerr << "[IPC] Socket not connected" << std::endl;
         return false;
@@ -154,14 +280,14 @@ bool ipc::send_message(const std::string& message) {
 
     // Send message length first
     size_t length = message.length();
-    if (send(m_socket_fd, &length, sizeof(length), 0) == -1) {
+    if (!send_all(m_socket_fd, &length, sizeof(length))) {
         std::cerr << "[IPC] Failed to send message length: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
         return false;
     }
 
     // Send message content
-    if (send(m_socket_fd, message.c_str(), length, 0) == -1) {
+    if (!send_all(m_socket_fd, message.c_str(), length)) {
         std::cerr << "[IPC] Failed to send message content: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
         return false;
@@ -171,6 +297,83 @@ bool ipc::send_message(const std::string& message) {
     return true;
 }
 
+bool ipc::send_fds(const std::vector<int>& fds) {
+    std::lock_guard<std::mutex> lock(m_send_mutex);
+    if (m_socket_fd == -1) {
+        std::cerr << "[IPC] Socket not connected" << std::endl;
+        return false;
+    }
+
+    uint8_t count = static_cast<uint8_t>(fds.size());
+    iovec iov{&count, sizeof(count)};
+
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    std::vector<char> control;
+    if (!fds.empty()) {
+        control.resize(CMSG_SPACE(sizeof(int) * fds.size()));
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    }
+
+    if (sendmsg(m_socket_fd, &msg, MSG_NOSIGNAL) == -1) {
+        std::cerr << "[IPC] Failed to send file descriptors: " << strerror(errno)
+                  << " (errno: " << errno << ")" << std::endl;
+        return false;
+    }
+
+    std::cout << "[IPC] Sent " << fds.size() << " file descriptor(s)" << std::endl;
+    return true;
+}
+
+std::vector<int> ipc::receive_fds(size_t max_fds) {
+    std::vector<int> fds;
+    if (m_socket_fd == -1) {
+        std::cerr << "[IPC] Socket not connected" << std::endl;
+        return fds;
+    }
+
+    uint8_t count = 0;
+    iovec iov{&count, sizeof(count)};
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * (max_fds > 0 ? max_fds : 1)));
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+
+    if (recvmsg(m_socket_fd, &msg, MSG_CMSG_CLOEXEC) <= 0) {
+        std::cerr << "[IPC] Failed to receive file descriptors: " << strerror(errno)
+                  << " (errno: " << errno << ")" << std::endl;
+        return fds;
+    }
+
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int* data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+        fds.insert(fds.end(), data, data + received);
+    }
+
+    if (msg.msg_flags & MSG_CTRUNC) {
+        std::cerr << "[IPC] File descriptor list truncated" << std::endl;
+    }
+
+    std::cout << "[IPC] Received " << fds.size() << " file descriptor(s)" << std::endl;
+    return fds;
+}
+
 std::string ipc::receive_message() {
     if (m_socket_fd == -1) {
         std::cerr << "[IPC] Socket not connected" << std::endl;
@@ -179,7 +382,7 @@ std::string ipc::receive_message() {
 
     // Receive message length first
     size_t length;
-    if (recv(m_socket_fd, &length, sizeof(length), 0) == -1) {
+    if (!recv_all(m_socket_fd, &length, sizeof(length))) {
         std::cerr << "[IPC] Failed to receive message length: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
         return "";
@@ -187,7 +390,7 @@ std::string ipc::receive_message() {
 
     // Receive message content
     std::string message(length, '\0');
-    if (recv(m_socket_fd, &message[0], length, 0) == -1) {
+    if (!recv_all(m_socket_fd, &message[0], length)) {
         std::cerr << "[IPC] Failed to receive message content: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
         return "";
@@ -201,7 +404,58 @@ uint64_t ipc::generate_workload_id() {
     return ++m_workload_id_counter;
 }
 
-uint64_t ipc::send_workload_request(workload_type workload, const nlohmann::json& params) {
+uint64_t ipc::attach_workload(uint64_t worker_workload_id, workload_callbacks callbacks) {
+    std::cout << "[IPC] Attaching to running workload (worker ID: " << worker_workload_id << ")"
+              << std::endl;
+    return execute_workload(workload_type::attach_workload,
+                            {{"workload_id", worker_workload_id}}, std::move(callbacks));
+}
+
+uint64_t ipc::subscribe_events(const std::vector<std::string>& topics,
+                               const nlohmann::json& filter, workload_callbacks callbacks) {
+    return execute_workload(workload_type::subscribe_events,
+                            {{"topics", topics}, {"filter", filter}}, std::move(callbacks));
+}
+
+bool ipc::send_hello(const nlohmann::json& hello) {
+    return send_workload_response(0, workload_status::completed, hello.dump());
+}
+
+std::optional<nlohmann::json> ipc::receive_hello(int timeout_ms) {
+    if (m_socket_fd == -1) {
+        std::cerr << "[IPC] Socket not connected" << std::endl;
+        return std::nullopt;
+    }
+
+    pollfd pfd{m_socket_fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        std::cerr << "[IPC] Timed out waiting for worker hello" << std::endl;
+        return std::nullopt;
+    }
+
+    auto [workload_id, status, message] = receive_workload_response();
+    if (workload_id != 0 || status != workload_status::completed) {
+        std::cerr << "[IPC] Expected hello, got response for workload " << workload_id
+                  << std::endl;
+        return std::nullopt;
+    }
+
+    try {
+        nlohmann::json hello = nlohmann::json::parse(message);
+        if (hello.value("protocol", 0) != IPC_PROTOCOL_VERSION) {
+            std::cerr << "[IPC] Worker speaks protocol " << hello.value("protocol", 0)
+                      << ", expected " << IPC_PROTOCOL_VERSION << std::endl;
+            return std::nullopt;
+        }
+        return hello;
+    } catch (const nlohmann::json::parse_error& e) {
+        std::cerr << "[IPC] Failed to parse hello: " << e.what() << std::endl;
+        return std::nullopt;
+    }
+}
+
+uint64_t ipc::send_workload_request(workload_type workload, const nlohmann::json& params,
+                                   std::chrono::milliseconds timeout) {
     if (m_socket_fd == -1) {
         std::cerr << "[IPC] Socket not connected" << std::endl;
         return 0;
@@ -221,19 +475,130 @@ uint64_t ipc::send_workload_request(workload_type workload, const nlohmann::json
     // Generate workload ID
     uint64_t workload_id = generate_workload_id();
 
+    uint64_t timeout_ms = timeout.count() > 0 ? static_cast<uint64_t>(timeout.count()) : 0;
+    if (!send_request_frame(workload_id, workload, timeout_ms, params)) {
+        return 0;
+    }
+    return workload_id;
+}
+
+uint64_t ipc::execute_batch(const std::vector<batch_request>& requests,
+                            workload_callbacks callbacks, std::chrono::milliseconds timeout) {
+    nlohmann::json entries = nlohmann::json::array();
+    for (const auto& [workload, params] : requests) {
+        entries.push_back({{"type", static_cast<int>(workload)}, {"params", params}});
+    }
+    return execute_workload(workload_type::batch, {{"requests", entries}}, std::move(callbacks),
+                            timeout);
+}
+
+void ipc::set_result_cache_ttl(std::chrono::milliseconds ttl) {
+    m_result_cache_ttl = ttl;
+    if (ttl.count() <= 0) {
+        m_result_cache.clear();
+    }
+}
+
+void ipc::cache_result(const std::string& key, const nlohmann::json& result) {
+    if (m_result_cache_ttl.count() <= 0) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = m_result_cache.begin(); it != m_result_cache.end();) {
+        if (it->second.expires <= now) {
+            it = m_result_cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_result_cache[key] = {result, now + m_result_cache_ttl};
+}
+
+bool ipc::leave_coalesced_request(uint64_t workload_id) {
+    auto wire = m_coalesced_wire_ids.find(workload_id);
+    if (wire == m_coalesced_wire_ids.end()) {
+        return false;
+    }
+
+    coalesced_request& request = m_coalesced[wire->second];
+    if (request.members.size() <= 1) {
+        // Last caller: nobody may join a request that is about to be cancelled
+        auto by_key = m_coalesced_by_key.find(request.key);
+        if (by_key != m_coalesced_by_key.end() && by_key->second == wire->second) {
+            m_coalesced_by_key.erase(by_key);
+        }
+        return false;
+    }
+
+    request.members.erase(
+        std::remove(request.members.begin(), request.members.end(), workload_id),
+        request.members.end());
+    m_coalesced_wire_ids.erase(wire);
+    return true;
+}
+
+bool ipc::cancel_workload(uint64_t workload_id) {
+    // Other callers still wait for a shared request, so only this one gives up on it
+    if (leave_coalesced_request(workload_id)) {
+        auto it = m_workload_callbacks.find(workload_id);
+        if (it != m_workload_callbacks.end()) {
+            workload_callbacks callbacks = std::move(it->second);
+            m_workload_callbacks.erase(it);
+            std::cout << "[IPC] Workload " << workload_id << " cancelled: Cancelled by client"
+                      << std::endl;
+            if (callbacks.on_cancelled) {
+                callbacks.on_cancelled("Cancelled by client");
+            } else if (callbacks.on_error) {
+                callbacks.on_error("Cancelled by client");
+            }
+        }
+        return true;
+    }
+
+    auto wire = m_coalesced_wire_ids.find(workload_id);
+    if (wire != m_coalesced_wire_ids.end()) {
+        workload_id = wire->second;
+    }
+
+    // Cancel frames reuse the request layout: the ID field names the workload to cancel
+    if (!send_request_frame(workload_id, workload_type::cancel_workload, 0,
+                            nlohmann::json::object())) {
+        std::cerr << "[IPC] Failed to send cancel request for workload " << workload_id
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ipc::send_request_frame(uint64_t workload_id, workload_type workload, uint64_t timeout_ms,
+                             const nlohmann::json& params) {
+    std::lock_guard<std::mutex> lock(m_send_mutex);
+    if (m_socket_fd == -1) {
+        std::cerr << "[IPC] Socket not connected" << std::endl;
+        return false;
+    }
+
     // Send workload ID first
-    if (send(m_socket_fd, &workload_id, sizeof(workload_id), 0) == -1) {
+    if (!send_all(m_socket_fd, &workload_id, sizeof(workload_id))) {
         std::cerr << "[IPC] Failed to send workload ID: " << strerror(errno) << " (errno: " << errno
                   << ")" << std::endl;
-        return 0;
+        return false;
     }
 
     // Send workload type
     uint8_t workload_byte = static_cast<uint8_t>(workload);
-    if (send(m_socket_fd, &workload_byte, sizeof(workload_byte), 0) == -1) {
+    if (!send_all(m_socket_fd, &workload_byte, sizeof(workload_byte))) {
         std::cerr << "[IPC] Failed to send workload request: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
-        return 0;
+        return false;
+    }
+
+    // Send timeout (0 = no deadline)
+    if (!send_all(m_socket_fd, &timeout_ms, sizeof(timeout_ms))) {
+        std::cerr << "[IPC] Failed to send workload timeout: " << strerror(errno)
+                  << " (errno: " << errno << ")" << std::endl;
+        return false;
     }
 
     // Send parameters as JSON string
@@ -241,61 +606,72 @@ uint64_t ipc::send_workload_request(workload_type workload, const nlohmann::json
     size_t params_length = params_str.length();
 
     // Send parameters length
-    if (send(m_socket_fd, &params_length, sizeof(params_length), 0) == -1) {
+    if (!send_all(m_socket_fd, &params_length, sizeof(params_length))) {
         std::cerr << "[IPC] Failed to send parameters length: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
-        return 0;
+        return false;
     }
 
     // Send parameters content
-    if (send(m_socket_fd, params_str.c_str(), params_length, 0) == -1) {
+    if (!send_all(m_socket_fd, params_str.c_str(), params_length)) {
         std::cerr << "[IPC] Failed to send parameters content: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
-        return 0;
+        return false;
     }
 
     std::cout << "[IPC] Workload request sent - ID: " << workload_id
-              << ", Type: " << static_cast<int>(workload_byte) << ", Params: " << params_str
-              << std::endl;
-    return workload_id;
+              << ", Type: " << static_cast<int>(workload_byte) << ", Timeout: " << timeout_ms
+              << "ms, Params: " << params_str << std::endl;
+    return true;
 }
 
-std::tuple<uint64_t, workload_type, nlohmann::json> ipc::receive_workload_request() {
+std::tuple<uint64_t, workload_type, nlohmann::json, uint64_t> ipc::receive_workload_request() {
+    const std::tuple<uint64_t, workload_type, nlohmann::json, uint64_t> failure = {
+        0, static_cast<workload_type>(-1), nlohmann::json::object(), 0};
+
     if (m_socket_fd == -1) {
         std::cerr << "[IPC] Socket not connected" << std::endl;
-        return {0, static_cast<workload_type>(-1), nlohmann::json::object()};
+        return failure;
     }
 
     // Receive workload ID first
     uint64_t workload_id;
-    if (recv(m_socket_fd, &workload_id, sizeof(workload_id), 0) == -1) {
+    if (!recv_all(m_socket_fd, &workload_id, sizeof(workload_id))) {
         std::cerr << "[IPC] Failed to receive workload ID: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
-        return {0, static_cast<workload_type>(-1), nlohmann::json::object()};
+        return failure;
     }
 
     // Receive workload type
     uint8_t workload_byte;
-    if (recv(m_socket_fd, &workload_byte, sizeof(workload_byte), 0) == -1) {
+    if (!recv_all(m_socket_fd, &workload_byte, sizeof(workload_byte))) {
         std::cerr << "[IPC] Failed to receive workload request: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
-        return {0, static_cast<workload_type>(-1), nlohmann::json::object()};
+        return failure;
+    }
+
+    // Receive timeout
+    uint64_t timeout_ms;
+    if (!recv_all(m_socket_fd, &timeout_ms, sizeof(timeout_ms))) {
+        std::cerr << "[IPC] Failed to receive workload timeout: " << strerror(errno)
+                  << " (errno: " << errno << ")" << std::endl;
+        return failure;
     }
 
     // Receive parameters length
     size_t params_length;
-    if (recv(m_socket_fd, &params_length, sizeof(params_length), 0) == -1) {
+    if (!recv_all(m_socket_fd, &params_length, sizeof(params_length))) {
         std::cerr << "[IPC] Failed to receive parameters length: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
-        return {0, static_cast<workload_type>(-1), nlohmann::json::object()};
+        return failure;
     }
 
     // Receive parameters content
     std::string params_str(params_length, '\0');
-    if (recv(m_socket_fd, &params_str[0], params_length, 0) == -1) {
+    if (!recv_all(m_socket_fd, &params_str[0], params_length)) {
         std::cerr << "[IPC] Failed to receive parameters content: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
-        return {0, static_cast<workload_type>(-1), nlohmann::json::object()};
+        return failure;
     }
 
     // Parse JSON parameters
@@ -308,20 +684,21 @@ std::tuple<uint64_t, workload_type, nlohmann::json> ipc::receive_workload_reques
     }
 
     std::cout << "[IPC] Workload request received - ID: " << workload_id
-              << ", Type: " << static_cast<int>(workload_byte) << ", Params: " << params_str
-              << std::endl;
-    return {workload_id, static_cast<workload_type>(workload_byte), params};
+              << ", Type: " << static_cast<int>(workload_byte) << ", Timeout: " << timeout_ms
+              << "ms, Params: " << params_str << std::endl;
+    return {workload_id, static_cast<workload_type>(workload_byte), params, timeout_ms};
 }
 
 bool ipc::send_workload_response(uint64_t workload_id, workload_status status,
                                  const std::string& message) {
+    std::lock_guard<std::mutex> lock(m_send_mutex);
     if (m_socket_fd == -1) {
         std::cerr << "[IPC] Socket not connected" << std::endl;
         return false;
     }
 
     // Send workload ID first
-    if (send(m_socket_fd, &workload_id, sizeof(workload_id), 0) == -1) {
+    if (!send_all(m_socket_fd, &workload_id, sizeof(workload_id))) {
         std::cerr << "[IPC] Failed to send workload ID: " << strerror(errno) << " (errno: " << errno
                   << ")" << std::endl;
         return false;
@@ -329,7 +706,7 @@ bool ipc::send_workload_response(uint64_t workload_id, workload_status status,
 
     // Send status byte
     uint8_t status_byte = static_cast<uint8_t>(status);
-    if (send(m_socket_fd, &status_byte, sizeof(status_byte), 0) == -1) {
+    if (!send_all(m_socket_fd, &status_byte, sizeof(status_byte))) {
         std::cerr << "[IPC] Failed to send status byte: " << strerror(errno) << " (errno: " << errno
                   << ")" << std::endl;
         return false;
@@ -337,14 +714,14 @@ bool ipc::send_workload_response(uint64_t workload_id, workload_status status,
 
     // Send message length
     size_t length = message.length();
-    if (send(m_socket_fd, &length, sizeof(length), 0) == -1) {
+    if (!send_all(m_socket_fd, &length, sizeof(length))) {
         std::cerr << "[IPC] Failed to send message length: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
         return false;
     }
 
     // Send message content
-    if (send(m_socket_fd, message.c_str(), length, 0) == -1) {
+    if (!send_all(m_socket_fd, message.c_str(), length)) {
         std::cerr << "[IPC] Failed to send message content: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
         return false;
@@ -364,7 +741,7 @@ std::tuple<uint64_t, workload_status, std::string> ipc::receive_workload_respons
 
     // Receive workload ID first
     uint64_t workload_id;
-    if (recv(m_socket_fd, &workload_id, sizeof(workload_id), 0) == -1) {
+    if (!recv_all(m_socket_fd, &workload_id, sizeof(workload_id))) {
         std::cerr << "[IPC] Failed to receive workload ID: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
         return {0, static_cast<workload_status>(-1), ""};
@@ -372,7 +749,7 @@ std::tuple<uint64_t, workload_status, std::string> ipc::receive_workload_respons
 
     // Receive status byte
     uint8_t status_byte;
-    if (recv(m_socket_fd, &status_byte, sizeof(status_byte), 0) == -1) {
+    if (!recv_all(m_socket_fd, &status_byte, sizeof(status_byte))) {
         std::cerr << "[IPC] Failed to receive status byte: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
         return {0, static_cast<workload_status>(-1), ""};
@@ -380,7 +757,7 @@ std::tuple<uint64_t, workload_status, std::string> ipc::receive_workload_respons
 
     // Receive message length
     size_t length;
-    if (recv(m_socket_fd, &length, sizeof(length), 0) == -1) {
+    if (!recv_all(m_socket_fd, &length, sizeof(length))) {
         std::cerr << "[IPC] Failed to receive message length: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
         return {0, static_cast<workload_status>(-1), ""};
@@ -388,7 +765,7 @@ std::tuple<uint64_t, workload_status, std::string> ipc::receive_workload_respons
 
     // Receive message content
     std::string message(length, '\0');
-    if (recv(m_socket_fd, &message[0], length, 0) == -1) {
+    if (!recv_all(m_socket_fd, &message[0], length)) {
         std::cerr << "[IPC] Failed to receive message content: " << strerror(errno)
                   << " (errno: " << errno << ")" << std::endl;
         return {0, static_cast<workload_status>(-1), ""};
@@ -401,32 +778,132 @@ std::tuple<uint64_t, workload_status, std::string> ipc::receive_workload_respons
     return {workload_id, status, message};
 }
 
-void ipc::execute_workload(workload_type workload, const nlohmann::json& params,
-                           workload_success_callback on_complete, workload_error_callback on_error,
-                           workload_progress_callback on_progress) {
+uint64_t ipc::execute_workload(workload_type workload, const nlohmann::json& params,
+                               workload_success_callback on_complete,
+                               workload_error_callback on_error,
+                               workload_progress_callback on_progress) {
+    return execute_workload(workload, params, {on_complete, on_error, on_progress});
+}
+
+uint64_t ipc::execute_workload(workload_type workload, const nlohmann::json& params,
+                               workload_callbacks callbacks, std::chrono::milliseconds timeout) {
+    std::string key;
+    if (is_read_workload(workload)) {
+        key = make_request_key(workload, params, timeout);
+
+        auto cached = m_result_cache.find(key);
+        if (cached != m_result_cache.end() &&
+            cached->second.expires > std::chrono::steady_clock::now()) {
+            uint64_t workload_id = generate_workload_id();
+            std::cout << "[IPC] Workload " << workload_id << " answered from cache" << std::endl;
+            if (callbacks.on_complete) {
+                callbacks.on_complete(cached->second.result);
+            }
+            return workload_id;
+        }
+
+        auto in_flight = m_coalesced_by_key.find(key);
+        if (in_flight != m_coalesced_by_key.end()) {
+            uint64_t workload_id = generate_workload_id();
+            m_workload_callbacks[workload_id] = std::move(callbacks);
+            m_coalesced[in_flight->second].members.push_back(workload_id);
+            m_coalesced_wire_ids[workload_id] = in_flight->second;
+            std::cout << "[IPC] Workload " << workload_id << " joined in-flight request (ID: "
+                      << in_flight->second << ")" << std::endl;
+            return workload_id;
+        }
+    } else if (invalidates_reads(workload)) {
+        m_result_cache.clear();
+    }
+
     // Send workload request (IPC will generate ID)
-    uint64_t workload_id = send_workload_request(workload, params);
+    uint64_t workload_id = send_workload_request(workload, params, timeout);
     if (workload_id == 0) {
         std::cerr << "[IPC] Failed to send workload request" << std::endl;
-        if (on_error) {
-            on_error("Failed to send workload request");
+        if (callbacks.on_error) {
+            callbacks.on_error("Failed to send workload request");
         }
-        return;
+        return 0;
     }
 
     // Store callbacks for this workload ID
-    m_workload_callbacks[workload_id] = {on_complete, on_error, on_progress};
+    m_workload_callbacks[workload_id] = std::move(callbacks);
+    if (!key.empty()) {
+        m_coalesced[workload_id] = {key, {workload_id}};
+        m_coalesced_by_key[key] = workload_id;
+        m_coalesced_wire_ids[workload_id] = workload_id;
+    }
 
     std::cout << "[IPC] Workload request sent (ID: " << workload_id << ")" << std::endl;
+    return workload_id;
+}
+
+workload_event workload_event::decode(uint64_t workload_id, workload_status status,
+                                     std::string message) {
+    workload_event event;
+    event.workload_id = workload_id;
+    event.status = status;
+    event.message = std::move(message);
+
+    if (status == workload_status::completed) {
+        try {
+            event.result = nlohmann::json::parse(event.message);
+        } catch (const nlohmann::json::parse_error& e) {
+            event.parse_error = e.what();
+        }
+    }
+    return event;
 }
 
 void ipc::handle_workload_response(uint64_t workload_id, workload_status status,
                                    const std::string& message) {
+    handle_workload_event(workload_event::decode(workload_id, status, message));
+}
+
+void ipc::handle_workload_event(const workload_event& event) {
+    auto coalesced = m_coalesced.find(event.workload_id);
+    if (coalesced == m_coalesced.end()) {
+        deliver_workload_event(event);
+        return;
+    }
+
+    // Callbacks may start new workloads, so settle the shared request before invoking them
+    std::vector<uint64_t> members = coalesced->second.members;
+    if (event.status != workload_status::in_progress) {
+        const std::string& key = coalesced->second.key;
+        if (event.status == workload_status::completed && event.parse_error.empty()) {
+            cache_result(key, event.result);
+        }
+        auto by_key = m_coalesced_by_key.find(key);
+        if (by_key != m_coalesced_by_key.end() && by_key->second == event.workload_id) {
+            m_coalesced_by_key.erase(by_key);
+        }
+        for (uint64_t member : members) {
+            m_coalesced_wire_ids.erase(member);
+        }
+        m_coalesced.erase(coalesced);
+    }
+
+    if (members.size() > 1) {
+        std::cout << "[IPC] Sharing response for workload " << event.workload_id << " with "
+                  << members.size() << " callers" << std::endl;
+    }
+    for (uint64_t member : members) {
+        workload_event member_event = event;
+        member_event.workload_id = member;
+        deliver_workload_event(member_event);
+    }
+}
+
+void ipc::deliver_workload_event(const workload_event& event) {
+    uint64_t workload_id = event.workload_id;
+    const std::string& message = event.message;
+
     // Find the callbacks for this workload ID
     auto it = m_workload_callbacks.find(workload_id);
     if (it != m_workload_callbacks.end()) {
         // Handle callbacks and log the response
-        switch (status) {
+        switch (event.status) {
         case workload_status::in_progress:
             std::cout << "[IPC] Workload " << workload_id << " in progress: " << message
                       << std::endl;
@@ -436,19 +913,15 @@ void ipc::handle_workload_response(uint64_t workload_id, workload_status status,
             break;
         case workload_status::completed:
             std::cout << "[IPC] Workload " << workload_id << " completed: " << message << std::endl;
-            if (it->second.on_complete) {
-                try {
-                    // Parse JSON result
-                    nlohmann::json result = nlohmann::json::parse(message);
-                    it->second.on_complete(result);
-                } catch (const nlohmann::json::parse_error& e) {
-                    std::cerr << "[IPC] Failed to parse JSON result: " << e.what() << std::endl;
-                    // Call error callback with parse error
-                    if (it->second.on_error) {
-                        it->second.on_error("Failed to parse JSON result: " +
-                                            std::string(e.what()));
-                    }
+            if (!event.parse_error.empty()) {
+                std::cerr << "[IPC] Failed to parse JSON result: " << event.parse_error
+                          << std::endl;
+                // Call error callback with parse error
+                if (it->second.on_error) {
+                    it->second.on_error("Failed to parse JSON result: " + event.parse_error);
                 }
+            } else if (it->second.on_complete) {
+                it->second.on_complete(event.result);
             }
             // Remove the callback entry since the workload is complete
             m_workload_callbacks.erase(it);
@@ -461,9 +934,60 @@ void ipc::handle_workload_response(uint64_t workload_id, workload_status status,
             // Remove the callback entry since the workload failed
             m_workload_callbacks.erase(it);
             break;
+        case workload_status::cancelled:
+            std::cout << "[IPC] Workload " << workload_id << " cancelled: " << message
+                      << std::endl;
+            if (it->second.on_cancelled) {
+                it->second.on_cancelled(message);
+            } else if (it->second.on_error) {
+                it->second.on_error(message);
+            }
+            // Remove the callback entry since the workload was cancelled
+            m_workload_callbacks.erase(it);
+            break;
         }
     } else {
         std::cout << "[IPC] Received response for unknown workload ID: " << workload_id
                   << std::endl;
     }
 }
+
+void ipc::fail_pending_workloads(const std::string& message) {
+    // Callbacks may start new workloads, so detach the current set before invoking them
+    std::unordered_map<uint64_t, workload_callbacks> pending;
+    pending.swap(m_workload_callbacks);
+    m_coalesced.clear();
+    m_coalesced_by_key.clear();
+    m_coalesced_wire_ids.clear();
+    m_result_cache.clear();
+
+    for (auto& [workload_id, callbacks] : pending) {
+        std::cout << "[IPC] Workload " << workload_id << " failed: " << message << std::endl;
+        if (callbacks.on_error) {
+            callbacks.on_error(message);
+        }
+    }
+}
+
+void ipc::handle_telemetry(const telemetry_record& record) {
+    if (record.kind == telemetry_kind::worker_queue) {
+        std::cout << "[IPC] Worker queue - interactive: " << record.values[0] << " queued, "
+                  << record.values[1] << " active; bulk: " << record.values[2] << " queued, "
+                  << record.values[3] << " active" << std::endl;
+        return;
+    }
+
+    std::vector<uint64_t> members = {record.workload_id};
+    auto coalesced = m_coalesced.find(record.workload_id);
+    if (coalesced != m_coalesced.end()) {
+        members = coalesced->second.members;
+    }
+
+    // Telemetry is best effort: records for finished or unknown workloads are dropped silently
+    for (uint64_t member : members) {
+        auto it = m_workload_callbacks.find(member);
+        if (it != m_workload_callbacks.end() && it->second.on_telemetry) {
+            it->second.on_telemetry(record);
+        }
+    }
+}
@@ -1,27 +1,92 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <functional>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 #include <nlohmann/json.hpp>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include "telemetry_ring.hpp"
 
 enum class workload_type {
     check_installed_apps,
-    scan_wim_versions,
+    scan_wim_versions, // params: {"iso_path"} or {"iso_url"} to scan before downloading
+    // optional "slim_media": {build_slim_media options} installs from slim media;
+    // optional "offline_apply": {"experimental": true, "drivers_iso", "drivers"} applies the
+    // image from the host instead of running Setup (experimental: unverified on real media, so
+    // it is refused without the flag); disk layout: "disk_format": "qcow2"|"raw",
+    // "disk_preallocation": "off"|"metadata"|"falloc"|"full", "disk_cluster_kib",
+    // "disk_extended_l2", "disk_lazy_refcounts"; "generalize": true runs sysprep and leaves
+    // the VM shut off for create_golden_image; "golden_image": name defines a linked clone of
+    // it in seconds;
+    // "install_timeout_minutes" (default 120) bounds the wait for Setup to shut the VM down;
+    // "iso_url" downloads the ISO to iso_path while the other steps run. The result lists the
+    // provisioning "steps" with their timings.
     install_vm,
     get_vm_status,
     start_vm,
     stop_vm,
     remove_vm,
+    cancel_workload, // control frame: the request's workload ID names the workload to cancel
+    // params: {"topics": [...], "filter": {...}, "stats_interval_ms": N}; streams events as
+    // in_progress until cancelled. Topics: "workloads", "vm" (lifecycle), "vm_stats",
+    // "library" (ISO library changes).
+    subscribe_events,
+    attach_workload,  // params: {"workload_id": N}; reroute a running workload's responses here
+    // params: {"requests": [{"type": N, "params": {...}}, ...]}; completes once with
+    // {"results": [{"status": "completed", "result": ...} | {"status": "error", ...}, ...]}
+    batch,
+    // params: {"directories": [...], "concurrency": N, "watch": bool}; indexes every ISO below
+    // the directories. While watched, changes are published on the "library" topic.
+    index_iso_library,
+    search_iso_library, // params: {"text", "edition", "build", "language", "architecture"}
+    // params: {"iso_path", "sha256", "force": bool, "threads": N}; full hash plus WIM integrity
+    // check, remembered per file fingerprint unless forced. The hash is compared with "sha256"
+    // (a published checksum) when given; otherwise it only identifies the content.
+    verify_iso,
+    // params: {"iso_path", "image_index" or "windows_edition", "compression": "lzms"|"xpress",
+    // "remove_paths": [...], "threads": N, "virtio_drivers": bool or "drivers_iso", "drivers":
+    // [...]}; an ISO holding only that edition, optionally with VirtIO drivers in boot.wim and
+    // the image, cached per source and options. Its image index is always 1.
+    build_slim_media,
+    // params: {"vm_name", "image_name"}; the disk of a shut off, generalized VM becomes a
+    // read-only golden image and the VM is undefined
+    create_golden_image,
+    // params: {"vm_name"}; copies a linked clone's golden image data into its own disk (block
+    // pull while running), so the image can go away
+    flatten_vm,
 };
 
+// The highest workload_type value; move it along when adding a workload
+constexpr workload_type LAST_WORKLOAD_TYPE = workload_type::flatten_vm;
+
 enum class workload_status {
     in_progress,
     error,
     completed,
+    cancelled, // terminal: cancelled by the client or its deadline passed
+};
+
+// Bumped whenever the frame layout changes; exchanged in the hello handshake
+constexpr int IPC_PROTOCOL_VERSION = 2;
+
+// A response frame with its payload decoded. Completed results are parsed as JSON when the
+// frame is decoded, so the reader can do it off the main thread.
+struct workload_event {
+    uint64_t workload_id = 0;
+    workload_status status = workload_status::in_progress;
+    std::string message;
+    nlohmann::json result;   // completed only
+    std::string parse_error; // completed only, set if the result is not valid JSON
+
+    static workload_event decode(uint64_t workload_id, workload_status status,
+                                 std::string message);
 };
 
 class ipc {
@@ -30,10 +95,13 @@ public:
     using workload_success_callback = std::function<void(const nlohmann::json& result)>;
     using workload_error_callback = std::function<void(const std::string& message)>;
     using workload_progress_callback = std::function<void(const std::string& message)>;
+    using workload_telemetry_callback = std::function<void(const telemetry_record& record)>;
     struct workload_callbacks {
         workload_success_callback on_complete = nullptr;
         workload_error_callback on_error = nullptr;
         workload_progress_callback on_progress = nullptr;
+        workload_telemetry_callback on_telemetry = nullptr;
+        workload_error_callback on_cancelled = nullptr; // falls back to on_error when unset
     };
 
     ipc();
@@ -42,8 +110,11 @@ public:
     // Client operations
     bool create_server_socket(const std::string& socket_path);
     bool listen_for_connections(int backlog = 1);
-    int accept_connection();
+    // Waits up to timeout_ms (-1 = forever) for a connection; returns -1 on timeout or error
+    int accept_connection(int timeout_ms = -1);
     void close_server_socket();
+    // Take over an already listening socket (e.g. one passed in by systemd)
+    bool adopt_server_socket(int socket_fd);
 
     // Worker operations
     bool connect_to_server(const std::string& socket_path);
@@ -52,38 +123,107 @@ public:
     // Message passing
     bool send_message(const std::string& message);
     std::string receive_message();
+
+    // File descriptor passing (SCM_RIGHTS). Always transfers one marker byte so the receiver
+    // does not block when the sender has no descriptors to offer.
+    bool send_fds(const std::vector<int>& fds);
+    std::vector<int> receive_fds(size_t max_fds);
+    // A non-zero timeout attaches a deadline; the worker cancels the workload once it passes
     uint64_t send_workload_request(workload_type workload,
-                                   const nlohmann::json& params = nlohmann::json::object());
-    std::tuple<uint64_t, workload_type, nlohmann::json> receive_workload_request();
+                                   const nlohmann::json& params = nlohmann::json::object(),
+                                   std::chrono::milliseconds timeout = {});
+    std::tuple<uint64_t, workload_type, nlohmann::json, uint64_t> receive_workload_request();
+    bool cancel_workload(uint64_t workload_id);
+
+    // Readiness handshake. The worker sends a hello (a completed response with workload ID 0)
+    // as soon as it is ready; the client waits for it instead of sleeping.
+    bool send_hello(const nlohmann::json& hello);
+    std::optional<nlohmann::json> receive_hello(int timeout_ms);
+
+    // Run several workloads with one request frame and one aggregated response
+    using batch_request = std::pair<workload_type, nlohmann::json>;
+    uint64_t execute_batch(const std::vector<batch_request>& requests,
+                           workload_callbacks callbacks, std::chrono::milliseconds timeout = {});
+
+    // How long completed read workloads (e.g. get_vm_status) are answered from cache;
+    // zero disables caching. Workloads that change VM state clear the cache.
+    void set_result_cache_ttl(std::chrono::milliseconds ttl);
 
     // Workload ID generation
     uint64_t generate_workload_id();
+    // Follow a workload started by an earlier client session, identified by the worker-side ID
+    // listed in the hello. Its further responses arrive under the returned workload ID.
+    uint64_t attach_workload(uint64_t worker_workload_id, workload_callbacks callbacks);
+    // Stream events for topics (optionally only those matching filter, e.g. {"vm_name": "..."})
+    // to on_progress until cancel_workload is called with the returned ID
+    uint64_t subscribe_events(const std::vector<std::string>& topics,
+                              const nlohmann::json& filter, workload_callbacks callbacks);
 
     // Worker response methods
     bool send_workload_response(uint64_t workload_id, workload_status status,
                                 const std::string& message);
     std::tuple<uint64_t, workload_status, std::string> receive_workload_response();
-    void execute_workload(workload_type workload,
-                          const nlohmann::json& params = nlohmann::json::object(),
-                          workload_success_callback on_complete = nullptr,
-                          workload_error_callback on_error = nullptr,
-                          workload_progress_callback on_progress = nullptr);
+    // Both return the workload ID (usable with cancel_workload), or 0 if sending failed.
+    // Read workloads identical to one already in flight share its request instead of sending
+    // another, and a cached result completes the workload before execute_workload returns.
+    uint64_t execute_workload(workload_type workload,
+                              const nlohmann::json& params = nlohmann::json::object(),
+                              workload_success_callback on_complete = nullptr,
+                              workload_error_callback on_error = nullptr,
+                              workload_progress_callback on_progress = nullptr);
+    uint64_t execute_workload(workload_type workload, const nlohmann::json& params,
+                              workload_callbacks callbacks,
+                              std::chrono::milliseconds timeout = {});
     void handle_workload_response(uint64_t workload_id, workload_status status,
                                   const std::string& message);
+    void handle_workload_event(const workload_event& event);
+    // Report an error to every workload still waiting for a response (e.g. the worker went away)
+    void fail_pending_workloads(const std::string& message);
+    void handle_telemetry(const telemetry_record& record);
 
     // Common operations
     bool is_connected() const;
     int get_socket_fd() const;
     void set_socket(int socket_fd);
+    // Give up ownership of the connection without closing it
+    int release_socket();
 
 private:
     int m_socket_fd = -1;
     std::string m_socket_path;
     bool m_is_server = false;
 
+    // Frames are written piecewise, so concurrent senders (worker threads) must not interleave
+    std::mutex m_send_mutex;
+
     // Workload ID counter
     uint64_t m_workload_id_counter = 0;
 
+    bool send_request_frame(uint64_t workload_id, workload_type workload, uint64_t timeout_ms,
+                            const nlohmann::json& params);
+
     // Callback storage - map workload ID to callbacks
     std::unordered_map<uint64_t, workload_callbacks> m_workload_callbacks;
+
+    // Read workloads in flight, by the ID sent to the worker. Every caller that asked for the
+    // same thing is a member with its own workload ID; the first member's ID is the wire ID.
+    struct coalesced_request {
+        std::string key;
+        std::vector<uint64_t> members;
+    };
+    std::unordered_map<uint64_t, coalesced_request> m_coalesced;
+    std::unordered_map<std::string, uint64_t> m_coalesced_by_key;
+    std::unordered_map<uint64_t, uint64_t> m_coalesced_wire_ids; // member ID -> wire ID
+
+    struct cached_result {
+        nlohmann::json result;
+        std::chrono::steady_clock::time_point expires;
+    };
+    std::unordered_map<std::string, cached_result> m_result_cache;
+    std::chrono::milliseconds m_result_cache_ttl{2000};
+
+    void deliver_workload_event(const workload_event& event);
+    // Detach one caller from a shared request; returns false if it is the last one waiting
+    bool leave_coalesced_request(uint64_t workload_id);
+    void cache_result(const std::string& key, const nlohmann::json& result);
 };
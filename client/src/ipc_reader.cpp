@@ -0,0 +1,245 @@
+#include "ipc_reader.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/socket.h>
+#include <glib-unix.h>
+
+namespace {
+// Wire layout of a response frame header: workload ID, status byte, message length
+constexpr size_t FRAME_HEADER_SIZE = sizeof(uint64_t) + sizeof(uint8_t) + sizeof(size_t);
+
+// Anything larger is a corrupt stream rather than a real response
+constexpr size_t MAX_FRAME_SIZE = 64 * 1024 * 1024;
+
+// Bytes read per wakeup before yielding back to the main loop; the watch fires again if more is
+// pending, so a large frame is received across several iterations instead of stalling the UI
+constexpr size_t MAX_READ_PER_WAKEUP = 1024 * 1024;
+constexpr size_t READ_CHUNK_SIZE = 64 * 1024;
+} // namespace
+
+ipc_reader::~ipc_reader() {
+    stop();
+}
+
+bool ipc_reader::start(int socket_fd, batch_callback on_batch,
+                       disconnect_callback on_disconnect) {
+    if (socket_fd == -1) {
+        std::cerr << "[IPC] Cannot start reader - no socket" << std::endl;
+        return false;
+    }
+
+    int flags = fcntl(socket_fd, F_GETFL);
+    if (flags == -1 || fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        std::cerr << "[IPC] Failed to make socket non-blocking: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    m_socket_fd = socket_fd;
+    m_on_batch = std::move(on_batch);
+    m_on_disconnect = std::move(on_disconnect);
+    m_stopping = false;
+    m_disconnected = false;
+    m_disconnect_delivered = false;
+
+    m_decode_thread = std::thread(&ipc_reader::decode_thread_main, this);
+    auto condition = static_cast<GIOCondition>(G_IO_IN | G_IO_HUP | G_IO_ERR);
+    m_watch_source = g_unix_fd_add(m_socket_fd, condition, on_socket_ready, this);
+    return true;
+}
+
+void ipc_reader::stop() {
+    if (m_watch_source != 0) {
+        g_source_remove(m_watch_source);
+        m_watch_source = 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+
+    if (m_decode_thread.joinable()) {
+        m_decode_thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_deliver_source != 0) {
+        g_source_remove(m_deliver_source);
+        m_deliver_source = 0;
+    }
+    m_raw_frames.clear();
+    m_decoded.clear();
+    m_buffer.clear();
+    m_socket_fd = -1;
+}
+
+gboolean ipc_reader::on_socket_ready(gint fd, GIOCondition condition, gpointer user_data) {
+    auto* self = static_cast<ipc_reader*>(user_data);
+
+    // Pending data is read even on HUP so the final responses are not lost
+    bool connected = self->read_available();
+    if (connected && (condition & G_IO_ERR)) {
+        connected = false;
+    }
+
+    if (!connected) {
+        self->m_watch_source = 0;
+        self->handle_disconnect();
+        return G_SOURCE_REMOVE;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+bool ipc_reader::read_available() {
+    char chunk[READ_CHUNK_SIZE];
+    size_t total = 0;
+
+    while (total < MAX_READ_PER_WAKEUP) {
+        ssize_t received = recv(m_socket_fd, chunk, sizeof(chunk), 0);
+        if (received > 0) {
+            m_buffer.append(chunk, static_cast<size_t>(received));
+            total += static_cast<size_t>(received);
+            continue;
+        }
+        if (received == 0) {
+            std::cout << "[IPC] Worker closed the connection" << std::endl;
+            parse_frames();
+            return false;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        std::cerr << "[IPC] Failed to read from socket: " << strerror(errno)
+                  << " (errno: " << errno << ")" << std::endl;
+        parse_frames();
+        return false;
+    }
+
+    return parse_frames();
+}
+
+bool ipc_reader::parse_frames() {
+    std::vector<raw_frame> frames;
+    size_t offset = 0;
+    bool valid = true;
+
+    while (m_buffer.size() - offset >= FRAME_HEADER_SIZE) {
+        const char* header = m_buffer.data() + offset;
+        uint64_t workload_id;
+        uint8_t status_byte;
+        size_t length;
+        std::memcpy(&workload_id, header, sizeof(workload_id));
+        std::memcpy(&status_byte, header + sizeof(workload_id), sizeof(status_byte));
+        std::memcpy(&length, header + sizeof(workload_id) + sizeof(status_byte), sizeof(length));
+
+        if (length > MAX_FRAME_SIZE ||
+            status_byte > static_cast<uint8_t>(workload_status::cancelled)) {
+            std::cerr << "[IPC] Corrupt response frame (ID: " << workload_id
+                      << ", Status: " << static_cast<int>(status_byte) << ", Length: " << length
+                      << ")" << std::endl;
+            valid = false;
+            break;
+        }
+
+        if (m_buffer.size() - offset - FRAME_HEADER_SIZE < length) {
+            // Incomplete frame: make room for the rest of it up front
+            m_buffer.reserve(offset + FRAME_HEADER_SIZE + length);
+            break;
+        }
+
+        frames.push_back({workload_id, static_cast<workload_status>(status_byte),
+                          m_buffer.substr(offset + FRAME_HEADER_SIZE, length)});
+        offset += FRAME_HEADER_SIZE + length;
+    }
+
+    m_buffer.erase(0, offset);
+
+    if (!frames.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto& frame : frames) {
+                m_raw_frames.push_back(std::move(frame));
+            }
+        }
+        m_condition.notify_one();
+    }
+
+    return valid;
+}
+
+void ipc_reader::handle_disconnect() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_disconnected = true;
+    // Delivered once the decode thread has flushed everything that arrived before
+    schedule_delivery();
+}
+
+void ipc_reader::decode_thread_main() {
+    while (true) {
+        std::deque<raw_frame> frames;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_stopping || !m_raw_frames.empty(); });
+            if (m_stopping) {
+                return;
+            }
+            frames.swap(m_raw_frames);
+            m_decoding = true;
+        }
+
+        std::vector<workload_event> events;
+        events.reserve(frames.size());
+        for (auto& frame : frames) {
+            events.push_back(workload_event::decode(frame.workload_id, frame.status,
+                                                    std::move(frame.message)));
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& event : events) {
+            m_decoded.push_back(std::move(event));
+        }
+        m_decoding = false;
+        schedule_delivery();
+    }
+}
+
+void ipc_reader::schedule_delivery() {
+    // One pending idle source at a time: events decoded meanwhile join the same batch
+    if (m_deliver_source == 0) {
+        m_deliver_source = g_idle_add(on_deliver, this);
+    }
+}
+
+gboolean ipc_reader::on_deliver(gpointer user_data) {
+    auto* self = static_cast<ipc_reader*>(user_data);
+
+    std::vector<workload_event> events;
+    bool disconnect = false;
+    {
+        std::lock_guard<std::mutex> lock(self->m_mutex);
+        events.swap(self->m_decoded);
+        self->m_deliver_source = 0;
+        if (self->m_disconnected && !self->m_disconnect_delivered &&
+            self->m_raw_frames.empty() && !self->m_decoding) {
+            self->m_disconnect_delivered = true;
+            disconnect = true;
+        }
+    }
+
+    if (!events.empty() && self->m_on_batch) {
+        self->m_on_batch(events);
+    }
+    if (disconnect && self->m_on_disconnect) {
+        self->m_on_disconnect();
+    }
+
+    return G_SOURCE_REMOVE;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glib.h>
+#include "ipc.hpp"
+
+// Reads workload responses on the client without blocking the GTK main loop. The socket is
+// switched to non-blocking mode and watched for G_IO_IN/HUP/ERR; whatever bytes are available
+// are fed to an incremental frame parser. Complete frames are handed to a decode thread that
+// parses their JSON, and decoded events are delivered back on the main context in batches.
+class ipc_reader {
+public:
+    using batch_callback = std::function<void(std::vector<workload_event>& events)>;
+    using disconnect_callback = std::function<void()>;
+
+    ipc_reader() = default;
+    ~ipc_reader();
+
+    ipc_reader(const ipc_reader&) = delete;
+    ipc_reader& operator=(const ipc_reader&) = delete;
+
+    ipc_reader(ipc_reader&&) = delete;
+    ipc_reader& operator=(ipc_reader&&) = delete;
+
+    // Both callbacks run on the main context. on_disconnect runs after every event received
+    // before the disconnect has been delivered.
+    bool start(int socket_fd, batch_callback on_batch, disconnect_callback on_disconnect);
+    void stop();
+
+private:
+    struct raw_frame {
+        uint64_t workload_id;
+        workload_status status;
+        std::string message;
+    };
+
+    int m_socket_fd = -1;
+    guint m_watch_source = 0;
+    batch_callback m_on_batch;
+    disconnect_callback m_on_disconnect;
+
+    // Incremental parser state (main thread only): bytes received but not yet framed
+    std::string m_buffer;
+
+    // Decode thread
+    std::thread m_decode_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<raw_frame> m_raw_frames;
+    std::vector<workload_event> m_decoded;
+    guint m_deliver_source = 0;
+    bool m_decoding = false;
+    bool m_disconnected = false;
+    bool m_disconnect_delivered = false;
+    bool m_stopping = false;
+
+    // Returns false once the peer has gone away or the stream is corrupt
+    bool read_available();
+    bool parse_frames();
+    void handle_disconnect();
+    void decode_thread_main();
+    // Requires m_mutex
+    void schedule_delivery();
+
+    static gboolean on_socket_ready(gint fd, GIOCondition condition, gpointer user_data);
+    static gboolean on_deliver(gpointer user_data);
+};
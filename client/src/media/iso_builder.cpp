@@ -0,0 +1,354 @@
+#include "media/iso_builder.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include "util/defer.hpp"
+#include "util/xxhash.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr int SECTOR_SIZE = 2048;
+constexpr size_t WRITE_SIZE = 1024 * 1024; // sectors are collected and written in chunks
+constexpr int MAX_LOAD_SECTORS = 0xffff;   // the El Torito load size field is 16 bits
+constexpr const char* BOOT_CATALOG_PATH = "/boot.catalog";
+constexpr int HIDDEN_EVERYWHERE = LIBISO_HIDE_ON_RR | LIBISO_HIDE_ON_JOLIET | LIBISO_HIDE_ON_1999;
+
+std::string describe(int code) {
+    return std::string(iso_error_to_msg(code)) + " (" + std::to_string(code) + ")";
+}
+
+// libisofs keeps global state; it is set up once and lives until the process exits
+int initialize_library() {
+    static std::once_flag once;
+    static int result = 0;
+    std::call_once(once, []() { result = iso_init(); });
+    return result;
+}
+
+// libisofs looks nodes up by absolute path
+std::string absolute(const std::string& path) {
+    return path.empty() || path[0] != '/' ? "/" + path : path;
+}
+
+std::vector<std::string> split_path(const std::string& path) {
+    std::vector<std::string> components;
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        if (end > start) {
+            components.push_back(path.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return components;
+}
+} // namespace
+
+iso_builder::iso_builder(const std::string& volume_id) : m_volume_id(volume_id) {
+    int result = initialize_library();
+    if (result < 0) {
+        m_init_error = "Failed to initialize libisofs: " + describe(result);
+        return;
+    }
+    result = iso_image_new(volume_id.c_str(), &m_image);
+    if (result < 0) {
+        m_init_error = "Failed to create ISO image: " + describe(result);
+        m_image = nullptr;
+        return;
+    }
+    iso_image_set_volume_id(m_image, volume_id.c_str());
+}
+
+iso_builder::~iso_builder() {
+    if (m_image) {
+        iso_image_unref(m_image);
+    }
+}
+
+IsoDir* iso_builder::get_directory(const std::string& path, std::string& error) {
+    if (!m_image) {
+        error = m_init_error;
+        return nullptr;
+    }
+
+    IsoDir* directory = iso_image_get_root(m_image);
+    for (const std::string& name : split_path(path)) {
+        IsoNode* node = nullptr;
+        if (iso_dir_get_node(directory, name.c_str(), &node) == 1) {
+            if (iso_node_get_type(node) != LIBISO_DIR) {
+                error = "Not a directory in the image: " + path;
+                return nullptr;
+            }
+            directory = reinterpret_cast<IsoDir*>(node);
+            continue;
+        }
+        int result = iso_tree_add_new_dir(directory, name.c_str(), &directory);
+        if (result < 0) {
+            error = "Failed to add directory " + path + ": " + describe(result);
+            return nullptr;
+        }
+    }
+    return directory;
+}
+
+bool iso_builder::add_file(const std::string& path, const std::string& contents,
+                           std::string& error) {
+    fs::path image_path(path);
+    std::string name = image_path.filename().string();
+    IsoDir* parent = get_directory(image_path.parent_path().generic_string(), error);
+    if (!parent) {
+        return false;
+    }
+    if (name.empty()) {
+        error = "No file name in " + path;
+        return false;
+    }
+
+    IsoNode* existing = nullptr;
+    if (iso_dir_get_node(parent, name.c_str(), &existing) == 1) {
+        iso_node_remove(existing);
+    }
+
+    // The stream takes ownership of the buffer, which must come from malloc
+    auto* buffer = static_cast<unsigned char*>(malloc(std::max<size_t>(contents.size(), 1)));
+    if (!buffer) {
+        error = "Out of memory adding " + path;
+        return false;
+    }
+    memcpy(buffer, contents.data(), contents.size());
+
+    IsoStream* stream = nullptr;
+    int result = iso_memory_stream_new(buffer, contents.size(), &stream);
+    if (result < 0) {
+        free(buffer);
+        error = "Failed to add " + path + ": " + describe(result);
+        return false;
+    }
+    // On success the new file takes over the reference to the stream
+    result = iso_tree_add_new_file(parent, name.c_str(), stream, nullptr);
+    if (result < 0) {
+        iso_stream_unref(stream);
+        error = "Failed to add " + path + ": " + describe(result);
+        return false;
+    }
+    m_sources.push_back({path, "", xxhash::hash64(contents.data(), contents.size())});
+    return true;
+}
+
+bool iso_builder::add_directory(const std::string& host_directory, const std::string& prefix,
+                                std::string& error) {
+    IsoDir* parent = get_directory(prefix, error);
+    if (!parent) {
+        return false;
+    }
+    int result = iso_tree_add_dir_rec(m_image, parent, host_directory.c_str());
+    if (result < 0) {
+        error = "Failed to add " + host_directory + ": " + describe(result);
+        return false;
+    }
+    m_sources.push_back({prefix, host_directory, 0});
+    return true;
+}
+
+std::optional<std::string> iso_builder::fingerprint(std::string& error) const {
+    std::string identity = m_volume_id;
+    for (const source& added : m_sources) {
+        if (added.host_directory.empty()) {
+            identity += "\n" + added.image_path + "\n" + std::to_string(added.contents_hash);
+            continue;
+        }
+
+        // Sorted, so the listing order of the host file system does not matter
+        std::vector<fs::path> files;
+        std::error_code ec;
+        for (fs::recursive_directory_iterator it(added.host_directory, ec), end;
+             !ec && it != end; it.increment(ec)) {
+            if (it->is_regular_file(ec)) {
+                files.push_back(it->path());
+            }
+        }
+        if (ec) {
+            error = "Failed to list " + added.host_directory + ": " + ec.message();
+            return std::nullopt;
+        }
+        std::sort(files.begin(), files.end());
+
+        for (const fs::path& file : files) {
+            std::ifstream input(file, std::ios::binary);
+            std::string contents((std::istreambuf_iterator<char>(input)),
+                                 std::istreambuf_iterator<char>());
+            if (input.bad() || !input.is_open()) {
+                error = "Failed to read " + file.string();
+                return std::nullopt;
+            }
+            std::string relative = file.lexically_relative(added.host_directory).generic_string();
+            identity += "\n" + added.image_path + "/" + relative + "\n" +
+                        std::to_string(xxhash::hash64(contents.data(), contents.size()));
+        }
+    }
+
+    char key[17];
+    snprintf(key, sizeof(key), "%016llx",
+             static_cast<unsigned long long>(xxhash::hash64(identity.data(), identity.size())));
+    return std::string(key);
+}
+
+bool iso_builder::set_bios_boot(const std::string& path, int load_sectors, std::string& error) {
+    if (!m_image) {
+        error = m_init_error;
+        return false;
+    }
+
+    ElToritoBootImage* boot = nullptr;
+    int result = iso_image_set_boot_image(m_image, absolute(path).c_str(), ELTORITO_NO_EMUL,
+                                          BOOT_CATALOG_PATH, &boot);
+    if (result < 0) {
+        error = "Failed to add BIOS boot entry for " + path + ": " + describe(result);
+        return false;
+    }
+    el_torito_set_load_size(boot, load_sectors);
+    iso_image_set_boot_catalog_hidden(m_image, HIDDEN_EVERYWHERE);
+    m_has_boot_catalog = true;
+    return true;
+}
+
+bool iso_builder::add_uefi_boot(const std::string& path, std::string& error) {
+    if (!m_image) {
+        error = m_init_error;
+        return false;
+    }
+
+    IsoNode* node = nullptr;
+    if (iso_tree_path_to_node(m_image, absolute(path).c_str(), &node) != 1 ||
+        iso_node_get_type(node) != LIBISO_FILE) {
+        error = "No UEFI boot image " + path + " in the image";
+        return false;
+    }
+    off_t size = iso_file_get_size(reinterpret_cast<IsoFile*>(node));
+    int load_sectors = static_cast<int>(std::min<off_t>((size + 511) / 512, MAX_LOAD_SECTORS));
+
+    // The first entry creates the catalog; a UEFI-only image has no BIOS entry before it
+    ElToritoBootImage* boot = nullptr;
+    std::string boot_path = absolute(path);
+    int result = m_has_boot_catalog ? iso_image_add_boot_image(m_image, boot_path.c_str(),
+                                                               ELTORITO_NO_EMUL, 0, &boot)
+                                    : iso_image_set_boot_image(m_image, boot_path.c_str(),
+                                                               ELTORITO_NO_EMUL,
+                                                               BOOT_CATALOG_PATH, &boot);
+    if (result < 0) {
+        error = "Failed to add UEFI boot entry for " + path + ": " + describe(result);
+        return false;
+    }
+    el_torito_set_boot_platform_id(boot, 0xEF);
+    el_torito_set_load_size(boot, load_sectors);
+    iso_image_set_boot_catalog_hidden(m_image, HIDDEN_EVERYWHERE);
+    m_has_boot_catalog = true;
+    return true;
+}
+
+bool iso_builder::write(const std::string& path, const cancellation_token& token,
+                        const progress_callback& on_progress, std::string& error) {
+    if (!m_image) {
+        error = m_init_error;
+        return false;
+    }
+
+    IsoWriteOpts* opts = nullptr;
+    int result = iso_write_opts_new(&opts, 0);
+    if (result < 0) {
+        error = "Failed to set up ISO writing: " + describe(result);
+        return false;
+    }
+    DEFER({ iso_write_opts_free(opts); });
+    iso_write_opts_set_iso_level(opts, 3);
+    iso_write_opts_set_joliet(opts, 1);
+    iso_write_opts_set_joliet_longer_paths(opts, 1);
+    iso_write_opts_set_joliet_long_names(opts, 1);
+
+    struct burn_source* source = nullptr;
+    result = iso_image_create_burn_source(m_image, opts, &source);
+    if (result < 0) {
+        error = "Failed to start writing the ISO: " + describe(result);
+        return false;
+    }
+    bool finished = false;
+    DEFER({
+        // The writer thread has to be stopped before the source is freed
+        if (!finished) {
+            source->cancel(source);
+        }
+        source->free_data(source);
+        free(source);
+    });
+
+    std::string partial_path = path + ".partial";
+    std::ofstream output(partial_path, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        error = "Failed to create " + partial_path + ": " + strerror(errno);
+        return false;
+    }
+    bool written = false;
+    DEFER({
+        if (!written) {
+            std::error_code ignored;
+            fs::remove(partial_path, ignored);
+        }
+    });
+
+    uint64_t total = static_cast<uint64_t>(source->get_size(source));
+    uint64_t done = 0;
+    std::vector<unsigned char> buffer(WRITE_SIZE);
+    int read = SECTOR_SIZE;
+    while (read == SECTOR_SIZE) {
+        size_t filled = 0;
+        while (filled < buffer.size() &&
+               (read = source->read_xt(source, buffer.data() + filled, SECTOR_SIZE)) ==
+                   SECTOR_SIZE) {
+            filled += SECTOR_SIZE;
+        }
+        output.write(reinterpret_cast<const char*>(buffer.data()),
+                     static_cast<std::streamsize>(filled));
+        if (!output) {
+            error = "Failed to write " + partial_path;
+            return false;
+        }
+        done += filled;
+        if (on_progress) {
+            on_progress(done, total);
+        }
+        if (token.is_cancelled()) {
+            error = token.get_reason();
+            return false;
+        }
+        if (read < 0) {
+            error = "Failed to produce the ISO image (a source file may be unreadable)";
+            return false;
+        }
+    }
+    finished = true;
+
+    output.close();
+    if (!output) {
+        error = "Failed to write " + partial_path;
+        return false;
+    }
+    std::error_code ec;
+    fs::rename(partial_path, path, ec);
+    if (ec) {
+        error = "Failed to move " + partial_path + " into place: " + ec.message();
+        return false;
+    }
+    written = true;
+    return true;
+}
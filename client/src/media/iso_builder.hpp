@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+#include <libisofs/libisofs.h>
+#include "util/cancellation.hpp"
+
+// Writes ISO images with libisofs: ISO9660 level 3, so files over 4 GiB are stored as several
+// extents, with Joliet names for Windows, and optionally bootable through El Torito entries for
+// BIOS and UEFI. Files added from the host are read while the image is written, so they must
+// stay in place until write returns.
+class iso_builder {
+public:
+    // done and total are bytes of the image
+    using progress_callback = std::function<void(uint64_t done, uint64_t total)>;
+
+    explicit iso_builder(const std::string& volume_id);
+    ~iso_builder();
+
+    iso_builder(const iso_builder&) = delete;
+    iso_builder& operator=(const iso_builder&) = delete;
+
+    // path is '/'-separated; parent directories are created implicitly. Adding the same path
+    // again replaces the file.
+    bool add_file(const std::string& path, const std::string& contents, std::string& error);
+    // Add everything below host_directory, under prefix ("" for the root of the image)
+    bool add_directory(const std::string& host_directory, const std::string& prefix,
+                       std::string& error);
+
+    // Boot entries refer to files already added. The BIOS entry loads load_sectors 512-byte
+    // sectors (8 for etfsboot.com); the UEFI entry is the whole file, as an EFI system partition
+    // image. The boot catalog is hidden from the directory tree.
+    bool set_bios_boot(const std::string& path, int load_sectors, std::string& error);
+    bool add_uefi_boot(const std::string& path, std::string& error);
+
+    // Hex key of the volume ID and every added path and its contents (xxhash; files of added
+    // directories are read for it): equal for images that would be built from the same files
+    std::optional<std::string> fingerprint(std::string& error) const;
+
+    // Write the image to path, through a temporary file renamed into place. Returns false with
+    // error on failure or when the token is cancelled.
+    bool write(const std::string& path, const cancellation_token& token,
+               const progress_callback& on_progress, std::string& error);
+
+private:
+    // What was added, in order, for the fingerprint
+    struct source {
+        std::string image_path;
+        std::string host_directory; // empty for a file added from memory
+        uint64_t contents_hash = 0;
+    };
+
+    std::string m_volume_id;
+    std::vector<source> m_sources;
+    IsoImage* m_image = nullptr;
+    bool m_has_boot_catalog = false;
+    std::string m_init_error;
+
+    // The directory at path, created along with its parents if missing
+    IsoDir* get_directory(const std::string& path, std::string& error);
+};
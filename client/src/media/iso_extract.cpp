@@ -0,0 +1,97 @@
+#include "media/iso_extract.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "util/defer.hpp"
+
+namespace iso_extract {
+
+namespace {
+constexpr size_t COPY_SIZE = 4 * 1024 * 1024;
+
+// Copy part of the ISO into a file. copy_file_range lets the filesystem share or offload the
+// data where it can; plain reads and writes are the fallback.
+bool copy_range(int source_fd, uint64_t offset, int target_fd, uint64_t length,
+                const cancellation_token& token, uint64_t& copied) {
+    bool use_copy_file_range = true;
+    std::vector<uint8_t> buffer;
+
+    while (length > 0) {
+        if (token.is_cancelled()) {
+            return false;
+        }
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(length, COPY_SIZE));
+
+        ssize_t result = -1;
+        if (use_copy_file_range) {
+            loff_t source_offset = static_cast<loff_t>(offset);
+            result = copy_file_range(source_fd, &source_offset, target_fd, nullptr, chunk, 0);
+            if (result == -1 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+                                 errno == EOPNOTSUPP)) {
+                use_copy_file_range = false;
+                continue;
+            }
+        } else {
+            buffer.resize(COPY_SIZE);
+            result = pread(source_fd, buffer.data(), chunk, static_cast<off_t>(offset));
+            if (result > 0) {
+                for (ssize_t written = 0; written < result;) {
+                    ssize_t part = write(target_fd, buffer.data() + written,
+                                         static_cast<size_t>(result - written));
+                    if (part == -1 && errno == EINTR) {
+                        continue;
+                    }
+                    if (part <= 0) {
+                        return false;
+                    }
+                    written += part;
+                }
+            }
+        }
+
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            if (result == 0) {
+                errno = EIO; // the ISO is shorter than its directory says
+            }
+            return false;
+        }
+        offset += static_cast<uint64_t>(result);
+        length -= static_cast<uint64_t>(result);
+        copied += static_cast<uint64_t>(result);
+    }
+    return true;
+}
+
+} // namespace
+
+bool extract_file(int source_fd, const iso_reader::file& entry, const std::string& target,
+                  const cancellation_token& token, uint64_t& copied, std::string& error) {
+    int target_fd = open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (target_fd == -1) {
+        error = "Failed to create " + target + ": " + strerror(errno);
+        return false;
+    }
+    DEFER({ close(target_fd); });
+
+    uint64_t remaining = entry.size;
+    for (const auto& part : entry.extents) {
+        uint64_t length = std::min(part.length, remaining);
+        if (!copy_range(source_fd, part.offset, target_fd, length, token, copied)) {
+            if (!token.is_cancelled()) {
+                error = "Failed to extract " + target + ": " + strerror(errno);
+            }
+            return false;
+        }
+        remaining -= length;
+    }
+    return true;
+}
+
+} // namespace iso_extract
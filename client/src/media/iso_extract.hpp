@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "media/iso_reader.hpp"
+#include "util/cancellation.hpp"
+
+// Copying files out of a local ISO without mounting it
+namespace iso_extract {
+
+// Write entry (from iso_reader on the image open as source_fd) to a new file at target, adding
+// the bytes written to copied. Returns false on error or cancellation; error is left empty when
+// cancelled.
+bool extract_file(int source_fd, const iso_reader::file& entry, const std::string& target,
+                  const cancellation_token& token, uint64_t& copied, std::string& error);
+
+} // namespace iso_extract
@@ -0,0 +1,513 @@
+#include "media/iso_library.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr int INDEX_VERSION = 1;
+
+// Changes are applied once the directory has been quiet this long, so a burst of events (a copy
+// finishing, a directory being moved in) is handled in one go
+constexpr auto SETTLE_TIME = std::chrono::seconds(1);
+
+constexpr uint32_t WATCH_MASK =
+    IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE;
+
+struct file_state {
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+};
+
+std::optional<file_state> stat_file(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) == -1 || !S_ISREG(st.st_mode)) {
+        return std::nullopt;
+    }
+    return file_state{static_cast<uint64_t>(st.st_size),
+                      static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec};
+}
+
+std::string to_lower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+bool is_iso(const std::filesystem::path& path) {
+    return to_lower(path.extension().string()) == ".iso";
+}
+
+bool is_below(const std::string& path, const std::string& root) {
+    std::string prefix = root;
+    while (prefix.size() > 1 && prefix.back() == '/') {
+        prefix.pop_back();
+    }
+    return path.compare(0, prefix.size(), prefix) == 0 &&
+           (path.size() == prefix.size() || path[prefix.size()] == '/' || prefix == "/");
+}
+
+int64_t now_seconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+} // namespace
+
+nlohmann::json iso_library::scan_stats::to_json() const {
+    return {{"files", files},
+            {"scanned", scanned},
+            {"unchanged", unchanged},
+            {"removed", removed},
+            {"failed", failed}};
+}
+
+iso_library::iso_library(std::string path) : m_path(std::move(path)) {}
+
+iso_library::~iso_library() {
+    stop_watching();
+}
+
+iso_library::scan_stats iso_library::scan(const std::vector<std::string>& roots,
+                                          size_t concurrency, const reader& read,
+                                          const cancellation_token& token,
+                                          const progress_callback& on_progress) {
+    scan_stats stats;
+
+    // Only roots that could be walked completely may drop entries, so an unreachable share
+    // does not empty the index
+    std::vector<std::string> files;
+    std::vector<std::string> walked_roots;
+    for (const auto& root : roots) {
+        std::error_code ec;
+        std::filesystem::recursive_directory_iterator it(
+            root, std::filesystem::directory_options::skip_permission_denied, ec);
+        for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+            if (token.is_cancelled()) {
+                return stats;
+            }
+            std::error_code type_ec;
+            if (it->is_regular_file(type_ec) && is_iso(it->path())) {
+                files.push_back(it->path().string());
+            }
+        }
+        if (ec) {
+            std::cerr << "[ISO Library] Failed to walk " << root << ": " << ec.message()
+                      << std::endl;
+        } else {
+            walked_roots.push_back(root);
+        }
+    }
+    stats.files = files.size();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        load();
+
+        std::unordered_set<std::string> present(files.begin(), files.end());
+        for (auto it = m_entries.begin(); it != m_entries.end();) {
+            const std::string& path = it.key();
+            bool below_walked = std::any_of(
+                walked_roots.begin(), walked_roots.end(),
+                [&path](const std::string& root) { return is_below(path, root); });
+            if (below_walked && present.count(path) == 0) {
+                it = m_entries.erase(it);
+                stats.removed++;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Reading an ISO is a handful of small random reads, so throughput over a network share is
+    // bound by latency: keep several reads in flight, but not so many that the share thrashes
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex stats_mutex;
+    auto scan_files = [&]() {
+        for (size_t i = next++; i < files.size() && !token.is_cancelled(); i = next++) {
+            nlohmann::json entry;
+            std::string change = update_file(files[i], read, entry);
+            {
+                std::lock_guard<std::mutex> lock(stats_mutex);
+                if (change.empty()) {
+                    stats.unchanged++;
+                } else if (entry.contains("error")) {
+                    stats.failed++;
+                } else {
+                    stats.scanned++;
+                }
+            }
+            if (on_progress) {
+                on_progress(++done, files.size());
+            }
+        }
+    };
+
+    size_t thread_count = std::min(std::max<size_t>(concurrency, 1), files.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < thread_count; i++) {
+        threads.emplace_back(scan_files);
+    }
+    scan_files();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        save();
+    }
+
+    std::cout << "[ISO Library] Scanned " << stats.files << " ISOs: " << stats.scanned
+              << " read, " << stats.unchanged << " unchanged, " << stats.removed << " removed, "
+              << stats.failed << " failed" << std::endl;
+    return stats;
+}
+
+std::string iso_library::update_file(const std::string& path, const reader& read,
+                                     nlohmann::json& entry) {
+    std::optional<file_state> state = stat_file(path);
+    std::string change;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        load();
+
+        auto it = m_entries.find(path);
+        if (!state) {
+            if (it == m_entries.end()) {
+                return "";
+            }
+            m_entries.erase(it);
+            entry = {{"path", path}};
+            return "removed";
+        }
+        if (it != m_entries.end() && it->value("size", uint64_t(0)) == state->size &&
+            it->value("mtime_ns", int64_t(0)) == state->mtime_ns) {
+            entry = *it;
+            return "";
+        }
+        change = it == m_entries.end() ? "added" : "updated";
+    }
+
+    // Read without the lock: this is the slow part, and other files are read meanwhile. The
+    // size and mtime are from before the read, so a file changing under us is read again later.
+    std::string hash;
+    std::string error;
+    std::optional<nlohmann::json> images = read(path, hash, error);
+
+    entry = {{"path", path},
+             {"size", state->size},
+             {"mtime_ns", state->mtime_ns},
+             {"indexed_at", now_seconds()}};
+    if (images) {
+        entry["hash"] = hash;
+        entry["images"] = std::move(*images);
+    } else {
+        // Remembered too, so an unchanged broken file is not read on every scan
+        entry["error"] = error;
+        std::cerr << "[ISO Library] Skipping " << path << ": " << error << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries[path] = entry;
+    return change;
+}
+
+nlohmann::json iso_library::search(const nlohmann::json& query) {
+    std::string text = to_lower(query.value("text", ""));
+    std::string edition = to_lower(query.value("edition", ""));
+    std::string build = query.value("build", "");
+    std::string language = to_lower(query.value("language", ""));
+    std::string architecture = to_lower(query.value("architecture", ""));
+
+    nlohmann::json results = nlohmann::json::array();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    load();
+
+    for (const auto& [path, entry] : m_entries.items()) {
+        auto images = entry.find("images");
+        if (images == entry.end()) {
+            continue;
+        }
+
+        for (const auto& image : *images) {
+            if (!edition.empty() && to_lower(image.value("edition_id", "")) != edition &&
+                to_lower(image.value("name", "")) != edition) {
+                continue;
+            }
+            if (!build.empty() && image.value("build", "").compare(0, build.size(), build) != 0) {
+                continue;
+            }
+            if (!architecture.empty() &&
+                to_lower(image.value("architecture", "")) != architecture) {
+                continue;
+            }
+            if (!language.empty()) {
+                const auto& languages = image.value("languages", nlohmann::json::array());
+                bool has_language =
+                    std::any_of(languages.begin(), languages.end(), [&](const auto& value) {
+                        return value.is_string() && to_lower(value.template get<std::string>()) ==
+                                                        language;
+                    });
+                if (!has_language) {
+                    continue;
+                }
+            }
+            if (!text.empty()) {
+                std::string haystack = to_lower(
+                    image.value("name", "") + "\n" + image.value("description", "") + "\n" +
+                    image.value("display_name", "") + "\n" + image.value("edition_id", "") +
+                    "\n" + path);
+                if (haystack.find(text) == std::string::npos) {
+                    continue;
+                }
+            }
+
+            nlohmann::json match = image;
+            match["path"] = path;
+            match["hash"] = entry.value("hash", "");
+            results.push_back(std::move(match));
+        }
+    }
+    return results;
+}
+
+size_t iso_library::get_entry_count() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    load();
+    return m_entries.size();
+}
+
+bool iso_library::watch(const std::vector<std::string>& roots, size_t concurrency, reader read,
+                        change_callback on_change) {
+    stop_watching();
+
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify_fd == -1) {
+        std::cerr << "[ISO Library] Failed to initialize inotify: " << strerror(errno)
+                  << std::endl;
+        return false;
+    }
+    m_stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_stop_fd == -1) {
+        std::cerr << "[ISO Library] Failed to create eventfd: " << strerror(errno) << std::endl;
+        close(m_inotify_fd);
+        m_inotify_fd = -1;
+        return false;
+    }
+
+    m_watching = true;
+    m_watch_thread = std::thread(&iso_library::watch_thread, this, roots, concurrency,
+                                 std::move(read), std::move(on_change));
+    return true;
+}
+
+void iso_library::stop_watching() {
+    if (!m_watch_thread.joinable()) {
+        return;
+    }
+
+    uint64_t one = 1;
+    if (write(m_stop_fd, &one, sizeof(one)) == -1) {
+        std::cerr << "[ISO Library] Failed to signal watch thread: " << strerror(errno)
+                  << std::endl;
+    }
+    m_watch_thread.join();
+
+    close(m_inotify_fd);
+    close(m_stop_fd);
+    m_inotify_fd = -1;
+    m_stop_fd = -1;
+    m_watching = false;
+}
+
+bool iso_library::is_watching() const {
+    return m_watching;
+}
+
+void iso_library::watch_thread(std::vector<std::string> roots, size_t concurrency, reader read,
+                               change_callback on_change) {
+    // inotify is not recursive: every directory below the roots needs its own watch
+    std::unordered_map<int, std::string> directories;
+    auto add_tree = [this, &directories](const std::string& root) {
+        auto add_directory = [this, &directories](const std::string& directory) {
+            int wd = inotify_add_watch(m_inotify_fd, directory.c_str(), WATCH_MASK);
+            if (wd == -1) {
+                std::cerr << "[ISO Library] Failed to watch " << directory << ": "
+                          << strerror(errno) << std::endl;
+                return;
+            }
+            directories[wd] = directory;
+        };
+
+        add_directory(root);
+        std::error_code ec;
+        std::filesystem::recursive_directory_iterator it(
+            root, std::filesystem::directory_options::skip_permission_denied, ec);
+        for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+            std::error_code type_ec;
+            if (it->is_directory(type_ec)) {
+                add_directory(it->path().string());
+            }
+        }
+    };
+    for (const auto& root : roots) {
+        add_tree(root);
+    }
+    std::cout << "[ISO Library] Watching " << directories.size() << " directories" << std::endl;
+
+    std::set<std::string> pending;
+    bool rescan = false;
+    auto last_event = std::chrono::steady_clock::now();
+    alignas(inotify_event) char buffer[16384];
+
+    while (true) {
+        int timeout_ms = -1;
+        if (!pending.empty() || rescan) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                last_event + SETTLE_TIME - std::chrono::steady_clock::now());
+            timeout_ms = static_cast<int>(std::max<int64_t>(remaining.count(), 0));
+        }
+
+        pollfd fds[2] = {{m_inotify_fd, POLLIN, 0}, {m_stop_fd, POLLIN, 0}};
+        int ready = poll(fds, 2, timeout_ms);
+        if (ready == -1 && errno != EINTR) {
+            std::cerr << "[ISO Library] Watch poll failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        if (ready > 0 && (fds[1].revents & POLLIN)) {
+            break;
+        }
+
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            ssize_t length;
+            while ((length = ::read(m_inotify_fd, buffer, sizeof(buffer))) > 0) {
+                for (char* cursor = buffer; cursor < buffer + length;) {
+                    const auto* event = reinterpret_cast<const inotify_event*>(cursor);
+                    cursor += sizeof(inotify_event) + event->len;
+
+                    if (event->mask & IN_Q_OVERFLOW) {
+                        rescan = true;
+                        continue;
+                    }
+                    if (event->mask & IN_IGNORED) {
+                        directories.erase(event->wd);
+                        continue;
+                    }
+                    auto directory = directories.find(event->wd);
+                    if (directory == directories.end() || event->len == 0) {
+                        continue;
+                    }
+
+                    std::string path = directory->second + "/" + event->name;
+                    if (event->mask & IN_ISDIR) {
+                        // A directory moved in may already hold ISOs, and one moved away takes
+                        // its entries along: both need a walk
+                        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                            add_tree(path);
+                        }
+                        rescan = true;
+                    } else if (is_iso(path)) {
+                        pending.insert(path);
+                    }
+                }
+            }
+            last_event = std::chrono::steady_clock::now();
+            continue;
+        }
+
+        if (std::chrono::steady_clock::now() < last_event + SETTLE_TIME) {
+            continue;
+        }
+
+        if (rescan) {
+            cancellation_token never_cancelled;
+            scan_stats stats = scan(roots, concurrency, read, never_cancelled, nullptr);
+            if (on_change) {
+                on_change("rescanned", stats.to_json());
+            }
+            rescan = false;
+            pending.clear();
+            continue;
+        }
+
+        for (const auto& path : pending) {
+            nlohmann::json entry;
+            std::string change = update_file(path, read, entry);
+            if (!change.empty() && on_change) {
+                on_change(change, entry);
+            }
+        }
+        pending.clear();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        save();
+    }
+
+    std::cout << "[ISO Library] Stopped watching" << std::endl;
+}
+
+void iso_library::load() {
+    if (m_loaded) {
+        return;
+    }
+    m_loaded = true;
+
+    std::ifstream input(m_path);
+    if (!input) {
+        return;
+    }
+
+    nlohmann::json index = nlohmann::json::parse(input, nullptr, false);
+    if (index.is_discarded() || index.value("version", 0) != INDEX_VERSION ||
+        !index.contains("entries") || !index["entries"].is_object()) {
+        std::cerr << "[ISO Library] Ignoring unreadable index " << m_path << std::endl;
+        return;
+    }
+    m_entries = std::move(index["entries"]);
+    std::cout << "[ISO Library] Loaded " << m_entries.size() << " entries" << std::endl;
+}
+
+void iso_library::save() {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(m_path).parent_path(), ec);
+
+    // Write to a temporary file and rename it over the index, so readers never see a torn file
+    std::string temp_path = m_path + ".tmp";
+    {
+        std::ofstream output(temp_path, std::ios::trunc);
+        if (!output) {
+            std::cerr << "[ISO Library] Failed to write " << temp_path << std::endl;
+            return;
+        }
+        nlohmann::json index = {{"version", INDEX_VERSION}, {"entries", m_entries}};
+        output << index.dump();
+        if (!output) {
+            std::cerr << "[ISO Library] Failed to write " << temp_path << std::endl;
+            return;
+        }
+    }
+
+    if (rename(temp_path.c_str(), m_path.c_str()) == -1) {
+        std::cerr << "[ISO Library] Failed to replace " << m_path << ": " << strerror(errno)
+                  << std::endl;
+        unlink(temp_path.c_str());
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "util/cancellation.hpp"
+
+// Persistent, searchable index of the Windows images on every ISO below a set of directories
+// (typically a NAS share), so any edition can be offered without touching the media again.
+//
+// Entries are keyed by path and remember the file's size and mtime: a rescan only reads ISOs
+// that are new or changed, a bounded number at a time. While watching, inotify keeps the index
+// current between scans. inotify only sees changes made through this machine, so files replaced
+// by other clients of a network share are picked up by the next scan.
+class iso_library {
+public:
+    static constexpr const char* DEFAULT_PATH = "/var/cache/lsw/iso-library.json";
+
+    // Reads the image list of one ISO and reports its content hash (the media fingerprint)
+    using reader = std::function<std::optional<nlohmann::json>(
+        const std::string& path, std::string& hash, std::string& error)>;
+    using progress_callback = std::function<void(size_t done, size_t total)>;
+    // change is "added", "updated", "removed" or "rescanned"; entry is the index entry (only the
+    // path for removals, the scan stats for rescans)
+    using change_callback =
+        std::function<void(const std::string& change, const nlohmann::json& entry)>;
+
+    struct scan_stats {
+        size_t files = 0;     // ISOs found below the roots
+        size_t scanned = 0;   // read because they were new or changed
+        size_t unchanged = 0; // answered from the index
+        size_t removed = 0;   // indexed before, gone now
+        size_t failed = 0;    // unreadable, or without Windows images
+
+        nlohmann::json to_json() const;
+    };
+
+    explicit iso_library(std::string path = DEFAULT_PATH);
+    ~iso_library();
+
+    iso_library(const iso_library&) = delete;
+    iso_library& operator=(const iso_library&) = delete;
+
+    // Walk the roots and bring their entries up to date, reading at most `concurrency` ISOs at
+    // once. Stops early (keeping what was read so far) when the token is cancelled.
+    scan_stats scan(const std::vector<std::string>& roots, size_t concurrency, const reader& read,
+                    const cancellation_token& token, const progress_callback& on_progress);
+
+    // Images matching every given field of query: "text" (substring of name, description,
+    // edition ID or path), "edition" (edition ID or name), "build" (prefix), "language",
+    // "architecture". Each result is the image plus the "path" and "hash" of its ISO.
+    nlohmann::json search(const nlohmann::json& query);
+
+    // Follow changes below the roots until stop_watching, replacing any previous watch.
+    // on_change runs on the watch thread.
+    bool watch(const std::vector<std::string>& roots, size_t concurrency, reader read,
+               change_callback on_change);
+    void stop_watching();
+    bool is_watching() const;
+
+    size_t get_entry_count();
+
+private:
+    std::string m_path;
+    std::mutex m_mutex;
+    bool m_loaded = false;
+    nlohmann::json m_entries = nlohmann::json::object(); // by ISO path
+
+    std::thread m_watch_thread;
+    std::atomic<bool> m_watching{false};
+    int m_inotify_fd = -1;
+    int m_stop_fd = -1;
+
+    // Reads the file if its size or mtime differ from the index. Returns the change made ("" if
+    // none) and fills in the entry.
+    std::string update_file(const std::string& path, const reader& read, nlohmann::json& entry);
+    void watch_thread(std::vector<std::string> roots, size_t concurrency, reader read,
+                      change_callback on_change);
+
+    void load();
+    void save();
+};
@@ -0,0 +1,703 @@
+#include "media/iso_reader.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_set>
+
+namespace {
+// ECMA-167 descriptor tag identifiers
+constexpr uint16_t UDF_TAG_ANCHOR = 2;
+constexpr uint16_t UDF_TAG_PARTITION = 5;
+constexpr uint16_t UDF_TAG_LOGICAL_VOLUME = 6;
+constexpr uint16_t UDF_TAG_TERMINATING = 8;
+constexpr uint16_t UDF_TAG_FILE_SET = 256;
+constexpr uint16_t UDF_TAG_FILE_IDENTIFIER = 257;
+constexpr uint16_t UDF_TAG_FILE_ENTRY = 261;
+constexpr uint16_t UDF_TAG_EXTENDED_FILE_ENTRY = 266;
+
+constexpr uint32_t UDF_ANCHOR_SECTOR = 256;
+constexpr uint32_t ISO9660_PVD_SECTOR = 16;
+constexpr uint32_t ISO9660_MAX_DESCRIPTORS = 32;
+
+// Directories are read whole; anything larger than this is not a real install medium
+constexpr uint64_t MAX_DIRECTORY_SIZE = 16 * 1024 * 1024;
+// Limits for listing the whole tree, so a malformed image cannot keep the walk going forever
+constexpr size_t MAX_LISTED_ENTRIES = 1000000;
+constexpr size_t MAX_DIRECTORY_DEPTH = 64;
+
+uint16_t le16(const uint8_t* data) {
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+uint32_t le32(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+uint64_t le64(const uint8_t* data) {
+    return static_cast<uint64_t>(le32(data)) | (static_cast<uint64_t>(le32(data + 4)) << 32);
+}
+
+bool equals_ignore_case(const std::string& a, const std::string& b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return std::tolower(static_cast<unsigned char>(x)) ==
+                      std::tolower(static_cast<unsigned char>(y));
+           });
+}
+
+std::vector<std::string> split_path(const std::string& path) {
+    std::vector<std::string> components;
+    std::stringstream stream(path);
+    std::string component;
+    while (std::getline(stream, component, '/')) {
+        if (!component.empty()) {
+            components.push_back(component);
+        }
+    }
+    return components;
+}
+
+void append_utf8(std::string& out, uint32_t code_point) {
+    if (code_point < 0x80) {
+        out.push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+}
+
+// UDF dstrings start with a compression ID: 8 for one byte per character (Latin-1), 16 for
+// UTF-16 (BE). Decoded to UTF-8, so names can also be used as paths on the host.
+std::string decode_udf_name(const uint8_t* data, size_t length) {
+    std::string name;
+    if (length == 0) {
+        return name;
+    }
+    if (data[0] == 8) {
+        for (size_t i = 1; i < length; i++) {
+            append_utf8(name, data[i]);
+        }
+    } else if (data[0] == 16) {
+        for (size_t i = 1; i + 1 < length; i += 2) {
+            uint32_t unit = static_cast<uint32_t>((data[i] << 8) | data[i + 1]);
+            if (unit >= 0xD800 && unit < 0xDC00 && i + 3 < length) {
+                uint32_t low = static_cast<uint32_t>((data[i + 2] << 8) | data[i + 3]);
+                if (low >= 0xDC00 && low < 0xE000) {
+                    unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                    i += 2;
+                }
+            }
+            append_utf8(name, unit);
+        }
+    }
+    return name;
+}
+
+// "INSTALL.WIM;1" -> "INSTALL.WIM"; directories may also carry a trailing dot
+std::string decode_iso9660_name(const uint8_t* data, size_t length) {
+    std::string name(reinterpret_cast<const char*>(data), length);
+    size_t version = name.find(';');
+    if (version != std::string::npos) {
+        name.resize(version);
+    }
+    if (!name.empty() && name.back() == '.') {
+        name.pop_back();
+    }
+    return name;
+}
+// Joliet names are UTF-16 (BE) and carry the same ";1" suffix as ISO9660 names
+std::string decode_joliet_name(const uint8_t* data, size_t length) {
+    std::vector<uint8_t> dstring(1, 16); // as a UDF dstring, to share the UTF-16 decoding
+    dstring.insert(dstring.end(), data, data + length);
+    std::string name = decode_udf_name(dstring.data(), dstring.size());
+    return decode_iso9660_name(reinterpret_cast<const uint8_t*>(name.data()), name.size());
+}
+
+bool is_safe_name(const std::string& name) {
+    // Never let a crafted name escape the directory it is extracted to
+    return !name.empty() && name != "." && name != ".." && name.find('/') == std::string::npos;
+}
+} // namespace
+
+iso_reader::~iso_reader() {
+    close();
+}
+
+bool iso_reader::open(const std::string& path) {
+    close();
+
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd == -1) {
+        set_error("Failed to open " + path + ": " + strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(m_fd, &st) == -1) {
+        set_error("Failed to stat " + path + ": " + strerror(errno));
+        close();
+        return false;
+    }
+    m_image_size = static_cast<uint64_t>(st.st_size);
+
+    // Lookups jump between descriptors, directories and the WIM header; readahead only wastes I/O
+    posix_fadvise(m_fd, 0, 0, POSIX_FADV_RANDOM);
+
+    load_volume(path);
+    return true;
+}
+
+bool iso_reader::open(uint64_t image_size, read_function read, const std::string& name) {
+    close();
+
+    if (!read) {
+        set_error("No image source");
+        return false;
+    }
+    m_source = std::move(read);
+    m_image_size = image_size;
+
+    load_volume(name);
+    return true;
+}
+
+void iso_reader::load_volume(const std::string& name) {
+    if (load_udf_volume()) {
+        std::cout << "[ISO] Opened " << name << " (UDF)" << std::endl;
+    } else {
+        std::cout << "[ISO] Opened " << name << " (ISO9660)" << std::endl;
+    }
+}
+
+void iso_reader::close() {
+    if (m_fd != -1) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_source = nullptr;
+    m_image_size = 0;
+    m_udf.reset();
+}
+
+std::optional<iso_reader::file> iso_reader::find_file(const std::string& path) {
+    if (m_fd == -1 && !m_source) {
+        set_error("No image open");
+        return std::nullopt;
+    }
+
+    std::vector<std::string> components = split_path(path);
+    if (components.empty()) {
+        set_error("Empty path");
+        return std::nullopt;
+    }
+
+    if (m_udf) {
+        std::optional<file> entry = find_udf_file(components);
+        if (entry) {
+            return entry;
+        }
+    }
+    return find_iso9660_file(components);
+}
+
+bool iso_reader::read_file(const file& entry, uint64_t offset, void* buffer, size_t length) {
+    if (offset > entry.size || length > entry.size - offset) {
+        set_error("Read past end of file");
+        return false;
+    }
+
+    auto* cursor = static_cast<uint8_t*>(buffer);
+    uint64_t extent_start = 0;
+    for (const extent& part : entry.extents) {
+        if (length == 0) {
+            break;
+        }
+        uint64_t extent_end = extent_start + part.length;
+        if (offset < extent_end) {
+            uint64_t within = offset - extent_start;
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(length, part.length - within));
+            if (!read_at(part.offset + within, cursor, chunk)) {
+                return false;
+            }
+            cursor += chunk;
+            offset += chunk;
+            length -= chunk;
+        }
+        extent_start = extent_end;
+    }
+
+    if (length > 0) {
+        set_error("File extents shorter than file size");
+        return false;
+    }
+    return true;
+}
+
+bool iso_reader::read_at(uint64_t offset, void* buffer, size_t length) {
+    if (offset > m_image_size || length > m_image_size - offset) {
+        set_error("Read past end of image");
+        return false;
+    }
+
+    if (m_source) {
+        if (!m_source(offset, buffer, length)) {
+            set_error("Read failed at offset " + std::to_string(offset));
+            return false;
+        }
+        return true;
+    }
+
+    auto* cursor = static_cast<char*>(buffer);
+    while (length > 0) {
+        ssize_t result = pread(m_fd, cursor, length, static_cast<off_t>(offset));
+        if (result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            set_error(std::string("Read failed: ") + strerror(errno));
+            return false;
+        }
+        if (result == 0) {
+            set_error("Unexpected end of image");
+            return false;
+        }
+        cursor += result;
+        offset += static_cast<uint64_t>(result);
+        length -= static_cast<size_t>(result);
+    }
+    return true;
+}
+
+void iso_reader::set_error(const std::string& error) {
+    m_last_error = error;
+}
+
+bool iso_reader::load_udf_volume() {
+    uint8_t sector[SECTOR_SIZE];
+    if (!read_at(static_cast<uint64_t>(UDF_ANCHOR_SECTOR) * SECTOR_SIZE, sector, SECTOR_SIZE) ||
+        le16(sector) != UDF_TAG_ANCHOR) {
+        return false;
+    }
+
+    // Main volume descriptor sequence
+    uint32_t sequence_length = le32(sector + 16);
+    uint32_t sequence_start = le32(sector + 20);
+
+    udf_volume volume;
+    std::optional<uint32_t> partition_start;
+    uint32_t file_set_block = 0;
+    bool have_logical_volume = false;
+
+    uint32_t sequence_sectors = std::min<uint32_t>(sequence_length / SECTOR_SIZE, 64);
+    for (uint32_t i = 0; i < sequence_sectors; i++) {
+        if (!read_at(static_cast<uint64_t>(sequence_start + i) * SECTOR_SIZE, sector,
+                     SECTOR_SIZE)) {
+            return false;
+        }
+
+        uint16_t tag = le16(sector);
+        if (tag == UDF_TAG_TERMINATING) {
+            break;
+        }
+        if (tag == UDF_TAG_PARTITION && !partition_start) {
+            partition_start = le32(sector + 188);
+        } else if (tag == UDF_TAG_LOGICAL_VOLUME) {
+            volume.block_size = le32(sector + 212);
+            file_set_block = le32(sector + 252);
+
+            // Only plain (type 1) partition maps; metadata partitions (UDF 2.5+) are not used by
+            // Windows media
+            uint32_t map_count = le32(sector + 268);
+            if (map_count < 1 || sector[440] != 1) {
+                set_error("Unsupported UDF partition map");
+                return false;
+            }
+            have_logical_volume = true;
+        }
+    }
+
+    if (!partition_start || !have_logical_volume || volume.block_size != SECTOR_SIZE) {
+        set_error("Incomplete UDF volume descriptors");
+        return false;
+    }
+    volume.partition_start = *partition_start;
+
+    uint64_t file_set_offset =
+        (static_cast<uint64_t>(volume.partition_start) + file_set_block) * volume.block_size;
+    if (!read_at(file_set_offset, sector, SECTOR_SIZE) || le16(sector) != UDF_TAG_FILE_SET) {
+        set_error("UDF file set descriptor not found");
+        return false;
+    }
+    volume.root_icb = le32(sector + 404);
+
+    m_udf = volume;
+    return true;
+}
+
+std::optional<iso_reader::file> iso_reader::read_udf_file_entry(uint64_t block) {
+    const udf_volume& volume = *m_udf;
+    uint64_t partition_offset = static_cast<uint64_t>(volume.partition_start) * volume.block_size;
+    uint64_t entry_offset = partition_offset + block * volume.block_size;
+
+    std::vector<uint8_t> entry(volume.block_size);
+    if (!read_at(entry_offset, entry.data(), entry.size())) {
+        return std::nullopt;
+    }
+
+    uint16_t tag = le16(entry.data());
+    size_t extended_attributes_field;
+    if (tag == UDF_TAG_FILE_ENTRY) {
+        extended_attributes_field = 168;
+    } else if (tag == UDF_TAG_EXTENDED_FILE_ENTRY) {
+        extended_attributes_field = 208;
+    } else {
+        set_error("Not a UDF file entry");
+        return std::nullopt;
+    }
+
+    uint32_t extended_attributes_length = le32(entry.data() + extended_attributes_field);
+    uint32_t descriptors_length = le32(entry.data() + extended_attributes_field + 4);
+    uint64_t descriptors_start = extended_attributes_field + 8 + extended_attributes_length;
+    if (descriptors_start + descriptors_length > entry.size()) {
+        set_error("Corrupt UDF file entry");
+        return std::nullopt;
+    }
+
+    file result;
+    result.size = le64(entry.data() + 56);
+
+    // ICB tag flags, bits 0-2: how the allocation descriptors are stored
+    uint16_t descriptor_type = le16(entry.data() + 34) & 0x7;
+    const uint8_t* descriptors = entry.data() + descriptors_start;
+
+    if (descriptor_type == 3) {
+        // Small files live inside the file entry itself
+        result.extents.push_back({entry_offset + descriptors_start, descriptors_length});
+        return result;
+    }
+    if (descriptor_type > 1) {
+        set_error("Unsupported UDF allocation descriptors");
+        return std::nullopt;
+    }
+
+    size_t descriptor_size = descriptor_type == 0 ? 8 : 16;
+    for (size_t p = 0; p + descriptor_size <= descriptors_length; p += descriptor_size) {
+        uint32_t length_field = le32(descriptors + p);
+        uint32_t length = length_field & 0x3FFFFFFF;
+        uint32_t extent_type = length_field >> 30;
+        if (length == 0) {
+            break;
+        }
+        // Only recorded extents; continuation and sparse extents do not occur on install media
+        if (extent_type != 0) {
+            set_error("Unsupported UDF extent type");
+            return std::nullopt;
+        }
+        uint64_t position = le32(descriptors + p + 4);
+        result.extents.push_back({partition_offset + position * volume.block_size, length});
+    }
+    return result;
+}
+
+std::optional<std::vector<iso_reader::udf_child>>
+iso_reader::read_udf_directory(const file& directory) {
+    if (directory.size > MAX_DIRECTORY_SIZE) {
+        set_error("UDF directory too large");
+        return std::nullopt;
+    }
+    std::vector<uint8_t> data(static_cast<size_t>(directory.size));
+    if (!read_file(directory, 0, data.data(), data.size())) {
+        return std::nullopt;
+    }
+
+    std::vector<udf_child> children;
+    size_t p = 0;
+    while (p + 38 <= data.size()) {
+        if (le16(data.data() + p) != UDF_TAG_FILE_IDENTIFIER) {
+            break;
+        }
+        uint8_t characteristics = data[p + 18];
+        uint8_t name_length = data[p + 19];
+        uint32_t icb_block = le32(data.data() + p + 24);
+        uint16_t implementation_length = le16(data.data() + p + 36);
+        size_t name_offset = p + 38 + implementation_length;
+        if (name_offset + name_length > data.size()) {
+            break;
+        }
+
+        // Skip deleted entries (bit 2) and the parent link (bit 3); bit 1 marks directories
+        if ((characteristics & 0x0C) == 0) {
+            children.push_back({decode_udf_name(data.data() + name_offset, name_length),
+                                icb_block, (characteristics & 0x02) != 0});
+        }
+        p = (name_offset + name_length + 3) & ~static_cast<size_t>(3);
+    }
+    return children;
+}
+
+std::optional<iso_reader::file>
+iso_reader::find_udf_file(const std::vector<std::string>& components) {
+    std::optional<file> current = read_udf_file_entry(m_udf->root_icb);
+
+    for (size_t c = 0; c < components.size() && current; c++) {
+        std::optional<std::vector<udf_child>> children = read_udf_directory(*current);
+        if (!children) {
+            return std::nullopt;
+        }
+
+        auto child = std::find_if(children->begin(), children->end(), [&](const udf_child& entry) {
+            return equals_ignore_case(entry.name, components[c]);
+        });
+        if (child == children->end()) {
+            set_error("Not found: " + components[c]);
+            return std::nullopt;
+        }
+        current = read_udf_file_entry(child->icb_block);
+    }
+    return current;
+}
+
+bool iso_reader::check_listing_limits(size_t entries, size_t depth) {
+    if (entries >= MAX_LISTED_ENTRIES) {
+        set_error("Too many files in the image (more than " +
+                  std::to_string(MAX_LISTED_ENTRIES) + ")");
+        return false;
+    }
+    if (depth > MAX_DIRECTORY_DEPTH) {
+        set_error("Directories nested too deeply in the image (more than " +
+                  std::to_string(MAX_DIRECTORY_DEPTH) + " levels)");
+        return false;
+    }
+    return true;
+}
+
+std::optional<std::vector<iso_reader::directory_entry>> iso_reader::list_files() {
+    if (m_fd == -1 && !m_source) {
+        set_error("No image open");
+        return std::nullopt;
+    }
+    if (!m_udf) {
+        return list_iso9660_files();
+    }
+
+    std::optional<file> root = read_udf_file_entry(m_udf->root_icb);
+    if (!root) {
+        return std::nullopt;
+    }
+
+    // Breadth first, so every directory is listed before its contents. Directories already seen
+    // are skipped, so a file identifier pointing back up the tree does not loop.
+    std::vector<directory_entry> entries;
+    std::vector<pending_directory> pending = {{"", std::move(*root), 0}};
+    std::unordered_set<uint64_t> visited = {m_udf->root_icb};
+    for (size_t next = 0; next < pending.size(); next++) {
+        std::optional<std::vector<udf_child>> children = read_udf_directory(pending[next].data);
+        if (!children) {
+            return std::nullopt;
+        }
+        std::string prefix = pending[next].path;
+        size_t depth = pending[next].depth + 1;
+
+        for (const udf_child& child : *children) {
+            if (!is_safe_name(child.name) ||
+                (child.is_directory && !visited.insert(child.icb_block).second)) {
+                continue;
+            }
+            if (!check_listing_limits(entries.size(), depth)) {
+                return std::nullopt;
+            }
+            std::optional<file> data = read_udf_file_entry(child.icb_block);
+            if (!data) {
+                return std::nullopt;
+            }
+
+            directory_entry entry;
+            entry.path = prefix.empty() ? child.name : prefix + "/" + child.name;
+            entry.is_directory = child.is_directory;
+            if (child.is_directory) {
+                pending.push_back({entry.path, std::move(*data), depth});
+            } else {
+                entry.data = std::move(*data);
+            }
+            entries.push_back(std::move(entry));
+        }
+    }
+    return entries;
+}
+
+std::optional<iso_reader::file> iso_reader::read_iso9660_root(bool prefer_joliet,
+                                                              bool& joliet) {
+    // Volume descriptors follow one another from sector 16 up to the set terminator
+    uint8_t sector[SECTOR_SIZE];
+    std::optional<file> root;
+    joliet = false;
+    for (uint32_t i = 0; i < ISO9660_MAX_DESCRIPTORS; i++) {
+        if (!read_at(static_cast<uint64_t>(ISO9660_PVD_SECTOR + i) * SECTOR_SIZE, sector,
+                     SECTOR_SIZE) ||
+            memcmp(sector + 1, "CD001", 5) != 0 || sector[0] == 255) {
+            break;
+        }
+
+        // A supplementary descriptor with a UCS-2 escape sequence is the Joliet tree
+        bool is_joliet = sector[0] == 2 && sector[88] == '%' && sector[89] == '/' &&
+                         (sector[90] == '@' || sector[90] == 'C' || sector[90] == 'E');
+        if ((sector[0] == 1 && !root) || (is_joliet && prefer_joliet)) {
+            // Root directory record, embedded in the volume descriptor
+            root = file();
+            root->size = le32(sector + 156 + 10);
+            root->extents.push_back(
+                {static_cast<uint64_t>(le32(sector + 156 + 2)) * SECTOR_SIZE, root->size});
+            joliet = is_joliet;
+            if (is_joliet) {
+                break;
+            }
+        }
+    }
+
+    if (!root) {
+        set_error("No ISO9660 primary volume descriptor");
+    }
+    return root;
+}
+
+std::optional<std::vector<iso_reader::iso9660_child>>
+iso_reader::read_iso9660_directory(const file& directory, bool joliet) {
+    if (directory.size > MAX_DIRECTORY_SIZE) {
+        set_error("ISO9660 directory too large");
+        return std::nullopt;
+    }
+    std::vector<uint8_t> data(static_cast<size_t>(directory.size));
+    if (!read_file(directory, 0, data.data(), data.size())) {
+        return std::nullopt;
+    }
+
+    std::vector<iso9660_child> children;
+    bool continues = false; // the previous record is not the final extent of its file
+    size_t p = 0;
+    while (p < data.size()) {
+        uint8_t record_length = data[p];
+        if (record_length == 0) {
+            // Records never span sectors; the rest of this one is padding
+            p = (p / SECTOR_SIZE + 1) * SECTOR_SIZE;
+            continue;
+        }
+        if (record_length < 34 || p + record_length > data.size()) {
+            break;
+        }
+
+        const uint8_t* record = data.data() + p;
+        p += record_length;
+        uint8_t name_length = record[32];
+        if (33u + name_length > record_length) {
+            break;
+        }
+        // The "." and ".." entries
+        if (name_length == 1 && (record[33] == 0 || record[33] == 1)) {
+            continue;
+        }
+
+        // Files over 4 GiB are split into several records with the same name, each flagged as
+        // "not the final extent" except the last
+        uint32_t length = le32(record + 10);
+        extent part{static_cast<uint64_t>(le32(record + 2)) * SECTOR_SIZE, length};
+        if (continues && !children.empty()) {
+            children.back().data.extents.push_back(part);
+            children.back().data.size += length;
+        } else {
+            iso9660_child child;
+            child.name = joliet ? decode_joliet_name(record + 33, name_length)
+                                : decode_iso9660_name(record + 33, name_length);
+            child.is_directory = (record[25] & 0x02) != 0;
+            child.data.size = length;
+            child.data.extents.push_back(part);
+            children.push_back(std::move(child));
+        }
+        continues = (record[25] & 0x80) != 0;
+    }
+    return children;
+}
+
+std::optional<iso_reader::file>
+iso_reader::find_iso9660_file(const std::vector<std::string>& components) {
+    bool joliet = false;
+    std::optional<file> current = read_iso9660_root(false, joliet);
+
+    for (size_t c = 0; c < components.size() && current; c++) {
+        std::optional<std::vector<iso9660_child>> children =
+            read_iso9660_directory(*current, joliet);
+        if (!children) {
+            return std::nullopt;
+        }
+
+        auto child =
+            std::find_if(children->begin(), children->end(), [&](const iso9660_child& entry) {
+                return equals_ignore_case(entry.name, components[c]);
+            });
+        if (child == children->end()) {
+            set_error("Not found: " + components[c]);
+            return std::nullopt;
+        }
+        current = std::move(child->data);
+    }
+    return current;
+}
+
+std::optional<std::vector<iso_reader::directory_entry>> iso_reader::list_iso9660_files() {
+    bool joliet = false;
+    std::optional<file> root = read_iso9660_root(true, joliet);
+    if (!root) {
+        return std::nullopt;
+    }
+
+    // Directories are identified by the offset of their first extent
+    std::vector<directory_entry> entries;
+    std::unordered_set<uint64_t> visited = {root->extents.front().offset};
+    std::vector<pending_directory> pending = {{"", std::move(*root), 0}};
+    for (size_t next = 0; next < pending.size(); next++) {
+        std::optional<std::vector<iso9660_child>> children =
+            read_iso9660_directory(pending[next].data, joliet);
+        if (!children) {
+            return std::nullopt;
+        }
+        std::string prefix = pending[next].path;
+        size_t depth = pending[next].depth + 1;
+
+        for (iso9660_child& child : *children) {
+            if (!is_safe_name(child.name) ||
+                (child.is_directory &&
+                 !visited.insert(child.data.extents.front().offset).second)) {
+                continue;
+            }
+            if (!check_listing_limits(entries.size(), depth)) {
+                return std::nullopt;
+            }
+            directory_entry entry;
+            entry.path = prefix.empty() ? child.name : prefix + "/" + child.name;
+            entry.is_directory = child.is_directory;
+            if (child.is_directory) {
+                pending.push_back({entry.path, std::move(child.data), depth});
+            } else {
+                entry.data = std::move(child.data);
+            }
+            entries.push_back(std::move(entry));
+        }
+    }
+    return entries;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Minimal read-only view of an ISO image, enough to locate a file and read it by offset
+// without loop-mounting the image (and so without root). Windows media keep install.wim on the
+// UDF side of a UDF/ISO9660 bridge, because it is usually larger than ISO9660 allows, so UDF is
+// tried first and plain ISO9660 is the fallback.
+class iso_reader {
+public:
+    // A contiguous run of file data inside the image
+    struct extent {
+        uint64_t offset; // bytes from the start of the image
+        uint64_t length;
+    };
+
+    struct file {
+        uint64_t size = 0;
+        std::vector<extent> extents;
+    };
+
+    struct directory_entry {
+        std::string path; // '/'-separated, relative to the root
+        bool is_directory = false;
+        file data; // files only
+    };
+
+    // Reads length bytes at offset of the image; used for images that are not local files
+    using read_function = std::function<bool(uint64_t offset, void* buffer, size_t length)>;
+
+    iso_reader() = default;
+    ~iso_reader();
+
+    iso_reader(const iso_reader&) = delete;
+    iso_reader& operator=(const iso_reader&) = delete;
+
+    iso_reader(iso_reader&&) = delete;
+    iso_reader& operator=(iso_reader&&) = delete;
+
+    bool open(const std::string& path);
+    // Open an image served by read (e.g. over HTTP); name is only used for logging
+    bool open(uint64_t image_size, read_function read, const std::string& name);
+    void close();
+
+    // Look up a file by '/'-separated path, ignoring case (e.g. "sources/install.wim")
+    std::optional<file> find_file(const std::string& path);
+
+    // Every directory and file of the image, each directory before its contents. Names come from
+    // UDF if present, else from Joliet, else from the primary ISO9660 tree. Directories reached
+    // twice are listed once; fails on images with too many entries or too deep a tree.
+    std::optional<std::vector<directory_entry>> list_files();
+
+    // Read from a file found with find_file, starting offset bytes into it
+    bool read_file(const file& entry, uint64_t offset, void* buffer, size_t length);
+
+    const std::string& get_last_error() const {
+        return m_last_error;
+    }
+
+private:
+    static constexpr uint32_t SECTOR_SIZE = 2048;
+
+    struct udf_volume {
+        uint32_t block_size = SECTOR_SIZE;
+        uint32_t partition_start = 0; // sector of partition block 0
+        uint64_t root_icb = 0;        // block of the root directory's file entry
+    };
+
+    struct udf_child {
+        std::string name;
+        uint32_t icb_block = 0;
+        bool is_directory = false;
+    };
+
+    struct iso9660_child {
+        std::string name;
+        bool is_directory = false;
+        file data;
+    };
+
+    // A directory waiting to be listed by list_files
+    struct pending_directory {
+        std::string path;
+        file data;
+        size_t depth = 0; // 0 for the root
+    };
+
+    int m_fd = -1;
+    read_function m_source; // instead of m_fd
+    uint64_t m_image_size = 0;
+    std::string m_last_error;
+    std::optional<udf_volume> m_udf;
+
+    bool read_at(uint64_t offset, void* buffer, size_t length);
+    void load_volume(const std::string& name);
+    void set_error(const std::string& error);
+
+    bool load_udf_volume();
+    std::optional<file> read_udf_file_entry(uint64_t block);
+    std::optional<std::vector<udf_child>> read_udf_directory(const file& directory);
+    std::optional<file> find_udf_file(const std::vector<std::string>& components);
+    std::optional<file> read_iso9660_root(bool prefer_joliet, bool& joliet);
+    std::optional<std::vector<iso9660_child>> read_iso9660_directory(const file& directory,
+                                                                     bool joliet);
+    std::optional<file> find_iso9660_file(const std::vector<std::string>& components);
+    std::optional<std::vector<directory_entry>> list_iso9660_files();
+    // Sets the error and returns false once the listing has grown past its limits
+    bool check_listing_limits(size_t entries, size_t depth);
+};
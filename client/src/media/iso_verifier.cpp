@@ -0,0 +1,368 @@
+#include "media/iso_verifier.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <glib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "media/iso_reader.hpp"
+#include "media/wim_metadata.hpp"
+#include "util/defer.hpp"
+
+namespace iso_verifier {
+
+namespace {
+constexpr size_t READ_SIZE = 4 * 1024 * 1024;
+constexpr size_t SHA256_SIZE = 32;
+constexpr size_t SHA1_SIZE = 20;
+constexpr auto PROGRESS_INTERVAL = std::chrono::milliseconds(250);
+
+bool read_fully(int fd, uint64_t offset, void* buffer, size_t length) {
+    auto* cursor = static_cast<uint8_t*>(buffer);
+    while (length > 0) {
+        ssize_t result = pread(fd, cursor, length, static_cast<off_t>(offset));
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            if (result == 0) {
+                errno = EIO; // the file shrank under us
+            }
+            return false;
+        }
+        cursor += result;
+        offset += static_cast<uint64_t>(result);
+        length -= static_cast<size_t>(result);
+    }
+    return true;
+}
+
+// Run task(0) .. task(count - 1) on up to thread_count threads, calling report from this thread
+// every PROGRESS_INTERVAL until they are done. Stops handing out tasks once one fails or the
+// token is cancelled, and returns false in that case.
+bool run_parallel(size_t count, size_t thread_count, const cancellation_token& token,
+                  const std::function<bool(size_t index)>& task,
+                  const std::function<void()>& report) {
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::mutex mutex;
+    std::condition_variable condition;
+    size_t finished = 0;
+
+    auto run = [&]() {
+        for (size_t i = next++; i < count && !failed && !token.is_cancelled(); i = next++) {
+            if (!task(i)) {
+                failed = true;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished++;
+        }
+        condition.notify_all();
+    };
+
+    thread_count = std::min(std::max<size_t>(thread_count, 1), std::max<size_t>(count, 1));
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < thread_count; i++) {
+        threads.emplace_back(run);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!condition.wait_for(lock, PROGRESS_INTERVAL,
+                                   [&]() { return finished == thread_count; })) {
+            lock.unlock();
+            report();
+            lock.lock();
+        }
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    report();
+
+    return !failed && !token.is_cancelled();
+}
+} // namespace
+
+nlohmann::json result::to_json() const {
+    nlohmann::json json = {{"valid", is_valid()},
+                           {"size", size},
+                           {"sha256", sha256},
+                           {"segment_size", segment_size},
+                           {"sha256_matches", sha256_matches()},
+                           {"wim_integrity", wim_integrity},
+                           {"seconds", seconds}};
+    if (!expected_sha256.empty()) {
+        json["expected_sha256"] = expected_sha256;
+    }
+    if (!detail.empty()) {
+        json["detail"] = detail;
+    }
+    return json;
+}
+
+std::optional<result> verify(const std::string& path, size_t threads,
+                             const std::string& expected_sha256, const cancellation_token& token,
+                             const progress_callback& on_progress, std::string& error) {
+    auto start = std::chrono::steady_clock::now();
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    result verified;
+    if (!expected_sha256.empty()) {
+        if (expected_sha256.size() != SHA256_SIZE * 2 ||
+            !std::all_of(expected_sha256.begin(), expected_sha256.end(), ::isxdigit)) {
+            error = "Expected SHA-256 is not 64 hex digits: " + expected_sha256;
+            return std::nullopt;
+        }
+        verified.expected_sha256 = expected_sha256;
+        std::transform(verified.expected_sha256.begin(), verified.expected_sha256.end(),
+                       verified.expected_sha256.begin(), ::tolower);
+    }
+
+    // Plain reads rather than a mapping: a file that shrinks or fails to read (a flaky network
+    // share) then reports EIO instead of raising SIGBUS in the worker
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        error = "Failed to open " + path + ": " + strerror(errno);
+        return std::nullopt;
+    }
+    DEFER({ close(fd); });
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        error = "Failed to stat " + path + ": " + strerror(errno);
+        return std::nullopt;
+    }
+
+    verified.size = static_cast<uint64_t>(st.st_size);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    std::mutex error_mutex;
+    std::string read_error;
+    auto set_read_error = [&](const std::string& message) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (read_error.empty()) {
+            read_error = message;
+        }
+    };
+
+    // Stage 1: SHA-256 of each segment, then of the segment digests. A plain SHA-256, needed to
+    // compare with a published checksum, is the whole file as one segment.
+    bool plain = !verified.expected_sha256.empty();
+    uint64_t segment_size = plain ? std::max<uint64_t>(verified.size, 1) : SEGMENT_SIZE;
+    verified.segment_size = plain ? 0 : SEGMENT_SIZE;
+    // An empty file still has a plain digest
+    size_t segment_count =
+        plain ? 1 : static_cast<size_t>((verified.size + segment_size - 1) / segment_size);
+    std::vector<std::array<uint8_t, SHA256_SIZE>> segment_digests(segment_count);
+    std::atomic<uint64_t> hashed{0};
+
+    auto hash_segment = [&](size_t index) {
+        std::vector<uint8_t> buffer(READ_SIZE);
+        uint64_t offset = index * segment_size;
+        uint64_t end = std::min(offset + segment_size, verified.size);
+
+        GChecksum* checksum = g_checksum_new(G_CHECKSUM_SHA256);
+        DEFER({ g_checksum_free(checksum); });
+        while (offset < end) {
+            if (token.is_cancelled()) {
+                return false;
+            }
+            size_t length = static_cast<size_t>(std::min<uint64_t>(READ_SIZE, end - offset));
+            if (!read_fully(fd, offset, buffer.data(), length)) {
+                set_read_error("Failed to read " + path + ": " + strerror(errno));
+                return false;
+            }
+            g_checksum_update(checksum, buffer.data(), static_cast<gssize>(length));
+            offset += length;
+            hashed += length;
+        }
+
+        gsize digest_size = SHA256_SIZE;
+        g_checksum_get_digest(checksum, segment_digests[index].data(), &digest_size);
+        return true;
+    };
+
+    bool hashed_all = run_parallel(segment_count, threads, token, hash_segment, [&]() {
+        if (on_progress) {
+            on_progress("hashing", hashed, verified.size);
+        }
+    });
+    if (!hashed_all) {
+        error = token.is_cancelled() ? token.get_reason() : read_error;
+        return std::nullopt;
+    }
+
+    if (plain) {
+        static const char* HEX = "0123456789abcdef";
+        for (uint8_t byte : segment_digests[0]) {
+            verified.sha256 += HEX[byte >> 4];
+            verified.sha256 += HEX[byte & 0xf];
+        }
+        if (!verified.sha256_matches()) {
+            verified.detail = "SHA-256 " + verified.sha256 + " does not match the expected " +
+                              verified.expected_sha256;
+        }
+    } else {
+        GChecksum* root = g_checksum_new(G_CHECKSUM_SHA256);
+        for (const auto& digest : segment_digests) {
+            g_checksum_update(root, digest.data(), SHA256_SIZE);
+        }
+        verified.sha256 = g_checksum_get_string(root);
+        g_checksum_free(root);
+    }
+
+    // Stage 2: the install.wim integrity table. This runs the same check as wimlib's
+    // WIMLIB_OPEN_FLAG_CHECK_INTEGRITY, but on the WIM inside the ISO and in parallel.
+    iso_reader::file wim_file;
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (extension == ".wim" || extension == ".esd" || extension == ".swm") {
+        wim_file.size = verified.size;
+        wim_file.extents.push_back({0, verified.size});
+    } else {
+        iso_reader iso;
+        if (!iso.open(path)) {
+            error = "Failed to read ISO structure: " + iso.get_last_error();
+            return std::nullopt;
+        }
+        std::optional<iso_reader::file> found;
+        for (const char* candidate :
+             {"sources/install.wim", "sources/install.esd", "sources/install.swm"}) {
+            found = iso.find_file(candidate);
+            if (found) {
+                break;
+            }
+        }
+        if (!found) {
+            verified.wim_integrity = "no_wim";
+            verified.seconds =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return verified;
+        }
+        wim_file = std::move(*found);
+    }
+
+    // Reads through the file's extents with pread, so the threads can share it. A failed read
+    // is an I/O error, kept apart from a WIM that reads fine but does not check out.
+    auto read_wim = [fd, &wim_file, &set_read_error](uint64_t offset, void* buffer,
+                                                     size_t length) {
+        auto* cursor = static_cast<uint8_t*>(buffer);
+        uint64_t extent_start = 0;
+        for (const auto& part : wim_file.extents) {
+            uint64_t extent_end = extent_start + part.length;
+            if (length > 0 && offset < extent_end) {
+                uint64_t within = offset - extent_start;
+                size_t chunk =
+                    static_cast<size_t>(std::min<uint64_t>(length, part.length - within));
+                if (!read_fully(fd, part.offset + within, cursor, chunk)) {
+                    set_read_error("Failed to read WIM data: " + std::string(strerror(errno)));
+                    return false;
+                }
+                cursor += chunk;
+                offset += chunk;
+                length -= chunk;
+            }
+            extent_start = extent_end;
+        }
+        return length == 0;
+    };
+
+    std::string table_error;
+    std::optional<wim_metadata::integrity_table> table =
+        wim_metadata::read_integrity_table(read_wim, wim_file.size, table_error);
+    if (!table && !read_error.empty()) {
+        error = read_error;
+        return std::nullopt;
+    }
+    if (!table) {
+        // Setup would fail on this WIM just the same
+        verified.wim_integrity = "corrupt";
+        if (verified.detail.empty()) {
+            verified.detail = table_error;
+        }
+        verified.seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return verified;
+    }
+
+    if (table->chunk_digests.empty()) {
+        verified.wim_integrity = "absent";
+    } else {
+        std::atomic<uint64_t> checked{0};
+        std::mutex corrupt_mutex;
+        std::optional<uint32_t> corrupt_chunk;
+
+        auto check_chunk = [&](size_t index) {
+            uint64_t offset = table->start + uint64_t(index) * table->chunk_size;
+            size_t length =
+                static_cast<size_t>(std::min<uint64_t>(table->chunk_size, table->end - offset));
+            std::vector<uint8_t> buffer(length);
+            if (!read_wim(offset, buffer.data(), length)) {
+                return false;
+            }
+
+            std::array<uint8_t, SHA1_SIZE> digest;
+            gsize digest_size = SHA1_SIZE;
+            GChecksum* checksum = g_checksum_new(G_CHECKSUM_SHA1);
+            g_checksum_update(checksum, buffer.data(), static_cast<gssize>(length));
+            g_checksum_get_digest(checksum, digest.data(), &digest_size);
+            g_checksum_free(checksum);
+            checked += length;
+
+            if (digest != table->chunk_digests[index]) {
+                std::lock_guard<std::mutex> lock(corrupt_mutex);
+                if (!corrupt_chunk || index < *corrupt_chunk) {
+                    corrupt_chunk = static_cast<uint32_t>(index);
+                }
+                return false;
+            }
+            return true;
+        };
+
+        uint64_t covered = table->end - table->start;
+        run_parallel(table->chunk_digests.size(), threads, token, check_chunk, [&]() {
+            if (on_progress) {
+                on_progress("checking WIM integrity", checked, covered);
+            }
+        });
+
+        if (token.is_cancelled()) {
+            error = token.get_reason();
+            return std::nullopt;
+        }
+        if (corrupt_chunk) {
+            verified.wim_integrity = "corrupt";
+            if (verified.detail.empty()) {
+                verified.detail = "WIM integrity chunk " + std::to_string(*corrupt_chunk) +
+                                  " does not match its checksum";
+            }
+        } else if (!read_error.empty()) {
+            error = read_error;
+            return std::nullopt;
+        } else {
+            verified.wim_integrity = "valid";
+        }
+    }
+
+    verified.seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return verified;
+}
+
+} // namespace iso_verifier
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <nlohmann/json.hpp>
+#include "util/cancellation.hpp"
+
+// Full integrity check of installation media: a SHA-256 over every byte of the file, computed on
+// all cores, plus the check of the install.wim integrity table, so a corrupt ISO is caught
+// before Setup trips over it.
+namespace iso_verifier {
+
+// The file is hashed as independent segments so each thread can take one. The reported digest
+// is the SHA-256 of the concatenated segment digests: it identifies the content as well as a
+// plain SHA-256, but does not equal the output of sha256sum. When an expected digest is given
+// the file is hashed as one plain SHA-256 instead, on one thread, so it can be compared with a
+// published checksum.
+constexpr uint64_t SEGMENT_SIZE = 64 * 1024 * 1024;
+
+struct result {
+    uint64_t size = 0;
+    std::string sha256; // hex
+    uint64_t segment_size = SEGMENT_SIZE; // 0 when sha256 is a plain SHA-256 of the file
+    std::string expected_sha256;           // hex, lower case; empty if none was given
+    // "valid", "corrupt", "absent" (the WIM carries no integrity table) or "no_wim"
+    std::string wim_integrity;
+    std::string detail; // why the media is considered corrupt
+    double seconds = 0.0;
+
+    bool sha256_matches() const {
+        return expected_sha256.empty() || sha256 == expected_sha256;
+    }
+    bool is_valid() const {
+        return sha256_matches() && wim_integrity != "corrupt";
+    }
+    nlohmann::json to_json() const;
+};
+
+// stage is "hashing" or "checking WIM integrity"; done and total are bytes of that stage.
+// Called on the thread that runs verify.
+using progress_callback =
+    std::function<void(const std::string& stage, uint64_t done, uint64_t total)>;
+
+// Verify an ISO (or a standalone .wim/.esd) with the given number of threads (0 for one per
+// core), against expected_sha256 (hex, any case) unless it is empty. Returns nullopt with error
+// if the file cannot be read, expected_sha256 is malformed or the token is cancelled.
+std::optional<result> verify(const std::string& path, size_t threads,
+                             const std::string& expected_sha256, const cancellation_token& token,
+                             const progress_callback& on_progress, std::string& error);
+
+} // namespace iso_verifier
@@ -0,0 +1,195 @@
+#include "media/metadata_cache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "util/defer.hpp"
+#include "util/xxhash.hpp"
+
+namespace {
+constexpr size_t EDGE_SAMPLE_SIZE = 64 * 1024;
+constexpr size_t INNER_SAMPLE_SIZE = 4096;
+constexpr size_t INNER_SAMPLE_COUNT = 16;
+constexpr int INDEX_VERSION = 1;
+
+bool read_sample(int fd, uint64_t offset, size_t length, std::vector<uint8_t>& buffer) {
+    size_t start = buffer.size();
+    buffer.resize(start + length);
+    size_t done = 0;
+    while (done < length) {
+        ssize_t result = pread(fd, buffer.data() + start + done, length - done,
+                               static_cast<off_t>(offset + done));
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        done += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+int64_t now_seconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+} // namespace
+
+std::string metadata_cache::fingerprint::to_string() const {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%llx-%llx-%016llx", static_cast<unsigned long long>(size),
+             static_cast<unsigned long long>(mtime_ns),
+             static_cast<unsigned long long>(sample_hash));
+    return buffer;
+}
+
+metadata_cache::metadata_cache(std::string path) : m_path(std::move(path)) {}
+
+std::optional<metadata_cache::fingerprint>
+metadata_cache::compute_fingerprint(const std::string& file_path, std::string& error) {
+    int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        error = "Failed to open " + file_path + ": " + strerror(errno);
+        return std::nullopt;
+    }
+    DEFER({ close(fd); });
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        error = "Failed to stat " + file_path + ": " + strerror(errno);
+        return std::nullopt;
+    }
+
+    fingerprint result;
+    result.size = static_cast<uint64_t>(st.st_size);
+    result.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+
+    std::vector<uint8_t> samples;
+    if (result.size <= 2 * EDGE_SAMPLE_SIZE + INNER_SAMPLE_COUNT * INNER_SAMPLE_SIZE) {
+        // Small enough to hash whole
+        if (!read_sample(fd, 0, static_cast<size_t>(result.size), samples)) {
+            error = "Failed to read " + file_path;
+            return std::nullopt;
+        }
+    } else {
+        bool ok = read_sample(fd, 0, EDGE_SAMPLE_SIZE, samples);
+        uint64_t inner_span = result.size - 2 * EDGE_SAMPLE_SIZE - INNER_SAMPLE_SIZE;
+        for (size_t i = 0; ok && i < INNER_SAMPLE_COUNT; i++) {
+            uint64_t offset = EDGE_SAMPLE_SIZE + inner_span * i / (INNER_SAMPLE_COUNT - 1);
+            ok = read_sample(fd, offset, INNER_SAMPLE_SIZE, samples);
+        }
+        ok = ok && read_sample(fd, result.size - EDGE_SAMPLE_SIZE, EDGE_SAMPLE_SIZE, samples);
+        if (!ok) {
+            error = "Failed to read " + file_path;
+            return std::nullopt;
+        }
+    }
+
+    result.sample_hash = xxhash::hash64(samples.data(), samples.size(), result.size);
+    return result;
+}
+
+std::optional<nlohmann::json> metadata_cache::lookup(const fingerprint& key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    load();
+
+    auto it = m_entries.find(key.to_string());
+    if (it == m_entries.end() || !it->contains("value")) {
+        return std::nullopt;
+    }
+
+    // Only kept in memory; it is written out with the next store
+    (*it)["last_used"] = now_seconds();
+    return (*it)["value"];
+}
+
+void metadata_cache::store(const fingerprint& key, const std::string& file_path,
+                           const nlohmann::json& value) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    load();
+
+    // Whatever was cached for an earlier version of this file can never hit again
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->value("path", "") == file_path) {
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    m_entries[key.to_string()] = {
+        {"path", file_path}, {"last_used", now_seconds()}, {"value", value}};
+
+    if (m_entries.size() > MAX_ENTRIES) {
+        std::vector<std::pair<int64_t, std::string>> by_age;
+        for (auto& [fingerprint_key, entry] : m_entries.items()) {
+            by_age.emplace_back(entry.value("last_used", int64_t(0)), fingerprint_key);
+        }
+        std::sort(by_age.begin(), by_age.end());
+        for (size_t i = 0; i < by_age.size() - MAX_ENTRIES; i++) {
+            m_entries.erase(by_age[i].second);
+        }
+    }
+
+    save();
+}
+
+void metadata_cache::load() {
+    if (m_loaded) {
+        return;
+    }
+    m_loaded = true;
+
+    std::ifstream input(m_path);
+    if (!input) {
+        return;
+    }
+
+    nlohmann::json index = nlohmann::json::parse(input, nullptr, false);
+    if (index.is_discarded() || index.value("version", 0) != INDEX_VERSION ||
+        !index.contains("entries") || !index["entries"].is_object()) {
+        std::cerr << "[Media Cache] Ignoring unreadable index " << m_path << std::endl;
+        return;
+    }
+    m_entries = std::move(index["entries"]);
+    std::cout << "[Media Cache] Loaded " << m_entries.size() << " entries" << std::endl;
+}
+
+void metadata_cache::save() {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(m_path).parent_path(), ec);
+
+    // Write to a temporary file and rename it over the index, so readers never see a torn file
+    std::string temp_path = m_path + ".tmp";
+    {
+        std::ofstream output(temp_path, std::ios::trunc);
+        if (!output) {
+            std::cerr << "[Media Cache] Failed to write " << temp_path << std::endl;
+            return;
+        }
+        nlohmann::json index = {{"version", INDEX_VERSION}, {"entries", m_entries}};
+        output << index.dump();
+        if (!output) {
+            std::cerr << "[Media Cache] Failed to write " << temp_path << std::endl;
+            return;
+        }
+    }
+
+    if (rename(temp_path.c_str(), m_path.c_str()) == -1) {
+        std::cerr << "[Media Cache] Failed to replace " << m_path << ": " << strerror(errno)
+                  << std::endl;
+        unlink(temp_path.c_str());
+    }
+}
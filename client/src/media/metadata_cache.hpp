@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <nlohmann/json.hpp>
+
+// On-disk index of media scan results (WIM image lists), so selecting an ISO that was seen
+// before does not read it again. Entries are keyed by a content fingerprint rather than the
+// path: a renamed or copied file still hits, and any change to the file misses.
+class metadata_cache {
+public:
+    static constexpr const char* DEFAULT_PATH = "/var/cache/lsw/media-index.json";
+
+    // Cheap identity of a file: size, mtime and an XXH64 of sampled blocks (the first and last
+    // 64 KiB, which hold the volume descriptors and usually the WIM XML, plus evenly spaced 4 KiB
+    // blocks in between). Costs one stat and a few small reads regardless of file size.
+    struct fingerprint {
+        uint64_t size = 0;
+        int64_t mtime_ns = 0;
+        uint64_t sample_hash = 0;
+
+        std::string to_string() const;
+    };
+
+    explicit metadata_cache(std::string path = DEFAULT_PATH);
+
+    metadata_cache(const metadata_cache&) = delete;
+    metadata_cache& operator=(const metadata_cache&) = delete;
+
+    static std::optional<fingerprint> compute_fingerprint(const std::string& file_path,
+                                                          std::string& error);
+
+    std::optional<nlohmann::json> lookup(const fingerprint& key);
+    // Stores the entry and writes the index back to disk
+    void store(const fingerprint& key, const std::string& file_path, const nlohmann::json& value);
+
+private:
+    // Oldest entries (by last use) are dropped beyond this
+    static constexpr size_t MAX_ENTRIES = 512;
+
+    std::string m_path;
+    std::mutex m_mutex;
+    bool m_loaded = false;
+    nlohmann::json m_entries = nlohmann::json::object();
+
+    void load();
+    void save();
+};
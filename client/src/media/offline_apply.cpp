@@ -0,0 +1,382 @@
+#include "media/offline_apply.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <wimlib.h>
+#include "media/iso_extract.hpp"
+#include "media/iso_reader.hpp"
+#include "media/wim_metadata.hpp"
+#include "media/wimlib_progress.hpp"
+#include "templates/offline_apply_template.hpp"
+#include "util/defer.hpp"
+#include "util/process.hpp"
+
+namespace fs = std::filesystem;
+
+namespace offline_apply {
+
+namespace {
+using clock = std::chrono::steady_clock;
+
+// Partition 1 starts at 1 MiB, as Windows lays it out
+constexpr uint64_t PARTITION_START_SECTOR = 2048;
+constexpr int NBD_DEVICE_COUNT = 16;
+constexpr auto DEVICE_POLL_INTERVAL = std::chrono::milliseconds(100);
+constexpr auto DEVICE_TIMEOUT = std::chrono::seconds(10);
+
+// Added to the image before it is applied: the unattend, and the tag the boot script finds the
+// applied system by
+constexpr const char* PANTHER_DIRECTORY = "/Windows/Panther";
+constexpr const char* APPLY_TAG = "lsw-apply.tag";
+
+// MBR boot code for the applied disk until Windows PE replaces it with its own (bootsect /mbr).
+// It chains to the active partition's boot sector and, while no partition is active, calls
+// INT 18h so the firmware boots the next device: the VM starts disk first and falls through to
+// the installer once, without its "Press any key" prompt, which only appears for a disk with an
+// active partition. Assembled from (loaded at 0x7c00, linked at 0x600):
+//     cli; xor ax,ax; mov ss,ax; mov sp,0x7c00; mov ds,ax; mov es,ax; sti; cld
+//     mov si,0x7c00; mov di,0x600; mov cx,256; rep movsw; jmp 0:relocated
+//   relocated:  mov si,0x7be; mov cx,4
+//   find:       cmp byte [si],0x80; je found; add si,16; loop find
+//   next:       int 0x18
+//   halt:       hlt; jmp halt
+//   found:      mov eax,[si+8]; mov [packet+8],eax; push si; mov si,packet; mov ah,0x42
+//               int 0x13; pop si; jc next; cmp word [0x7dfe],0xaa55; jne next; jmp 0:0x7c00
+//   packet:     db 16,0; dw 1; dw 0x7c00,0; dq 0
+constexpr uint8_t MBR_BOOT_CODE[] = {
+    0xfa, 0x31, 0xc0, 0x8e, 0xd0, 0xbc, 0x00, 0x7c, 0x8e, 0xd8, 0x8e, 0xc0, 0xfb, 0xfc, 0xbe,
+    0x00, 0x7c, 0xbf, 0x00, 0x06, 0xb9, 0x00, 0x01, 0xf3, 0xa5, 0xea, 0x1e, 0x06, 0x00, 0x00,
+    0xbe, 0xbe, 0x07, 0xb9, 0x04, 0x00, 0x80, 0x3c, 0x80, 0x74, 0x0a, 0x83, 0xc6, 0x10, 0xe2,
+    0xf6, 0xcd, 0x18, 0xf4, 0xeb, 0xfd, 0x66, 0x8b, 0x44, 0x08, 0x66, 0xa3, 0x5b, 0x06, 0x56,
+    0xbe, 0x53, 0x06, 0xb4, 0x42, 0xcd, 0x13, 0x5e, 0x72, 0xe8, 0x81, 0x3e, 0xfe, 0x7d, 0x55,
+    0xaa, 0x75, 0xe0, 0xea, 0x00, 0x7c, 0x00, 0x00, 0x10, 0x00, 0x01, 0x00, 0x00, 0x7c, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+// The boot code area ends where the disk signature and partition table begin
+constexpr size_t MBR_BOOT_CODE_AREA = 440;
+static_assert(sizeof(MBR_BOOT_CODE) <= MBR_BOOT_CODE_AREA, "MBR boot code too large");
+
+double seconds_since(clock::time_point start) {
+    return std::chrono::duration<double>(clock::now() - start).count();
+}
+
+bool write_text_file(const std::string& path, const std::string& content, std::string& error) {
+    std::ofstream file(path, std::ios::binary);
+    file << content;
+    file.close();
+    if (!file) {
+        error = "Failed to write " + path;
+        return false;
+    }
+    return true;
+}
+
+// cmd.exe expects CRLF line endings in batch files
+std::string to_crlf(const std::string& text) {
+    std::string converted;
+    converted.reserve(text.size() + text.size() / 32);
+    for (char c : text) {
+        if (c == '\n') {
+            converted += '\r';
+        }
+        converted += c;
+    }
+    return converted;
+}
+
+// The install image on Windows media, install.wim or (on download media) install.esd
+std::optional<iso_reader::file> find_install_image(iso_reader& iso, std::string& error) {
+    std::optional<iso_reader::file> install_image = iso.find_file("sources/install.wim");
+    if (!install_image) {
+        install_image = iso.find_file("sources/install.esd");
+    }
+    if (!install_image) {
+        error = "No install image on the ISO";
+    }
+    return install_image;
+}
+
+// Write MBR_BOOT_CODE into the boot code area of device, leaving its partition table alone
+bool write_mbr_boot_code(const std::string& device, std::string& error) {
+    int fd = open(device.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        error = "Failed to open " + device + ": " + strerror(errno);
+        return false;
+    }
+    DEFER({ close(fd); });
+
+    uint8_t code[MBR_BOOT_CODE_AREA] = {};
+    memcpy(code, MBR_BOOT_CODE, sizeof(MBR_BOOT_CODE));
+    if (pwrite(fd, code, sizeof(code), 0) != static_cast<ssize_t>(sizeof(code)) ||
+        fsync(fd) == -1) {
+        error = "Failed to write boot code to " + device + ": " + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+// Run a command, leaving error empty when it was cancelled
+bool run(const std::string& command, const cancellation_token& token, std::string& error) {
+    int exit_code = process::run(command, token);
+    if (exit_code == process::CANCELLED_EXIT_CODE) {
+        return false;
+    }
+    if (exit_code != 0) {
+        error = "Command failed (exit code " + std::to_string(exit_code) + "): " + command;
+        return false;
+    }
+    return true;
+}
+
+bool wait_for_device(const std::string& device, const cancellation_token& token,
+                     std::string& error) {
+    clock::time_point deadline = clock::now() + DEVICE_TIMEOUT;
+    std::error_code ec;
+    while (!fs::exists(device, ec)) {
+        if (clock::now() >= deadline) {
+            error = device + " did not appear";
+            return false;
+        }
+        if (token.wait_for(DEVICE_POLL_INTERVAL)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Attach the disk image as a block device. Returns the device, or an empty string.
+std::string connect_nbd(const std::string& disk_path, const std::string& format,
+                        const cancellation_token& token, std::string& error) {
+    // Fails harmlessly when nbd is built in or already loaded
+    process::run("modprobe nbd max_part=16 2>/dev/null", token);
+
+    std::error_code ec;
+    for (int i = 0; i < NBD_DEVICE_COUNT; i++) {
+        std::string name = "nbd" + std::to_string(i);
+        // Devices in use have a pid attribute
+        std::string sysfs = "/sys/block/" + name;
+        if (!fs::exists(sysfs, ec) || fs::exists(sysfs + "/pid", ec)) {
+            continue;
+        }
+        std::string device = "/dev/" + name;
+        int exit_code = process::run("qemu-nbd --connect=" + device + " --format=" + format +
+                                         " --discard=unmap " + process::quote(disk_path),
+                                     token);
+        if (exit_code == process::CANCELLED_EXIT_CODE) {
+            return "";
+        }
+        if (exit_code == 0) {
+            return device;
+        }
+        // Taken by someone else since the check; try the next one
+    }
+    error = "No free nbd device (is the nbd module available?)";
+    return "";
+}
+
+// Apply image_index of wim_path, plus the files of panther_directory, to the NTFS volume
+bool apply_image(const std::string& wim_path, uint32_t image_index,
+                 const std::string& panther_directory, const std::string& volume,
+                 const cancellation_token& token, const progress_callback& on_progress,
+                 uint64_t& applied_bytes, std::string& error) {
+    wimlib_progress::context context{&token, &on_progress};
+
+    WIMStruct* wim = nullptr;
+    int result = wimlib_open_wim_with_progress(wim_path.c_str(), 0, &wim,
+                                               wimlib_progress::handle, &context);
+    if (result != WIMLIB_ERR_SUCCESS) {
+        error = std::string("Failed to open install image: ") + wimlib_get_error_string(result);
+        return false;
+    }
+    DEFER({ wimlib_free(wim); });
+
+    // Only changed in memory; extraction reads the added files from the host
+    std::string source_path = panther_directory;
+    std::string target_path = PANTHER_DIRECTORY;
+    wimlib_update_command command{};
+    command.op = WIMLIB_UPDATE_OP_ADD;
+    command.add.fs_source_path = &source_path[0];
+    command.add.wim_target_path = &target_path[0];
+    result = wimlib_update_image(wim, static_cast<int>(image_index), &command, 1, 0);
+    if (result != WIMLIB_ERR_SUCCESS) {
+        error = std::string("Failed to add the unattend: ") + wimlib_get_error_string(result);
+        return false;
+    }
+
+    result = wimlib_extract_image(wim, static_cast<int>(image_index), volume.c_str(),
+                                  WIMLIB_EXTRACT_FLAG_NTFS);
+    if (result != WIMLIB_ERR_SUCCESS) {
+        if (result != WIMLIB_ERR_ABORTED_BY_PROGRESS) {
+            error = "Failed to apply image " + std::to_string(image_index) + ": " +
+                    wimlib_get_error_string(result);
+        }
+        return false;
+    }
+    applied_bytes = context.total_bytes;
+    return true;
+}
+} // namespace
+
+options options::from_json(const nlohmann::json& json) {
+    options opts;
+    opts.drivers_iso = json.value("drivers_iso", opts.drivers_iso);
+    opts.drivers = json.value("drivers", opts.drivers);
+    return opts;
+}
+
+nlohmann::json result::to_json() const {
+    return {{"applied_bytes", applied_bytes},
+            {"extract_seconds", extract_seconds},
+            {"format_seconds", format_seconds},
+            {"apply_seconds", apply_seconds}};
+}
+
+std::optional<result> apply(const std::string& source_iso, uint32_t image_index,
+                            const std::string& disk_path, const std::string& disk_format,
+                            const std::string& unattend_xml, const options& opts,
+                            const cancellation_token& token, const progress_callback& on_progress,
+                            std::string& error) {
+    result applied;
+    clock::time_point start = clock::now();
+
+    iso_reader iso;
+    if (!iso.open(source_iso)) {
+        error = "Failed to open ISO: " + iso.get_last_error();
+        return std::nullopt;
+    }
+    std::optional<iso_reader::file> install_image = find_install_image(iso, error);
+    if (!install_image) {
+        return std::nullopt;
+    }
+
+    // wimlib reads from a path, so the install image is copied out next to the disk
+    std::string source_wim = disk_path + ".source.wim";
+    std::string panther_directory = disk_path + ".panther";
+    DEFER({
+        std::error_code ignored;
+        fs::remove(source_wim, ignored);
+        fs::remove_all(panther_directory, ignored);
+    });
+
+    int source_fd = open(source_iso.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source_fd == -1) {
+        error = "Failed to open " + source_iso + ": " + strerror(errno);
+        return std::nullopt;
+    }
+    DEFER({ close(source_fd); });
+
+    std::cout << "[Offline Apply] Extracting the install image from " << source_iso << std::endl;
+    if (on_progress) {
+        on_progress("extracting", 0, install_image->size);
+    }
+    uint64_t copied = 0;
+    if (!iso_extract::extract_file(source_fd, *install_image, source_wim, token, copied, error)) {
+        return std::nullopt;
+    }
+    if (on_progress) {
+        on_progress("extracting", copied, install_image->size);
+    }
+    applied.extract_seconds = seconds_since(start);
+
+    std::error_code ec;
+    fs::create_directories(panther_directory, ec);
+    if (ec) {
+        error = "Failed to create " + panther_directory + ": " + ec.message();
+        return std::nullopt;
+    }
+    if (!write_text_file(panther_directory + "/unattend.xml", unattend_xml, error) ||
+        !write_text_file(panther_directory + "/" + APPLY_TAG, "", error)) {
+        return std::nullopt;
+    }
+
+    start = clock::now();
+    std::string device = connect_nbd(disk_path, disk_format, token, error);
+    if (device.empty()) {
+        return std::nullopt;
+    }
+    // Detaching flushes the image, so it must happen even when the workload is cancelled
+    cancellation_token detach_token;
+    DEFER({ process::run("qemu-nbd --disconnect " + device + " >/dev/null", detach_token); });
+
+    // One NTFS partition for BIOS boot, as the VM template uses. It stays inactive until the
+    // boot script has made it bootable, so the first boot falls through to Windows PE.
+    std::string layout =
+        "label: dos\\nstart=" + std::to_string(PARTITION_START_SECTOR) + ", type=7\\n";
+    if (!run("printf '" + layout + "' | sfdisk --quiet " + device, token, error) ||
+        !write_mbr_boot_code(device, error)) {
+        return std::nullopt;
+    }
+    std::string partition = device + "p1";
+    if (!wait_for_device(partition, token, error)) {
+        return std::nullopt;
+    }
+    if (!run("mkntfs --quick --quiet --label Windows --partition-start " +
+                 std::to_string(PARTITION_START_SECTOR) + " " + partition,
+             token, error)) {
+        return std::nullopt;
+    }
+    applied.format_seconds = seconds_since(start);
+
+    start = clock::now();
+    std::cout << "[Offline Apply] Applying image " << image_index << " to " << partition
+              << std::endl;
+    if (!apply_image(source_wim, image_index, panther_directory, partition, token, on_progress,
+                     applied.applied_bytes, error)) {
+        return std::nullopt;
+    }
+    applied.apply_seconds = seconds_since(start);
+
+    std::cout << "[Offline Apply] Applied " << applied.applied_bytes / (1024 * 1024)
+              << " MiB in " << applied.apply_seconds << "s (extract " << applied.extract_seconds
+              << "s, format " << applied.format_seconds << "s)" << std::endl;
+    return applied;
+}
+
+bool write_boot_media(const std::string& media_directory, const std::string& source_iso,
+                      uint32_t image_index, const options& opts, const cancellation_token& token,
+                      std::string& error) {
+    // The drivers are chosen by the Windows version and architecture of the image
+    iso_reader iso;
+    if (!iso.open(source_iso)) {
+        error = "Failed to open ISO: " + iso.get_last_error();
+        return false;
+    }
+    std::optional<iso_reader::file> install_image = find_install_image(iso, error);
+    if (!install_image) {
+        return false;
+    }
+    std::optional<std::vector<wim_metadata::image>> images = wim_metadata::read_images(
+        [&](uint64_t offset, void* buffer, size_t length) {
+            return iso.read_file(*install_image, offset, buffer, length);
+        },
+        install_image->size, error);
+    if (!images) {
+        error = "Failed to read install image metadata: " + error;
+        return false;
+    }
+    auto image = std::find_if(images->begin(), images->end(), [&](const auto& candidate) {
+        return candidate.index == image_index;
+    });
+    if (image == images->end()) {
+        error = "No image " + std::to_string(image_index) + " in the install image";
+        return false;
+    }
+
+    if (!write_text_file(media_directory + "/autounattend.xml",
+                         offline_apply_templates::boot_unattend_xml, error) ||
+        !write_text_file(media_directory + "/" + BOOT_SCRIPT,
+                         to_crlf(offline_apply_templates::boot_script), error)) {
+        return false;
+    }
+    return slim_media::extract_drivers(opts.drivers_iso, *image, opts.drivers,
+                                       media_directory + "/drivers", token, error);
+}
+
+} // namespace offline_apply
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "media/slim_media.hpp"
+#include "util/cancellation.hpp"
+
+// Provisioning without Windows Setup. The host lays out the VM disk, formats it NTFS and applies
+// the install image with wimlib (through libntfs-3g), placing the unattend for specialize and
+// OOBE in \Windows\Panther. Only the boot configuration needs Windows tools, so the first boot
+// runs a short script in the install ISO's Windows PE (VirtIO drivers, bcdboot, bootsect) and
+// restarts straight into OOBE. Needs root plus qemu-nbd, sfdisk and mkntfs.
+// Experimental: not yet verified against real Windows media, and not yet timed against Setup.
+namespace offline_apply {
+
+// Placed on the autounattend ISO next to autounattend.xml
+constexpr const char* BOOT_SCRIPT = "lsw-apply.cmd";
+
+struct options {
+    // The storage driver is needed to reach the disk from Windows PE and to boot from it
+    std::string drivers_iso = slim_media::DEFAULT_VIRTIO_ISO;
+    std::vector<std::string> drivers = {"viostor", "vioscsi", "NetKVM"};
+
+    static options from_json(const nlohmann::json& json);
+};
+
+struct result {
+    uint64_t applied_bytes = 0;
+    double extract_seconds = 0.0; // install image out of the ISO
+    double format_seconds = 0.0;  // partitioning and mkntfs
+    double apply_seconds = 0.0;
+
+    nlohmann::json to_json() const;
+};
+
+// stage is "extracting" or "applying"; done and total are bytes of that stage. Called on the
+// thread that runs apply.
+using progress_callback =
+    std::function<void(const std::string& stage, uint64_t done, uint64_t total)>;
+
+// Lay out the empty disk image disk_path ("qcow2" or "raw") as one NTFS partition holding image
+// image_index of source_iso's install image, with unattend_xml as its Panther unattend. The
+// partition is left inactive behind MBR code that boots the next device, so a VM booting the
+// disk first reaches Windows PE once; the boot script activates it.
+std::optional<result> apply(const std::string& source_iso, uint32_t image_index,
+                            const std::string& disk_path, const std::string& disk_format,
+                            const std::string& unattend_xml, const options& opts,
+                            const cancellation_token& token, const progress_callback& on_progress,
+                            std::string& error);
+
+// Write the Windows PE unattend, boot script and the drivers for image image_index of
+// source_iso into media_directory, the tree of the autounattend ISO
+bool write_boot_media(const std::string& media_directory, const std::string& source_iso,
+                      uint32_t image_index, const options& opts, const cancellation_token& token,
+                      std::string& error);
+
+} // namespace offline_apply
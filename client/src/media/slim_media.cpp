@@ -0,0 +1,592 @@
+#include "media/slim_media.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <wimlib.h>
+#include "media/iso_builder.hpp"
+#include "media/iso_extract.hpp"
+#include "media/iso_reader.hpp"
+#include "media/metadata_cache.hpp"
+#include "media/wim_metadata.hpp"
+#include "media/wimlib_progress.hpp"
+#include "util/defer.hpp"
+#include "util/xxhash.hpp"
+
+namespace fs = std::filesystem;
+
+namespace slim_media {
+
+namespace {
+constexpr auto LOCK_POLL_INTERVAL = std::chrono::milliseconds(200);
+
+// Largest file ISO9660 stores in one extent (4 GiB less a sector). Larger install images would be
+// split across extents, which Setup has not been verified to read.
+constexpr uint64_t MAX_SINGLE_EXTENT_SIZE = 0xFFFFF800;
+
+// Injected driver folders inside boot.wim (X: in Windows PE) and the install image
+constexpr const char* BOOT_DRIVER_DIRECTORY = "/lsw-drivers";
+constexpr const char* INSTALL_DRIVER_DIRECTORY = "/Windows/lsw-drivers";
+
+// A file to take from the drivers ISO
+struct driver_file {
+    std::string driver; // as named in options::drivers
+    std::string name;
+    iso_reader::file data;
+};
+
+std::string to_lower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+    return text;
+}
+
+// Add the host directory source to target in the given image of wim
+bool add_directory(WIMStruct* wim, int image, const std::string& source,
+                   const std::string& target, std::string& error) {
+    // wimlib takes mutable strings but does not change them
+    std::string source_path = source;
+    std::string target_path = target;
+
+    wimlib_update_command command{};
+    command.op = WIMLIB_UPDATE_OP_ADD;
+    command.add.fs_source_path = &source_path[0];
+    command.add.wim_target_path = &target_path[0];
+    int result = wimlib_update_image(wim, image, &command, 1, 0);
+    if (result != WIMLIB_ERR_SUCCESS) {
+        error = "Failed to add drivers to image " + std::to_string(image) + ": " +
+                wimlib_get_error_string(result);
+        return false;
+    }
+    return true;
+}
+
+// Export one image of source_wim into a new WIM at target_wim, dropping remove_paths and adding
+// drivers_directory unless it is empty
+bool export_image(const std::string& source_wim, const std::string& target_wim,
+                  const options& opts, const std::string& drivers_directory,
+                  const cancellation_token& token, const progress_callback& on_progress,
+                  std::string& error) {
+    wimlib_progress::context context{&token, &on_progress};
+
+    WIMStruct* source = nullptr;
+    int result = wimlib_open_wim_with_progress(source_wim.c_str(), 0, &source,
+                                               wimlib_progress::handle, &context);
+    if (result != WIMLIB_ERR_SUCCESS) {
+        error = std::string("Failed to open install image: ") + wimlib_get_error_string(result);
+        return false;
+    }
+    DEFER({ wimlib_free(source); });
+
+    bool solid = opts.compression == "lzms";
+    WIMStruct* slim = nullptr;
+    result = wimlib_create_new_wim(
+        solid ? WIMLIB_COMPRESSION_TYPE_LZMS : WIMLIB_COMPRESSION_TYPE_XPRESS, &slim);
+    if (result != WIMLIB_ERR_SUCCESS) {
+        error = std::string("Failed to create WIM: ") + wimlib_get_error_string(result);
+        return false;
+    }
+    DEFER({ wimlib_free(slim); });
+    wimlib_register_progress_function(slim, wimlib_progress::handle, &context);
+
+    result = wimlib_export_image(source, static_cast<int>(opts.image_index), slim, nullptr,
+                                 nullptr, 0);
+    if (result != WIMLIB_ERR_SUCCESS) {
+        error = "Failed to export image " + std::to_string(opts.image_index) + ": " +
+                wimlib_get_error_string(result);
+        return false;
+    }
+
+    for (const std::string& path : opts.remove_paths) {
+        // Paths missing from this edition are not an error: one list serves every edition
+        result = wimlib_delete_path(slim, static_cast<int>(IMAGE_INDEX), path.c_str(),
+                                    WIMLIB_DELETE_FLAG_RECURSIVE | WIMLIB_DELETE_FLAG_FORCE);
+        if (result != WIMLIB_ERR_SUCCESS) {
+            error = "Failed to remove " + path + ": " + wimlib_get_error_string(result);
+            return false;
+        }
+    }
+
+    if (!drivers_directory.empty() &&
+        !add_directory(slim, static_cast<int>(IMAGE_INDEX), drivers_directory,
+                       INSTALL_DRIVER_DIRECTORY, error)) {
+        return false;
+    }
+
+    unsigned threads = opts.threads > 0 ? opts.threads : std::thread::hardware_concurrency();
+    result = wimlib_write(slim, target_wim.c_str(), WIMLIB_ALL_IMAGES,
+                          solid ? WIMLIB_WRITE_FLAG_SOLID : 0, threads);
+    if (result != WIMLIB_ERR_SUCCESS) {
+        if (result != WIMLIB_ERR_ABORTED_BY_PROGRESS) {
+            error = std::string("Failed to write WIM: ") + wimlib_get_error_string(result);
+        }
+        return false;
+    }
+    return true;
+}
+
+// virtio-win folders for the image's Windows version, best match first, older ones as fallback
+std::vector<std::string> driver_os_folders(const wim_metadata::image& image) {
+    struct release {
+        int build;
+        const char* folder;
+    };
+    static const release SERVER[] = {
+        {26100, "2k25"}, {20348, "2k22"}, {17763, "2k19"}, {14393, "2k16"}};
+    static const release CLIENT[] = {{22000, "w11"}, {10240, "w10"}};
+
+    int build = std::atoi(image.build.c_str());
+    bool server = image.edition_id.rfind("Server", 0) == 0;
+    const release* begin = server ? std::begin(SERVER) : std::begin(CLIENT);
+    const release* end = server ? std::end(SERVER) : std::end(CLIENT);
+
+    std::vector<std::string> folders;
+    for (const release* candidate = begin; candidate != end; candidate++) {
+        if (build >= candidate->build || !folders.empty()) {
+            folders.push_back(candidate->folder);
+        }
+    }
+    return folders;
+}
+
+std::string driver_architecture_folder(const std::string& architecture) {
+    if (architecture == "arm64") {
+        return "arm64";
+    }
+    return architecture == "x86" ? "x86" : "amd64";
+}
+
+// The files of each requested driver for the image, from the first OS folder that has it
+std::optional<std::vector<driver_file>>
+select_driver_files(iso_reader& drivers_iso, const wim_metadata::image& image,
+                    const std::vector<std::string>& drivers, std::string& error) {
+    std::optional<std::vector<iso_reader::directory_entry>> entries = drivers_iso.list_files();
+    if (!entries) {
+        error = "Failed to list drivers ISO: " + drivers_iso.get_last_error();
+        return std::nullopt;
+    }
+
+    std::vector<std::string> os_folders = driver_os_folders(image);
+    std::string architecture = driver_architecture_folder(image.architecture);
+
+    std::vector<driver_file> selected;
+    for (const std::string& driver : drivers) {
+        bool found = false;
+        for (const std::string& os : os_folders) {
+            // Driver packages are flat: <driver>/<os>/<architecture>/<file>
+            std::string prefix = to_lower(driver + "/" + os + "/" + architecture + "/");
+            for (const auto& entry : *entries) {
+                std::string path = to_lower(entry.path);
+                if (!entry.is_directory && path.compare(0, prefix.size(), prefix) == 0 &&
+                    path.find('/', prefix.size()) == std::string::npos) {
+                    selected.push_back(
+                        {driver, entry.path.substr(prefix.size()), entry.data});
+                    found = true;
+                }
+            }
+            if (found) {
+                std::cout << "[Slim Media] Using " << driver << "/" << os << "/" << architecture
+                          << std::endl;
+                break;
+            }
+        }
+        if (!found) {
+            error = "No " + driver + " driver for Windows build " + image.build + " (" +
+                    image.architecture + ") on the drivers ISO";
+            return std::nullopt;
+        }
+    }
+    return selected;
+}
+
+// Add the drivers to every image of boot.wim (Windows PE and Setup) and rewrite it in place
+bool inject_boot_drivers(const std::string& boot_wim, const std::string& drivers_directory,
+                         unsigned threads, const cancellation_token& token,
+                         const progress_callback& on_progress, std::string& error) {
+    wimlib_progress::context context{&token, &on_progress};
+
+    WIMStruct* wim = nullptr;
+    int result = wimlib_open_wim_with_progress(boot_wim.c_str(), 0, &wim,
+                                               wimlib_progress::handle, &context);
+    if (result != WIMLIB_ERR_SUCCESS) {
+        error = std::string("Failed to open boot.wim: ") + wimlib_get_error_string(result);
+        return false;
+    }
+    DEFER({ wimlib_free(wim); });
+
+    wimlib_wim_info info{};
+    wimlib_get_wim_info(wim, &info);
+    for (uint32_t image = 1; image <= info.image_count; image++) {
+        if (!add_directory(wim, static_cast<int>(image), drivers_directory,
+                           BOOT_DRIVER_DIRECTORY, error)) {
+            return false;
+        }
+    }
+
+    // Rebuilt rather than appended to, so boot.wim does not grow by the old metadata
+    result = wimlib_overwrite(wim, WIMLIB_WRITE_FLAG_REBUILD, threads);
+    if (result != WIMLIB_ERR_SUCCESS) {
+        if (result != WIMLIB_ERR_ABORTED_BY_PROGRESS) {
+            error = std::string("Failed to write boot.wim: ") + wimlib_get_error_string(result);
+        }
+        return false;
+    }
+    return true;
+}
+
+// Waits for an exclusive lock on path, giving up when the token is cancelled. Returns the
+// locked descriptor, or -1.
+int acquire_lock(const std::string& path, const cancellation_token& token, std::string& error) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        error = "Failed to open " + path + ": " + strerror(errno);
+        return -1;
+    }
+    while (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+        if (errno != EWOULDBLOCK && errno != EINTR) {
+            error = "Failed to lock " + path + ": " + strerror(errno);
+            close(fd);
+            return -1;
+        }
+        if (token.is_cancelled()) {
+            close(fd);
+            return -1;
+        }
+        std::this_thread::sleep_for(LOCK_POLL_INTERVAL);
+    }
+    return fd;
+}
+} // namespace
+
+options options::from_json(const nlohmann::json& json) {
+    options opts;
+    opts.compression = json.value("compression", opts.compression);
+    opts.remove_paths = json.value("remove_paths", std::vector<std::string>());
+    opts.threads = json.value("threads", 0u);
+    opts.drivers_iso =
+        json.value("drivers_iso", json.value("virtio_drivers", false) ? DEFAULT_VIRTIO_ISO : "");
+    opts.drivers = json.value("drivers", opts.drivers);
+    return opts;
+}
+
+nlohmann::json result::to_json() const {
+    nlohmann::json json = {{"iso_path", iso_path},
+                           {"image_index", IMAGE_INDEX},
+                           {"size", size},
+                           {"cached", cached},
+                           {"seconds", seconds}};
+    if (!driver_path.empty()) {
+        json["driver_path"] = driver_path;
+    }
+    return json;
+}
+
+bool extract_drivers(const std::string& drivers_iso, const wim_metadata::image& image,
+                     const std::vector<std::string>& drivers, const std::string& directory,
+                     const cancellation_token& token, std::string& error) {
+    iso_reader reader;
+    if (!reader.open(drivers_iso)) {
+        error = "Failed to open drivers ISO: " + reader.get_last_error();
+        return false;
+    }
+    std::optional<std::vector<driver_file>> selected =
+        select_driver_files(reader, image, drivers, error);
+    if (!selected) {
+        return false;
+    }
+
+    int drivers_fd = open(drivers_iso.c_str(), O_RDONLY | O_CLOEXEC);
+    if (drivers_fd == -1) {
+        error = "Failed to open " + drivers_iso + ": " + strerror(errno);
+        return false;
+    }
+    DEFER({ close(drivers_fd); });
+
+    // One folder per driver, the layout DriverPaths and pnputil expect
+    uint64_t copied = 0;
+    for (const driver_file& file : *selected) {
+        std::string target = directory + "/" + file.driver;
+        std::error_code ec;
+        fs::create_directories(target, ec);
+        if (ec) {
+            error = "Failed to create " + target + ": " + ec.message();
+            return false;
+        }
+        if (!iso_extract::extract_file(drivers_fd, file.data, target + "/" + file.name, token,
+                                       copied, error)) {
+            return false;
+        }
+    }
+    std::cout << "[Slim Media] Extracted " << selected->size() << " driver files ("
+              << copied / 1024 << " KiB)" << std::endl;
+    return true;
+}
+
+std::string cache_key(const std::string& source_fingerprint, const options& opts,
+                      const std::string& drivers_fingerprint) {
+    // The order of remove_paths does not change the output
+    std::vector<std::string> paths = opts.remove_paths;
+    std::sort(paths.begin(), paths.end());
+
+    std::string identity = source_fingerprint + "\n" + std::to_string(opts.image_index) + "\n" +
+                           opts.compression;
+    for (const std::string& path : paths) {
+        identity += "\n" + path;
+    }
+    if (!drivers_fingerprint.empty()) {
+        std::vector<std::string> drivers = opts.drivers;
+        std::sort(drivers.begin(), drivers.end());
+        identity += "\ndrivers " + drivers_fingerprint;
+        for (const std::string& driver : drivers) {
+            identity += "\n" + driver;
+        }
+    }
+
+    char key[17];
+    snprintf(key, sizeof(key), "%016llx",
+             static_cast<unsigned long long>(xxhash::hash64(identity.data(), identity.size())));
+    return key;
+}
+
+std::optional<result> build(const std::string& source_iso, const std::string& source_fingerprint,
+                            const options& opts, const std::string& cache_directory,
+                            const cancellation_token& token, const progress_callback& on_progress,
+                            std::string& error) {
+    auto start = std::chrono::steady_clock::now();
+    auto finish = [&start](result built) {
+        built.seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return built;
+    };
+
+    if (opts.image_index == 0) {
+        error = "No image index given";
+        return std::nullopt;
+    }
+    if (opts.compression != "lzms" && opts.compression != "xpress") {
+        error = "Unknown compression '" + opts.compression + "' (expected lzms or xpress)";
+        return std::nullopt;
+    }
+
+    std::error_code ec;
+    fs::create_directories(cache_directory, ec);
+    if (ec) {
+        error = "Failed to create " + cache_directory + ": " + ec.message();
+        return std::nullopt;
+    }
+
+    // The drivers ISO's fingerprint stands for the driver version
+    result built;
+    std::string drivers_fingerprint;
+    if (!opts.drivers_iso.empty()) {
+        std::optional<metadata_cache::fingerprint> fingerprint =
+            metadata_cache::compute_fingerprint(opts.drivers_iso, error);
+        if (!fingerprint) {
+            error = "Failed to open drivers ISO: " + error;
+            return std::nullopt;
+        }
+        drivers_fingerprint = fingerprint->to_string();
+        built.driver_path = WINPE_DRIVER_PATH;
+    }
+
+    std::string key = cache_key(source_fingerprint, opts, drivers_fingerprint);
+    std::string base = cache_directory + "/" + key;
+    built.iso_path = base + ".iso";
+
+    // Another workload may be building the same media; wait for it and reuse its result
+    int lock_fd = acquire_lock(base + ".lock", token, error);
+    if (lock_fd == -1) {
+        return std::nullopt;
+    }
+    DEFER({ close(lock_fd); });
+
+    if (fs::exists(built.iso_path, ec)) {
+        built.size = fs::file_size(built.iso_path, ec);
+        built.cached = true;
+        return finish(built);
+    }
+
+    iso_reader iso;
+    if (!iso.open(source_iso)) {
+        error = "Failed to open ISO: " + iso.get_last_error();
+        return std::nullopt;
+    }
+    std::optional<std::vector<iso_reader::directory_entry>> entries = iso.list_files();
+    if (!entries) {
+        error = "Failed to list ISO contents: " + iso.get_last_error();
+        return std::nullopt;
+    }
+
+    // Everything but the install image goes into the new tree as is
+    const iso_reader::directory_entry* install_image = nullptr;
+    std::string boot_wim;
+    std::string bios_boot;
+    std::string uefi_boot;
+    uint64_t total = 0;
+    for (const auto& entry : *entries) {
+        std::string path = to_lower(entry.path);
+        if (path == "sources/install.wim" || path == "sources/install.esd") {
+            install_image = &entry;
+        } else if (path == "sources/install.swm") {
+            error = "Split install images are not supported";
+            return std::nullopt;
+        } else if (path == "sources/boot.wim") {
+            boot_wim = entry.path;
+        } else if (path == "boot/etfsboot.com") {
+            bios_boot = entry.path;
+        } else if (path == "efi/microsoft/boot/efisys.bin") {
+            uefi_boot = entry.path;
+        }
+        total += entry.data.size;
+    }
+    if (!install_image) {
+        error = "No install image on the ISO";
+        return std::nullopt;
+    }
+    if (bios_boot.empty() && uefi_boot.empty()) {
+        error = "No boot image on the ISO";
+        return std::nullopt;
+    }
+
+    // Drivers are picked for the Windows version of the image being exported
+    std::optional<wim_metadata::image> driver_image;
+    if (!opts.drivers_iso.empty()) {
+        if (boot_wim.empty()) {
+            error = "No boot.wim on the ISO";
+            return std::nullopt;
+        }
+        std::optional<std::vector<wim_metadata::image>> images = wim_metadata::read_images(
+            [&](uint64_t offset, void* buffer, size_t length) {
+                return iso.read_file(install_image->data, offset, buffer, length);
+            },
+            install_image->data.size, error);
+        if (!images) {
+            error = "Failed to read install image metadata: " + error;
+            return std::nullopt;
+        }
+        auto image = std::find_if(images->begin(), images->end(), [&](const auto& candidate) {
+            return candidate.index == opts.image_index;
+        });
+        if (image == images->end()) {
+            error = "No image " + std::to_string(opts.image_index) + " in the install image";
+            return std::nullopt;
+        }
+        driver_image = *image;
+    }
+
+    std::string staging = base + ".staging";
+    std::string tree = staging + "/tree";
+    fs::remove_all(staging, ec); // left over from an interrupted build
+    fs::create_directories(tree, ec);
+    if (ec) {
+        error = "Failed to create " + tree + ": " + ec.message();
+        return std::nullopt;
+    }
+    DEFER({
+        std::error_code ignored;
+        fs::remove_all(staging, ignored);
+    });
+
+    std::string drivers_directory;
+    if (driver_image) {
+        drivers_directory = staging + "/drivers";
+        if (!extract_drivers(opts.drivers_iso, *driver_image, opts.drivers, drivers_directory,
+                             token, error)) {
+            return std::nullopt;
+        }
+    }
+
+    int source_fd = open(source_iso.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source_fd == -1) {
+        error = "Failed to open " + source_iso + ": " + strerror(errno);
+        return std::nullopt;
+    }
+    DEFER({ close(source_fd); });
+    posix_fadvise(source_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    std::cout << "[Slim Media] Extracting " << source_iso << " (" << entries->size()
+              << " entries)" << std::endl;
+    uint64_t copied = 0;
+    std::string source_wim = staging + "/source.wim";
+    for (const auto& entry : *entries) {
+        if (entry.is_directory) {
+            fs::create_directories(tree + "/" + entry.path, ec);
+            if (ec) {
+                error = "Failed to create " + entry.path + ": " + ec.message();
+                return std::nullopt;
+            }
+            continue;
+        }
+        // wimlib reads from a path, so the install image is extracted outside the tree
+        std::string target = &entry == install_image ? source_wim : tree + "/" + entry.path;
+        if (!iso_extract::extract_file(source_fd, entry.data, target, token, copied, error)) {
+            return std::nullopt;
+        }
+        if (on_progress) {
+            on_progress("extracting", copied, total);
+        }
+    }
+
+    bool solid = opts.compression == "lzms";
+    std::string slim_wim = tree + "/" + fs::path(install_image->path).parent_path().string() +
+                           (solid ? "/install.esd" : "/install.wim");
+    std::cout << "[Slim Media] Exporting image " << opts.image_index << " with "
+              << opts.compression << " compression" << std::endl;
+    if (!export_image(source_wim, slim_wim, opts, drivers_directory, token, on_progress, error)) {
+        return std::nullopt;
+    }
+    fs::remove(source_wim, ec);
+
+    uint64_t slim_size = fs::file_size(slim_wim, ec);
+    if (ec) {
+        error = "Failed to read the size of " + slim_wim + ": " + ec.message();
+        return std::nullopt;
+    }
+    if (slim_size > MAX_SINGLE_EXTENT_SIZE) {
+        error = "The exported image is " + std::to_string(slim_size / (1024 * 1024)) +
+                " MiB, over the 4 GiB an ISO9660 file can hold in one piece; " +
+                (solid ? std::string("remove more paths from the image")
+                       : std::string("choose lzms compression or remove more paths"));
+        return std::nullopt;
+    }
+
+    if (!drivers_directory.empty()) {
+        std::cout << "[Slim Media] Adding drivers to " << boot_wim << std::endl;
+        unsigned threads = opts.threads > 0 ? opts.threads : std::thread::hardware_concurrency();
+        if (!inject_boot_drivers(tree + "/" + boot_wim, drivers_directory, threads, token,
+                                 on_progress, error)) {
+            return std::nullopt;
+        }
+    }
+
+    iso_builder image("LSW_SLIM");
+    if (!image.add_directory(tree, "", error) ||
+        (!bios_boot.empty() && !image.set_bios_boot(bios_boot, 8, error)) ||
+        (!uefi_boot.empty() && !image.add_uefi_boot(uefi_boot, error))) {
+        return std::nullopt;
+    }
+    auto on_written = [&on_progress](uint64_t done, uint64_t total) {
+        if (on_progress) {
+            on_progress("writing ISO", done, total);
+        }
+    };
+    if (!image.write(built.iso_path, token, on_written, error)) {
+        error = "Failed to write ISO: " + error;
+        return std::nullopt;
+    }
+    built.size = fs::file_size(built.iso_path, ec);
+
+    built = finish(built);
+    std::cout << "[Slim Media] Built " << built.iso_path << " (" << built.size / (1024 * 1024)
+              << " MiB) in " << built.seconds << "s" << std::endl;
+    return built;
+}
+
+} // namespace slim_media
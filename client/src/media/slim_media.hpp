@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "media/wim_metadata.hpp"
+#include "util/cancellation.hpp"
+
+// Slim installation media: a copy of a Windows ISO whose install image holds only the edition
+// being installed, recompressed and optionally with paths removed. Setup then applies a fraction
+// of the data. VirtIO storage and network drivers can be added to boot.wim and the install image,
+// so Setup sees the virtio disk without loading drivers from a second ISO. Results are cached by
+// source and options, so every VM installed with the same choices reuses one build.
+namespace slim_media {
+
+constexpr const char* DEFAULT_CACHE_DIRECTORY = "/var/cache/lsw/slim-media";
+
+// The exported edition is the only image on the slim media
+constexpr uint32_t IMAGE_INDEX = 1;
+
+constexpr const char* DEFAULT_VIRTIO_ISO = "/usr/share/virtio-win/virtio-win.iso";
+
+// Where injected drivers are found while Setup runs: boot.wim is mounted as X: in Windows PE
+constexpr const char* WINPE_DRIVER_PATH = "X:\\lsw-drivers";
+
+struct options {
+    uint32_t image_index = 0; // in the source install image
+    // "lzms": solid LZMS, written as install.esd; smallest, slowest to build.
+    // "xpress": quick to build and to apply, written as install.wim. The build fails if the
+    // exported image does not fit in 4 GiB, which xpress exceeds for the larger editions.
+    std::string compression = "lzms";
+    std::vector<std::string> remove_paths; // inside the image, e.g. "/Windows/Web/Wallpaper"
+    unsigned threads = 0;                  // compression threads; 0 for one per core
+    // virtio-win ISO to take drivers from ("virtio_drivers": true picks the system one); empty
+    // for none. Only the folders for the image's Windows version and architecture are used.
+    std::string drivers_iso;
+    std::vector<std::string> drivers = {"viostor", "vioscsi", "NetKVM"};
+
+    static options from_json(const nlohmann::json& json);
+};
+
+struct result {
+    std::string iso_path;
+    uint64_t size = 0;
+    bool cached = false;
+    double seconds = 0.0;
+    std::string driver_path; // WINPE_DRIVER_PATH if drivers were added, else empty
+
+    nlohmann::json to_json() const;
+};
+
+// stage is "extracting", "compressing" or "writing ISO"; done and total are bytes of that stage.
+// Called on the thread that runs build.
+using progress_callback =
+    std::function<void(const std::string& stage, uint64_t done, uint64_t total)>;
+
+// Extract the VirtIO drivers for image from drivers_iso into directory/<driver>, taking the
+// folders for its Windows version and architecture
+bool extract_drivers(const std::string& drivers_iso, const wim_metadata::image& image,
+                     const std::vector<std::string>& drivers, const std::string& directory,
+                     const cancellation_token& token, std::string& error);
+
+// Name of the cached ISO: the source and drivers ISO fingerprints plus every option that changes
+// the output
+std::string cache_key(const std::string& source_fingerprint, const options& opts,
+                      const std::string& drivers_fingerprint = "");
+
+// Build the slim ISO for source_iso (identified by source_fingerprint) in cache_directory, or
+// return the one built earlier. Concurrent builds of the same key wait for each other.
+std::optional<result> build(const std::string& source_iso, const std::string& source_fingerprint,
+                            const options& opts, const std::string& cache_directory,
+                            const cancellation_token& token, const progress_callback& on_progress,
+                            std::string& error);
+
+} // namespace slim_media
@@ -0,0 +1,401 @@
+#include "media/wim_metadata.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <wimlib.h>
+
+namespace wim_metadata {
+
+namespace {
+constexpr char WIM_MAGIC[8] = {'M', 'S', 'W', 'I', 'M', 0, 0, 0};
+constexpr char PIPABLE_WIM_MAGIC[8] = {'W', 'L', 'P', 'W', 'M', 0, 0, 0};
+
+constexpr uint8_t RESOURCE_FLAG_COMPRESSED = 0x04;
+
+// Real install media carry well under a megabyte of XML
+constexpr uint64_t MAX_XML_SIZE = 64 * 1024 * 1024;
+
+// Integrity table: size, entry count and chunk size, then one SHA-1 per chunk
+constexpr size_t INTEGRITY_HEADER_SIZE = 12;
+constexpr size_t SHA1_SIZE = 20;
+
+uint16_t le16(const uint8_t* data) {
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+uint32_t le32(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+uint64_t le64(const uint8_t* data) {
+    return static_cast<uint64_t>(le32(data)) | (static_cast<uint64_t>(le32(data + 4)) << 32);
+}
+
+void append_utf8(std::string& out, uint32_t code_point) {
+    if (code_point < 0x80) {
+        out.push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+}
+
+std::string unescape_xml(const std::string& text) {
+    static const std::pair<const char*, char> entities[] = {
+        {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''}};
+
+    std::string result;
+    result.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        bool replaced = false;
+        if (text[i] == '&') {
+            for (const auto& [entity, character] : entities) {
+                size_t length = strlen(entity);
+                if (text.compare(i, length, entity) == 0) {
+                    result.push_back(character);
+                    i += length - 1;
+                    replaced = true;
+                    break;
+                }
+            }
+        }
+        if (!replaced) {
+            result.push_back(text[i]);
+        }
+    }
+    return result;
+}
+
+// Text of the first <tag>...</tag> inside element, or "" if absent
+std::string element_text(const std::string& element, const std::string& tag) {
+    std::string open = "<" + tag + ">";
+    std::string close = "</" + tag + ">";
+    size_t start = element.find(open);
+    if (start == std::string::npos) {
+        return "";
+    }
+    start += open.size();
+    size_t end = element.find(close, start);
+    if (end == std::string::npos) {
+        return "";
+    }
+    return unescape_xml(element.substr(start, end - start));
+}
+
+std::vector<std::string> element_texts(const std::string& element, const std::string& tag) {
+    std::vector<std::string> texts;
+    std::string open = "<" + tag + ">";
+    std::string close = "</" + tag + ">";
+    size_t position = 0;
+    while ((position = element.find(open, position)) != std::string::npos) {
+        size_t start = position + open.size();
+        size_t end = element.find(close, start);
+        if (end == std::string::npos) {
+            break;
+        }
+        texts.push_back(unescape_xml(element.substr(start, end - start)));
+        position = end + close.size();
+    }
+    return texts;
+}
+
+uint64_t parse_u64(const std::string& text) {
+    if (text.empty()) {
+        return 0;
+    }
+    // Counters are decimal, but some tools write hex with a 0x prefix
+    return std::strtoull(text.c_str(), nullptr, 0);
+}
+
+// PROCESSOR_ARCHITECTURE_* values used by the <ARCH> element
+std::string architecture_name(const std::string& value) {
+    if (value.empty()) {
+        return "";
+    }
+    switch (std::atoi(value.c_str())) {
+    case 0:
+        return "x86";
+    case 5:
+        return "arm";
+    case 9:
+        return "x64";
+    case 12:
+        return "arm64";
+    default:
+        return value;
+    }
+}
+} // namespace
+
+nlohmann::json image::to_json() const {
+    return {{"index", index},
+            {"name", name},
+            {"description", description},
+            {"display_name", display_name},
+            {"display_description", display_description},
+            {"edition_id", edition_id},
+            {"architecture", architecture},
+            {"build", build},
+            {"languages", languages},
+            {"default_language", default_language},
+            {"total_bytes", total_bytes},
+            {"file_count", file_count}};
+}
+
+std::optional<header> parse_header(const uint8_t* data, size_t length, std::string& error) {
+    if (length < HEADER_SIZE) {
+        error = "File too small for a WIM header";
+        return std::nullopt;
+    }
+    if (memcmp(data, WIM_MAGIC, sizeof(WIM_MAGIC)) != 0 &&
+        memcmp(data, PIPABLE_WIM_MAGIC, sizeof(PIPABLE_WIM_MAGIC)) != 0) {
+        error = "Not a WIM file";
+        return std::nullopt;
+    }
+    if (le32(data + 8) < HEADER_SIZE) {
+        error = "Invalid WIM header size";
+        return std::nullopt;
+    }
+
+    header result;
+    result.version = le32(data + 12);
+    result.flags = le32(data + 16);
+    result.part_number = le16(data + 40);
+    result.total_parts = le16(data + 42);
+    result.image_count = le32(data + 44);
+
+    // Resource headers: 7-byte stored size, flags byte, offset, original size
+    const uint8_t* blob_table_resource = data + 48;
+    result.blob_table_size = le64(blob_table_resource) & 0x00FFFFFFFFFFFFFFULL;
+    result.blob_table_offset = le64(blob_table_resource + 8);
+
+    const uint8_t* integrity_resource = data + 124;
+    result.integrity_size = le64(integrity_resource) & 0x00FFFFFFFFFFFFFFULL;
+    result.integrity_offset = le64(integrity_resource + 8);
+
+    const uint8_t* xml_resource = data + 72;
+    uint64_t stored_size = le64(xml_resource) & 0x00FFFFFFFFFFFFFFULL;
+    uint8_t resource_flags = xml_resource[7];
+    result.xml_offset = le64(xml_resource + 8);
+    result.xml_size = le64(xml_resource + 16);
+
+    if (resource_flags & RESOURCE_FLAG_COMPRESSED) {
+        error = "Compressed WIM XML data is not supported";
+        return std::nullopt;
+    }
+    if (result.xml_size == 0) {
+        result.xml_size = stored_size;
+    }
+    return result;
+}
+
+std::string utf16le_to_utf8(const std::string& utf16) {
+    std::string result;
+    result.reserve(utf16.size() / 2);
+
+    const auto* data = reinterpret_cast<const uint8_t*>(utf16.data());
+    size_t count = utf16.size() / 2;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t unit = le16(data + i * 2);
+        if (unit >= 0xD800 && unit <= 0xDBFF && i + 1 < count) {
+            uint32_t low = le16(data + (i + 1) * 2);
+            if (low >= 0xDC00 && low <= 0xDFFF) {
+                append_utf8(result, 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00));
+                i++;
+                continue;
+            }
+        }
+        if (unit == 0xFEFF && result.empty()) {
+            continue;
+        }
+        append_utf8(result, unit);
+    }
+    return result;
+}
+
+std::vector<image> parse_xml(const std::string& xml_utf16) {
+    std::string xml = utf16le_to_utf8(xml_utf16);
+    std::vector<image> images;
+
+    size_t position = 0;
+    while ((position = xml.find("<IMAGE ", position)) != std::string::npos) {
+        size_t tag_end = xml.find('>', position);
+        size_t end = xml.find("</IMAGE>", position);
+        if (tag_end == std::string::npos || end == std::string::npos) {
+            break;
+        }
+
+        std::string attributes = xml.substr(position, tag_end - position);
+        std::string element = xml.substr(tag_end + 1, end - tag_end - 1);
+        position = end + 8;
+
+        image entry;
+        size_t index_attribute = attributes.find("INDEX=\"");
+        if (index_attribute != std::string::npos) {
+            entry.index = static_cast<uint32_t>(std::strtoul(
+                attributes.c_str() + index_attribute + strlen("INDEX=\""), nullptr, 10));
+        }
+        if (entry.index == 0) {
+            continue;
+        }
+
+        entry.name = element_text(element, "NAME");
+        entry.description = element_text(element, "DESCRIPTION");
+        entry.display_name = element_text(element, "DISPLAYNAME");
+        entry.display_description = element_text(element, "DISPLAYDESCRIPTION");
+        entry.total_bytes = parse_u64(element_text(element, "TOTALBYTES"));
+        entry.file_count = parse_u64(element_text(element, "FILECOUNT"));
+
+        std::string windows = element_text(element, "WINDOWS");
+        entry.edition_id = element_text(windows, "EDITIONID");
+        entry.architecture = architecture_name(element_text(windows, "ARCH"));
+
+        std::string version = element_text(windows, "VERSION");
+        std::string build = element_text(version, "BUILD");
+        std::string sp_build = element_text(version, "SPBUILD");
+        entry.build = sp_build.empty() || build.empty() ? build : build + "." + sp_build;
+
+        std::string languages = element_text(windows, "LANGUAGES");
+        entry.languages = element_texts(languages, "LANGUAGE");
+        entry.default_language = element_text(languages, "DEFAULT");
+
+        images.push_back(std::move(entry));
+    }
+
+    std::sort(images.begin(), images.end(),
+              [](const image& a, const image& b) { return a.index < b.index; });
+    return images;
+}
+
+std::optional<std::vector<image>> read_images(const read_function& read, uint64_t file_size,
+                                              std::string& error) {
+    uint8_t header_data[HEADER_SIZE];
+    if (file_size < HEADER_SIZE || !read(0, header_data, sizeof(header_data))) {
+        error = "Failed to read WIM header";
+        return std::nullopt;
+    }
+
+    std::optional<header> parsed = parse_header(header_data, sizeof(header_data), error);
+    if (!parsed) {
+        return std::nullopt;
+    }
+
+    if (parsed->xml_size == 0 || parsed->xml_size > MAX_XML_SIZE ||
+        parsed->xml_offset > file_size || parsed->xml_size > file_size - parsed->xml_offset) {
+        error = "Invalid WIM XML location";
+        return std::nullopt;
+    }
+
+    std::string xml(static_cast<size_t>(parsed->xml_size), '\0');
+    if (!read(parsed->xml_offset, &xml[0], xml.size())) {
+        error = "Failed to read WIM XML data";
+        return std::nullopt;
+    }
+
+    std::vector<image> images = parse_xml(xml);
+    if (images.size() != parsed->image_count) {
+        error = "WIM XML lists " + std::to_string(images.size()) + " images, header says " +
+                std::to_string(parsed->image_count);
+        return std::nullopt;
+    }
+    return images;
+}
+
+std::optional<integrity_table> read_integrity_table(const read_function& read, uint64_t file_size,
+                                                    std::string& error) {
+    uint8_t header_data[HEADER_SIZE];
+    if (file_size < HEADER_SIZE || !read(0, header_data, sizeof(header_data))) {
+        error = "Failed to read WIM header";
+        return std::nullopt;
+    }
+
+    std::optional<header> parsed = parse_header(header_data, sizeof(header_data), error);
+    if (!parsed) {
+        return std::nullopt;
+    }
+
+    integrity_table table;
+    table.start = HEADER_SIZE;
+    table.end = parsed->blob_table_offset + parsed->blob_table_size;
+    if (parsed->integrity_size == 0) {
+        return table;
+    }
+
+    if (table.end <= table.start || table.end > file_size ||
+        parsed->integrity_size < INTEGRITY_HEADER_SIZE ||
+        parsed->integrity_offset > file_size ||
+        parsed->integrity_size > file_size - parsed->integrity_offset) {
+        error = "Invalid WIM integrity table location";
+        return std::nullopt;
+    }
+
+    std::vector<uint8_t> data(static_cast<size_t>(parsed->integrity_size));
+    if (!read(parsed->integrity_offset, data.data(), data.size())) {
+        error = "Failed to read WIM integrity table";
+        return std::nullopt;
+    }
+
+    uint32_t entry_count = le32(data.data() + 4);
+    table.chunk_size = le32(data.data() + 8);
+    uint64_t covered = table.end - table.start;
+    if (table.chunk_size == 0 ||
+        entry_count != (covered + table.chunk_size - 1) / table.chunk_size ||
+        data.size() < INTEGRITY_HEADER_SIZE + uint64_t(entry_count) * SHA1_SIZE) {
+        error = "Malformed WIM integrity table";
+        return std::nullopt;
+    }
+
+    table.chunk_digests.resize(entry_count);
+    for (uint32_t i = 0; i < entry_count; i++) {
+        memcpy(table.chunk_digests[i].data(), data.data() + INTEGRITY_HEADER_SIZE + i * SHA1_SIZE,
+               SHA1_SIZE);
+    }
+    return table;
+}
+
+std::optional<std::vector<image>> read_images_from_file(const std::string& path,
+                                                        std::string& error) {
+    WIMStruct* wim = nullptr;
+    int result = wimlib_open_wim(path.c_str(), 0, &wim);
+    if (result != WIMLIB_ERR_SUCCESS) {
+        error = std::string("Failed to open WIM file: ") + wimlib_get_error_string(result);
+        return std::nullopt;
+    }
+
+    wimlib_wim_info info{};
+    wimlib_get_wim_info(wim, &info);
+
+    void* xml_data = nullptr;
+    size_t xml_size = 0;
+    result = wimlib_get_xml_data(wim, &xml_data, &xml_size);
+    wimlib_free(wim);
+    if (result != WIMLIB_ERR_SUCCESS) {
+        error = std::string("Failed to read WIM XML data: ") + wimlib_get_error_string(result);
+        return std::nullopt;
+    }
+
+    std::string xml(static_cast<const char*>(xml_data), xml_size);
+    free(xml_data);
+
+    std::vector<image> images = parse_xml(xml);
+    if (images.size() != info.image_count) {
+        error = "WIM XML lists " + std::to_string(images.size()) + " images, header says " +
+                std::to_string(info.image_count);
+        return std::nullopt;
+    }
+    return images;
+}
+
+} // namespace wim_metadata
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// Reads the image list straight from a WIM/ESD file's header and XML metadata. Only the header
+// and the XML resource (stored uncompressed, at the offset the header gives) are touched, so a
+// multi-gigabyte install.wim inside an ISO is scanned with a couple of small reads.
+namespace wim_metadata {
+
+struct header {
+    uint32_t version = 0;
+    uint32_t flags = 0;
+    uint16_t part_number = 1;
+    uint16_t total_parts = 1;
+    uint32_t image_count = 0;
+    uint64_t xml_offset = 0;
+    uint64_t xml_size = 0;
+    uint64_t blob_table_offset = 0;
+    uint64_t blob_table_size = 0; // as stored
+    uint64_t integrity_offset = 0;
+    uint64_t integrity_size = 0; // 0 if the WIM has no integrity table
+};
+
+// SHA-1 of every chunk of the WIM between the header and the end of the blob table, written
+// when the WIM is captured with integrity checking. Tampering or bit rot anywhere in the
+// resources shows up as a chunk mismatch.
+struct integrity_table {
+    uint64_t start = 0; // first byte covered (the end of the header)
+    uint64_t end = 0;   // one past the last byte covered
+    uint32_t chunk_size = 0;
+    std::vector<std::array<uint8_t, 20>> chunk_digests; // empty if the WIM has none
+};
+
+struct image {
+    uint32_t index = 0;
+    std::string name;
+    std::string description;
+    std::string display_name;
+    std::string display_description;
+    std::string edition_id;
+    std::string architecture; // "x86", "x64", "arm", "arm64"
+    std::string build;        // e.g. "22621.1"
+    std::vector<std::string> languages;
+    std::string default_language;
+    uint64_t total_bytes = 0;
+    uint64_t file_count = 0;
+
+    nlohmann::json to_json() const;
+};
+
+// Fixed WIM header size; the header sits at offset 0
+constexpr size_t HEADER_SIZE = 208;
+
+using read_function = std::function<bool(uint64_t offset, void* buffer, size_t length)>;
+
+std::optional<header> parse_header(const uint8_t* data, size_t length, std::string& error);
+
+// Parse the UTF-16LE XML blob (with or without a byte order mark), ordered by image index
+std::vector<image> parse_xml(const std::string& xml_utf16);
+
+// Header, then XML, through read; file_size guards against offsets beyond the file
+std::optional<std::vector<image>> read_images(const read_function& read, uint64_t file_size,
+                                              std::string& error);
+
+// Standalone .wim/.esd/.swm files, through wimlib: one wimlib_get_wim_info and one XML read
+// rather than a call per image. Every part of a split (.swm) set carries the full XML, so the
+// first part alone is enough.
+std::optional<std::vector<image>> read_images_from_file(const std::string& path,
+                                                        std::string& error);
+
+// Header, then the integrity table if there is one
+std::optional<integrity_table> read_integrity_table(const read_function& read, uint64_t file_size,
+                                                    std::string& error);
+
+std::string utf16le_to_utf8(const std::string& utf16);
+
+} // namespace wim_metadata
@@ -0,0 +1,29 @@
+#include "media/wimlib_progress.hpp"
+
+namespace wimlib_progress {
+
+enum wimlib_progress_status handle(enum wimlib_progress_msg message,
+                                   union wimlib_progress_info* info, void* progress_context) {
+    auto* progress = static_cast<context*>(progress_context);
+    if (progress->token->is_cancelled()) {
+        return WIMLIB_PROGRESS_STATUS_ABORT;
+    }
+
+    const char* stage = nullptr;
+    uint64_t done = 0;
+    if (message == WIMLIB_PROGRESS_MSG_WRITE_STREAMS) {
+        stage = "compressing";
+        done = info->write_streams.completed_bytes;
+        progress->total_bytes = info->write_streams.total_bytes;
+    } else if (message == WIMLIB_PROGRESS_MSG_EXTRACT_STREAMS) {
+        stage = "applying";
+        done = info->extract.completed_bytes;
+        progress->total_bytes = info->extract.total_bytes;
+    }
+    if (stage && *progress->on_progress) {
+        (*progress->on_progress)(stage, done, progress->total_bytes);
+    }
+    return WIMLIB_PROGRESS_STATUS_CONTINUE;
+}
+
+} // namespace wimlib_progress
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <wimlib.h>
+#include "util/cancellation.hpp"
+
+// Progress function for wimlib calls: aborts them once the token is cancelled and reports
+// writing ("compressing") and extraction ("applying") to a stage callback
+namespace wimlib_progress {
+
+using progress_callback =
+    std::function<void(const std::string& stage, uint64_t done, uint64_t total)>;
+
+struct context {
+    const cancellation_token* token;
+    const progress_callback* on_progress; // may hold an empty function
+    uint64_t total_bytes = 0;             // of the last write or extraction
+};
+
+// Pass with a context to wimlib_open_wim_with_progress or wimlib_register_progress_function
+enum wimlib_progress_status handle(enum wimlib_progress_msg message,
+                                   union wimlib_progress_info* info, void* progress_context);
+
+} // namespace wimlib_progress
@@ -0,0 +1,200 @@
+#include "net/http_random_access_file.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+namespace {
+constexpr int MAX_ATTEMPTS = 3;
+
+// Total size from a Content-Range header such as "bytes 0-0/5819498496", or 0
+std::uint64_t parse_range_total(const http_client::response& response) {
+    auto it = response.headers.find("content-range");
+    if (it == response.headers.end()) {
+        return 0;
+    }
+    size_t slash = it->second.rfind('/');
+    if (slash == std::string::npos || slash + 1 >= it->second.size()) {
+        return 0;
+    }
+    try {
+        return static_cast<std::uint64_t>(std::stoull(it->second.substr(slash + 1)));
+    } catch (const std::exception&) {
+        return 0;
+    }
+}
+} // namespace
+
+http_random_access_file::options::options()
+    : block_size(256 * 1024), cache_blocks(256), read_ahead_blocks(2), max_read_ahead_blocks(32),
+      per_request_timeout_seconds(30) {}
+
+http_random_access_file::http_random_access_file(std::string url, const options& opts)
+    : m_url(std::move(url)), m_options(opts) {
+    m_options.block_size = std::max<std::size_t>(m_options.block_size, 4096);
+    m_options.cache_blocks = std::max<std::size_t>(m_options.cache_blocks, 1);
+    m_options.max_read_ahead_blocks =
+        std::max(m_options.max_read_ahead_blocks, m_options.read_ahead_blocks);
+    m_read_ahead = m_options.read_ahead_blocks;
+}
+
+bool http_random_access_file::open() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_client.set_timeout(m_options.per_request_timeout_seconds);
+
+    // A one-byte range tells both the size and whether ranges are honoured
+    http_client::request request(m_url);
+    request.headers["Range"] = "bytes=0-0";
+    http_client::response response = m_client.get(request);
+    m_statistics.requests++;
+
+    if (response.status_code != 206) {
+        m_last_error = response.status_code == 200
+                           ? "Server does not support range requests"
+                           : "HTTP status " + std::to_string(response.status_code);
+        return false;
+    }
+
+    m_size = parse_range_total(response);
+    if (m_size == 0) {
+        m_last_error = "Server did not report the file size";
+        return false;
+    }
+
+    std::cout << "[HTTP File] Opened " << m_url << " (" << m_size << " bytes)" << std::endl;
+    return true;
+}
+
+bool http_random_access_file::read(std::uint64_t offset, void* buffer, std::size_t length) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (offset > m_size || length > m_size - offset) {
+        m_last_error = "Read past end of file";
+        return false;
+    }
+    if (length == 0) {
+        return true;
+    }
+
+    std::uint64_t block_size = m_options.block_size;
+    std::uint64_t first = offset / block_size;
+    std::uint64_t last = (offset + length - 1) / block_size;
+
+    auto* cursor = static_cast<std::uint8_t*>(buffer);
+    for (std::uint64_t block = first; block <= last; block++) {
+        const std::vector<std::uint8_t>* data = get_block(block, last);
+        if (!data) {
+            return false;
+        }
+
+        std::uint64_t block_start = block * block_size;
+        std::size_t from = block == first ? static_cast<std::size_t>(offset - block_start) : 0;
+        std::size_t to = block == last ? static_cast<std::size_t>(offset + length - block_start)
+                                       : data->size();
+        std::memcpy(cursor, data->data() + from, to - from);
+        cursor += to - from;
+    }
+    return true;
+}
+
+const std::vector<std::uint8_t>* http_random_access_file::get_block(std::uint64_t block,
+                                                                     std::uint64_t last_needed) {
+    auto it = m_blocks.find(block);
+    if (it != m_blocks.end()) {
+        m_lru.splice(m_lru.begin(), m_lru, it->second.position);
+        m_statistics.cache_hits++;
+        return &it->second.data;
+    }
+
+    // A miss right after the previous fetch means the caller is streaming: fetch further
+    // ahead each time. Any jump starts over with the base read-ahead.
+    if (block == m_last_fetched_block + 1) {
+        m_read_ahead = std::min(std::max<std::size_t>(m_read_ahead * 2, 1),
+                                m_options.max_read_ahead_blocks);
+    } else {
+        m_read_ahead = m_options.read_ahead_blocks;
+    }
+
+    // Everything the caller still needs plus the read-ahead, up to the next cached block, in one
+    // request; never more than the cache can hold
+    std::uint64_t end = std::min<std::uint64_t>(last_needed + 1 + m_read_ahead, block_count());
+    std::uint64_t count = 1;
+    while (block + count < end && count < m_options.cache_blocks &&
+           m_blocks.count(block + count) == 0) {
+        count++;
+    }
+
+    if (!fetch_blocks(block, count)) {
+        return nullptr;
+    }
+    m_last_fetched_block = block + count - 1;
+    return &m_blocks.at(block).data;
+}
+
+bool http_random_access_file::fetch_blocks(std::uint64_t first, std::uint64_t count) {
+    std::uint64_t block_size = m_options.block_size;
+    std::uint64_t start = first * block_size;
+    std::uint64_t end = std::min((first + count) * block_size, m_size); // exclusive
+
+    http_client::request request(m_url);
+    request.headers["Range"] = "bytes=" + std::to_string(start) + "-" + std::to_string(end - 1);
+
+    http_client::response response;
+    for (int attempt = 1; attempt <= MAX_ATTEMPTS; attempt++) {
+        response = m_client.get(request);
+        m_statistics.requests++;
+        if (response.status_code == 206 && response.body.size() == end - start) {
+            break;
+        }
+        m_last_error = response.status_code == 206
+                           ? "Short range response"
+                           : "HTTP status " + std::to_string(response.status_code);
+        std::cerr << "[HTTP File] Range " << start << "-" << end - 1 << " failed (attempt "
+                  << attempt << "): " << m_last_error << std::endl;
+        if (attempt == MAX_ATTEMPTS) {
+            return false;
+        }
+    }
+
+    m_statistics.bytes_transferred += response.body.size();
+    m_statistics.cache_misses += count;
+
+    const auto* body = reinterpret_cast<const std::uint8_t*>(response.body.data());
+    for (std::uint64_t i = 0; i < count; i++) {
+        std::uint64_t from = i * block_size;
+        std::uint64_t to = std::min(from + block_size, end - start);
+        insert_block(first + i, std::vector<std::uint8_t>(body + from, body + to));
+    }
+    return true;
+}
+
+void http_random_access_file::insert_block(std::uint64_t block, std::vector<std::uint8_t> data) {
+    auto it = m_blocks.find(block);
+    if (it != m_blocks.end()) {
+        it->second.data = std::move(data);
+        m_lru.splice(m_lru.begin(), m_lru, it->second.position);
+        return;
+    }
+
+    m_lru.push_front(block);
+    m_blocks.emplace(block, cached_block{std::move(data), m_lru.begin()});
+
+    while (m_blocks.size() > m_options.cache_blocks) {
+        m_blocks.erase(m_lru.back());
+        m_lru.pop_back();
+    }
+}
+
+std::uint64_t http_random_access_file::block_count() const {
+    return (m_size + m_options.block_size - 1) / m_options.block_size;
+}
+
+http_random_access_file::statistics http_random_access_file::get_statistics() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+std::string http_random_access_file::get_last_error() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_last_error;
+}
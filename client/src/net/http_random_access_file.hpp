@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "net/http.hpp"
+
+// Read-only random access to a remote file through HTTP range requests, so a few structures
+// can be read out of a multi-gigabyte ISO without downloading it.
+//
+// Reads are served from an LRU cache of fixed-size blocks. A miss fetches the missing blocks
+// plus some read-ahead in a single request: for the small scattered reads of a directory walk,
+// round trips rather than bandwidth dominate. Read-ahead grows while reads stay sequential.
+class http_random_access_file {
+public:
+    struct options {
+        std::size_t block_size;            // cache granularity, in bytes
+        std::size_t cache_blocks;          // kept until the least recently used is dropped
+        std::size_t read_ahead_blocks;     // extra blocks fetched after a miss
+        std::size_t max_read_ahead_blocks; // limit while reads stay sequential
+        long per_request_timeout_seconds;
+
+        options();
+    };
+
+    struct statistics {
+        std::uint64_t requests = 0;
+        std::uint64_t bytes_transferred = 0;
+        std::uint64_t cache_hits = 0;   // blocks served from the cache
+        std::uint64_t cache_misses = 0; // blocks fetched
+    };
+
+    explicit http_random_access_file(std::string url, const options& opts = options());
+
+    http_random_access_file(const http_random_access_file&) = delete;
+    http_random_access_file& operator=(const http_random_access_file&) = delete;
+
+    // Probe the size and make sure the server honours ranges. Must succeed before reading.
+    bool open();
+
+    // Read length bytes at offset. Thread-safe; concurrent reads are serialized.
+    bool read(std::uint64_t offset, void* buffer, std::size_t length);
+
+    std::uint64_t size() const {
+        return m_size;
+    }
+    statistics get_statistics();
+    std::string get_last_error();
+
+private:
+    using block_list = std::list<std::uint64_t>; // block numbers, most recently used first
+
+    struct cached_block {
+        std::vector<std::uint8_t> data;
+        block_list::iterator position;
+    };
+
+    std::string m_url;
+    options m_options;
+    std::uint64_t m_size = 0;
+
+    std::mutex m_mutex;
+    http_client m_client; // one connection, kept alive across requests
+    block_list m_lru;
+    std::unordered_map<std::uint64_t, cached_block> m_blocks;
+    std::size_t m_read_ahead = 0;
+    std::uint64_t m_last_fetched_block = UINT64_MAX;
+    statistics m_statistics;
+    std::string m_last_error;
+
+    const std::vector<std::uint8_t>* get_block(std::uint64_t block, std::uint64_t last_needed);
+    bool fetch_blocks(std::uint64_t first, std::uint64_t count);
+    void insert_block(std::uint64_t block, std::vector<std::uint8_t> data);
+    std::uint64_t block_count() const;
+};
@@ -5,8 +5,11 @@
 #include <fstream>
 #include <future>
 #include <iostream>
+#include <iterator>
 #include <mutex>
 
+#include "util/defer.hpp"
+
 namespace {
 inline std::string to_lower_copy(const std::string& s) {
     std::string r = s;
@@ -92,89 +95,235 @@ std::vector<multipart_transfer::part_range> multipart_transfer::plan_parts(
     return parts;
 }
 
-bool multipart_transfer::download_part(const std::string& url, const part_range& range,
-                                       std::size_t part_index, std::vector<std::uint8_t>& target,
-                                       std::atomic<std::uint64_t>& global_written,
-                                       const progress_callback_t& on_progress,
-                                       std::string& out_error,
-                                       const std::chrono::steady_clock::time_point& global_start_tp,
-                                       const options& opts) {
-    if (cancel_requested_.load(std::memory_order_relaxed)) {
-        out_error = "cancelled";
-        return false;
+std::vector<multipart_transfer::chunk> multipart_transfer::plan_chunks(
+    const std::vector<part_range>& parts, const options& opts) const {
+    std::uint64_t chunk_size = opts.chunk_size_bytes > 0 ? opts.chunk_size_bytes : 1;
+    std::vector<chunk> chunks;
+    for (std::size_t i = 0; i < parts.size(); ++i) {
+        for (std::uint64_t start = parts[i].start; start <= parts[i].end_inclusive;
+             start += chunk_size) {
+            std::uint64_t end = std::min(start + chunk_size - 1, parts[i].end_inclusive);
+            chunks.push_back({start, end, i});
+        }
     }
+    return chunks;
+}
 
-    http_client client;
-    client.set_timeout(opts.per_request_timeout_seconds);
+bool multipart_transfer::download_chunk(http_client& client, const std::string& url,
+                                        const chunk& c, std::string& out_error) {
+    std::uint64_t length = c.end_inclusive - c.start + 1;
 
-    std::uint64_t part_total = range.end_inclusive - range.start + 1;
-    std::uint64_t part_done = 0;
-    auto part_start_tp = std::chrono::steady_clock::now();
+    http_client::request req(url);
+    req.headers["Range"] =
+        "bytes=" + std::to_string(c.start) + "-" + std::to_string(c.end_inclusive);
 
-    while (part_done < part_total) {
-        if (cancel_requested_.load(std::memory_order_relaxed)) {
-            out_error = "cancelled";
+    auto resp = client.get(req);
+    if (resp.status_code != 206 && resp.status_code != 200) {
+        out_error = "http status " + std::to_string(resp.status_code);
+        return false;
+    }
+
+    const std::string& body = resp.body;
+    if (resp.status_code == 200) {
+        // Server ignored range; ensure we can copy the desired window
+        if (body.size() < (c.end_inclusive + 1)) {
+            out_error = "unexpected short 200 body";
             return false;
         }
+        std::memcpy(&buffer_[c.start], body.data() + static_cast<std::ptrdiff_t>(c.start),
+                    static_cast<size_t>(length));
+    } else {
+        if (body.size() != length) {
+            out_error = "partial body length mismatch";
+            return false;
+        }
+        std::memcpy(&buffer_[c.start], body.data(), static_cast<size_t>(length));
+    }
+    return true;
+}
+
+void multipart_transfer::add_priority_range(std::uint64_t offset, std::uint64_t length,
+                                            range_callback_t on_ready) {
+    if (length == 0 || !on_ready)
+        return;
+
+    std::vector<priority_range> ready;
+    {
+        std::lock_guard<std::mutex> lk(schedule_mutex_);
+        if (range_state_ == range_state::failed) {
+            ready.push_back({offset, 0, std::move(on_ready)});
+        } else {
+            priority_ranges_.push_back({offset, length, std::move(on_ready)});
+        }
+        if (range_state_ == range_state::scheduling || range_state_ == range_state::complete) {
+            // The bytes may already be here
+            clamp_ranges_locked(buffer_.size(), ready);
+            std::vector<priority_range> arrived;
+            if (range_state_ == range_state::complete) {
+                arrived.swap(priority_ranges_);
+            } else {
+                arrived = take_ready_ranges_locked();
+            }
+            std::move(arrived.begin(), arrived.end(), std::back_inserter(ready));
+        }
+    }
+    deliver_ranges(ready);
+}
+
+void multipart_transfer::release() {
+    std::lock_guard<std::mutex> lk(schedule_mutex_);
+    if (range_state_ == range_state::complete) {
+        range_state_ = range_state::failed;
+    }
+    std::vector<std::uint8_t>().swap(buffer_);
+}
+
+void multipart_transfer::clamp_ranges_locked(std::uint64_t total_bytes,
+                                             std::vector<priority_range>& dropped) {
+    auto it = priority_ranges_.begin();
+    while (it != priority_ranges_.end()) {
+        if (it->offset >= total_bytes) {
+            std::cerr << "[multipart_transfer] Dropping priority range at " << it->offset
+                      << ", past the end of the file" << std::endl;
+            dropped.push_back({it->offset, 0, std::move(it->on_ready)});
+            it = priority_ranges_.erase(it);
+            continue;
+        }
+        it->length = std::min(it->length, total_bytes - it->offset);
+        ++it;
+    }
+}
 
-        std::uint64_t chunk =
-            std::min<std::uint64_t>(opts.chunk_size_bytes, part_total - part_done);
-        std::uint64_t chunk_start = range.start + part_done;
-        std::uint64_t chunk_end = chunk_start + chunk - 1;
+std::size_t multipart_transfer::chunk_at_locked(std::uint64_t offset) const {
+    // Chunks tile the file in order, so the last one starting at or before offset holds it
+    auto it = std::upper_bound(chunks_.begin(), chunks_.end(), offset,
+                               [](std::uint64_t value, const chunk& c) { return value < c.start; });
+    return static_cast<std::size_t>(it - chunks_.begin()) - 1;
+}
 
-        http_client::request req(url);
-        req.headers["Range"] =
-            "bytes=" + std::to_string(chunk_start) + "-" + std::to_string(chunk_end);
+bool multipart_transfer::next_chunk(std::size_t part_index, std::size_t& out_index) {
+    std::lock_guard<std::mutex> lk(schedule_mutex_);
 
-        auto resp = client.get(req);
-        if (resp.status_code != 206 && resp.status_code != 200) {
-            out_error = "http status " + std::to_string(resp.status_code);
-            return false;
+    auto take = [&](std::size_t index) {
+        chunk_states_[index] = chunk_state::in_flight;
+        out_index = index;
+        return true;
+    };
+
+    // Priority ranges first, in registration order
+    for (const auto& range : priority_ranges_) {
+        std::uint64_t range_end = range.offset + range.length - 1;
+        for (std::size_t i = chunk_at_locked(range.offset);
+             i < chunks_.size() && chunks_[i].start <= range_end; ++i) {
+            if (chunk_states_[i] == chunk_state::pending)
+                return take(i);
         }
+    }
+
+    // Then this thread's own part, front to back
+    for (std::size_t i = 0; i < chunks_.size(); ++i) {
+        if (chunks_[i].part_index == part_index && chunk_states_[i] == chunk_state::pending)
+            return take(i);
+    }
 
-        const std::string& body = resp.body;
-        if (resp.status_code == 200) {
-            // Server ignored range; ensure we can copy the desired window
-            if (body.size() < (chunk_end + 1)) {
-                out_error = "unexpected short 200 body";
-                return false;
+    // Then help with whatever is left, so a part held back by priority ranges finishes early
+    for (std::size_t i = 0; i < chunks_.size(); ++i) {
+        if (chunk_states_[i] == chunk_state::pending)
+            return take(i);
+    }
+    return false;
+}
+
+std::vector<multipart_transfer::priority_range> multipart_transfer::complete_chunk(
+    std::size_t index) {
+    std::lock_guard<std::mutex> lk(schedule_mutex_);
+    chunk_states_[index] = chunk_state::done;
+    return take_ready_ranges_locked();
+}
+
+std::vector<multipart_transfer::priority_range> multipart_transfer::take_ready_ranges_locked() {
+    std::vector<priority_range> ready;
+    auto it = priority_ranges_.begin();
+    while (it != priority_ranges_.end()) {
+        std::uint64_t range_end = it->offset + it->length - 1;
+        bool complete = true;
+        for (std::size_t i = chunk_at_locked(it->offset);
+             i < chunks_.size() && chunks_[i].start <= range_end; ++i) {
+            if (chunk_states_[i] != chunk_state::done) {
+                complete = false;
+                break;
             }
-            std::memcpy(&target[chunk_start],
-                        body.data() + static_cast<std::ptrdiff_t>(chunk_start),
-                        static_cast<size_t>(chunk));
+        }
+        if (complete) {
+            ready.push_back(std::move(*it));
+            it = priority_ranges_.erase(it);
         } else {
-            if (body.size() != chunk) {
-                out_error = "partial body length mismatch";
-                return false;
-            }
-            std::memcpy(&target[chunk_start], body.data(), static_cast<size_t>(chunk));
+            ++it;
         }
+    }
+    return ready;
+}
 
-        part_done += chunk;
-        auto written = global_written.fetch_add(chunk, std::memory_order_relaxed) + chunk;
-        using clock = std::chrono::steady_clock;
-        auto now = clock::now();
-        double part_secs =
-            std::chrono::duration_cast<std::chrono::duration<double>>(now - part_start_tp).count();
-        double global_secs =
-            std::chrono::duration_cast<std::chrono::duration<double>>(now - global_start_tp)
-                .count();
-        double part_bps = part_secs > 0.0 ? static_cast<double>(part_done) / part_secs : 0.0;
-        double global_bps = global_secs > 0.0 ? static_cast<double>(written) / global_secs : 0.0;
-        if (on_progress) {
-            progress_info p{part_index,    part_done, part_total, written,
-                            target.size(), part_bps,  global_bps};
-            on_progress(p);
+void multipart_transfer::deliver_ranges(const std::vector<priority_range>& ranges) const {
+    for (const auto& range : ranges) {
+        if (range.length == 0) {
+            range.on_ready(range.offset, nullptr, 0);
+            continue;
         }
+        std::cout << "[multipart_transfer] Priority range " << range.offset << "-"
+                  << range.offset + range.length - 1 << " ready" << std::endl;
+        range.on_ready(range.offset, buffer_.data() + range.offset, range.length);
     }
+}
 
-    return true;
+void multipart_transfer::deliver_all_ranges() {
+    // Single-request fallbacks: everything arrived at once
+    std::vector<priority_range> ready;
+    {
+        std::lock_guard<std::mutex> lk(schedule_mutex_);
+        range_state_ = range_state::complete;
+        clamp_ranges_locked(buffer_.size(), ready);
+        std::move(priority_ranges_.begin(), priority_ranges_.end(), std::back_inserter(ready));
+        priority_ranges_.clear();
+    }
+    deliver_ranges(ready);
+}
+
+void multipart_transfer::fail_all_ranges() {
+    std::vector<priority_range> failed;
+    {
+        std::lock_guard<std::mutex> lk(schedule_mutex_);
+        range_state_ = range_state::failed;
+        failed.swap(priority_ranges_);
+    }
+    for (auto& range : failed) {
+        range.length = 0;
+    }
+    deliver_ranges(failed);
 }
 
 void multipart_transfer::download(const std::string& url, const options& opts,
                                   const progress_callback_t& on_progress,
                                   const completion_callback_t& on_complete) {
     cancel_requested_.store(false, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lk(schedule_mutex_);
+        range_state_ = range_state::waiting;
+    }
+    total_bytes_ = 0;
+    DEFER({
+        bool complete;
+        {
+            std::lock_guard<std::mutex> lk(schedule_mutex_);
+            chunks_.clear();
+            chunk_states_.clear();
+            complete = range_state_ == range_state::complete;
+        }
+        // Ranges added from now on are answered straight from buffer_, or failed
+        if (!complete) {
+            fail_all_ranges();
+        }
+    });
     std::cout << "[multipart_transfer] Starting download: " << url << std::endl;
     std::cout << "[multipart_transfer] max_threads(parts)=" << opts.max_threads
               << ", timeout_s=" << opts.per_request_timeout_seconds << std::endl;
@@ -228,11 +377,13 @@ void multipart_transfer::download(const std::string& url, const options& opts,
             return;
         }
         buffer_.assign(resp.body.begin(), resp.body.end());
+        total_bytes_ = buffer_.size();
         if (on_progress) {
             progress_info p{0,  buffer_.size(), buffer_.size(), buffer_.size(), buffer_.size(), 0.0,
                             0.0};
             on_progress(p);
         }
+        deliver_all_ranges();
         if (on_complete)
             on_complete(true, "");
         return;
@@ -257,68 +408,90 @@ void multipart_transfer::download(const std::string& url, const options& opts,
         if (resp.body.size() != total_bytes)
             buffer_.resize(resp.body.size());
         std::memcpy(buffer_.data(), resp.body.data(), buffer_.size());
+        total_bytes_ = buffer_.size();
         if (on_progress) {
             progress_info p{0,  buffer_.size(), buffer_.size(), buffer_.size(), buffer_.size(), 0.0,
                             0.0};
             on_progress(p);
         }
+        deliver_all_ranges();
         if (on_complete)
             on_complete(true, "");
         return;
     }
 
-    // Plan parts and dispatch pool of futures (bounded by max_threads)
+    // Plan parts, split them into chunks and run one thread per part. Each thread takes the
+    // chunks of pending priority ranges first, then those of its own part, then any left over.
     auto parts = plan_parts(total_bytes, opts);
     std::cout << "[multipart_transfer] Planned parts=" << parts.size() << std::endl;
+    std::vector<priority_range> dropped;
+    {
+        std::lock_guard<std::mutex> lk(schedule_mutex_);
+        chunks_ = plan_chunks(parts, opts);
+        chunk_states_.assign(chunks_.size(), chunk_state::pending);
+        clamp_ranges_locked(total_bytes, dropped);
+        total_bytes_ = total_bytes;
+        range_state_ = range_state::scheduling;
+        if (!priority_ranges_.empty()) {
+            std::cout << "[multipart_transfer] Priority ranges=" << priority_ranges_.size()
+                      << std::endl;
+        }
+    }
+    deliver_ranges(dropped);
+
     std::atomic<std::uint64_t> global_written(0);
+    std::vector<std::atomic<std::uint64_t>> part_written(parts.size());
     auto global_start_tp = std::chrono::steady_clock::now();
 
-    // Use the original URL for all parts (no mirror/effective URL caching)
-    std::string base_url_for_parts = url;
-
-    std::vector<std::future<bool>> in_flight;
     std::mutex error_mutex;
     std::string first_error;
     std::atomic<bool> failed(false);
 
-    std::size_t next_index = 0;
-
-    auto launch_next = [&](std::size_t count) {
-        for (std::size_t i = 0; i < count && next_index < parts.size(); ++i, ++next_index) {
-            const auto range = parts[next_index];
-            std::cout << "[multipart_transfer] Launching part index=" << next_index
-                      << " range=" << range.start << "-" << range.end_inclusive << std::endl;
-            std::size_t part_idx_captured = next_index;
-            // Use validated base URL for all parts
-            std::string part_url = base_url_for_parts;
-
-            in_flight.emplace_back(std::async(std::launch::async, [&, range, part_idx_captured,
-                                                                   part_url]() {
-                std::string err;
-                bool ok = download_part(part_url, range, part_idx_captured, buffer_, global_written,
-                                        on_progress, err, global_start_tp, opts);
-                if (!ok) {
-                    std::lock_guard<std::mutex> lk(error_mutex);
-                    if (!failed.exchange(true))
-                        first_error = err;
-                }
-                return ok;
-            }));
-        }
-    };
+    auto run_part = [&](std::size_t part_index) {
+        http_client client; // keeps its connection alive across chunks
+        client.set_timeout(opts.per_request_timeout_seconds);
+
+        std::size_t index = 0;
+        while (!failed.load() && !cancel_requested_.load(std::memory_order_relaxed) &&
+               next_chunk(part_index, index)) {
+            const chunk& c = chunks_[index];
+            std::string err;
+            if (!download_chunk(client, url, c, err)) {
+                std::lock_guard<std::mutex> lk(error_mutex);
+                if (!failed.exchange(true))
+                    first_error = err;
+                return;
+            }
 
-    launch_next(std::min<std::size_t>(opts.max_threads, parts.size()));
+            std::uint64_t length = c.end_inclusive - c.start + 1;
+            std::uint64_t part_done =
+                part_written[c.part_index].fetch_add(length, std::memory_order_relaxed) + length;
+            auto written = global_written.fetch_add(length, std::memory_order_relaxed) + length;
+            double secs = std::chrono::duration_cast<std::chrono::duration<double>>(
+                              std::chrono::steady_clock::now() - global_start_tp)
+                              .count();
+            if (on_progress) {
+                std::uint64_t part_total =
+                    parts[c.part_index].end_inclusive - parts[c.part_index].start + 1;
+                double part_bps = secs > 0.0 ? static_cast<double>(part_done) / secs : 0.0;
+                double global_bps = secs > 0.0 ? static_cast<double>(written) / secs : 0.0;
+                progress_info p{c.part_index, part_done,   part_total, written,
+                                total_bytes,  part_bps, global_bps};
+                on_progress(p);
+            }
 
-    while (!in_flight.empty()) {
-        auto fut = std::move(in_flight.back());
-        in_flight.pop_back();
-        bool ok = fut.get();
-        if (!ok || cancel_requested_.load(std::memory_order_relaxed)) {
-            // Stop launching new parts; wait for currently launched to drain
-            failed.store(true);
-        } else {
-            launch_next(1);
+            deliver_ranges(complete_chunk(index));
         }
+    };
+
+    std::vector<std::future<void>> in_flight;
+    for (std::size_t i = 0; i < parts.size(); ++i) {
+        std::cout << "[multipart_transfer] Launching part index=" << i
+                  << " range=" << parts[i].start << "-" << parts[i].end_inclusive << std::endl;
+        in_flight.emplace_back(std::async(std::launch::async, run_part, i));
+    }
+    for (auto& fut : in_flight) {
+        fut.get();
     }
 
     if (cancel_requested_.load(std::memory_order_relaxed)) {
@@ -336,6 +509,7 @@ void multipart_transfer::download(const std::string& url, const options& opts,
     }
 
     std::cout << "[multipart_transfer] All parts completed successfully" << std::endl;
+    deliver_all_ranges();
 
     // Write to file if output path is specified
     if (!opts.output_file_path.empty()) {
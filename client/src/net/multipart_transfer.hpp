@@ -5,6 +5,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -25,6 +26,10 @@ public:
     using progress_callback_t = std::function<void(const progress_info&)>;
     using completion_callback_t =
         std::function<void(bool success, const std::string& error_message)>;
+    // Receives the bytes of a priority range; data points into the download buffer. data is
+    // null (and length 0) when the bytes will never arrive: the download failed or was cancelled.
+    using range_callback_t =
+        std::function<void(std::uint64_t offset, const std::uint8_t* data, std::uint64_t length)>;
 
     struct options {
         std::size_t max_threads;          // number of concurrent downloads (also part count)
@@ -48,6 +53,25 @@ public:
     // Request cooperative cancellation. Safe to call from callbacks/other threads.
     void cancel();
 
+    // Fetch [offset, offset + length) ahead of the rest of the file, e.g. the ISO volume
+    // descriptors or the install.wim header and XML, and call `on_ready` once all of it has
+    // arrived. Ranges are fetched in the order they are registered.
+    // May be called before download() or while it runs, including from another range's callback,
+    // so a caller can follow the offsets it just parsed. `on_ready` runs on a download thread, or
+    // right away on the calling thread when the bytes are already there or the download has
+    // already failed.
+    void add_priority_range(std::uint64_t offset, std::uint64_t length, range_callback_t on_ready);
+
+    // Size of the resource, known once download() has probed it (0 before). Always known by the
+    // time a priority range is delivered.
+    std::uint64_t size() const {
+        return total_bytes_.load();
+    }
+
+    // Free the downloaded bytes, e.g. once they are in output_file_path. Priority ranges added
+    // afterwards fail.
+    void release();
+
     // Access the aggregated downloaded bytes after successful completion.
     const std::vector<std::uint8_t>& data() const {
         return buffer_;
@@ -59,18 +83,57 @@ private:
         std::uint64_t end_inclusive; // HTTP Range end is inclusive
     };
 
+    // One request's worth of a part
+    struct chunk {
+        std::uint64_t start;
+        std::uint64_t end_inclusive;
+        std::size_t part_index;
+    };
+
+    enum class chunk_state : std::uint8_t { pending, in_flight, done };
+
+    // Where the download stands, for delivering priority ranges
+    enum class range_state : std::uint8_t {
+        waiting,    // ranges are queued until download() plans its chunks
+        scheduling, // chunks_ describes the running download
+        complete,   // every byte is in buffer_
+        failed      // ranges get no bytes
+    };
+
+    struct priority_range {
+        std::uint64_t offset;
+        std::uint64_t length;
+        range_callback_t on_ready;
+    };
+
     static bool server_supports_ranges(const http_client::response& head_like_response);
     static std::uint64_t parse_content_length(const http_client::response& response);
 
     std::vector<part_range> plan_parts(std::uint64_t total_bytes, const options& opts) const;
-    bool download_part(const std::string& url, const part_range& range, std::size_t part_index,
-                       std::vector<std::uint8_t>& target,
-                       std::atomic<std::uint64_t>& global_written,
-                       const progress_callback_t& on_progress, std::string& out_error,
-                       const std::chrono::steady_clock::time_point& global_start_tp,
-                       const options& opts);
+    std::vector<chunk> plan_chunks(const std::vector<part_range>& parts,
+                                   const options& opts) const;
+    bool download_chunk(http_client& client, const std::string& url, const chunk& c,
+                        std::string& out_error);
+
+    // Scheduling state, guarded by schedule_mutex_
+    std::size_t chunk_at_locked(std::uint64_t offset) const;
+    bool next_chunk(std::size_t part_index, std::size_t& out_index);
+    std::vector<priority_range> complete_chunk(std::size_t index);
+    std::vector<priority_range> take_ready_ranges_locked();
+    // Trims ranges to the file; those past its end move to dropped, to be failed
+    void clamp_ranges_locked(std::uint64_t total_bytes, std::vector<priority_range>& dropped);
+    void deliver_ranges(const std::vector<priority_range>& ranges) const;
+    void deliver_all_ranges();
+    void fail_all_ranges();
 
 private:
     std::atomic<bool> cancel_requested_;
     std::vector<std::uint8_t> buffer_;
+    std::atomic<std::uint64_t> total_bytes_{0};
+
+    std::mutex schedule_mutex_;
+    std::vector<priority_range> priority_ranges_; // registered and not yet delivered
+    std::vector<chunk> chunks_;                   // of the running download, ordered by start
+    std::vector<chunk_state> chunk_states_;
+    range_state range_state_ = range_state::waiting;
 };
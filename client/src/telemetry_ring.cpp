@@ -0,0 +1,242 @@
+#include "telemetry_ring.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr uint32_t RING_MAGIC = 0x4c535754; // "LSWT"
+constexpr uint32_t RING_VERSION = 1;
+
+size_t round_up_pow2(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+} // namespace
+
+// Lives at the start of the shared mapping. Head and tail sit on separate cache lines so the
+// producer and consumer do not false-share.
+struct telemetry_ring::ring_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    alignas(64) std::atomic<uint64_t> head;  // next slot to write, owned by the producer
+    alignas(64) std::atomic<uint64_t> tail;  // next slot to read, owned by the consumer
+    alignas(64) std::atomic<uint32_t> armed; // consumer is idle and wants an eventfd signal
+    std::atomic<uint64_t> dropped;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shared-memory ring requires lock-free 64-bit atomics");
+
+telemetry_ring::~telemetry_ring() {
+    close();
+}
+
+bool telemetry_ring::create(size_t capacity) {
+    close();
+
+    capacity = round_up_pow2(capacity == 0 ? 1 : capacity);
+    size_t mapping_size = sizeof(ring_header) + capacity * sizeof(telemetry_record);
+
+    m_memory_fd = memfd_create("lsw-telemetry", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (m_memory_fd == -1) {
+        std::cerr << "[Telemetry] Failed to create memfd: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (ftruncate(m_memory_fd, static_cast<off_t>(mapping_size)) == -1) {
+        std::cerr << "[Telemetry] Failed to size memfd: " << strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+
+    // The consumer trusts the size, so forbid anyone from changing it
+    fcntl(m_memory_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+    m_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_event_fd == -1) {
+        std::cerr << "[Telemetry] Failed to create eventfd: " << strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+
+    if (!map(mapping_size)) {
+        close();
+        return false;
+    }
+
+    // Freshly truncated memfd pages are zeroed, so the atomics start at 0
+    m_header->magic = RING_MAGIC;
+    m_header->version = RING_VERSION;
+    m_header->capacity = capacity;
+    m_header->armed.store(1);
+
+    std::cout << "[Telemetry] Ring created (" << capacity << " records)" << std::endl;
+    return true;
+}
+
+bool telemetry_ring::attach(int memory_fd, int event_fd) {
+    close();
+    m_memory_fd = memory_fd;
+    m_event_fd = event_fd;
+
+    struct stat st;
+    if (fstat(m_memory_fd, &st) == -1 || st.st_size < static_cast<off_t>(sizeof(ring_header))) {
+        std::cerr << "[Telemetry] Invalid ring memfd" << std::endl;
+        close();
+        return false;
+    }
+
+    if (!map(static_cast<size_t>(st.st_size))) {
+        close();
+        return false;
+    }
+
+    uint64_t capacity = m_header->capacity;
+    bool valid = m_header->magic == RING_MAGIC && m_header->version == RING_VERSION &&
+                 capacity != 0 && (capacity & (capacity - 1)) == 0 &&
+                 sizeof(ring_header) + capacity * sizeof(telemetry_record) <= m_mapping_size;
+    if (!valid) {
+        std::cerr << "[Telemetry] Ring header mismatch" << std::endl;
+        close();
+        return false;
+    }
+
+    int flags = fcntl(m_event_fd, F_GETFL);
+    if (flags != -1) {
+        fcntl(m_event_fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    std::cout << "[Telemetry] Ring attached (" << capacity << " records)" << std::endl;
+    return true;
+}
+
+bool telemetry_ring::map(size_t mapping_size) {
+    void* mapping =
+        mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_memory_fd, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "[Telemetry] Failed to map ring: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    m_mapping_size = mapping_size;
+    m_header = static_cast<ring_header*>(mapping);
+    m_records = reinterpret_cast<telemetry_record*>(static_cast<char*>(mapping) +
+                                                    sizeof(ring_header));
+    return true;
+}
+
+void telemetry_ring::close() {
+    if (m_header) {
+        munmap(m_header, m_mapping_size);
+        m_header = nullptr;
+        m_records = nullptr;
+        m_mapping_size = 0;
+    }
+    if (m_memory_fd != -1) {
+        ::close(m_memory_fd);
+        m_memory_fd = -1;
+    }
+    if (m_event_fd != -1) {
+        ::close(m_event_fd);
+        m_event_fd = -1;
+    }
+}
+
+bool telemetry_ring::push(const telemetry_record& record) {
+    if (!m_header) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_push_mutex);
+    uint64_t head = m_header->head.load(std::memory_order_relaxed);
+    uint64_t tail = m_header->tail.load(std::memory_order_acquire);
+    if (head - tail >= m_header->capacity) {
+        m_header->dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    m_records[head & (m_header->capacity - 1)] = record;
+    m_header->head.store(head + 1, std::memory_order_seq_cst);
+
+    // Only wake the consumer if it went idle; otherwise it will pick the record up on its next
+    // frame anyway
+    if (m_header->armed.exchange(0, std::memory_order_seq_cst) != 0) {
+        uint64_t one = 1;
+        if (write(m_event_fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+            std::cerr << "[Telemetry] Failed to signal consumer: " << strerror(errno)
+                      << std::endl;
+        }
+    }
+    return true;
+}
+
+size_t telemetry_ring::drain(const record_callback& callback) {
+    if (!m_header) {
+        return 0;
+    }
+
+    uint64_t tail = m_header->tail.load(std::memory_order_relaxed);
+    uint64_t head = m_header->head.load(std::memory_order_acquire);
+    size_t count = 0;
+
+    // Never trust the producer's head blindly: it lives in shared memory
+    if (head - tail > m_header->capacity) {
+        tail = head - m_header->capacity;
+    }
+
+    while (tail != head) {
+        telemetry_record record = m_records[tail & (m_header->capacity - 1)];
+        ++tail;
+        ++count;
+        if (callback) {
+            callback(record);
+        }
+    }
+
+    m_header->tail.store(tail, std::memory_order_release);
+    return count;
+}
+
+void telemetry_ring::acknowledge() {
+    if (m_event_fd == -1) {
+        return;
+    }
+
+    uint64_t counter;
+    while (read(m_event_fd, &counter, sizeof(counter)) > 0) {
+    }
+}
+
+bool telemetry_ring::arm() {
+    if (!m_header) {
+        return false;
+    }
+
+    m_header->armed.store(1, std::memory_order_seq_cst);
+
+    // A record published between the last drain and arming did not signal us
+    uint64_t head = m_header->head.load(std::memory_order_seq_cst);
+    uint64_t tail = m_header->tail.load(std::memory_order_relaxed);
+    return head != tail;
+}
+
+uint64_t telemetry_ring::get_dropped_count() const {
+    return m_header ? m_header->dropped.load(std::memory_order_relaxed) : 0;
+}
+
+uint64_t telemetry_ring::now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+// Telemetry record kinds. The meaning of telemetry_record::values depends on the kind.
+enum class telemetry_kind : uint32_t {
+    progress, // values: done, total, rate (units/s), eta (s)
+    worker_queue, // workload_id 0; values: interactive queued, interactive active, bulk queued,
+                  // bulk active
+};
+
+// Fixed-size record, one cache line, so the ring never needs framing
+struct telemetry_record {
+    uint64_t workload_id;
+    telemetry_kind kind;
+    uint32_t reserved;
+    uint64_t timestamp_ns; // CLOCK_MONOTONIC
+    double values[5];
+};
+
+static_assert(sizeof(telemetry_record) == 64, "telemetry_record must stay one cache line");
+
+// Single-producer/single-consumer ring buffer in a memfd shared between the worker (producer)
+// and the client (consumer). The consumer is woken through an eventfd, but only when it has
+// declared itself idle, so a busy producer does not issue a syscall per record.
+//
+// High-rate numeric telemetry (progress counters) goes through the ring; control
+// messages stay on the IPC socket.
+class telemetry_ring {
+public:
+    using record_callback = std::function<void(const telemetry_record& record)>;
+
+    telemetry_ring() = default;
+    ~telemetry_ring();
+
+    telemetry_ring(const telemetry_ring&) = delete;
+    telemetry_ring& operator=(const telemetry_ring&) = delete;
+
+    telemetry_ring(telemetry_ring&&) = delete;
+    telemetry_ring& operator=(telemetry_ring&&) = delete;
+
+    // Producer side: allocate a ring with room for `capacity` records (rounded up to a power of
+    // two) and the eventfd used to wake the consumer
+    bool create(size_t capacity = 1024);
+
+    // Consumer side: map a ring created by the producer. Takes ownership of both descriptors.
+    bool attach(int memory_fd, int event_fd);
+
+    void close();
+
+    bool is_open() const {
+        return m_header != nullptr;
+    }
+    int get_memory_fd() const {
+        return m_memory_fd;
+    }
+    int get_event_fd() const {
+        return m_event_fd;
+    }
+
+    // Producer: append a record. Returns false (and counts a drop) if the ring is full.
+    // Threads of the producing process are serialized, so the ring stays single-producer.
+    bool push(const telemetry_record& record);
+
+    // Consumer: deliver every available record, oldest first. Returns the number delivered.
+    size_t drain(const record_callback& callback);
+
+    // Consumer: reset the eventfd after a wakeup
+    void acknowledge();
+
+    // Consumer: declare the consumer idle so the next push signals the eventfd. Returns true if
+    // records arrived while arming, in which case the caller should keep draining.
+    bool arm();
+
+    uint64_t get_dropped_count() const;
+
+    // Monotonic timestamp in the same clock the records use
+    static uint64_t now_ns();
+
+private:
+    struct ring_header;
+
+    int m_memory_fd = -1;
+    int m_event_fd = -1;
+    ring_header* m_header = nullptr;
+    telemetry_record* m_records = nullptr;
+    size_t m_mapping_size = 0;
+    std::mutex m_push_mutex;
+
+    bool map(size_t mapping_size);
+};
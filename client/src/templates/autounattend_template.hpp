@@ -5,8 +5,8 @@ namespace autounattend {
 inline constexpr const char* template_xml = R"XML(<?xml version="1.0" encoding="utf-8"?>
 <unattend xmlns="urn:schemas-microsoft-com:unattend" xmlns:wcm="http://schemas.microsoft.com/WMIConfig/2002/State">
 	<!--https://schneegans.de/windows/unattend-generator/?LanguageMode=Unattended&UILanguage=en-US&Locale=en-US&Keyboard=00000409&GeoLocation=244&ProcessorArchitecture=amd64&BypassRequirementsCheck=true&BypassNetworkCheck=true&ComputerNameMode=Custom&ComputerName=lswvm&CompactOsMode=Default&TimeZoneMode=Implicit&PartitionMode=Interactive&DiskAssertionMode=Skip&WindowsEditionMode=Generic&WindowsEdition=pro&InstallFromMode=Index&InstallFromIndex=6&PEMode=Default&UserAccountMode=Unattended&AccountName0=LSW_USER_NAME&AccountDisplayName0=LSW_DISPLAY_NAME&AccountPassword0=LSW_USER_PASS&AccountGroup0=Administrators&AutoLogonMode=Own&PasswordExpirationMode=Unlimited&LockoutMode=Default&HideFiles=Hidden&ClassicContextMenu=true&TaskbarSearch=Hide&TaskbarIconsMode=Default&DisableWidgets=true&StartTilesMode=Default&StartPinsMode=Default&DisableDefender=true&DisableUac=true&DisableSac=true&DisableSmartScreen=true&EnableLongPaths=true&AllowPowerShellScripts=true&PreventAutomaticReboot=true&HideEdgeFre=true&DisableEdgeStartupBoost=true&DisablePointerPrecision=true&DeleteWindowsOld=true&EffectsMode=Default&DesktopIconsMode=Default&StartFoldersMode=Default&VirtIoGuestTools=true&WifiMode=Interactive&ExpressSettings=DisableAll&LockKeysMode=Skip&StickyKeysMode=Default&ColorMode=Default&WallpaperMode=Default&LockScreenMode=Default&WdacMode=Skip-->
-	<settings pass="offlineServicing"></settings>
-	<settings pass="windowsPE">
+	<settings pass="offlineServicing">OFFLINE_DRIVER_PATHS_PLACEHOLDER</settings>
+	<settings pass="windowsPE">WINPE_DRIVER_PATHS_PLACEHOLDER
 		<component name="Microsoft-Windows-International-Core-WinPE" processorArchitecture="amd64" publicKeyToken="31bf3856ad364e35" language="neutral" versionScope="nonSxS">
 			<UILanguage>en-US</UILanguage>
 		</component>
@@ -50,7 +50,7 @@ inline constexpr const char* template_xml = R"XML(<?xml version="1.0" encoding="
 					<InstallFrom>
 						<MetaData wcm:action="add">
 							<Key>/IMAGE/INDEX</Key>
-							<Value>6</Value>
+							<Value>WINDOWS_EDITION_INDEX_PLACEHOLDER</Value>
 						</MetaData>
 					</InstallFrom>
 					<InstallTo>
@@ -207,7 +207,7 @@ inline constexpr const char* template_xml = R"XML(<?xml version="1.0" encoding="
 				<SynchronousCommand wcm:action="add">
 					<Order>1</Order>
 					<CommandLine>powershell.exe -WindowStyle Normal -NoProfile -Command "Get-Content -LiteralPath 'C:\Windows\Setup\Scripts\FirstLogon.ps1' -Raw | Invoke-Expression;"</CommandLine>
-				</SynchronousCommand>
+				</SynchronousCommand>GENERALIZE_COMMAND_PLACEHOLDER
 			</FirstLogonCommands>
 		</component>
 	</settings>
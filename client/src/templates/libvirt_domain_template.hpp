@@ -60,7 +60,7 @@ const std::string LIBVIRT_DOMAIN_TEMPLATE = R"(<domain type="kvm">
 
     <!-- System disk -->
     <disk type="file" device="disk">
-      <driver name="qemu" type="qcow2" discard="unmap"/>
+      <driver name="qemu" type="{{DISK_FORMAT}}" discard="unmap"/>
       <source file="{{DISK_PATH}}"/>
       <target dev="vda" bus="virtio"/>
     </disk>
@@ -152,6 +152,7 @@ const std::string LIBVIRT_DOMAIN_TEMPLATE = R"(<domain type="kvm">
 // {{MEMORY_KB}} - Memory in KiB (e.g., "4194304" for 4GB)
 // {{CPU_COUNT}} - Number of CPU cores (e.g., "4")
 // {{DISK_PATH}} - Path to the VM disk image (e.g., "/var/lib/libvirt/images/LSWVM.qcow2")
+// {{DISK_FORMAT}} - Format of the VM disk image ("qcow2" or "raw")
 // {{WINDOWS_ISO_PATH}} - Path to Windows installer ISO
 // {{AUTOUNATTEND_ISO_PATH}} - Path to autounattend ISO (e.g., "/tmp/autounattend.iso")
 // {{VIRTIO_ISO_PATH}} - Path to VirtIO guest tools ISO (e.g.,
@@ -0,0 +1,54 @@
+#pragma once
+
+namespace offline_apply_templates {
+
+// autounattend.xml for the one Windows PE boot of an offline-applied VM: Setup only runs the
+// boot script from the autounattend ISO, which restarts the VM before Setup goes any further
+inline constexpr const char* boot_unattend_xml = R"XML(<?xml version="1.0" encoding="utf-8"?>
+<unattend xmlns="urn:schemas-microsoft-com:unattend" xmlns:wcm="http://schemas.microsoft.com/WMIConfig/2002/State">
+	<settings pass="windowsPE">
+		<component name="Microsoft-Windows-International-Core-WinPE" processorArchitecture="amd64" publicKeyToken="31bf3856ad364e35" language="neutral" versionScope="nonSxS">
+			<UILanguage>en-US</UILanguage>
+		</component>
+		<component name="Microsoft-Windows-Setup" processorArchitecture="amd64" publicKeyToken="31bf3856ad364e35" language="neutral" versionScope="nonSxS">
+			<RunSynchronous>
+				<RunSynchronousCommand wcm:action="add">
+					<Order>1</Order>
+					<Path>cmd.exe /c "for %d in (C D E F G H I J K L M N O P Q R S T U V W Y Z) do if exist %d:\lsw-apply.cmd call %d:\lsw-apply.cmd"</Path>
+				</RunSynchronousCommand>
+			</RunSynchronous>
+		</component>
+	</settings>
+</unattend>
+)XML";
+
+// lsw-apply.cmd: runs in Windows PE from the autounattend ISO. Loads the VirtIO storage driver to
+// reach the applied system, stages the drivers into it, writes the boot configuration that only
+// Windows tools can create and activates the partition, then restarts into specialize and OOBE.
+inline constexpr const char* boot_script = R"CMD(@echo off
+set MEDIA=%~d0
+for /r "%MEDIA%\drivers" %%f in (*.inf) do drvload "%%f"
+
+set SYSTEM=
+set INSTALLER=
+for %%d in (C D E F G H I J K L M N O P Q R S T U V W Y Z) do (
+    if exist %%d:\Windows\Panther\lsw-apply.tag set SYSTEM=%%d:
+    if exist %%d:\boot\bootsect.exe set INSTALLER=%%d:
+)
+if "%SYSTEM%"=="" (
+    echo The applied Windows installation was not found
+    exit /b 1
+)
+
+dism /Image:%SYSTEM%\ /Add-Driver /Driver:"%MEDIA%\drivers" /Recurse
+bcdboot %SYSTEM%\Windows /s %SYSTEM% /f BIOS
+if not "%INSTALLER%"=="" %INSTALLER%\boot\bootsect.exe /nt60 %SYSTEM% /mbr
+rem Until its partition is active the disk falls through to this media; now it can boot
+> X:\lsw-active.txt echo select volume %SYSTEM:~0,1%
+>> X:\lsw-active.txt echo active
+diskpart /s X:\lsw-active.txt
+del %SYSTEM%\Windows\Panther\lsw-apply.tag
+wpeutil reboot
+)CMD";
+
+} // namespace offline_apply_templates
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Cooperative cancellation for long-running workloads. A token is cancelled either explicitly
+// (e.g. by a cancel frame from the client) or implicitly once its deadline passes. Workloads
+// poll is_cancelled() between steps and use wait_for() instead of sleeping, so both wake them
+// immediately. Callbacks let blocking operations (subprocesses, libvirt waits) be interrupted;
+// a token with a deadline keeps a timer thread so they also run when the deadline passes.
+class cancellation_token {
+public:
+    using clock = std::chrono::steady_clock;
+    using callback_id = std::size_t;
+
+    cancellation_token() = default;
+
+    ~cancellation_token() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_destroying = true;
+        }
+        m_condition.notify_all();
+        if (!m_timer.joinable()) {
+            return;
+        }
+        // A deadline callback may drop the last reference to the token; cancel() touches no
+        // member once its callbacks run, so the timer thread can be left to finish on its own
+        if (m_timer.get_id() == std::this_thread::get_id()) {
+            m_timer.detach();
+        } else {
+            m_timer.join();
+        }
+    }
+
+    cancellation_token(const cancellation_token&) = delete;
+    cancellation_token& operator=(const cancellation_token&) = delete;
+
+    cancellation_token(cancellation_token&&) = delete;
+    cancellation_token& operator=(cancellation_token&&) = delete;
+
+    void set_deadline(clock::time_point deadline) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_deadline = deadline;
+        m_has_deadline = true;
+        m_condition.notify_all();
+        if (!m_timer.joinable()) {
+            m_timer = std::thread([this]() { run_timer(); });
+        }
+    }
+
+    bool has_deadline() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_has_deadline;
+    }
+
+    clock::time_point get_deadline() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_has_deadline ? m_deadline : clock::time_point::max();
+    }
+
+    // Request cancellation. Registered callbacks run once, on the calling thread (the timer
+    // thread when the deadline passes).
+    void cancel(const std::string& reason = "Cancelled") {
+        std::map<callback_id, std::function<void()>> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_cancelled) {
+                return;
+            }
+            m_cancelled = true;
+            m_reason = reason;
+            callbacks.swap(m_callbacks);
+        }
+        m_condition.notify_all();
+
+        for (auto& [id, callback] : callbacks) {
+            callback();
+        }
+    }
+
+    bool is_cancelled() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_cancelled || deadline_passed();
+    }
+
+    std::string get_reason() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_cancelled) {
+            return m_reason;
+        }
+        return deadline_passed() ? "Deadline exceeded" : "";
+    }
+
+    // Interruptible sleep. Returns true if the token was cancelled (or expired) while waiting.
+    template <typename RepT, typename PeriodT>
+    bool wait_for(std::chrono::duration<RepT, PeriodT> duration) const {
+        return wait_until(clock::now() +
+                          std::chrono::duration_cast<clock::duration>(duration));
+    }
+
+    bool wait_until(clock::time_point time_point) const {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_cancelled && !deadline_passed()) {
+            clock::time_point wake = time_point;
+            if (m_has_deadline && m_deadline < wake) {
+                wake = m_deadline;
+            }
+            if (m_condition.wait_until(lock, wake) == std::cv_status::timeout &&
+                clock::now() >= time_point) {
+                break;
+            }
+        }
+        return m_cancelled || deadline_passed();
+    }
+
+    // Register a callback to run on cancellation, explicit or by the deadline. If the token is
+    // already cancelled the callback runs immediately and 0 is returned. Const like wait_for: workloads only see
+    // a const token but still need to interrupt their blocking waits.
+    callback_id add_callback(std::function<void()> callback) const {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_cancelled && !deadline_passed()) {
+                callback_id id = ++m_next_callback_id;
+                m_callbacks.emplace(id, std::move(callback));
+                return id;
+            }
+        }
+        callback();
+        return 0;
+    }
+
+    void remove_callback(callback_id id) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_callbacks.erase(id);
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable m_condition;
+    bool m_cancelled = false;
+    bool m_has_deadline = false;
+    bool m_destroying = false;
+    clock::time_point m_deadline;
+    std::thread m_timer;
+    std::string m_reason;
+    mutable callback_id m_next_callback_id = 0;
+    mutable std::map<callback_id, std::function<void()>> m_callbacks;
+
+    bool deadline_passed() const {
+        return m_has_deadline && clock::now() >= m_deadline;
+    }
+
+    // Cancels the token once the deadline passes, so callbacks run for deadlines too
+    void run_timer() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_cancelled && !m_destroying) {
+            if (deadline_passed()) {
+                lock.unlock();
+                cancel("Deadline exceeded");
+                return;
+            }
+            m_condition.wait_until(lock, m_deadline);
+        }
+    }
+};
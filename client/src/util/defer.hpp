@@ -27,7 +27,8 @@ auto make_deferred(FunctionT&& function) {
 }
 
 #define UNIQUE_VAR_NAME(prefix) UNIQUE_VAR_NAME_IMPL(prefix, __COUNTER__)
-#define UNIQUE_VAR_NAME_IMPL(prefix, counter) prefix##counter
+#define UNIQUE_VAR_NAME_IMPL(prefix, counter) UNIQUE_VAR_NAME_CONCAT(prefix, counter)
+#define UNIQUE_VAR_NAME_CONCAT(prefix, counter) prefix##counter
 
 #define DEFER_IMPL(varname, content) auto varname = make_deferred([&]() { content })
 #define DEFER(content) DEFER_IMPL(UNIQUE_VAR_NAME(__deferred_holder_), content)
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "util/process.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+constexpr auto POLL_INTERVAL = std::chrono::milliseconds(50);
+constexpr auto TERMINATE_GRACE_PERIOD = std::chrono::seconds(3);
+} // namespace
+
+namespace process {
+
+int run(const std::string& command, const cancellation_token& token) {
+    if (token.is_cancelled()) {
+        return CANCELLED_EXIT_CODE;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        std::cerr << "[Process] Failed to fork: " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    if (pid == 0) {
+        // Own process group, so a cancel reaches every process the shell spawns
+        setpgid(0, 0);
+        execl("/bin/sh", "sh", "-c", command.c_str(), nullptr);
+        _exit(127);
+    }
+    setpgid(pid, pid);
+
+    bool terminating = false;
+    auto terminate_deadline = cancellation_token::clock::time_point::max();
+
+    while (true) {
+        int status = 0;
+        pid_t result = waitpid(pid, &status, WNOHANG);
+        if (result == pid) {
+            if (terminating) {
+                std::cout << "[Process] Command cancelled: " << command << std::endl;
+                return CANCELLED_EXIT_CODE;
+            }
+            return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        }
+        if (result == -1 && errno != EINTR) {
+            std::cerr << "[Process] waitpid failed: " << strerror(errno) << std::endl;
+            return -1;
+        }
+
+        if (!terminating && token.is_cancelled()) {
+            kill(-pid, SIGTERM);
+            terminating = true;
+            terminate_deadline = cancellation_token::clock::now() + TERMINATE_GRACE_PERIOD;
+        } else if (terminating && cancellation_token::clock::now() >= terminate_deadline) {
+            kill(-pid, SIGKILL);
+            terminate_deadline = cancellation_token::clock::time_point::max();
+        }
+
+        if (terminating) {
+            std::this_thread::sleep_for(POLL_INTERVAL);
+        } else {
+            token.wait_for(POLL_INTERVAL);
+        }
+    }
+}
+
+std::string quote(const std::string& text) {
+    std::string quoted = "'";
+    for (char c : text) {
+        if (c == '\'') {
+            quoted += "'\\''";
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "'";
+}
+
+} // namespace process
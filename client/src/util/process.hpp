@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include "util/cancellation.hpp"
+
+namespace process {
+
+// Exit code reported when the command was interrupted by its cancellation token
+constexpr int CANCELLED_EXIT_CODE = -2;
+
+// Run a shell command like system(), but in its own process group so that cancelling the token
+// terminates the whole command (SIGTERM, then SIGKILL after a grace period). Returns the exit
+// status, -1 if the command could not be started, or CANCELLED_EXIT_CODE if it was cancelled.
+int run(const std::string& command, const cancellation_token& token);
+
+// Quote text as a single shell word
+std::string quote(const std::string& text);
+
+} // namespace process
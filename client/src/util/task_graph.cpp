@@ -0,0 +1,137 @@
+#include "util/task_graph.hpp"
+
+#include <exception>
+#include <thread>
+
+task_graph::task_id task_graph::add(std::string name, task_function run,
+                                    std::vector<task_id> dependencies) {
+    task entry;
+    entry.name = std::move(name);
+    entry.run = std::move(run);
+    entry.dependencies = std::move(dependencies);
+    m_tasks.push_back(std::move(entry));
+    return m_tasks.size() - 1;
+}
+
+bool task_graph::run(const cancellation_token& token, std::string& error,
+                     const finished_callback& on_finished) {
+    // Cancellation only stops new tasks; the condition variable is not the token's, so wake it
+    cancellation_token::callback_id callback = token.add_callback([this]() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_condition.notify_all();
+    });
+
+    std::vector<std::thread> threads;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_start = std::chrono::steady_clock::now();
+    m_failed = false;
+    m_error.clear();
+
+    while (true) {
+        bool stopping = m_failed || token.is_cancelled();
+        if (!stopping) {
+            for (task_id id = 0; id < m_tasks.size(); id++) {
+                task& entry = m_tasks[id];
+                if (entry.status != state::pending || !is_ready(entry)) {
+                    continue;
+                }
+                entry.status = state::running;
+                entry.started = std::chrono::steady_clock::now();
+                m_running++;
+                threads.emplace_back([this, id, &on_finished]() {
+                    // A throwing task fails like any other instead of ending the process
+                    std::string task_error;
+                    bool succeeded = false;
+                    try {
+                        succeeded = m_tasks[id].run(task_error);
+                    } catch (const std::exception& e) {
+                        task_error = e.what();
+                    } catch (...) {
+                        task_error = "unknown exception";
+                    }
+
+                    timing finished;
+                    size_t finished_count;
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        task& entry = m_tasks[id];
+                        entry.finished = std::chrono::steady_clock::now();
+                        entry.status = succeeded ? state::completed : state::failed;
+                        if (!succeeded && !m_failed) {
+                            m_failed = true;
+                            m_error = task_error.empty() ? entry.name + " failed" : task_error;
+                        }
+                        m_running--;
+                        finished_count = ++m_finished;
+                        finished = make_timing(entry);
+                    }
+                    m_condition.notify_all();
+                    if (on_finished) {
+                        on_finished(finished, finished_count, m_tasks.size());
+                    }
+                });
+            }
+        }
+
+        if (m_running == 0) {
+            break;
+        }
+        m_condition.wait(lock);
+    }
+
+    // Whatever never got to run
+    bool succeeded = !m_failed && !token.is_cancelled();
+    for (task& entry : m_tasks) {
+        if (entry.status == state::pending) {
+            entry.status = state::skipped;
+            succeeded = false;
+        }
+    }
+    if (!succeeded) {
+        error = m_failed ? m_error : token.get_reason();
+    }
+    lock.unlock();
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    token.remove_callback(callback);
+    return succeeded;
+}
+
+std::vector<task_graph::timing> task_graph::timings() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<timing> result;
+    for (const task& entry : m_tasks) {
+        result.push_back(make_timing(entry));
+    }
+    return result;
+}
+
+bool task_graph::is_ready(const task& entry) const {
+    for (task_id dependency : entry.dependencies) {
+        if (m_tasks[dependency].status != state::completed) {
+            return false;
+        }
+    }
+    return true;
+}
+
+task_graph::timing task_graph::make_timing(const task& entry) const {
+    timing result;
+    result.name = entry.name;
+    switch (entry.status) {
+    case state::completed:
+        result.status = "completed";
+        break;
+    case state::failed:
+        result.status = "failed";
+        break;
+    default:
+        result.status = "skipped";
+        return result;
+    }
+    result.start_seconds = std::chrono::duration<double>(entry.started - m_start).count();
+    result.seconds = std::chrono::duration<double>(entry.finished - entry.started).count();
+    return result;
+}
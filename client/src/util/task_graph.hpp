@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "util/cancellation.hpp"
+
+// Runs a handful of dependent steps, each on its own thread as soon as everything it depends on
+// has succeeded. Meant for workloads made of a few slow, mostly independent steps (disk
+// creation, ISO builds, downloads) rather than for fine-grained parallelism: there is no pool,
+// and a graph runs once.
+class task_graph {
+public:
+    using task_id = size_t;
+    // Returns false and sets error on failure; should give up early once the token is cancelled.
+    // A task that throws counts as failed, with the exception's message as its error.
+    using task_function = std::function<bool(std::string& error)>;
+
+    struct timing {
+        std::string name;
+        double start_seconds = 0.0; // since run() started
+        double seconds = 0.0;
+        std::string status; // "completed", "failed" or "skipped"
+    };
+
+    // Called on the task's thread after each task finishes, with the number finished so far
+    using finished_callback =
+        std::function<void(const timing& task, size_t finished, size_t total)>;
+
+    task_graph() = default;
+
+    task_graph(const task_graph&) = delete;
+    task_graph& operator=(const task_graph&) = delete;
+
+    task_graph(task_graph&&) = delete;
+    task_graph& operator=(task_graph&&) = delete;
+
+    // Dependencies must have been added before
+    task_id add(std::string name, task_function run, std::vector<task_id> dependencies = {});
+
+    // Run every task and wait for all started ones. Stops starting tasks after the first
+    // failure or cancellation; error is the first failed task's, or "<name> failed" if it gave
+    // none (timings() tell which one).
+    bool run(const cancellation_token& token, std::string& error,
+             const finished_callback& on_finished = nullptr);
+
+    // Per-task timings of the last run, in the order tasks were added
+    std::vector<timing> timings() const;
+
+private:
+    enum class state { pending, running, completed, failed, skipped };
+
+    struct task {
+        std::string name;
+        task_function run;
+        std::vector<task_id> dependencies;
+        state status = state::pending;
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::time_point finished;
+    };
+
+    std::vector<task> m_tasks;
+    std::chrono::steady_clock::time_point m_start;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    size_t m_running = 0;
+    size_t m_finished = 0;
+    bool m_failed = false;
+    std::string m_error; // of the first failed task
+
+    bool is_ready(const task& entry) const;
+    timing make_timing(const task& entry) const;
+};
@@ -0,0 +1,128 @@
+#include "util/thread_pool.hpp"
+
+#include <iostream>
+
+thread_pool::thread_pool(std::string name) : m_name(std::move(name)) {}
+
+thread_pool::~thread_pool() {
+    shutdown();
+}
+
+bool thread_pool::start(size_t thread_count, stats_callback on_stats) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_threads.empty()) {
+        std::cerr << "[Pool:" << m_name << "] Already started" << std::endl;
+        return false;
+    }
+
+    m_on_stats = std::move(on_stats);
+    m_stopping = false;
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    for (size_t i = 0; i < thread_count; i++) {
+        m_threads.emplace_back(&thread_pool::thread_main, this);
+    }
+
+    std::cout << "[Pool:" << m_name << "] Started " << thread_count << " thread(s)" << std::endl;
+    return true;
+}
+
+bool thread_pool::submit(task work) {
+    size_t queued;
+    size_t active;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping || m_threads.empty()) {
+            return false;
+        }
+        m_queue.push_back(std::move(work));
+        queued = m_queue.size();
+        active = m_active;
+    }
+    m_condition.notify_one();
+
+    report_stats(queued, active);
+    return true;
+}
+
+void thread_pool::shutdown() {
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        threads.swap(m_threads);
+    }
+    m_condition.notify_all();
+
+    if (threads.empty()) {
+        return;
+    }
+
+    std::cout << "[Pool:" << m_name << "] Draining " << get_queue_depth() << " queued task(s)"
+              << std::endl;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::cout << "[Pool:" << m_name << "] Stopped" << std::endl;
+}
+
+size_t thread_pool::get_thread_count() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_threads.size();
+}
+
+size_t thread_pool::get_queue_depth() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queue.size();
+}
+
+size_t thread_pool::get_active_count() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_active;
+}
+
+void thread_pool::thread_main() {
+    while (true) {
+        task work;
+        size_t queued;
+        size_t active;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+
+            // Keep running queued tasks while stopping so shutdown drains the queue
+            if (m_queue.empty()) {
+                return;
+            }
+
+            work = std::move(m_queue.front());
+            m_queue.pop_front();
+            queued = m_queue.size();
+            active = ++m_active;
+        }
+        report_stats(queued, active);
+
+        try {
+            work();
+        } catch (const std::exception& e) {
+            std::cerr << "[Pool:" << m_name << "] Exception in task: " << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "[Pool:" << m_name << "] Unknown exception in task" << std::endl;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            queued = m_queue.size();
+            active = --m_active;
+        }
+        report_stats(queued, active);
+    }
+}
+
+void thread_pool::report_stats(size_t queued, size_t active) {
+    if (m_on_stats) {
+        m_on_stats(queued, active);
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads fed from a FIFO queue. The worker runs one pool per
+// priority lane so that long-running workloads cannot starve quick ones.
+class thread_pool {
+public:
+    using task = std::function<void()>;
+    // Called with (queued, active) whenever either changes
+    using stats_callback = std::function<void(size_t queued, size_t active)>;
+
+    explicit thread_pool(std::string name);
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    thread_pool(thread_pool&&) = delete;
+    thread_pool& operator=(thread_pool&&) = delete;
+
+    bool start(size_t thread_count, stats_callback on_stats = nullptr);
+
+    // Queue a task. Returns false once the pool is shutting down.
+    bool submit(task work);
+
+    // Stop accepting work, let the threads finish everything already queued and join them
+    void shutdown();
+
+    size_t get_thread_count() const;
+    size_t get_queue_depth() const;
+    size_t get_active_count() const;
+
+private:
+    std::string m_name;
+    std::vector<std::thread> m_threads;
+    std::deque<task> m_queue;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    stats_callback m_on_stats;
+    size_t m_active = 0;
+    bool m_stopping = false;
+
+    void thread_main();
+    void report_stats(size_t queued, size_t active);
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// XXH64 (one-shot), for fast non-cryptographic fingerprints of file contents. Produces the same
+// values as the reference xxHash implementation.
+namespace xxhash {
+
+namespace detail {
+constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t read64(const uint8_t* data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value; // little-endian hosts only, like the rest of the on-disk formats here
+}
+
+inline uint32_t read32(const uint8_t* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+inline uint64_t round(uint64_t accumulator, uint64_t input) {
+    accumulator += input * PRIME2;
+    accumulator = rotl(accumulator, 31);
+    return accumulator * PRIME1;
+}
+
+inline uint64_t merge_round(uint64_t accumulator, uint64_t value) {
+    accumulator ^= round(0, value);
+    return accumulator * PRIME1 + PRIME4;
+}
+} // namespace detail
+
+inline uint64_t hash64(const void* input, size_t length, uint64_t seed = 0) {
+    using namespace detail;
+
+    const auto* data = static_cast<const uint8_t*>(input);
+    const uint8_t* end = data + length;
+    uint64_t hash;
+
+    if (length >= 32) {
+        uint64_t v1 = seed + PRIME1 + PRIME2;
+        uint64_t v2 = seed + PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME1;
+        const uint8_t* limit = end - 32;
+        do {
+            v1 = round(v1, read64(data));
+            v2 = round(v2, read64(data + 8));
+            v3 = round(v3, read64(data + 16));
+            v4 = round(v4, read64(data + 24));
+            data += 32;
+        } while (data <= limit);
+
+        hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        hash = merge_round(hash, v1);
+        hash = merge_round(hash, v2);
+        hash = merge_round(hash, v3);
+        hash = merge_round(hash, v4);
+    } else {
+        hash = seed + PRIME5;
+    }
+
+    hash += static_cast<uint64_t>(length);
+
+    while (data + 8 <= end) {
+        hash ^= round(0, read64(data));
+        hash = rotl(hash, 27) * PRIME1 + PRIME4;
+        data += 8;
+    }
+    if (data + 4 <= end) {
+        hash ^= static_cast<uint64_t>(read32(data)) * PRIME1;
+        hash = rotl(hash, 23) * PRIME2 + PRIME3;
+        data += 4;
+    }
+    while (data < end) {
+        hash ^= (*data) * PRIME5;
+        hash = rotl(hash, 11) * PRIME1;
+        data++;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+} // namespace xxhash
@@ -0,0 +1,449 @@
+#include "vm_event_monitor.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "telemetry_ring.hpp"
+
+namespace {
+// The event loop wakes at least this often to notice stop(), sample stats and reconnect
+constexpr int TICK_MS = 250;
+constexpr auto RECONNECT_INTERVAL = std::chrono::seconds(5);
+
+std::once_flag g_event_impl_once;
+
+const char* lifecycle_event_name(int event) {
+    switch (event) {
+    case VIR_DOMAIN_EVENT_DEFINED:
+        return "defined";
+    case VIR_DOMAIN_EVENT_UNDEFINED:
+        return "undefined";
+    case VIR_DOMAIN_EVENT_STARTED:
+        return "started";
+    case VIR_DOMAIN_EVENT_SUSPENDED:
+        return "suspended";
+    case VIR_DOMAIN_EVENT_RESUMED:
+        return "resumed";
+    case VIR_DOMAIN_EVENT_STOPPED:
+        return "stopped";
+    case VIR_DOMAIN_EVENT_SHUTDOWN:
+        return "shutdown";
+    case VIR_DOMAIN_EVENT_PMSUSPENDED:
+        return "pmsuspended";
+    case VIR_DOMAIN_EVENT_CRASHED:
+        return "crashed";
+    default:
+        return "unknown";
+    }
+}
+
+bool has_suffix(const char* value, const char* suffix) {
+    size_t value_length = strlen(value);
+    size_t suffix_length = strlen(suffix);
+    return value_length >= suffix_length &&
+           strcmp(value + value_length - suffix_length, suffix) == 0;
+}
+
+uint64_t typed_param_as_u64(const virTypedParameter& param) {
+    switch (param.type) {
+    case VIR_TYPED_PARAM_UINT:
+        return param.value.ui;
+    case VIR_TYPED_PARAM_ULLONG:
+        return param.value.ul;
+    case VIR_TYPED_PARAM_LLONG:
+        return param.value.l > 0 ? static_cast<uint64_t>(param.value.l) : 0;
+    case VIR_TYPED_PARAM_INT:
+        return param.value.i > 0 ? static_cast<uint64_t>(param.value.i) : 0;
+    default:
+        return 0;
+    }
+}
+
+double rate_per_second(uint64_t current, uint64_t previous, double elapsed_seconds) {
+    if (elapsed_seconds <= 0.0 || current < previous) {
+        return 0.0;
+    }
+    return static_cast<double>(current - previous) / elapsed_seconds;
+}
+} // namespace
+
+vm_event_monitor::~vm_event_monitor() {
+    stop();
+}
+
+bool vm_event_monitor::start(const std::string& uri) {
+    if (m_running) {
+        return true;
+    }
+
+    // libvirt dispatches events through one process-wide loop implementation, which has to be
+    // registered before the first connection is opened
+    bool registered = true;
+    std::call_once(g_event_impl_once, [&registered]() {
+        if (virEventRegisterDefaultImpl() < 0) {
+            registered = false;
+        }
+    });
+    if (!registered) {
+        std::cerr << "[VM Events] Failed to register event loop: " << virGetLastErrorMessage()
+                  << std::endl;
+        return false;
+    }
+
+    m_uri = uri;
+    m_stopping = false;
+    m_running = true;
+    m_thread = std::thread(&vm_event_monitor::thread_main, this);
+    return true;
+}
+
+void vm_event_monitor::stop() {
+    if (!m_running) {
+        return;
+    }
+
+    m_stopping = true;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    m_running = false;
+}
+
+bool vm_event_monitor::is_running() const {
+    return m_running;
+}
+
+vm_event_monitor::listener_id vm_event_monitor::add_listener(listener callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    listener_id id = ++m_next_listener_id;
+    m_listeners.emplace(id, std::move(callback));
+    return id;
+}
+
+void vm_event_monitor::remove_listener(listener_id id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_listeners.erase(id);
+}
+
+void vm_event_monitor::set_stats_interval(std::chrono::milliseconds interval) {
+    m_stats_interval_ms = interval.count() > 0 ? interval.count() : 0;
+}
+
+nlohmann::json vm_event_monitor::get_domain_states() {
+    nlohmann::json states = nlohmann::json::array();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& [vm_name, state] : m_states) {
+        states.push_back({{"vm_name", vm_name}, {"state", state}});
+    }
+    return states;
+}
+
+uint64_t vm_event_monitor::lifecycle_seq() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lifecycle_seq;
+}
+
+std::optional<vm_event_monitor::lifecycle_change> vm_event_monitor::wait_for_state(
+    const std::string& vm_name, const std::vector<std::string>& states, uint64_t after_seq,
+    cancellation_token::clock::time_point until, const cancellation_token& token) {
+    // The token has its own condition variable; wake this one when it is cancelled
+    cancellation_token::callback_id callback = token.add_callback([this]() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_state_changed.notify_all();
+    });
+    until = std::min(until, token.get_deadline());
+
+    std::optional<lifecycle_change> reached;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_state_changed.wait_until(lock, until, [&]() {
+            auto change = m_changes.find(vm_name);
+            if (change != m_changes.end() && change->second.seq > after_seq &&
+                std::find(states.begin(), states.end(), change->second.state) != states.end()) {
+                reached = change->second;
+            }
+            return reached.has_value() || token.is_cancelled();
+        });
+    }
+
+    token.remove_callback(callback);
+    return reached;
+}
+
+std::string vm_event_monitor::state_to_string(int state) {
+    // Same names get_vm_info reports
+    switch (state) {
+    case VIR_DOMAIN_RUNNING:
+        return "running";
+    case VIR_DOMAIN_BLOCKED:
+        return "blocked";
+    case VIR_DOMAIN_PAUSED:
+        return "paused";
+    case VIR_DOMAIN_SHUTDOWN:
+        return "shutdown";
+    case VIR_DOMAIN_SHUTOFF:
+        return "shutoff";
+    case VIR_DOMAIN_CRASHED:
+        return "crashed";
+    case VIR_DOMAIN_PMSUSPENDED:
+        return "suspended";
+    default:
+        return "unknown";
+    }
+}
+
+void vm_event_monitor::thread_main() {
+    m_tick_timer = virEventAddTimeout(TICK_MS, on_tick, this, nullptr);
+    if (m_tick_timer < 0) {
+        std::cerr << "[VM Events] Failed to add event loop timer: " << virGetLastErrorMessage()
+                  << std::endl;
+        return;
+    }
+
+    open_connection();
+
+    // Each iteration blocks until libvirt has an event to dispatch or the tick timer fires
+    while (!m_stopping) {
+        if (virEventRunDefaultImpl() < 0) {
+            std::cerr << "[VM Events] Event loop failed: " << virGetLastErrorMessage()
+                      << std::endl;
+            break;
+        }
+    }
+
+    close_connection();
+    virEventRemoveTimeout(m_tick_timer);
+    m_tick_timer = -1;
+}
+
+bool vm_event_monitor::open_connection() {
+    m_last_connect_attempt = std::chrono::steady_clock::now();
+
+    m_connection = virConnectOpen(m_uri.c_str());
+    if (!m_connection) {
+        std::cerr << "[VM Events] Failed to connect to " << m_uri << ", retrying in "
+                  << RECONNECT_INTERVAL.count() << "s" << std::endl;
+        return false;
+    }
+
+    m_lifecycle_callback = virConnectDomainEventRegisterAny(
+        m_connection, nullptr, VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+        VIR_DOMAIN_EVENT_CALLBACK(on_lifecycle), this, nullptr);
+    if (m_lifecycle_callback < 0) {
+        std::cerr << "[VM Events] Failed to register lifecycle events: "
+                  << virGetLastErrorMessage() << std::endl;
+        close_connection();
+        return false;
+    }
+    virConnectRegisterCloseCallback(m_connection, on_connection_closed, this, nullptr);
+    m_connection_lost = false;
+
+    // Seed the state table once; from here on lifecycle events keep it current
+    std::map<std::string, std::string> states;
+    virDomainPtr* domains = nullptr;
+    int count = virConnectListAllDomains(m_connection, &domains, 0);
+    for (int i = 0; i < count; i++) {
+        int state;
+        int reason;
+        if (virDomainGetState(domains[i], &state, &reason, 0) == 0) {
+            states[virDomainGetName(domains[i])] = state_to_string(state);
+        }
+        virDomainFree(domains[i]);
+    }
+    free(domains);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_states.swap(states);
+    }
+
+    std::cout << "[VM Events] Watching " << m_uri << " (" << (count > 0 ? count : 0)
+              << " domains)" << std::endl;
+    return true;
+}
+
+void vm_event_monitor::close_connection() {
+    if (!m_connection) {
+        return;
+    }
+
+    if (m_lifecycle_callback >= 0) {
+        virConnectDomainEventDeregisterAny(m_connection, m_lifecycle_callback);
+        m_lifecycle_callback = -1;
+    }
+    virConnectUnregisterCloseCallback(m_connection, on_connection_closed);
+    virConnectClose(m_connection);
+    m_connection = nullptr;
+    m_previous_stats.clear();
+}
+
+void vm_event_monitor::sample_stats() {
+    // One round trip for every running domain, rather than a lookup per VM
+    virDomainStatsRecordPtr* records = nullptr;
+    unsigned int stats =
+        VIR_DOMAIN_STATS_CPU_TOTAL | VIR_DOMAIN_STATS_BLOCK | VIR_DOMAIN_STATS_INTERFACE;
+    int count = virConnectGetAllDomainStats(m_connection, stats, &records,
+                                            VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE);
+    if (count < 0) {
+        std::cerr << "[VM Events] Failed to sample domain stats: " << virGetLastErrorMessage()
+                  << std::endl;
+        return;
+    }
+
+    uint64_t now = telemetry_ring::now_ns();
+    std::unordered_map<std::string, stats_sample> samples;
+
+    for (int i = 0; i < count; i++) {
+        const virDomainStatsRecord* record = records[i];
+        stats_sample sample;
+        sample.timestamp_ns = now;
+
+        for (int p = 0; p < record->nparams; p++) {
+            const virTypedParameter& param = record->params[p];
+            if (strcmp(param.field, "cpu.time") == 0) {
+                sample.cpu_time_ns = typed_param_as_u64(param);
+            } else if (strncmp(param.field, "block.", 6) == 0) {
+                if (has_suffix(param.field, ".rd.bytes")) {
+                    sample.disk_read_bytes += typed_param_as_u64(param);
+                } else if (has_suffix(param.field, ".wr.bytes")) {
+                    sample.disk_write_bytes += typed_param_as_u64(param);
+                }
+            } else if (strncmp(param.field, "net.", 4) == 0) {
+                if (has_suffix(param.field, ".rx.bytes")) {
+                    sample.net_rx_bytes += typed_param_as_u64(param);
+                } else if (has_suffix(param.field, ".tx.bytes")) {
+                    sample.net_tx_bytes += typed_param_as_u64(param);
+                }
+            }
+        }
+
+        std::string vm_name = virDomainGetName(record->dom);
+        nlohmann::json data = {{"event", "stats"},
+                               {"vm_name", vm_name},
+                               {"cpu_time_ns", sample.cpu_time_ns},
+                               {"disk_read_bytes", sample.disk_read_bytes},
+                               {"disk_write_bytes", sample.disk_write_bytes},
+                               {"net_rx_bytes", sample.net_rx_bytes},
+                               {"net_tx_bytes", sample.net_tx_bytes}};
+
+        // Rates need two samples, so the first one after a VM starts only carries counters
+        auto previous = m_previous_stats.find(vm_name);
+        if (previous != m_previous_stats.end()) {
+            const stats_sample& last = previous->second;
+            double elapsed = static_cast<double>(now - last.timestamp_ns) / 1e9;
+            data["cpu_percent"] =
+                rate_per_second(sample.cpu_time_ns, last.cpu_time_ns, elapsed) / 1e7;
+            data["disk_read_rate"] =
+                rate_per_second(sample.disk_read_bytes, last.disk_read_bytes, elapsed);
+            data["disk_write_rate"] =
+                rate_per_second(sample.disk_write_bytes, last.disk_write_bytes, elapsed);
+            data["net_rx_rate"] = rate_per_second(sample.net_rx_bytes, last.net_rx_bytes, elapsed);
+            data["net_tx_rate"] = rate_per_second(sample.net_tx_bytes, last.net_tx_bytes, elapsed);
+        }
+
+        samples[vm_name] = sample;
+        emit({vm_name, "stats", std::move(data)});
+    }
+
+    virDomainStatsRecordListFree(records);
+    m_previous_stats.swap(samples);
+}
+
+void vm_event_monitor::emit(const vm_event& event) {
+    std::vector<listener> listeners;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& [id, callback] : m_listeners) {
+            listeners.push_back(callback);
+        }
+    }
+
+    for (const auto& callback : listeners) {
+        callback(event);
+    }
+}
+
+void vm_event_monitor::on_tick(int, void* opaque) {
+    auto* self = static_cast<vm_event_monitor*>(opaque);
+    if (self->m_stopping) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+
+    if (self->m_connection_lost) {
+        self->close_connection();
+        self->m_connection_lost = false;
+    }
+    if (!self->m_connection) {
+        if (now - self->m_last_connect_attempt >= RECONNECT_INTERVAL) {
+            self->open_connection();
+        }
+        return;
+    }
+
+    int64_t interval_ms = self->m_stats_interval_ms;
+    if (interval_ms <= 0) {
+        // Nobody wants stats; drop the baseline so rates restart cleanly later
+        self->m_previous_stats.clear();
+        return;
+    }
+    if (now - self->m_last_stats >= std::chrono::milliseconds(interval_ms)) {
+        self->m_last_stats = now;
+        self->sample_stats();
+    }
+}
+
+int vm_event_monitor::on_lifecycle(virConnectPtr, virDomainPtr domain, int event, int detail,
+                                   void* opaque) {
+    auto* self = static_cast<vm_event_monitor*>(opaque);
+    std::string vm_name = virDomainGetName(domain);
+
+    std::string state = "undefined";
+    if (event != VIR_DOMAIN_EVENT_UNDEFINED) {
+        int current_state;
+        int reason;
+        state = virDomainGetState(domain, &current_state, &reason, 0) == 0
+                    ? state_to_string(current_state)
+                    : "unknown";
+    }
+
+    // on_crash="destroy" turns a guest crash into a stop with the crashed detail
+    bool crashed = event == VIR_DOMAIN_EVENT_CRASHED ||
+                   (event == VIR_DOMAIN_EVENT_STOPPED &&
+                    (detail == VIR_DOMAIN_EVENT_STOPPED_CRASHED ||
+                     detail == VIR_DOMAIN_EVENT_STOPPED_FAILED));
+
+    {
+        std::lock_guard<std::mutex> lock(self->m_mutex);
+        if (event == VIR_DOMAIN_EVENT_UNDEFINED) {
+            self->m_states.erase(vm_name);
+        } else {
+            self->m_states[vm_name] = state;
+        }
+        self->m_changes[vm_name] = {++self->m_lifecycle_seq, lifecycle_event_name(event), state,
+                                    crashed};
+    }
+    self->m_state_changed.notify_all();
+
+    std::cout << "[VM Events] " << vm_name << ": " << lifecycle_event_name(event) << " ("
+              << state << ")" << std::endl;
+
+    nlohmann::json data = {{"event", lifecycle_event_name(event)},
+                           {"vm_name", vm_name},
+                           {"state", state},
+                           {"detail", detail}};
+    self->emit({vm_name, "lifecycle", std::move(data)});
+    return 0;
+}
+
+void vm_event_monitor::on_connection_closed(virConnectPtr, int reason, void* opaque) {
+    auto* self = static_cast<vm_event_monitor*>(opaque);
+    std::cerr << "[VM Events] Connection to libvirt lost (reason " << reason << ")" << std::endl;
+
+    // Closing the connection from inside its own close callback is not allowed; the next tick
+    // tears it down and starts reconnecting
+    self->m_connection_lost = true;
+}
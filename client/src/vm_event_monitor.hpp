@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <libvirt/libvirt.h>
+#include <nlohmann/json.hpp>
+#include "util/cancellation.hpp"
+
+// Watches libvirt for domain lifecycle events on its own connection and event loop thread, so
+// the worker learns about state changes as they happen instead of polling get_vm_info. It can
+// also sample statistics for all running domains in a single bulk call at a fixed interval.
+class vm_event_monitor {
+public:
+    struct vm_event {
+        std::string vm_name;
+        std::string type; // "lifecycle" or "stats"
+        nlohmann::json data;
+    };
+
+    // The last lifecycle event seen for a domain. seq orders events across all domains.
+    struct lifecycle_change {
+        uint64_t seq = 0;
+        std::string event; // e.g. "started", "stopped"
+        std::string state; // state right after the event, as from state_to_string
+        bool crashed = false;
+    };
+
+    using listener = std::function<void(const vm_event& event)>;
+    using listener_id = size_t;
+
+    vm_event_monitor() = default;
+    ~vm_event_monitor();
+
+    vm_event_monitor(const vm_event_monitor&) = delete;
+    vm_event_monitor& operator=(const vm_event_monitor&) = delete;
+
+    vm_event_monitor(vm_event_monitor&&) = delete;
+    vm_event_monitor& operator=(vm_event_monitor&&) = delete;
+
+    bool start(const std::string& uri = "qemu:///system");
+    void stop();
+    bool is_running() const;
+
+    // Listeners run on the monitor thread and must not block
+    listener_id add_listener(listener callback);
+    void remove_listener(listener_id id);
+
+    // 0 disables stats sampling (the default)
+    void set_stats_interval(std::chrono::milliseconds interval);
+
+    // Current state of every defined domain, as {vm_name, state} objects
+    nlohmann::json get_domain_states();
+
+    // Sequence number of the latest lifecycle event; take it before acting on a domain and
+    // pass it to wait_for_state to ignore everything that happened earlier
+    uint64_t lifecycle_seq();
+    // Block until a lifecycle event newer than after_seq leaves vm_name in one of states, the
+    // token is cancelled or until passes. Returns that event, or nothing if it did not happen.
+    std::optional<lifecycle_change> wait_for_state(const std::string& vm_name,
+                                                   const std::vector<std::string>& states,
+                                                   uint64_t after_seq,
+                                                   cancellation_token::clock::time_point until,
+                                                   const cancellation_token& token);
+
+    static std::string state_to_string(int state);
+
+private:
+    struct stats_sample {
+        uint64_t timestamp_ns = 0;
+        uint64_t cpu_time_ns = 0;
+        uint64_t disk_read_bytes = 0;
+        uint64_t disk_write_bytes = 0;
+        uint64_t net_rx_bytes = 0;
+        uint64_t net_tx_bytes = 0;
+    };
+
+    std::string m_uri;
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+    std::atomic<bool> m_stopping{false};
+
+    // Owned by the monitor thread
+    virConnectPtr m_connection = nullptr;
+    int m_lifecycle_callback = -1;
+    int m_tick_timer = -1;
+    bool m_connection_lost = false;
+    std::chrono::steady_clock::time_point m_last_connect_attempt;
+    std::chrono::steady_clock::time_point m_last_stats;
+    std::unordered_map<std::string, stats_sample> m_previous_stats;
+
+    std::mutex m_mutex;
+    std::map<listener_id, listener> m_listeners;
+    std::map<std::string, std::string> m_states; // vm name -> state, kept current by events
+    std::map<std::string, lifecycle_change> m_changes; // vm name -> latest lifecycle event
+    uint64_t m_lifecycle_seq = 0;
+    std::condition_variable m_state_changed;
+    listener_id m_next_listener_id = 0;
+    std::atomic<int64_t> m_stats_interval_ms{0};
+
+    void thread_main();
+    bool open_connection();
+    void close_connection();
+    void sample_stats();
+    void emit(const vm_event& event);
+
+    static void on_tick(int timer, void* opaque);
+    static int on_lifecycle(virConnectPtr connection, virDomainPtr domain, int event, int detail,
+                            void* opaque);
+    static void on_connection_closed(virConnectPtr connection, int reason, void* opaque);
+};
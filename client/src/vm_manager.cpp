@@ -1,14 +1,21 @@
+#include <algorithm>
+#include <cctype>
 #include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <random>
 #include <sstream>
 #include <thread>
+#include <grp.h>
+#include <pwd.h>
 #include <unistd.h>
 #include <wimlib.h>
 #include "templates/libvirt_domain_template.hpp"
+#include "util/process.hpp"
 #include "vm_manager.hpp"
 
 namespace {
@@ -65,6 +72,47 @@ std::string replace_string(std::string str, const std::string& from, const std::
     }
     return str;
 }
+
+// Golden images keep the extension of the disk they were made from
+std::string image_format(const std::string& path) {
+    return std::filesystem::path(path).extension() == ".img" ? "raw" : "qcow2";
+}
+
+// Virtual disk size in bytes: from the header of a qcow2 image, the file size of a raw one
+uint64_t image_virtual_size(const std::string& path) {
+    std::error_code ec;
+    if (image_format(path) == "raw") {
+        uint64_t size = std::filesystem::file_size(path, ec);
+        return ec ? 0 : size;
+    }
+
+    unsigned char header[32];
+    std::ifstream file(path, std::ios::binary);
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+        std::memcmp(header, "QFI\xfb", 4) != 0) {
+        return 0;
+    }
+    uint64_t size = 0;
+    for (int i = 24; i < 32; i++) { // big-endian size field
+        size = (size << 8) | header[i];
+    }
+    return size;
+}
+
+// A linked clone boots straight from its disk, so it gets no installer drive
+std::string remove_installer_drive(std::string xml) {
+    size_t start = xml.find("    <!-- Windows installer ISO (bootable) -->");
+    size_t end = xml.find("</disk>\n", start);
+    if (start != std::string::npos && end != std::string::npos) {
+        xml.erase(start, end + 8 - start);
+    }
+    return xml;
+}
+
+std::string boot_disk_first(const std::string& xml) {
+    return replace_string(xml, "    <boot dev=\"cdrom\"/>\n    <boot dev=\"hd\"/>",
+                          "    <boot dev=\"hd\"/>\n    <boot dev=\"cdrom\"/>");
+}
 } // namespace
 
 vm_manager::vm_manager() : m_connection(nullptr) {}
@@ -135,14 +183,22 @@ bool vm_manager::create_vm(const vm_config& config) {
         return false;
     }
 
-    // Create the VM
-    virDomainPtr domain = virDomainDefineXML(m_connection, xml_config.c_str());
+    return define_vm(config.name, xml_config);
+}
+
+bool vm_manager::define_vm(const std::string& vm_name, const std::string& xml) {
+    if (!is_connected()) {
+        set_error("Not connected to libvirt daemon");
+        return false;
+    }
+
+    virDomainPtr domain = virDomainDefineXML(m_connection, xml.c_str());
     if (!domain) {
         set_error("Failed to define VM: " + std::string(virGetLastErrorMessage()));
         return false;
     }
 
-    std::cout << "[VM Manager] VM '" << config.name << "' created successfully" << std::endl;
+    std::cout << "[VM Manager] VM '" << vm_name << "' created successfully" << std::endl;
     virDomainFree(domain);
     return true;
 }
@@ -227,9 +283,24 @@ bool vm_manager::delete_vm(const std::string& vm_name) {
     }
 
     // Clean up disk image
-    std::string disk_path = "/var/lib/libvirt/images/" + vm_name + ".qcow2";
-    if (std::filesystem::exists(disk_path)) {
-        std::filesystem::remove(disk_path);
+    for (const char* disk_format : {"qcow2", "raw"}) {
+        std::string disk_path = disk_image_path(vm_name, disk_format);
+        if (std::filesystem::exists(disk_path)) {
+            std::filesystem::remove(disk_path);
+        }
+    }
+
+    // And the answer files it was installed with, whatever configuration they were built for
+    std::string autounattend_prefix = vm_name + AUTOUNATTEND_ISO_INFIX;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(IMAGES_DIRECTORY, ec)) {
+        std::string file_name = entry.path().filename().string();
+        if (file_name.size() == autounattend_prefix.size() + 16 + 4 &&
+            file_name.compare(0, autounattend_prefix.size(), autounattend_prefix) == 0 &&
+            entry.path().extension() == ".iso") {
+            std::error_code ignored;
+            std::filesystem::remove(entry.path(), ignored);
+        }
     }
 
     std::cout << "[VM Manager] VM '" << vm_name << "' deleted successfully" << std::endl;
@@ -343,11 +414,15 @@ std::vector<std::string> vm_manager::list_vms() {
 }
 
 std::string vm_manager::get_last_error() const {
+    std::lock_guard<std::mutex> lock(m_error_mutex);
     return m_last_error;
 }
 
 void vm_manager::set_error(const std::string& error) {
-    m_last_error = error;
+    {
+        std::lock_guard<std::mutex> lock(m_error_mutex);
+        m_last_error = error;
+    }
     std::cerr << "[VM Manager] Error: " << error << std::endl;
 }
 
@@ -367,7 +442,8 @@ std::string vm_manager::generate_vm_xml(const vm_config& config) {
     xml = replace_string(xml, "{{VM_UUID}}", uuid);
     xml = replace_string(xml, "{{MEMORY_KB}}", std::to_string(memory_kib));
     xml = replace_string(xml, "{{CPU_COUNT}}", std::to_string(config.cpu_cores));
-    xml = replace_string(xml, "{{DISK_PATH}}", "/var/lib/libvirt/images/" + config.name + ".qcow2");
+    xml = replace_string(xml, "{{DISK_PATH}}", disk_image_path(config.name, config.disk_format));
+    xml = replace_string(xml, "{{DISK_FORMAT}}", config.disk_format);
     xml = replace_string(xml, "{{WINDOWS_ISO_PATH}}", config.iso_path);
     xml = replace_string(xml, "{{AUTOUNATTEND_ISO_PATH}}", config.autounattend_iso_path);
     xml = replace_string(xml, "{{VIRTIO_ISO_PATH}}", config.virtio_iso_path);
@@ -375,62 +451,452 @@ std::string vm_manager::generate_vm_xml(const vm_config& config) {
     xml = replace_string(xml, "{{NETWORK_NAME}}", "default");
     xml = replace_string(xml, "{{RENDER_NODE}}", "/dev/dri/by-path/pci-0000:03:00.0-render");
 
+    if (!config.backing_path.empty()) {
+        xml = remove_installer_drive(xml);
+    }
+    if (config.boot_disk_first) {
+        xml = boot_disk_first(xml);
+    }
     return xml;
 }
 
-std::string vm_manager::create_disk_image(const vm_config& config) {
-    std::string disk_path = "/var/lib/libvirt/images/" + config.name + ".qcow2";
+std::string vm_manager::disk_image_path(const std::string& vm_name,
+                                        const std::string& disk_format) {
+    return std::string(IMAGES_DIRECTORY) + "/" + vm_name +
+           (disk_format == "raw" ? ".img" : ".qcow2");
+}
+
+std::string vm_manager::autounattend_iso_path(const std::string& vm_name,
+                                              const std::string& key) {
+    return std::string(IMAGES_DIRECTORY) + "/" + vm_name + AUTOUNATTEND_ISO_INFIX + key + ".iso";
+}
 
-    // Create the disk image using qemu-img
-    std::string cmd =
-        "qemu-img create -f qcow2 " + disk_path + " " + std::to_string(config.disk_gb) + "G";
+std::string vm_manager::create_disk_image(const vm_config& config) {
+    std::string disk_path = disk_image_path(config.name, config.disk_format);
 
-    std::cout << "[VM Manager] Creating disk image: " << cmd << std::endl;
-    std::cout << "[VM Manager] Disk size: " << config.disk_gb << "GB" << std::endl;
+    if (!config.create_disk) {
+        // Prepared beforehand (e.g. by offline apply), through this same function
+        if (!std::filesystem::exists(disk_path)) {
+            set_error("Disk image was not prepared: " + disk_path);
+            return "";
+        }
+        std::cout << "[VM Manager] Using prepared disk image: " << disk_path << std::endl;
+        return disk_path;
+    }
 
-    int result = system(cmd.c_str());
-    if (result != 0) {
-        set_error("Failed to create disk image (exit code: " + std::to_string(result) + ")");
+    if (!is_connected()) {
+        set_error("Not connected to libvirt daemon");
+        return "";
+    }
+    // The installer may still be downloading; the disk does not need it
+    if (!validate_config(config, false)) {
         return "";
     }
 
-    // Verify the disk was created and has correct size
-    if (!std::filesystem::exists(disk_path)) {
-        set_error("Disk image was not created: " + disk_path);
+    virStoragePoolPtr pool = lookup_image_pool();
+    if (!pool) {
         return "";
     }
 
-    // Check disk size
-    auto file_size = std::filesystem::file_size(disk_path);
-    std::cout << "[VM Manager] Created disk size: " << file_size << " bytes" << std::endl;
+    // A disk left behind by a VM that no longer exists would make the creation fail
+    std::string volume_name = std::filesystem::path(disk_path).filename().string();
+    virStoragePoolRefresh(pool, 0);
+    virStorageVolPtr stale = virStorageVolLookupByName(pool, volume_name.c_str());
+    if (stale) {
+        std::cout << "[VM Manager] Removing stale disk image: " << disk_path << std::endl;
+        virStorageVolDelete(stale, 0);
+        virStorageVolFree(stale);
+    }
+
+    // libvirt maps allocation == capacity to falloc preallocation (qcow2) or an allocated file
+    // (raw); the flag adds qcow2 metadata preallocation
+    bool qcow2 = config.disk_format == "qcow2";
+    unsigned int flags = 0;
+    if (qcow2 && config.disk_preallocation != "off") {
+        flags |= VIR_STORAGE_VOL_CREATE_PREALLOC_METADATA;
+    }
+
+    std::string xml = generate_volume_xml(config, volume_name);
+    if (config.backing_path.empty()) {
+        std::cout << "[VM Manager] Creating disk image: " << disk_path << " (" << config.disk_gb
+                  << "GB " << config.disk_format << ", preallocation "
+                  << config.disk_preallocation << ")" << std::endl;
+    } else {
+        std::cout << "[VM Manager] Creating linked clone disk: " << disk_path << " (backed by "
+                  << config.backing_path << ")" << std::endl;
+    }
 
-    // Set proper permissions
-    std::string chown_cmd = "chown libvirt-qemu:libvirt-qemu " + disk_path;
-    int chown_result = system(chown_cmd.c_str());
-    if (chown_result != 0) {
-        std::cout << "[VM Manager] Warning: Failed to set permissions (exit code: " << chown_result
-                  << ")" << std::endl;
+    virStorageVolPtr volume = virStorageVolCreateXML(pool, xml.c_str(), flags);
+    virStoragePoolFree(pool);
+    if (!volume) {
+        set_error("Failed to create disk image: " + std::string(virGetLastErrorMessage()));
+        return "";
     }
 
+    // fallocate reserves blocks without writing them; full preallocation writes every one
+    if (config.disk_preallocation == "full" && virStorageVolWipe(volume, 0) < 0) {
+        set_error("Failed to preallocate disk image: " + std::string(virGetLastErrorMessage()));
+        virStorageVolDelete(volume, 0);
+        virStorageVolFree(volume);
+        return "";
+    }
+
+    char* volume_path = virStorageVolGetPath(volume);
+    if (volume_path) {
+        disk_path = volume_path;
+        free(volume_path);
+    }
+    virStorageVolFree(volume);
     return disk_path;
 }
 
-bool vm_manager::validate_config(const vm_config& config) {
-    if (config.name.empty()) {
-        set_error("VM name cannot be empty");
+std::string vm_manager::create_golden_image(const std::string& vm_name,
+                                            const std::string& image_name) {
+    if (!is_connected()) {
+        set_error("Not connected to libvirt daemon");
+        return "";
+    }
+    if (!validate_image_name(image_name)) {
+        return "";
+    }
+    if (!golden_image_path(image_name).empty()) {
+        set_error("Golden image '" + image_name + "' already exists");
+        return "";
+    }
+
+    virDomainPtr domain = virDomainLookupByName(m_connection, vm_name.c_str());
+    if (!domain) {
+        set_error("VM '" + vm_name + "' not found");
+        return "";
+    }
+
+    // Only a system that sysprep generalized and shut down is safe to clone
+    int state;
+    int reason;
+    if (virDomainGetState(domain, &state, &reason, 0) < 0 || state != VIR_DOMAIN_SHUTOFF) {
+        set_error("VM '" + vm_name + "' must be shut off (generalized by sysprep)");
+        virDomainFree(domain);
+        return "";
+    }
+
+    std::string disk_path;
+    for (const char* disk_format : {"qcow2", "raw"}) {
+        std::string path = disk_image_path(vm_name, disk_format);
+        if (std::filesystem::exists(path)) {
+            disk_path = path;
+            break;
+        }
+    }
+    if (disk_path.empty()) {
+        set_error("VM '" + vm_name + "' has no disk image in " + std::string(IMAGES_DIRECTORY));
+        virDomainFree(domain);
+        return "";
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(GOLDEN_DIRECTORY, ec);
+    std::string golden_path = std::string(GOLDEN_DIRECTORY) + "/" + image_name +
+                              std::filesystem::path(disk_path).extension().string();
+    std::filesystem::rename(disk_path, golden_path, ec);
+    if (ec) {
+        set_error("Failed to move " + disk_path + " to " + golden_path + ": " + ec.message());
+        virDomainFree(domain);
+        return "";
+    }
+
+    // The VM would write to the image every clone reads from
+    if (virDomainUndefine(domain) < 0) {
+        set_error("Failed to undefine VM '" + vm_name +
+                  "': " + std::string(virGetLastErrorMessage()));
+        std::filesystem::rename(golden_path, disk_path, ec);
+        virDomainFree(domain);
+        return "";
+    }
+    virDomainFree(domain);
+
+    std::filesystem::permissions(golden_path,
+                                 std::filesystem::perms::owner_read |
+                                     std::filesystem::perms::group_read |
+                                     std::filesystem::perms::others_read,
+                                 ec);
+
+    // The moved disk is still listed as a volume of the images pool
+    virStoragePoolPtr pool = virStoragePoolLookupByTargetPath(m_connection, IMAGES_DIRECTORY);
+    if (pool) {
+        virStoragePoolRefresh(pool, 0);
+        virStoragePoolFree(pool);
+    }
+
+    std::cout << "[VM Manager] VM '" << vm_name << "' is now golden image '" << image_name
+              << "': " << golden_path << std::endl;
+    return golden_path;
+}
+
+std::string vm_manager::golden_image_path(const std::string& image_name) {
+    for (const char* extension : {".qcow2", ".img"}) {
+        std::string path = std::string(GOLDEN_DIRECTORY) + "/" + image_name + extension;
+        if (std::filesystem::exists(path)) {
+            return path;
+        }
+    }
+    return "";
+}
+
+bool vm_manager::flatten_vm(const std::string& vm_name, const cancellation_token& token,
+                            const flatten_progress& on_progress) {
+    if (!is_connected()) {
+        set_error("Not connected to libvirt daemon");
+        return false;
+    }
+
+    // Linked clones are always qcow2
+    std::string disk_path = disk_image_path(vm_name, "qcow2");
+    virDomainPtr domain = virDomainLookupByName(m_connection, vm_name.c_str());
+    if (!domain) {
+        set_error("VM '" + vm_name + "' not found");
+        return false;
+    }
+    if (!std::filesystem::exists(disk_path)) {
+        set_error("VM '" + vm_name + "' has no qcow2 disk to flatten");
+        virDomainFree(domain);
+        return false;
+    }
+
+    int state;
+    int reason;
+    bool live = virDomainGetState(domain, &state, &reason, 0) == 0 &&
+                (state == VIR_DOMAIN_RUNNING || state == VIR_DOMAIN_PAUSED);
+    std::cout << "[VM Manager] Flattening disk of VM '" << vm_name << "' ("
+              << (live ? "block pull" : "rebase") << ")" << std::endl;
+
+    if (!live) {
+        virDomainFree(domain);
+        // Rebasing onto no backing file copies every cluster the overlay still reads from it.
+        // Safe mode only switches the header once the data is in, so stopping early is harmless.
+        int exit_code =
+            process::run("qemu-img rebase -f qcow2 -b '' " + process::quote(disk_path), token);
+        if (exit_code == process::CANCELLED_EXIT_CODE) {
+            set_error("Flattening was cancelled");
+            return false;
+        }
+        if (exit_code != 0) {
+            set_error("qemu-img rebase failed with exit code " + std::to_string(exit_code));
+            return false;
+        }
+        std::cout << "[VM Manager] VM '" << vm_name << "' no longer needs its golden image"
+                  << std::endl;
+        return true;
+    }
+
+    // Pull rather than commit: committing would write this clone's changes into the golden
+    // image every other clone shares
+    if (virDomainBlockPull(domain, "vda", 0, 0) < 0) {
+        set_error("Failed to start block pull: " + std::string(virGetLastErrorMessage()));
+        virDomainFree(domain);
+        return false;
+    }
+
+    while (true) {
+        virDomainBlockJobInfo info;
+        int status = virDomainGetBlockJobInfo(domain, "vda", &info, 0);
+        if (status < 0) {
+            set_error("Failed to query block pull: " + std::string(virGetLastErrorMessage()));
+            virDomainFree(domain);
+            return false;
+        }
+        if (status == 0) {
+            break; // the job is gone once the overlay stands alone
+        }
+        if (on_progress) {
+            on_progress(info.cur, info.end);
+        }
+        if (token.wait_for(std::chrono::milliseconds(500))) {
+            virDomainBlockJobAbort(domain, "vda", 0);
+            set_error("Flattening was cancelled");
+            virDomainFree(domain);
+            return false;
+        }
+    }
+    virDomainFree(domain);
+
+    std::cout << "[VM Manager] VM '" << vm_name << "' no longer needs its golden image"
+              << std::endl;
+    return true;
+}
+
+virStoragePoolPtr vm_manager::lookup_image_pool() {
+    virStoragePoolPtr pool = virStoragePoolLookupByTargetPath(m_connection, IMAGES_DIRECTORY);
+    if (!pool) {
+        // No pool defined over the directory: use a transient one, as virt-install does
+        std::string xml = std::string("<pool type=\"dir\"><name>lsw-images</name><target><path>") +
+                          IMAGES_DIRECTORY + "</path></target></pool>";
+        pool = virStoragePoolCreateXML(m_connection, xml.c_str(), 0);
+        if (!pool) {
+            set_error("Failed to open storage pool for " + std::string(IMAGES_DIRECTORY) + ": " +
+                      std::string(virGetLastErrorMessage()));
+            return nullptr;
+        }
+    }
+
+    if (virStoragePoolIsActive(pool) == 0 && virStoragePoolCreate(pool, 0) < 0) {
+        set_error("Failed to start storage pool: " + std::string(virGetLastErrorMessage()));
+        virStoragePoolFree(pool);
+        return nullptr;
+    }
+    return pool;
+}
+
+std::string vm_manager::generate_volume_xml(const vm_config& config,
+                                            const std::string& volume_name) {
+    bool qcow2 = config.disk_format == "qcow2";
+    bool allocate = config.disk_preallocation == "falloc" || config.disk_preallocation == "full";
+
+    // An overlay smaller than its backing file would cut the golden system volume short
+    uint64_t capacity = static_cast<uint64_t>(config.disk_gb) << 30;
+    if (!config.backing_path.empty()) {
+        capacity = std::max(capacity, image_virtual_size(config.backing_path));
+    }
+
+    std::ostringstream xml;
+    xml << "<volume>\n"
+        << "  <name>" << volume_name << "</name>\n"
+        << "  <capacity unit=\"bytes\">" << capacity << "</capacity>\n"
+        << "  <allocation unit=\"bytes\">" << (allocate ? capacity : 0) << "</allocation>\n"
+        << "  <target>\n"
+        << "    <format type=\"" << config.disk_format << "\"/>\n";
+    if (qcow2) {
+        xml << "    <compat>1.1</compat>\n";
+        if (config.disk_cluster_kib > 0) {
+            xml << "    <clusterSize unit=\"KiB\">" << config.disk_cluster_kib
+                << "</clusterSize>\n";
+        }
+        if (config.disk_lazy_refcounts || config.disk_extended_l2) {
+            xml << "    <features>\n";
+            if (config.disk_lazy_refcounts) {
+                xml << "      <lazy_refcounts/>\n";
+            }
+            if (config.disk_extended_l2) {
+                xml << "      <extended_l2/>\n";
+            }
+            xml << "    </features>\n";
+        }
+    }
+
+    // Owned by the user QEMU runs as, so the domain can open it
+    struct passwd* owner = getpwnam("libvirt-qemu");
+    struct group* group = getgrnam("libvirt-qemu");
+    if (owner && group) {
+        xml << "    <permissions>\n"
+            << "      <owner>" << owner->pw_uid << "</owner>\n"
+            << "      <group>" << group->gr_gid << "</group>\n"
+            << "      <mode>0600</mode>\n"
+            << "    </permissions>\n";
+    }
+    xml << "  </target>\n";
+    if (!config.backing_path.empty()) {
+        xml << "  <backingStore>\n"
+            << "    <path>" << config.backing_path << "</path>\n"
+            << "    <format type=\"" << image_format(config.backing_path) << "\"/>\n"
+            << "  </backingStore>\n";
+    }
+    xml << "</volume>\n";
+    return xml.str();
+}
+
+bool vm_manager::validate_disk_layout(const vm_config& config) {
+    bool qcow2 = config.disk_format == "qcow2";
+    if (!qcow2 && config.disk_format != "raw") {
+        set_error("Disk format must be qcow2 or raw");
+        return false;
+    }
+
+    const std::string& preallocation = config.disk_preallocation;
+    if (preallocation != "off" && preallocation != "metadata" && preallocation != "falloc" &&
+        preallocation != "full") {
+        set_error("Disk preallocation must be off, metadata, falloc or full");
+        return false;
+    }
+    if (preallocation == "metadata" && !qcow2) {
+        set_error("Metadata preallocation needs a qcow2 disk");
+        return false;
+    }
+    // libvirt only offers qemu-img's falloc mode for qcow2
+    if (preallocation == "full" && qcow2) {
+        set_error("Full preallocation needs a raw disk; use falloc for qcow2");
         return false;
     }
 
-    if (config.iso_path.empty()) {
-        set_error("ISO path cannot be empty");
+    if (!qcow2 &&
+        (config.disk_cluster_kib > 0 || config.disk_extended_l2 || config.disk_lazy_refcounts)) {
+        set_error("Cluster size, extended_l2 and lazy_refcounts need a qcow2 disk");
+        return false;
+    }
+    int cluster_kib = config.disk_cluster_kib;
+    if (cluster_kib != 0 && (cluster_kib > 2048 || (cluster_kib & (cluster_kib - 1)) != 0)) {
+        set_error("Cluster size must be a power of two between 1 KiB and 2 MiB");
+        return false;
+    }
+    // Subclusters are a 32nd of a cluster and cannot be smaller than 512 bytes
+    if (config.disk_extended_l2 && cluster_kib != 0 && cluster_kib < 16) {
+        set_error("extended_l2 needs clusters of at least 16 KiB");
         return false;
     }
 
-    if (!std::filesystem::exists(config.iso_path)) {
-        set_error("ISO file does not exist: " + config.iso_path);
+    if (!config.backing_path.empty()) {
+        if (!qcow2) {
+            set_error("Linked clones need a qcow2 disk");
+            return false;
+        }
+        // Reserving the whole disk up front would defeat the point of sharing the golden image
+        if (preallocation != "off" && preallocation != "metadata") {
+            set_error("Linked clones only support off or metadata preallocation");
+            return false;
+        }
+        if (!std::filesystem::exists(config.backing_path)) {
+            set_error("Golden image does not exist: " + config.backing_path);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool vm_manager::validate_image_name(const std::string& image_name) {
+    bool valid = !image_name.empty() && image_name.size() <= 64 && image_name[0] != '.' &&
+                 std::all_of(image_name.begin(), image_name.end(), [](unsigned char c) {
+                     return std::isalnum(c) || c == '-' || c == '_' || c == '.';
+                 });
+    if (!valid) {
+        set_error("Golden image names may only contain letters, digits, '-', '_' and '.'");
+    }
+    return valid;
+}
+
+bool vm_manager::is_valid_vm_name(const std::string& vm_name) {
+    return !vm_name.empty() && vm_name.size() <= 64 &&
+           std::all_of(vm_name.begin(), vm_name.end(), [](unsigned char c) {
+               return std::isalnum(c) || c == '-' || c == '_';
+           });
+}
+
+bool vm_manager::validate_config(const vm_config& config, bool check_media) {
+    if (!is_valid_vm_name(config.name)) {
+        set_error(INVALID_VM_NAME_MESSAGE);
         return false;
     }
 
+    // Linked clones boot an installed system and need no installer
+    if (check_media && config.backing_path.empty()) {
+        if (config.iso_path.empty()) {
+            set_error("ISO path cannot be empty");
+            return false;
+        }
+
+        if (!std::filesystem::exists(config.iso_path)) {
+            set_error("ISO file does not exist: " + config.iso_path);
+            return false;
+        }
+    }
+
     if (config.memory_gb < 1 || config.memory_gb > 128) {
         set_error("Memory must be between 1 and 128 GB");
         return false;
@@ -446,7 +912,7 @@ bool vm_manager::validate_config(const vm_config& config) {
         return false;
     }
 
-    return true;
+    return validate_disk_layout(config);
 }
 
 bool vm_manager::is_network_active(const std::string& network_name) {
@@ -1,10 +1,14 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <libvirt/libvirt.h>
 #include <libvirt/virterror.h>
 #include <nlohmann/json.hpp>
+#include "util/cancellation.hpp"
 
 struct vm_config {
     std::string name;
@@ -15,14 +19,33 @@ struct vm_config {
     int memory_gb;
     int cpu_cores;
     int disk_gb;
+    std::string disk_format = "qcow2"; // or "raw"
+    // "off" (sparse), "metadata" (qcow2 tables written up front), "falloc" (blocks reserved) or
+    // "full" (raw only: every block written)
+    std::string disk_preallocation = "off";
+    int disk_cluster_kib = 0;         // qcow2 cluster size; 0 for the default (64 KiB)
+    bool disk_extended_l2 = false;    // qcow2 subclusters: less copy-on-write for small writes
+    bool disk_lazy_refcounts = false; // qcow2: fewer metadata writes, slower crash recovery
+    bool create_disk = true;          // false when the disk was prepared beforehand
+    // Linked clone: the disk is a qcow2 overlay of this golden image and no installer is attached
+    std::string backing_path;
     bool hardware_acceleration = true;
     bool use_autounattend = true;
+    // Boot the disk before the installer, which the disk falls through to while it cannot boot
+    bool boot_disk_first = false;
     std::string autounattend_iso_path; // Path to separate autounattend ISO
     std::string virtio_iso_path;       // Path to VirtIO guest tools ISO
 };
 
 class vm_manager {
 public:
+    static constexpr const char* IMAGES_DIRECTORY = "/var/lib/libvirt/images";
+    static constexpr const char* GOLDEN_DIRECTORY = "/var/lib/libvirt/images/golden";
+    static constexpr const char* INVALID_VM_NAME_MESSAGE =
+        "VM names must be 1 to 64 letters, digits, '-' or '_'";
+    // <vm_name>-autounattend-<key>.iso in IMAGES_DIRECTORY
+    static constexpr const char* AUTOUNATTEND_ISO_INFIX = "-autounattend-";
+
     vm_manager();
     ~vm_manager();
 
@@ -38,12 +61,44 @@ public:
     bool is_connected() const;
 
     // VM operations
+    // Create the disk and define the VM, as create_disk_image, generate_vm_xml and define_vm
     bool create_vm(const vm_config& config);
+    // Domain XML for config, using the disk path create_disk_image gives it
+    std::string generate_vm_xml(const vm_config& config);
+    bool define_vm(const std::string& vm_name, const std::string& xml);
+    // Check config before building anything for it; check_media=false skips the installer ISO,
+    // e.g. while it is still being downloaded
+    bool validate_config(const vm_config& config, bool check_media = true);
     bool start_vm(const std::string& vm_name);
     bool stop_vm(const std::string& vm_name);
     bool delete_vm(const std::string& vm_name);
     bool vm_exists(const std::string& vm_name);
 
+    // VM names become file names, domain XML and log text, so only plain names are accepted
+    static bool is_valid_vm_name(const std::string& vm_name);
+    // Where the disk image of a VM lives
+    static std::string disk_image_path(const std::string& vm_name,
+                                       const std::string& disk_format = "qcow2");
+    // Where the autounattend ISO of a VM lives; key identifies its contents (see
+    // iso_builder::fingerprint), so an unchanged configuration maps to the same file
+    static std::string autounattend_iso_path(const std::string& vm_name, const std::string& key);
+    // Create the disk image as a volume of the storage pool over IMAGES_DIRECTORY, with the
+    // layout and preallocation of config. Returns its path, or an empty string.
+    std::string create_disk_image(const vm_config& config);
+
+    // Golden images: generalized system disks that linked clones use as their backing file.
+    // Turn the disk of a shut off (sysprepped) VM into the read-only golden image image_name and
+    // undefine the VM. Returns the image path, or an empty string.
+    std::string create_golden_image(const std::string& vm_name, const std::string& image_name);
+    // Path of golden image image_name, or an empty string if there is none
+    static std::string golden_image_path(const std::string& image_name);
+    // Copy everything a linked clone reads from its golden image into its own disk, so it no
+    // longer depends on it. Block pull while the VM runs, qemu-img rebase while it is shut off.
+    // on_progress gets bytes done and total (live only).
+    using flatten_progress = std::function<void(uint64_t done, uint64_t total)>;
+    bool flatten_vm(const std::string& vm_name, const cancellation_token& token,
+                    const flatten_progress& on_progress = nullptr);
+
     // VM information
     nlohmann::json get_vm_info(const std::string& vm_name);
     std::vector<std::string> list_vms();
@@ -62,11 +117,14 @@ public:
 
 private:
     virConnectPtr m_connection;
+    // Workloads (and the steps of one install) share the manager
+    mutable std::mutex m_error_mutex;
     std::string m_last_error;
 
     // Helper methods
     void set_error(const std::string& error);
-    std::string generate_vm_xml(const vm_config& config);
-    std::string create_disk_image(const vm_config& config);
-    bool validate_config(const vm_config& config);
+    virStoragePoolPtr lookup_image_pool();
+    std::string generate_volume_xml(const vm_config& config, const std::string& volume_name);
+    bool validate_disk_layout(const vm_config& config);
+    bool validate_image_name(const std::string& image_name);
 };
@@ -1,30 +1,242 @@
 #include <cstdlib>
 #include "application.hpp"
 #include "autounattend_manager.hpp"
+#include "install_progress.hpp"
+#include "media/iso_builder.hpp"
+#include "media/iso_reader.hpp"
+#include "media/iso_verifier.hpp"
+#include "media/metadata_cache.hpp"
+#include "media/wim_metadata.hpp"
+#include "net/http_random_access_file.hpp"
+#include "net/multipart_transfer.hpp"
 #include "util/defer.hpp"
+#include "util/process.hpp"
+#include "util/task_graph.hpp"
 #include "vm_manager.hpp"
 #include "worker.hpp"
 
+#include <algorithm>
+#include <cerrno>
 #include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <string>
 #include <thread>
 #include <vector>
+#include <fcntl.h>
+#include <grp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
-#include <wimlib.h>
 
-// Helper structure for WIM image information
-struct wim_image_info {
-    std::string name;
-    std::string display_name;
-    std::string description;
-    std::string display_description;
-};
+// Coarse install_vm steps reported through the telemetry ring
+constexpr double INSTALL_STEPS = 6;
+// install_vm learns about the end of Setup from lifecycle events; polling is only the fallback
+// for events missed while the event monitor reconnects
+constexpr auto INSTALL_POLL_INTERVAL = std::chrono::minutes(1);
+constexpr auto INSTALL_REPORT_INTERVAL = std::chrono::minutes(10);
+// How often guest I/O is sampled for the install progress estimate
+constexpr auto INSTALL_STATS_INTERVAL = std::chrono::seconds(5);
+
+namespace {
+// Every field in the filter must be present in the event with an equal value
+bool matches_filter(const nlohmann::json& filter, const nlohmann::json& event) {
+    if (!filter.is_object()) {
+        return true;
+    }
+    for (const auto& [key, value] : filter.items()) {
+        auto it = event.find(key);
+        if (it == event.end() || *it != value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The string the edition picker shows for an image
+std::string describe_image(const nlohmann::json& image) {
+    std::string display_name = image.value("display_name", "");
+    std::string version_info = display_name.empty() ? image.value("name", "") : display_name;
+    std::string display_description = image.value("display_description", "");
+    std::string description = image.value("description", "");
+    if (!display_description.empty()) {
+        version_info += " - " + display_description;
+    } else if (!description.empty()) {
+        version_info += " - " + description;
+    }
+    return version_info;
+}
+
+// scan_wim_versions result: display strings for the edition picker plus the full image list
+nlohmann::json make_scan_result(const nlohmann::json& images) {
+    std::vector<std::string> windows_versions;
+    for (const auto& image : images) {
+        windows_versions.push_back(describe_image(image));
+    }
+
+    nlohmann::json result;
+    result["windows_versions"] = windows_versions;
+    result["total_count"] = windows_versions.size();
+    result["images"] = images;
+    return result;
+}
+
+// Map an edition as the client names it (picker string, image name or edition ID) to its image
+// index. Returns 0 if no image matches.
+uint32_t find_image_index(const nlohmann::json& images, const std::string& edition) {
+    for (const auto& image : images) {
+        if (describe_image(image) == edition || image.value("name", "") == edition ||
+            image.value("edition_id", "") == edition) {
+            return image.value("index", 0u);
+        }
+    }
+    return images.size() == 1 ? images[0].value("index", 0u) : 0;
+}
+
+// Image list of the install.wim/.esd/.swm inside an opened ISO
+std::optional<std::vector<wim_metadata::image>> read_iso_images(iso_reader& iso,
+                                                                std::string& error) {
+    std::optional<iso_reader::file> wim_file;
+    for (const char* candidate :
+         {"sources/install.wim", "sources/install.esd", "sources/install.swm"}) {
+        wim_file = iso.find_file(candidate);
+        if (wim_file) {
+            break;
+        }
+    }
+    if (!wim_file) {
+        error = "No install.wim, install.esd or install.swm found in ISO";
+        return std::nullopt;
+    }
+
+    return wim_metadata::read_images(
+        [&iso, &wim_file](uint64_t offset, void* buffer, size_t length) {
+            return iso.read_file(*wim_file, offset, buffer, length);
+        },
+        wim_file->size, error);
+}
+
+// JSON image list of a WIM scan, failing on an empty one
+std::optional<nlohmann::json> to_image_list(
+    const std::optional<std::vector<wim_metadata::image>>& images, std::string& error) {
+    if (!images) {
+        error = "Failed to read WIM metadata: " + error;
+        return std::nullopt;
+    }
+    if (images->empty()) {
+        error = "Failed to scan WIM images or no images found";
+        return std::nullopt;
+    }
+
+    nlohmann::json image_list = nlohmann::json::array();
+    for (const auto& image : *images) {
+        image_list.push_back(image.to_json());
+    }
+    return image_list;
+}
+
+// Image list of an ISO that is still on the web server: only the volume descriptors, the
+// directories on the way to install.wim and the WIM header and XML are transferred
+std::optional<nlohmann::json> read_remote_images(const std::string& url, std::string& error,
+                                                 http_random_access_file::statistics& statistics) {
+    http_random_access_file remote(url);
+    if (!remote.open()) {
+        error = "Failed to open ISO URL: " + remote.get_last_error();
+        return std::nullopt;
+    }
+
+    iso_reader iso;
+    iso.open(
+        remote.size(),
+        [&remote](uint64_t offset, void* buffer, size_t length) {
+            return remote.read(offset, buffer, length);
+        },
+        url);
+    std::optional<std::vector<wim_metadata::image>> images = read_iso_images(iso, error);
+    statistics = remote.get_statistics();
+    return to_image_list(images, error);
+}
+
+// Read [offset, offset + length) of a file transfer is still downloading, fetched ahead of the
+// rest through a priority range. Fails if the download fails or the token is cancelled first.
+bool read_while_downloading(multipart_transfer& transfer, uint64_t offset, void* buffer,
+                            size_t length, const cancellation_token& token) {
+    // Shared with the range callback, which may still run after a cancelled read returned
+    struct pending_read {
+        std::mutex mutex;
+        std::condition_variable arrived;
+        bool done = false;
+        std::vector<uint8_t> data;
+    };
+    auto pending = std::make_shared<pending_read>();
+
+    transfer.add_priority_range(
+        offset, length, [pending](uint64_t, const uint8_t* data, uint64_t received) {
+            std::lock_guard<std::mutex> lock(pending->mutex);
+            if (data) {
+                pending->data.assign(data, data + received);
+            }
+            pending->done = true;
+            pending->arrived.notify_all();
+        });
+    cancellation_token::callback_id callback = token.add_callback([pending]() {
+        std::lock_guard<std::mutex> lock(pending->mutex);
+        pending->arrived.notify_all();
+    });
+    DEFER({ token.remove_callback(callback); });
+
+    std::unique_lock<std::mutex> lock(pending->mutex);
+    pending->arrived.wait(lock, [&]() { return pending->done || token.is_cancelled(); });
+    if (pending->data.size() != length) {
+        return false;
+    }
+    memcpy(buffer, pending->data.data(), length);
+    return true;
+}
+
+// Image list of an ISO that transfer is downloading: the volume descriptors, directories and
+// WIM header and XML are moved to the front of the download rather than fetched a second time
+std::optional<nlohmann::json> read_downloading_images(multipart_transfer& transfer,
+                                                      const std::string& url,
+                                                      const cancellation_token& token,
+                                                      std::string& error) {
+    auto read = [&transfer, &token](uint64_t offset, void* buffer, size_t length) {
+        return read_while_downloading(transfer, offset, buffer, length, token);
+    };
+
+    // The size is known once the first range has arrived
+    uint8_t first_byte;
+    if (!read(0, &first_byte, 1)) {
+        error = token.is_cancelled() ? token.get_reason() : "The ISO download failed";
+        return std::nullopt;
+    }
+    iso_reader iso;
+    iso.open(transfer.size(), read, url);
+    std::optional<std::vector<wim_metadata::image>> images = read_iso_images(iso, error);
+    return to_image_list(images, error);
+}
+
+// Quick workloads go to the interactive lane; anything that can run for minutes goes to bulk.
+// scan_wim_versions only reads an ISO's WIM header and XML, so it counts as quick.
+bool is_interactive_workload(workload_type workload) {
+    switch (workload) {
+    case workload_type::install_vm:
+    case workload_type::index_iso_library:
+    case workload_type::verify_iso:
+    case workload_type::build_slim_media:
+    case workload_type::flatten_vm:
+        return false;
+    default:
+        return true;
+    }
+}
+} // namespace
 
-worker::worker() = default;
+worker::worker(const worker_options& options) : m_options(options) {}
 
 worker::~worker() = default;
 
@@ -35,112 +247,835 @@ int worker::run(const std::string& socket_path) {
         return 1;
     }
 
-    if (!m_ipc.connect_to_server(socket_path)) {
+    ipc connection;
+    if (!connection.connect_to_server(socket_path)) {
         return 1;
     }
 
     std::cout << "[Worker] Connected to client socket" << std::endl;
 
-    // Main worker loop - listen for workload requests
-    while (m_ipc.is_connected()) {
-        try {
-            auto request = m_ipc.receive_workload_request();
-            uint64_t workload_id = std::get<0>(request);
-            workload_type workload = std::get<1>(request);
-            nlohmann::json params = std::get<2>(request);
-
-            // Launch each workload in its own thread
-            std::thread workload_thread([this, workload_id, workload, params]() {
-                try {
-                    switch (workload) {
-                    case workload_type::check_installed_apps:
-                        std::cout << "[Worker] Received check_installed_apps request (ID: "
-                                  << workload_id << ")" << std::endl;
-                        check_installed_apps(workload_id, params);
-                        break;
-                    case workload_type::scan_wim_versions:
-                        std::cout << "[Worker] Received scan_wim_versions request (ID: "
-                                  << workload_id << ")" << std::endl;
-                        scan_wim_versions(workload_id, params);
-                        break;
-                    case workload_type::install_vm:
-                        std::cout << "[Worker] Received install_vm request (ID: " << workload_id
-                                  << ")" << std::endl;
-                        install_vm(workload_id, params);
-                        break;
-                    case workload_type::get_vm_status:
-                        std::cout << "[Worker] Received get_vm_status request (ID: " << workload_id
-                                  << ")" << std::endl;
-                        get_vm_status(workload_id, params);
-                        break;
-                    case workload_type::start_vm:
-                        std::cout << "[Worker] Received start_vm request (ID: " << workload_id
-                                  << ")" << std::endl;
-                        start_vm(workload_id, params);
-                        break;
-                    case workload_type::stop_vm:
-                        std::cout << "[Worker] Received stop_vm request (ID: " << workload_id << ")"
-                                  << std::endl;
-                        stop_vm(workload_id, params);
-                        break;
-                    case workload_type::remove_vm:
-                        std::cout << "[Worker] Received remove_vm request (ID: " << workload_id
-                                  << ")" << std::endl;
-                        remove_vm(workload_id, params);
-                        break;
-                    default:
-                        std::cout << "[Worker] Received invalid workload request" << std::endl;
-                        break;
+    start_services();
+
+    std::shared_ptr<worker_session> session = attach_session(connection.release_socket());
+    if (session) {
+        session->wait_closed();
+    }
+
+    // Nobody is left to report to: cancel everything, so queued workloads are skipped and running
+    // ones unwind at their next check, then wait for both lanes to drain
+    cancel_all_workloads();
+    stop_services();
+
+    return 0;
+}
+
+int worker::run_daemon(const std::string& socket_path) {
+    std::cout << "[Worker] Running as daemon" << std::endl;
+
+    if (!check_root_privileges()) {
+        return 1;
+    }
+
+    // Under systemd socket activation the listening socket is passed in as fd 3
+    int activated_fd = get_activated_socket();
+    if (activated_fd != -1) {
+        if (!m_listener.adopt_server_socket(activated_fd)) {
+            return 1;
+        }
+        std::cout << "[Worker] Using socket-activated listener" << std::endl;
+    } else {
+        std::filesystem::create_directories(std::filesystem::path(socket_path).parent_path());
+        if (!m_listener.create_server_socket(socket_path) ||
+            !m_listener.listen_for_connections(SOMAXCONN)) {
+            return 1;
+        }
+        // Same policy as the shipped socket unit: root and the libvirt group may connect
+        chmod(socket_path.c_str(), 0660);
+        group* libvirt_group = getgrnam("libvirt");
+        if (libvirt_group) {
+            chown(socket_path.c_str(), 0, libvirt_group->gr_gid);
+        }
+        std::cout << "[Worker] Listening on " << socket_path << std::endl;
+    }
+
+    m_daemon = true;
+    start_services();
+
+    // Any number of clients (GUI, CLI, scripts) may be attached at once. Workloads keep running
+    // while their client is away and can be picked up again with attach_workload.
+    while (true) {
+        int client_fd = m_listener.accept_connection();
+        reap_closed_sessions();
+
+        if (client_fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        ucred credentials{};
+        socklen_t credentials_length = sizeof(credentials);
+        if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &credentials, &credentials_length) ==
+            0) {
+            std::cout << "[Worker] Client connected (PID: " << credentials.pid
+                      << ", UID: " << credentials.uid << ")" << std::endl;
+        }
+
+        attach_session(client_fd);
+    }
+
+    cancel_all_workloads();
+    stop_services();
+
+    return 1;
+}
+
+int worker::get_activated_socket() {
+    // sd_listen_fds() protocol: LISTEN_PID names us and LISTEN_FDS counts descriptors from fd 3
+    const char* listen_pid = getenv("LISTEN_PID");
+    const char* listen_fds = getenv("LISTEN_FDS");
+    if (!listen_pid || !listen_fds) {
+        return -1;
+    }
+    if (std::strtol(listen_pid, nullptr, 10) != getpid() ||
+        std::strtol(listen_fds, nullptr, 10) < 1) {
+        return -1;
+    }
+
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+
+    constexpr int SD_LISTEN_FDS_START = 3;
+    fcntl(SD_LISTEN_FDS_START, F_SETFD, FD_CLOEXEC);
+    return SD_LISTEN_FDS_START;
+}
+
+void worker::start_services() {
+    auto on_stats = [this](size_t, size_t) { publish_queue_stats(); };
+    m_interactive_pool.start(m_options.interactive_threads, on_stats);
+    m_bulk_pool.start(m_options.bulk_threads, on_stats);
+
+    m_vm_events.add_listener(
+        [this](const vm_event_monitor::vm_event& event) { on_vm_event(event); });
+    if (!m_vm_events.start()) {
+        std::cerr << "[Worker] VM events unavailable; clients must query VM status" << std::endl;
+    }
+}
+
+void worker::stop_services() {
+    m_vm_events.stop();
+    m_iso_library.stop_watching();
+    m_interactive_pool.shutdown();
+    m_bulk_pool.shutdown();
+
+    std::vector<std::shared_ptr<worker_session>> sessions;
+    {
+        std::lock_guard<std::mutex> lock(m_sessions_mutex);
+        for (auto& [session_id, session] : m_sessions) {
+            sessions.push_back(session);
+        }
+        m_sessions.clear();
+    }
+    for (auto& session : sessions) {
+        session->close();
+    }
+    reap_closed_sessions();
+}
+
+std::shared_ptr<worker_session> worker::attach_session(int socket_fd) {
+    nlohmann::json running = nlohmann::json::array();
+    {
+        std::lock_guard<std::mutex> lock(m_tokens_mutex);
+        for (const auto& [workload_id, workload] : m_workloads) {
+            if (workload.topics.empty()) {
+                running.push_back(
+                    {{"workload_id", workload_id}, {"type", static_cast<int>(workload.type)}});
+            }
+        }
+    }
+
+    uint64_t session_id;
+    std::shared_ptr<worker_session> session;
+    {
+        std::lock_guard<std::mutex> lock(m_sessions_mutex);
+        session_id = ++m_next_session_id;
+        session = std::make_shared<worker_session>(session_id, socket_fd);
+        m_sessions[session_id] = session;
+    }
+
+    nlohmann::json hello = {{"protocol", IPC_PROTOCOL_VERSION},
+                            {"daemon", m_daemon},
+                            {"pid", getpid()},
+                            {"session_id", session_id},
+                            {"running_workloads", running}};
+
+    bool started = session->start(
+        hello,
+        [this](worker_session& session, uint64_t client_workload_id, workload_type workload,
+               nlohmann::json params, uint64_t timeout_ms) {
+            handle_request(session, client_workload_id, workload, params, timeout_ms);
+        },
+        [this](worker_session& session) { on_session_closed(session); });
+
+    if (!started) {
+        std::cerr << "[Worker] Failed to start session " << session_id << std::endl;
+        std::lock_guard<std::mutex> lock(m_sessions_mutex);
+        m_sessions.erase(session_id);
+        return nullptr;
+    }
+
+    std::cout << "[Worker] Session " << session_id << " attached" << std::endl;
+    return session;
+}
+
+void worker::on_session_closed(worker_session& session) {
+    // Subscriptions only make sense while their client is there; everything else keeps running
+    // in daemon mode so the client can re-attach to it later
+    std::vector<std::shared_ptr<cancellation_token>> subscriptions;
+    size_t orphaned = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_tokens_mutex);
+        for (auto& [workload_id, workload] : m_workloads) {
+            if (workload.session_id != session.get_id()) {
+                continue;
+            }
+            if (!workload.topics.empty()) {
+                subscriptions.push_back(workload.token);
+            } else {
+                orphaned++;
+            }
+        }
+    }
+    for (auto& token : subscriptions) {
+        token->cancel("Client disconnected");
+    }
+
+    std::cout << "[Worker] Session " << session.get_id() << " detached, " << orphaned
+              << " workload(s) still running" << std::endl;
+
+    std::lock_guard<std::mutex> lock(m_sessions_mutex);
+    auto it = m_sessions.find(session.get_id());
+    if (it != m_sessions.end()) {
+        m_closed_sessions.push_back(it->second);
+        m_sessions.erase(it);
+    }
+}
+
+void worker::reap_closed_sessions() {
+    std::vector<std::shared_ptr<worker_session>> closed;
+    {
+        std::lock_guard<std::mutex> lock(m_sessions_mutex);
+        closed.swap(m_closed_sessions);
+    }
+    for (auto& session : closed) {
+        session->close();
+    }
+}
+
+void worker::handle_request(worker_session& session, uint64_t client_workload_id,
+                            workload_type workload, const nlohmann::json& params,
+                            uint64_t timeout_ms) {
+    switch (workload) {
+    case workload_type::cancel_workload:
+        // Cancel frames are handled inline so they are never queued behind the workload they
+        // target
+        cancel_workload(session.get_id(), client_workload_id);
+        return;
+    case workload_type::subscribe_events:
+        subscribe(session, client_workload_id, params);
+        return;
+    case workload_type::attach_workload:
+        attach_workload(session, client_workload_id, params);
+        return;
+    case workload_type::batch:
+        run_batch(session, client_workload_id, params, timeout_ms);
+        return;
+    default:
+        break;
+    }
+
+    std::shared_ptr<cancellation_token> token_ptr;
+    uint64_t workload_id =
+        register_workload(session, client_workload_id, workload, timeout_ms, token_ptr);
+    submit_workload(workload_id, workload, params, token_ptr);
+}
+
+bool worker::submit_workload(uint64_t workload_id, workload_type workload,
+                             const nlohmann::json& params,
+                             const std::shared_ptr<cancellation_token>& token) {
+    thread_pool& lane = is_interactive_workload(workload) ? m_interactive_pool : m_bulk_pool;
+    bool queued = lane.submit([this, workload_id, workload, params, token]() {
+        DEFER({ unregister_workload(workload_id); });
+
+        // Cancelled (or expired) while waiting in the queue
+        if (check_cancelled(workload_id, *token)) {
+            return;
+        }
+        dispatch_workload(workload_id, workload, params, *token);
+    });
+
+    if (!queued) {
+        respond(workload_id, workload_status::error, "Worker is shutting down");
+        unregister_workload(workload_id);
+    }
+    return queued;
+}
+
+void worker::run_batch(worker_session& session, uint64_t client_workload_id,
+                       const nlohmann::json& params, uint64_t timeout_ms) {
+    nlohmann::json requests = params.value("requests", nlohmann::json::array());
+    if (!requests.is_array() || requests.empty()) {
+        session.enqueue_response(client_workload_id, workload_status::error,
+                                 "Batch contains no requests");
+        return;
+    }
+
+    std::shared_ptr<cancellation_token> batch_token;
+    uint64_t batch_id = register_workload(session, client_workload_id, workload_type::batch,
+                                          timeout_ms, batch_token);
+
+    // Members run like ordinary workloads, in parallel on their lanes. Their final responses are
+    // collected and the batch completes once with all of them, in request order.
+    struct batch_state {
+        std::mutex mutex;
+        nlohmann::json results = nlohmann::json::array();
+        size_t remaining = 0;
+    };
+    auto state = std::make_shared<batch_state>();
+    for (size_t i = 0; i < requests.size(); i++) {
+        state->results.push_back(nullptr);
+    }
+    state->remaining = requests.size();
+
+    auto finish = [this, state, batch_id, batch_token](size_t index, nlohmann::json result) {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!state->results[index].is_null()) {
+                return;
+            }
+            state->results[index] = std::move(result);
+            if (--state->remaining > 0) {
+                return;
+            }
+        }
+
+        if (batch_token->is_cancelled()) {
+            respond(batch_id, workload_status::cancelled, batch_token->get_reason());
+        } else {
+            nlohmann::json response = {{"results", state->results}};
+            respond(batch_id, workload_status::completed, response.dump());
+        }
+        unregister_workload(batch_id);
+    };
+
+    std::cout << "[Worker] Running batch of " << requests.size() << " requests (ID: " << batch_id
+              << ")" << std::endl;
+
+    for (size_t i = 0; i < requests.size(); i++) {
+        const nlohmann::json& request = requests[i];
+        int type = request.is_object() ? request.value("type", -1) : -1;
+
+        // Control frames and nested batches only make sense at the top level
+        auto workload = static_cast<workload_type>(type);
+        if (type < 0 || type > static_cast<int>(LAST_WORKLOAD_TYPE) ||
+            workload == workload_type::cancel_workload ||
+            workload == workload_type::subscribe_events ||
+            workload == workload_type::attach_workload || workload == workload_type::batch) {
+            finish(i, {{"status", "error"}, {"message", "Unsupported workload type in batch"}});
+            continue;
+        }
+
+        std::shared_ptr<cancellation_token> token;
+        uint64_t workload_id = register_workload(session, 0, workload, timeout_ms, token);
+        {
+            std::lock_guard<std::mutex> lock(m_tokens_mutex);
+            m_workloads[workload_id].sink = [finish, i](workload_status status,
+                                                        const std::string& message) {
+                switch (status) {
+                case workload_status::in_progress:
+                    break;
+                case workload_status::completed: {
+                    nlohmann::json result = nlohmann::json::parse(message, nullptr, false);
+                    if (result.is_discarded()) {
+                        result = message;
                     }
-                } catch (const std::exception& e) {
-                    std::cerr << "[Worker] Exception in workload thread (ID: " << workload_id
-                              << "): " << e.what() << std::endl;
-                } catch (...) {
-                    std::cerr << "[Worker] Unknown exception in workload thread (ID: "
-                              << workload_id << ")" << std::endl;
+                    finish(i, {{"status", "completed"}, {"result", result}});
+                    break;
                 }
-            });
+                case workload_status::error:
+                    finish(i, {{"status", "error"}, {"message", message}});
+                    break;
+                case workload_status::cancelled:
+                    finish(i, {{"status", "cancelled"}, {"message", message}});
+                    break;
+                }
+            };
+        }
+
+        batch_token->add_callback([token]() { token->cancel("Batch cancelled"); });
+        submit_workload(workload_id, workload, request.value("params", nlohmann::json::object()),
+                        token);
+    }
+}
+
+void worker::subscribe(worker_session& session, uint64_t client_workload_id,
+                       const nlohmann::json& params) {
+    std::vector<std::string> topics = params.value("topics", std::vector<std::string>{});
+    if (topics.empty()) {
+        session.enqueue_response(client_workload_id, workload_status::error,
+                                 "No topics to subscribe to");
+        return;
+    }
+
+    nlohmann::json filter = params.value("filter", nlohmann::json::object());
+    if (!filter.is_object()) {
+        session.enqueue_response(client_workload_id, workload_status::error,
+                                 "Subscription filter must be an object");
+        return;
+    }
+    bool wants_vm = std::find(topics.begin(), topics.end(), "vm") != topics.end();
+    bool wants_vm_stats = std::find(topics.begin(), topics.end(), "vm_stats") != topics.end();
+
+    // Subscriptions hold no thread: they exist only as a registry entry that publish_event
+    // fans out to, until the token is cancelled
+    std::shared_ptr<cancellation_token> token;
+    uint64_t workload_id = register_workload(session, client_workload_id,
+                                             workload_type::subscribe_events, 0, token);
+    {
+        std::lock_guard<std::mutex> lock(m_tokens_mutex);
+        running_workload& entry = m_workloads[workload_id];
+        entry.topics = topics;
+        entry.filter = filter;
+        if (wants_vm_stats) {
+            entry.stats_interval =
+                std::chrono::milliseconds(params.value("stats_interval_ms", uint64_t(2000)));
+        }
+    }
+    if (wants_vm_stats) {
+        update_vm_stats_interval();
+    }
+
+    token->add_callback([this, workload_id, token_ptr = token.get()]() {
+        respond(workload_id, workload_status::cancelled, token_ptr->get_reason());
+        unregister_workload(workload_id);
+    });
+
+    nlohmann::json event = {{"event", "subscribed"}, {"topics", topics}};
+    respond(workload_id, workload_status::in_progress, event.dump());
+
+    // Start "vm" subscribers from the current states, so they never need get_vm_status to
+    // find out where things stand before the first event arrives
+    if (wants_vm) {
+        nlohmann::json vms = nlohmann::json::array();
+        for (const auto& vm : m_vm_events.get_domain_states()) {
+            if (matches_filter(filter, vm)) {
+                vms.push_back(vm);
+            }
+        }
+        nlohmann::json snapshot = {{"event", "snapshot"}, {"topic", "vm"}, {"vms", vms}};
+        respond(workload_id, workload_status::in_progress, snapshot.dump());
+    }
+}
+
+void worker::attach_workload(worker_session& session, uint64_t client_workload_id,
+                             const nlohmann::json& params) {
+    uint64_t workload_id = params.value("workload_id", uint64_t(0));
+
+    bool attached = false;
+    {
+        std::lock_guard<std::mutex> lock(m_tokens_mutex);
+        auto it = m_workloads.find(workload_id);
+        if (it != m_workloads.end() && it->second.topics.empty()) {
+            it->second.session_id = session.get_id();
+            it->second.session = session.weak_from_this();
+            it->second.client_workload_id = client_workload_id;
+            attached = true;
+        }
+    }
+
+    if (!attached) {
+        session.enqueue_response(client_workload_id, workload_status::error,
+                                 "No running workload with ID " + std::to_string(workload_id));
+        return;
+    }
+
+    std::cout << "[Worker] Workload " << workload_id << " attached to session "
+              << session.get_id() << std::endl;
+    nlohmann::json event = {{"event", "attached"}, {"workload_id", workload_id}};
+    respond(workload_id, workload_status::in_progress, event.dump());
+}
+
+void worker::publish_event(const std::string& topic, const nlohmann::json& event) {
+    std::vector<uint64_t> subscribers;
+    {
+        std::lock_guard<std::mutex> lock(m_tokens_mutex);
+        for (const auto& [workload_id, workload] : m_workloads) {
+            if (!matches_filter(workload.filter, event)) {
+                continue;
+            }
+            for (const auto& subscribed : workload.topics) {
+                if (subscribed == topic) {
+                    subscribers.push_back(workload_id);
+                    break;
+                }
+            }
+        }
+    }
+
+    if (subscribers.empty()) {
+        return;
+    }
+
+    nlohmann::json message = event;
+    message["topic"] = topic;
+    std::string payload = message.dump();
+
+    // Each client has its own bounded queue, so one slow subscriber only loses its own events
+    for (uint64_t workload_id : subscribers) {
+        respond(workload_id, workload_status::in_progress, payload);
+    }
+}
+
+void worker::on_vm_event(const vm_event_monitor::vm_event& event) {
+    publish_event(event.type == "stats" ? "vm_stats" : "vm", event.data);
+}
 
-            // Detach the thread so it runs independently
-            workload_thread.detach();
-        } catch (const std::exception& e) {
-            std::cerr << "[Worker] Exception in main loop: " << e.what() << std::endl;
+void worker::update_vm_stats_interval() {
+    std::chrono::milliseconds interval{0};
+    {
+        std::lock_guard<std::mutex> lock(m_tokens_mutex);
+        for (const auto& [workload_id, workload] : m_workloads) {
+            if (workload.stats_interval.count() > 0 &&
+                (interval.count() == 0 || workload.stats_interval < interval)) {
+                interval = workload.stats_interval;
+            }
+        }
+    }
+    m_vm_events.set_stats_interval(interval);
+}
+
+void worker::set_stats_interval(uint64_t workload_id, std::chrono::milliseconds interval) {
+    {
+        std::lock_guard<std::mutex> lock(m_tokens_mutex);
+        auto it = m_workloads.find(workload_id);
+        if (it == m_workloads.end()) {
+            return;
+        }
+        it->second.stats_interval = interval;
+    }
+    update_vm_stats_interval();
+}
+
+bool worker::respond(uint64_t workload_id, workload_status status, const std::string& message) {
+    std::shared_ptr<worker_session> session;
+    uint64_t client_workload_id = 0;
+    std::function<void(workload_status, const std::string&)> sink;
+    {
+        std::lock_guard<std::mutex> lock(m_tokens_mutex);
+        auto it = m_workloads.find(workload_id);
+        if (it == m_workloads.end()) {
+            return false;
+        }
+        session = it->second.session.lock();
+        client_workload_id = it->second.client_workload_id;
+        sink = it->second.sink;
+    }
+
+    if (sink) {
+        sink(status, message);
+        return true;
+    }
+
+    // The client went away; the workload keeps running until someone attaches to it
+    if (!session) {
+        return false;
+    }
+    return session->enqueue_response(client_workload_id, status, message);
+}
+
+void worker::dispatch_workload(uint64_t workload_id, workload_type workload,
+                               const nlohmann::json& params, const cancellation_token& token) {
+    // Checked once here, before any workload builds a path or XML from it
+    if (params.contains("vm_name") && (!params["vm_name"].is_string() ||
+                                       !vm_manager::is_valid_vm_name(params["vm_name"]))) {
+        respond(workload_id, workload_status::error, vm_manager::INVALID_VM_NAME_MESSAGE);
+        return;
+    }
+
+    try {
+        switch (workload) {
+        case workload_type::check_installed_apps:
+            std::cout << "[Worker] Received check_installed_apps request (ID: " << workload_id
+                      << ")" << std::endl;
+            check_installed_apps(workload_id, params, token);
+            break;
+        case workload_type::scan_wim_versions:
+            std::cout << "[Worker] Received scan_wim_versions request (ID: " << workload_id << ")"
+                      << std::endl;
+            scan_wim_versions(workload_id, params, token);
+            break;
+        case workload_type::install_vm:
+            std::cout << "[Worker] Received install_vm request (ID: " << workload_id << ")"
+                      << std::endl;
+            install_vm(workload_id, params, token);
+            break;
+        case workload_type::get_vm_status:
+            std::cout << "[Worker] Received get_vm_status request (ID: " << workload_id << ")"
+                      << std::endl;
+            get_vm_status(workload_id, params, token);
+            break;
+        case workload_type::start_vm:
+            std::cout << "[Worker] Received start_vm request (ID: " << workload_id << ")"
+                      << std::endl;
+            start_vm(workload_id, params, token);
+            break;
+        case workload_type::stop_vm:
+            std::cout << "[Worker] Received stop_vm request (ID: " << workload_id << ")"
+                      << std::endl;
+            stop_vm(workload_id, params, token);
             break;
-        } catch (...) {
-            std::cerr << "[Worker] Unknown exception in main loop" << std::endl;
+        case workload_type::remove_vm:
+            std::cout << "[Worker] Received remove_vm request (ID: " << workload_id << ")"
+                      << std::endl;
+            remove_vm(workload_id, params, token);
+            break;
+        case workload_type::index_iso_library:
+            std::cout << "[Worker] Received index_iso_library request (ID: " << workload_id << ")"
+                      << std::endl;
+            index_iso_library(workload_id, params, token);
+            break;
+        case workload_type::search_iso_library:
+            std::cout << "[Worker] Received search_iso_library request (ID: " << workload_id
+                      << ")" << std::endl;
+            search_iso_library(workload_id, params, token);
+            break;
+        case workload_type::verify_iso:
+            std::cout << "[Worker] Received verify_iso request (ID: " << workload_id << ")"
+                      << std::endl;
+            verify_iso(workload_id, params, token);
+            break;
+        case workload_type::build_slim_media:
+            std::cout << "[Worker] Received build_slim_media request (ID: " << workload_id << ")"
+                      << std::endl;
+            build_slim_media(workload_id, params, token);
+            break;
+        case workload_type::create_golden_image:
+            std::cout << "[Worker] Received create_golden_image request (ID: " << workload_id
+                      << ")" << std::endl;
+            create_golden_image(workload_id, params, token);
+            break;
+        case workload_type::flatten_vm:
+            std::cout << "[Worker] Received flatten_vm request (ID: " << workload_id << ")"
+                      << std::endl;
+            flatten_vm(workload_id, params, token);
+            break;
+        default:
+            std::cout << "[Worker] Received invalid workload request" << std::endl;
+            respond(workload_id, workload_status::error, "Unsupported workload type");
             break;
         }
+    } catch (const std::exception& e) {
+        // Still answer: a client (or a batch collecting its members) waits for a final response
+        std::cerr << "[Worker] Exception in workload thread (ID: " << workload_id
+                  << "): " << e.what() << std::endl;
+        respond(workload_id, workload_status::error,
+                std::string("Internal error: ") + e.what());
+    } catch (...) {
+        std::cerr << "[Worker] Unknown exception in workload thread (ID: " << workload_id << ")"
+                  << std::endl;
+        respond(workload_id, workload_status::error, "Internal error");
     }
-
-    return 0;
 }
 
 bool worker::check_root_privileges() {
     int uid = getuid();
     std::cout << "[Worker] UID: " << uid << std::endl;
 
-    if (uid != 0) {
-        std::cerr << "[Worker] Requires root privileges" << std::endl;
-        return false;
+    if (uid != 0) {
+        std::cerr << "[Worker] Requires root privileges" << std::endl;
+        return false;
+    }
+
+    std::cout << "[Worker] Running in root mode" << std::endl;
+    return true;
+}
+
+uint64_t worker::register_workload(worker_session& session, uint64_t client_workload_id,
+                                   workload_type workload, uint64_t timeout_ms,
+                                   std::shared_ptr<cancellation_token>& token) {
+    token = std::make_shared<cancellation_token>();
+    if (timeout_ms > 0) {
+        token->set_deadline(cancellation_token::clock::now() +
+                            std::chrono::milliseconds(timeout_ms));
+    }
+
+    uint64_t workload_id;
+    {
+        std::lock_guard<std::mutex> lock(m_tokens_mutex);
+        workload_id = ++m_next_workload_id;
+
+        running_workload& entry = m_workloads[workload_id];
+        entry.type = workload;
+        entry.token = token;
+        entry.session_id = session.get_id();
+        entry.session = session.weak_from_this();
+        entry.client_workload_id = client_workload_id;
+    }
+
+    if (workload != workload_type::subscribe_events) {
+        publish_event("workloads", {{"event", "started"},
+                                    {"workload_id", workload_id},
+                                    {"type", static_cast<int>(workload)}});
+    }
+    return workload_id;
+}
+
+void worker::unregister_workload(uint64_t workload_id) {
+    workload_type workload;
+    bool had_stats = false;
+    {
+        std::lock_guard<std::mutex> lock(m_tokens_mutex);
+        auto it = m_workloads.find(workload_id);
+        if (it == m_workloads.end()) {
+            return;
+        }
+        workload = it->second.type;
+        had_stats = it->second.stats_interval.count() > 0;
+        m_workloads.erase(it);
+    }
+
+    if (had_stats) {
+        update_vm_stats_interval();
+    }
+
+    if (workload != workload_type::subscribe_events) {
+        publish_event("workloads", {{"event", "finished"},
+                                    {"workload_id", workload_id},
+                                    {"type", static_cast<int>(workload)}});
+    }
+}
+
+void worker::cancel_workload(uint64_t session_id, uint64_t client_workload_id) {
+    uint64_t workload_id = 0;
+    std::shared_ptr<cancellation_token> token;
+    {
+        std::lock_guard<std::mutex> lock(m_tokens_mutex);
+        for (const auto& [id, workload] : m_workloads) {
+            if (workload.session_id == session_id &&
+                workload.client_workload_id == client_workload_id) {
+                workload_id = id;
+                token = workload.token;
+                break;
+            }
+        }
+    }
+
+    if (!token) {
+        std::cout << "[Worker] Cancel requested for unknown workload (session " << session_id
+                  << ", ID: " << client_workload_id << ")" << std::endl;
+        return;
+    }
+
+    std::cout << "[Worker] Cancelling workload (ID: " << workload_id << ")" << std::endl;
+    token->cancel("Cancelled by client");
+}
+
+void worker::cancel_all_workloads() {
+    std::vector<std::shared_ptr<cancellation_token>> tokens;
+    {
+        std::lock_guard<std::mutex> lock(m_tokens_mutex);
+        for (auto& [workload_id, workload] : m_workloads) {
+            tokens.push_back(workload.token);
+        }
+    }
+
+    for (auto& token : tokens) {
+        token->cancel("Client disconnected");
+    }
+}
+
+bool worker::check_cancelled(uint64_t workload_id, const cancellation_token& token) {
+    if (!token.is_cancelled()) {
+        return false;
+    }
+
+    std::cout << "[Worker] Workload cancelled (ID: " << workload_id << "): " << token.get_reason()
+              << std::endl;
+    respond(workload_id, workload_status::cancelled, token.get_reason());
+    return true;
+}
+
+void worker::publish_queue_stats() {
+    size_t interactive_queued = m_interactive_pool.get_queue_depth();
+    size_t bulk_queued = m_bulk_pool.get_queue_depth();
+
+    // A backlog means the lane is undersized for the load, which is worth seeing in the log
+    if (interactive_queued > 0 || bulk_queued > 0) {
+        std::cout << "[Worker] Queue depth - interactive: " << interactive_queued
+                  << ", bulk: " << bulk_queued << std::endl;
+    }
+
+    telemetry_record record{};
+    record.workload_id = 0;
+    record.kind = telemetry_kind::worker_queue;
+    record.timestamp_ns = telemetry_ring::now_ns();
+    record.values[0] = static_cast<double>(interactive_queued);
+    record.values[1] = static_cast<double>(m_interactive_pool.get_active_count());
+    record.values[2] = static_cast<double>(bulk_queued);
+    record.values[3] = static_cast<double>(m_bulk_pool.get_active_count());
+
+    std::lock_guard<std::mutex> lock(m_sessions_mutex);
+    for (auto& [session_id, session] : m_sessions) {
+        session->publish_telemetry(record);
     }
+}
 
-    std::cout << "[Worker] Running in root mode" << std::endl;
-    return true;
+void worker::publish_progress(uint64_t workload_id, double done, double total, double rate,
+                              double eta_seconds) {
+    std::shared_ptr<worker_session> session;
+    uint64_t client_workload_id = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_tokens_mutex);
+        auto it = m_workloads.find(workload_id);
+        if (it == m_workloads.end()) {
+            return;
+        }
+        session = it->second.session.lock();
+        client_workload_id = it->second.client_workload_id;
+    }
+    if (!session) {
+        return;
+    }
+
+    telemetry_record record{};
+    record.workload_id = client_workload_id;
+    record.kind = telemetry_kind::progress;
+    record.timestamp_ns = telemetry_ring::now_ns();
+    record.values[0] = done;
+    record.values[1] = total;
+    record.values[2] = rate;
+    record.values[3] = eta_seconds;
+    session->publish_telemetry(record);
 }
 
-void worker::check_installed_apps(uint64_t workload_id, const nlohmann::json& params) {
+void worker::check_installed_apps(uint64_t workload_id, const nlohmann::json& params,
+                                  const cancellation_token& token) {
     std::cout << "[Worker] Checking installed applications (ID: " << workload_id << ")..."
               << std::endl;
 
     // Send in-progress status
-    m_ipc.send_workload_response(workload_id, workload_status::in_progress,
-                                 "Scanning for installed applications...");
+    respond(workload_id, workload_status::in_progress, "Scanning for installed applications...");
 
     // TODO: Implement app checking logic
     // This would involve scanning system for installed applications
 
     // Simulate some work
-    sleep(1);
+    if (token.wait_for(std::chrono::seconds(1))) {
+        check_cancelled(workload_id, token);
+        return;
+    }
 
     std::cout << "[Worker] Application check completed (ID: " << workload_id << ")" << std::endl;
 
@@ -154,367 +1089,1065 @@ void worker::check_installed_apps(uint64_t workload_id, const nlohmann::json& pa
         "total_count": 3
     })";
 
-    m_ipc.send_workload_response(workload_id, workload_status::completed, result);
+    respond(workload_id, workload_status::completed, result);
 }
 
-void worker::scan_wim_versions(uint64_t workload_id, const nlohmann::json& params) {
+void worker::scan_wim_versions(uint64_t workload_id, const nlohmann::json& params,
+                               const cancellation_token& token) {
     std::cout << "[Worker] Scanning WIM versions (ID: " << workload_id << ")..." << std::endl;
     std::cout << "[Worker] Parameters: " << params.dump() << std::endl;
 
-    // Extract parameters
+    // Extract parameters; an ISO can also be scanned where it is hosted, before downloading it
     std::string iso_path = params.value("iso_path", "");
-    if (iso_path.empty()) {
-        m_ipc.send_workload_response(workload_id, workload_status::error, "No ISO path provided");
+    std::string iso_url = params.value("iso_url", "");
+    if (iso_path.empty() && iso_url.empty()) {
+        respond(workload_id, workload_status::error, "No ISO path provided");
         return;
     }
 
     // Send in-progress status
-    m_ipc.send_workload_response(workload_id, workload_status::in_progress,
-                                 "Scanning WIM images in ISO...");
+    respond(workload_id, workload_status::in_progress, "Scanning WIM images in ISO...");
 
-    // Inline WIM scanning using wimlib
-    std::vector<wim_image_info> images;
+    auto scan_start = std::chrono::steady_clock::now();
 
-    // Create a temporary mount point
-    std::string mount_point = "/tmp/lsw_mount_" + std::to_string(getpid());
-    std::string wim_path = mount_point + "/sources/install.wim";
-
-    // Mount the ISO
-    std::string mount_cmd =
-        "mkdir -p " + mount_point + " && mount -o loop,ro " + iso_path + " " + mount_point;
-    int mount_result = system(mount_cmd.c_str());
-
-    if (mount_result != 0) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to mount ISO file");
+    std::string error;
+    std::optional<nlohmann::json> images;
+    http_random_access_file::statistics transfer;
+    if (iso_path.empty()) {
+        images = read_remote_images(iso_url, error, transfer);
+        std::cout << "[Worker] Remote scan used " << transfer.requests << " requests, "
+                  << transfer.bytes_transferred << " bytes" << std::endl;
+    } else {
+        images = read_media_images(iso_path, error);
+    }
+    if (!images) {
+        respond(workload_id, workload_status::error, error);
         return;
     }
 
-    // Check if install.wim exists
-    if (!std::filesystem::exists(wim_path)) {
-        system(("umount " + mount_point + " && rmdir " + mount_point).c_str());
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "No install.wim found in ISO");
+    if (check_cancelled(workload_id, token)) {
         return;
     }
 
-    // Open the WIM file using wimlib
-    WIMStruct* wim = nullptr;
-    int ret = wimlib_open_wim(wim_path.c_str(), 0, &wim);
+    nlohmann::json result = make_scan_result(*images);
+    if (iso_path.empty()) {
+        result["transferred_bytes"] = transfer.bytes_transferred;
+    }
 
-    if (ret != WIMLIB_ERR_SUCCESS) {
-        system(("umount " + mount_point + " && rmdir " + mount_point).c_str());
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to open WIM file");
-        return;
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - scan_start);
+    std::cout << "[Worker] WIM scan completed (ID: " << workload_id << ") in " << elapsed.count()
+              << "ms. Found " << images->size() << " versions." << std::endl;
+
+    // Send completion status with result data
+    respond(workload_id, workload_status::completed, result.dump());
+}
+
+std::optional<nlohmann::json> worker::read_media_images(const std::string& media_path,
+                                                        std::string& error, std::string* hash) {
+    // Media seen before (same size, mtime and sampled content) are answered from the index
+    std::optional<metadata_cache::fingerprint> fingerprint =
+        metadata_cache::compute_fingerprint(media_path, error);
+    if (!fingerprint) {
+        error = "Failed to open media file: " + error;
+        return std::nullopt;
+    }
+    if (hash) {
+        *hash = fingerprint->to_string();
+    }
+    std::optional<nlohmann::json> cached = m_media_cache.lookup(*fingerprint);
+    if (cached) {
+        std::cout << "[Worker] Image list for " << media_path << " answered from cache"
+                  << std::endl;
+        return cached;
     }
 
-    // Get number of images by checking each index
-    size_t num_images = 0;
-    for (int i = 1; i <= 10; i++) { // Try up to 10 images
-        const char* name = wimlib_get_image_name(wim, i);
-        if (name && strlen(name) > 0) {
-            num_images = i;
-        } else {
-            break;
+    std::optional<std::vector<wim_metadata::image>> images;
+    std::string extension = std::filesystem::path(media_path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    if (extension == ".wim" || extension == ".esd" || extension == ".swm") {
+        images = wim_metadata::read_images_from_file(media_path, error);
+    } else {
+        // Read the image list straight out of the ISO: no loop mount, so no root needed
+        iso_reader iso;
+        if (!iso.open(media_path)) {
+            error = "Failed to open ISO file: " + iso.get_last_error();
+            return std::nullopt;
         }
+        images = read_iso_images(iso, error);
     }
 
-    // Extract image information
-    for (size_t i = 1; i <= num_images; i++) {
-        wim_image_info image_info;
-
-        // Get image name
-        const char* name = wimlib_get_image_name(wim, i);
-        if (name) {
-            image_info.name = name;
-        }
+    if (!images) {
+        error = "Failed to read WIM metadata: " + error;
+        return std::nullopt;
+    }
+    if (images->empty()) {
+        error = "Failed to scan WIM images or no images found";
+        return std::nullopt;
+    }
 
-        // Get image description
-        const char* description = wimlib_get_image_description(wim, i);
-        if (description) {
-            image_info.description = description;
-        }
+    nlohmann::json image_list = nlohmann::json::array();
+    for (const auto& image : *images) {
+        image_list.push_back(image.to_json());
+    }
+    m_media_cache.store(*fingerprint, media_path, image_list);
+    return image_list;
+}
 
-        // For display name and description, use the same as name/description
-        image_info.display_name = image_info.name;
-        image_info.display_description = image_info.description;
+void worker::index_iso_library(uint64_t workload_id, const nlohmann::json& params,
+                               const cancellation_token& token) {
+    std::cout << "[Worker] Indexing ISO library (ID: " << workload_id << ")..." << std::endl;
+    std::cout << "[Worker] Parameters: " << params.dump() << std::endl;
 
-        // Only add if we have at least a name
-        if (!image_info.name.empty()) {
-            images.push_back(image_info);
+    std::vector<std::string> directories;
+    for (const auto& directory : params.value("directories", nlohmann::json::array())) {
+        if (directory.is_string()) {
+            directories.push_back(directory.get<std::string>());
         }
     }
+    if (directories.empty()) {
+        respond(workload_id, workload_status::error, "No directories provided");
+        return;
+    }
+
+    // Bounds how many ISOs are read at once; a few in flight hide network share latency
+    size_t concurrency = std::clamp<size_t>(params.value("concurrency", 4u), 1, 32);
+    bool watch = params.value("watch", false);
 
-    // Free WIM structure
-    wimlib_free(wim);
+    respond(workload_id, workload_status::in_progress, "Scanning ISO library...");
 
-    // Unmount and cleanup
-    system(("umount " + mount_point + " && rmdir " + mount_point).c_str());
+    auto read = [this](const std::string& path, std::string& hash, std::string& error) {
+        return read_media_images(path, error, &hash);
+    };
 
-    if (images.empty()) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to scan WIM images or no images found");
+    auto scan_start = std::chrono::steady_clock::now();
+    auto on_progress = [this, workload_id, scan_start](size_t done, size_t total) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - scan_start;
+        double rate = elapsed.count() > 0 ? done / elapsed.count() : 0.0;
+        double eta = rate > 0 ? (total - done) / rate : -1.0;
+        publish_progress(workload_id, static_cast<double>(done), static_cast<double>(total), rate,
+                         eta);
+    };
+    iso_library::scan_stats stats =
+        m_iso_library.scan(directories, concurrency, read, token, on_progress);
+
+    if (check_cancelled(workload_id, token)) {
         return;
     }
 
-    // Convert to the expected format
-    std::vector<std::string> windows_versions;
-    for (const auto& image : images) {
-        std::string version_info = image.display_name.empty() ? image.name : image.display_name;
-        if (!image.display_description.empty()) {
-            version_info += " - " + image.display_description;
-        } else if (!image.description.empty()) {
-            version_info += " - " + image.description;
+    if (watch) {
+        bool watching = m_iso_library.watch(
+            directories, concurrency, read,
+            [this](const std::string& change, const nlohmann::json& entry) {
+                publish_event("library", {{"change", change}, {"entry", entry}});
+            });
+        if (!watching) {
+            std::cerr << "[Worker] ISO library will only update on the next index" << std::endl;
         }
-        windows_versions.push_back(version_info);
     }
 
-    // Create result JSON
-    nlohmann::json result;
-    result["windows_versions"] = windows_versions;
-    result["total_count"] = windows_versions.size();
+    nlohmann::json result = stats.to_json();
+    result["total_entries"] = m_iso_library.get_entry_count();
+    result["watching"] = m_iso_library.is_watching();
+    respond(workload_id, workload_status::completed, result.dump());
+}
 
-    std::cout << "[Worker] WIM scan completed (ID: " << workload_id << "). Found "
-              << windows_versions.size() << " versions." << std::endl;
+void worker::search_iso_library(uint64_t workload_id, const nlohmann::json& params,
+                                const cancellation_token& token) {
+    nlohmann::json matches = m_iso_library.search(params);
+    if (check_cancelled(workload_id, token)) {
+        return;
+    }
 
-    // Send completion status with result data
-    m_ipc.send_workload_response(workload_id, workload_status::completed, result.dump());
+    nlohmann::json result = {{"images", matches}, {"total_count", matches.size()}};
+    respond(workload_id, workload_status::completed, result.dump());
 }
 
-void worker::install_vm(uint64_t workload_id, const nlohmann::json& params) {
-    std::cout << "[Worker] Installing VM (ID: " << workload_id << ")..." << std::endl;
+void worker::verify_iso(uint64_t workload_id, const nlohmann::json& params,
+                        const cancellation_token& token) {
+    std::cout << "[Worker] Verifying ISO (ID: " << workload_id << ")..." << std::endl;
     std::cout << "[Worker] Parameters: " << params.dump() << std::endl;
 
-    // Extract parameters
-    std::string vm_name = params.value("vm_name", "LSWVM");
     std::string iso_path = params.value("iso_path", "");
-    std::string windows_edition = params.value("windows_edition", "Home");
-    std::string admin_username = params.value("admin_username", "lsw");
-    std::string admin_password = params.value("admin_password", "");
-    int memory_gb = params.value("memory_gb", 4);
-    int cpu_cores = params.value("cpu_cores", 4);
-    int disk_gb = params.value("disk_gb", 30);
-    bool hardware_acceleration = params.value("hardware_acceleration", true);
-
-    // Validate required parameters
     if (iso_path.empty()) {
-        m_ipc.send_workload_response(workload_id, workload_status::error, "ISO path is required");
+        respond(workload_id, workload_status::error, "No ISO path provided");
         return;
     }
 
-    if (admin_password.empty()) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Admin password is required");
+    std::string error;
+    std::optional<metadata_cache::fingerprint> fingerprint =
+        metadata_cache::compute_fingerprint(iso_path, error);
+    if (!fingerprint) {
+        respond(workload_id, workload_status::error, error);
         return;
     }
 
-    // Send in-progress status
-    m_ipc.send_workload_response(workload_id, workload_status::in_progress,
-                                 "Connecting to libvirt daemon...");
+    // Hashing gigabytes takes a while; an unchanged file keeps its earlier verdict, as long as it
+    // was reached against the same expected hash
+    std::string expected_sha256 = params.value("sha256", "");
+    std::transform(expected_sha256.begin(), expected_sha256.end(), expected_sha256.begin(),
+                   ::tolower);
+    if (!params.value("force", false)) {
+        std::optional<nlohmann::json> cached = m_verify_cache.lookup(*fingerprint);
+        if (cached && cached->value("expected_sha256", "") == expected_sha256) {
+            std::cout << "[Worker] Verification of " << iso_path << " answered from cache"
+                      << std::endl;
+            (*cached)["cached"] = true;
+            respond(workload_id, workload_status::completed, cached->dump());
+            return;
+        }
+    }
 
-    // Use application singleton's VM manager
-    vm_manager& vm_mgr = application::instance().get_vm_manager();
-    if (!vm_mgr.connect()) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to connect to libvirt: " + vm_mgr.get_last_error());
+    respond(workload_id, workload_status::in_progress, "Verifying ISO...");
+
+    // The bar runs over both stages: hashing the ISO fills the first half and the WIM integrity
+    // check the second, each scaled to the ISO size. Throughput and ETA are taken per stage, as
+    // the stages read at different speeds.
+    uint64_t iso_size = fingerprint->size;
+    double combined_total = 2.0 * static_cast<double>(std::max<uint64_t>(iso_size, 1));
+    std::string current_stage;
+    double stage_base = 0.0;
+    auto stage_start = std::chrono::steady_clock::now();
+    int reported_percent = -1;
+    auto on_progress = [&](const std::string& stage, uint64_t done, uint64_t total) {
+        bool new_stage = stage != current_stage;
+        if (new_stage) {
+            if (!current_stage.empty()) {
+                stage_base = combined_total / 2;
+            }
+            current_stage = stage;
+            stage_start = std::chrono::steady_clock::now();
+        }
+
+        double stage_fraction = total > 0 ? static_cast<double>(done) / total : 1.0;
+        double combined_done = stage_base + stage_fraction * combined_total / 2;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - stage_start;
+        double rate = elapsed.count() > 0 ? done / elapsed.count() : 0.0;
+        double units_per_second =
+            elapsed.count() > 0 ? (combined_done - stage_base) / elapsed.count() : 0.0;
+        double eta =
+            units_per_second > 0 ? (combined_total - combined_done) / units_per_second : -1.0;
+        publish_progress(workload_id, combined_done, combined_total, rate, eta);
+
+        // The ring carries every tick; a text frame only goes out per stage and every 5%
+        int percent = static_cast<int>(stage_fraction * 100);
+        if (!new_stage && percent / 5 == reported_percent / 5) {
+            return;
+        }
+        reported_percent = percent;
+        char message[128];
+        snprintf(message, sizeof(message), "Verifying ISO (%s): %d%% at %.0f MB/s", stage.c_str(),
+                 percent, rate / (1024 * 1024));
+        respond(workload_id, workload_status::in_progress, message);
+    };
+
+    std::optional<iso_verifier::result> verified =
+        iso_verifier::verify(iso_path, params.value("threads", 0u), expected_sha256, token,
+                             on_progress, error);
+    if (check_cancelled(workload_id, token)) {
         return;
     }
-
-    // Ensure network is available
-    m_ipc.send_workload_response(workload_id, workload_status::in_progress,
-                                 "Ensuring network connectivity...");
-    if (!vm_mgr.ensure_network_available("default")) {
-        // Get detailed diagnostics
-        std::string diagnostics = vm_mgr.get_network_diagnostics("default");
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to ensure network availability: " +
-                                         vm_mgr.get_last_error() + "\n\n" + diagnostics);
+    if (!verified) {
+        respond(workload_id, workload_status::error, "Failed to verify ISO: " + error);
         return;
     }
 
-    // Check if VM already exists
-    if (vm_mgr.vm_exists(vm_name)) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "VM '" + vm_name + "' already exists");
-        return;
+    std::cout << "[Worker] Verified " << iso_path << " in " << verified->seconds
+              << "s: " << (verified->is_valid() ? "valid" : "corrupt") << " (SHA-256 "
+              << (verified->expected_sha256.empty()
+                      ? "not compared"
+                      : (verified->sha256_matches() ? "matches" : "mismatch"))
+              << ", WIM integrity " << verified->wim_integrity << ")" << std::endl;
+
+    // Only finished checks are cached; a read error returned above, so the next request retries
+    nlohmann::json result = verified->to_json();
+    m_verify_cache.store(*fingerprint, iso_path, result);
+    result["cached"] = false;
+    respond(workload_id, workload_status::completed, result.dump());
+}
+
+std::optional<slim_media::result> worker::prepare_slim_media(uint64_t workload_id,
+                                                             const std::string& iso_path,
+                                                             uint32_t image_index,
+                                                             const nlohmann::json& spec,
+                                                             const cancellation_token& token,
+                                                             std::string& error) {
+    std::optional<metadata_cache::fingerprint> fingerprint =
+        metadata_cache::compute_fingerprint(iso_path, error);
+    if (!fingerprint) {
+        return std::nullopt;
     }
 
-    // Create separate autounattend ISO
-    std::string autounattend_iso_path =
-        "/tmp/" + vm_name + "_autounattend_" + std::to_string(getpid()) + ".iso";
+    slim_media::options opts = slim_media::options::from_json(spec);
+    opts.image_index = image_index;
 
-    // Send progress update
-    m_ipc.send_workload_response(workload_id, workload_status::in_progress,
-                                 "Creating autounattend ISO...");
+    auto build_start = std::chrono::steady_clock::now();
+    std::string reported_stage;
+    int reported_percent = -1;
+    auto on_progress = [&](const std::string& stage, uint64_t done, uint64_t total) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - build_start;
+        double rate = elapsed.count() > 0 ? done / elapsed.count() : 0.0;
+        publish_progress(workload_id, static_cast<double>(done), static_cast<double>(total), rate);
+
+        // Text frames only on a stage change and every 5%
+        int percent = total > 0 ? static_cast<int>(done * 100 / total) : 100;
+        if (stage == reported_stage && percent / 5 == reported_percent / 5) {
+            return;
+        }
+        reported_stage = stage;
+        reported_percent = percent;
+        char message[128];
+        snprintf(message, sizeof(message), "Building slim media (%s): %d%%", stage.c_str(),
+                 percent);
+        respond(workload_id, workload_status::in_progress, message);
+    };
+
+    std::optional<slim_media::result> built =
+        slim_media::build(iso_path, fingerprint->to_string(), opts,
+                          slim_media::DEFAULT_CACHE_DIRECTORY, token, on_progress, error);
+    if (built && built->cached) {
+        std::cout << "[Worker] Slim media for " << iso_path << " image " << image_index
+                  << " answered from cache: " << built->iso_path << std::endl;
+    }
+    return built;
+}
+
+std::optional<offline_apply::result>
+worker::apply_offline_image(uint64_t workload_id, const std::string& iso_path,
+                            uint32_t image_index, const std::string& disk_path,
+                            const std::string& disk_format,
+                            const std::string& unattend_xml, const offline_apply::options& opts,
+                            const cancellation_token& token, std::string& error) {
+    auto apply_start = std::chrono::steady_clock::now();
+    std::string reported_stage;
+    int reported_percent = -1;
+    auto on_progress = [&](const std::string& stage, uint64_t done, uint64_t total) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - apply_start;
+        double rate = elapsed.count() > 0 ? done / elapsed.count() : 0.0;
+        publish_progress(workload_id, static_cast<double>(done), static_cast<double>(total), rate);
+
+        int percent = total > 0 ? static_cast<int>(done * 100 / total) : 100;
+        if (stage == reported_stage && percent / 5 == reported_percent / 5) {
+            return;
+        }
+        reported_stage = stage;
+        reported_percent = percent;
+        char message[128];
+        snprintf(message, sizeof(message), "Applying Windows image (%s): %d%%", stage.c_str(),
+                 percent);
+        respond(workload_id, workload_status::in_progress, message);
+    };
+
+    return offline_apply::apply(iso_path, image_index, disk_path, disk_format, unattend_xml,
+                                opts, token, on_progress, error);
+}
+
+bool worker::download_media(uint64_t workload_id, const std::string& url, const std::string& path,
+                            multipart_transfer& transfer, const cancellation_token& token,
+                            std::string& error) {
+    // Same transfer settings as the installer's download page
+    multipart_transfer::options opts;
+    opts.max_threads = 4;
+    opts.chunk_size_bytes = 4 * 1024 * 1024; // 4MB chunks
+    opts.per_request_timeout_seconds = 60;
+    opts.output_file_path = path + ".part";
+
+    cancellation_token::callback_id callback =
+        token.add_callback([&transfer]() { transfer.cancel(); });
+    DEFER({ token.remove_callback(callback); });
+
+    // Parts report from their own threads; only every 5% goes to the client
+    std::mutex progress_mutex;
+    int reported_percent = -1;
+    bool succeeded = false;
+    if (!token.is_cancelled()) {
+        transfer.download(
+            url, opts,
+            [&](const multipart_transfer::progress_info& info) {
+                if (info.global_total_bytes == 0) {
+                    return;
+                }
+                int percent = static_cast<int>(info.global_bytes_downloaded * 100 /
+                                               info.global_total_bytes);
+                {
+                    std::lock_guard<std::mutex> lock(progress_mutex);
+                    if (percent / 5 == reported_percent / 5) {
+                        return;
+                    }
+                    reported_percent = percent;
+                }
+                char message[128];
+                snprintf(message, sizeof(message), "Downloading Windows ISO: %d%% (%.1f MB/s)",
+                         percent, info.global_bytes_per_sec / (1024.0 * 1024.0));
+                respond(workload_id, workload_status::in_progress, message);
+            },
+            [&](bool success, const std::string& message) {
+                succeeded = success;
+                if (!success) {
+                    error = "Failed to download ISO: " + message;
+                }
+            });
+    }
 
-    // Create autounattend configuration
-    autounattend_manager::configuration autounattend_config;
-    autounattend_config.computer_name = vm_name;
-    autounattend_config.username = admin_username;
-    autounattend_config.display_name = admin_username;
-    autounattend_config.password = admin_password;
+    std::error_code ignored;
+    if (token.is_cancelled()) {
+        error = token.get_reason();
+        succeeded = false;
+    }
+    if (!succeeded) {
+        std::filesystem::remove(opts.output_file_path, ignored);
+        return false;
+    }
 
-    // Generate autounattend.xml content using application singleton
-    autounattend_manager& autounattend_mgr = application::instance().get_autounattend_manager();
-    std::string autounattend_content = autounattend_mgr.generate_autounattend(autounattend_config);
+    std::error_code ec;
+    std::filesystem::rename(opts.output_file_path, path, ec);
+    if (ec) {
+        error = "Failed to move downloaded ISO to " + path + ": " + ec.message();
+        std::filesystem::remove(opts.output_file_path, ignored);
+        return false;
+    }
+    std::cout << "[Worker] Downloaded " << url << " to " << path << std::endl;
+    return true;
+}
 
-    // Create temporary directory for autounattend ISO
-    std::string temp_dir = "/tmp/lsw_autounattend_" + std::to_string(getpid());
-    std::string autounattend_dir = temp_dir + "/autounattend";
+void worker::build_slim_media(uint64_t workload_id, const nlohmann::json& params,
+                              const cancellation_token& token) {
+    std::cout << "[Worker] Building slim media (ID: " << workload_id << ")..." << std::endl;
+    std::cout << "[Worker] Parameters: " << params.dump() << std::endl;
 
-    // Create directory
-    std::string mkdir_cmd = "mkdir -p " + autounattend_dir;
-    if (system(mkdir_cmd.c_str()) != 0) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to create temporary directory");
+    std::string iso_path = params.value("iso_path", "");
+    if (iso_path.empty()) {
+        respond(workload_id, workload_status::error, "No ISO path provided");
         return;
     }
 
-    // Set up cleanup for temporary directory
-    DEFER({
-        std::cout << "[Worker] Cleaning up temporary autounattend files..." << std::endl;
-        // Remove temporary directory
-        system(("rm -rf " + temp_dir + " 2>/dev/null || true").c_str());
-        std::cout << "[Worker] Temporary autounattend cleanup completed" << std::endl;
-    });
+    std::string error;
+    uint32_t image_index = params.value("image_index", 0u);
+    if (image_index == 0) {
+        std::string windows_edition = params.value("windows_edition", "");
+        std::optional<nlohmann::json> images = read_media_images(iso_path, error);
+        if (!images) {
+            respond(workload_id, workload_status::error, error);
+            return;
+        }
+        image_index = find_image_index(*images, windows_edition);
+        if (image_index == 0) {
+            respond(workload_id, workload_status::error,
+                    "Windows edition '" + windows_edition + "' not found on the ISO");
+            return;
+        }
+    }
+
+    respond(workload_id, workload_status::in_progress, "Building slim media...");
+    std::optional<slim_media::result> built =
+        prepare_slim_media(workload_id, iso_path, image_index, params, token, error);
+    if (check_cancelled(workload_id, token)) {
+        return;
+    }
+    if (!built) {
+        respond(workload_id, workload_status::error, "Failed to build slim media: " + error);
+        return;
+    }
+    respond(workload_id, workload_status::completed, built->to_json().dump());
+}
+
+void worker::install_vm(uint64_t workload_id, const nlohmann::json& params,
+                        const cancellation_token& token) {
+    std::cout << "[Worker] Installing VM (ID: " << workload_id << ")..." << std::endl;
+    std::cout << "[Worker] Parameters: " << params.dump() << std::endl;
+    auto install_start = std::chrono::steady_clock::now();
+
+    // Extract parameters
+    std::string vm_name = params.value("vm_name", "LSWVM");
+    std::string iso_path = params.value("iso_path", "");
+    std::string windows_edition = params.value("windows_edition", "Home");
+    std::string admin_username = params.value("admin_username", "lsw");
+    std::string admin_password = params.value("admin_password", "");
+    int memory_gb = params.value("memory_gb", 4);
+    int cpu_cores = params.value("cpu_cores", 4);
+    int disk_gb = params.value("disk_gb", 30);
+    // Disk layout: "disk_format" qcow2|raw, "disk_preallocation" off|metadata|falloc|full and the
+    // qcow2 options "disk_cluster_kib", "disk_extended_l2", "disk_lazy_refcounts"
+    std::string disk_format = params.value("disk_format", "qcow2");
+    std::string disk_preallocation = params.value("disk_preallocation", "off");
+    int disk_cluster_kib = params.value("disk_cluster_kib", 0);
+    bool disk_extended_l2 = params.value("disk_extended_l2", false);
+    bool disk_lazy_refcounts = params.value("disk_lazy_refcounts", false);
+    bool hardware_acceleration = params.value("hardware_acceleration", true);
+    // "generalize" runs sysprep after the first logon, leaving a disk for create_golden_image;
+    // "golden_image" defines a linked clone of that image instead of installing
+    bool generalize = params.value("generalize", false);
+    std::string golden_image = params.value("golden_image", "");
+    int install_timeout_minutes = params.value("install_timeout_minutes", 120);
+    // "offline_apply": {options} applies the image from the host instead of running Setup
+    bool offline = params.contains("offline_apply") && params["offline_apply"].is_object();
+    offline_apply::options offline_opts;
+    if (offline) {
+        // Not yet verified end to end, so it only runs when asked for as such
+        if (!params["offline_apply"].value("experimental", false)) {
+            respond(workload_id, workload_status::error,
+                    "Offline apply is experimental; set \"experimental\": true in "
+                    "\"offline_apply\" to use it");
+            return;
+        }
+        offline_opts = offline_apply::options::from_json(params["offline_apply"]);
+        std::cout << "[Worker] Provisioning with offline apply (experimental)" << std::endl;
+    }
 
-    // Write autounattend.xml to the autounattend directory
-    std::string autounattend_path = autounattend_dir + "/autounattend.xml";
-    std::ofstream autounattend_file(autounattend_path);
-    if (!autounattend_file.is_open()) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to create autounattend.xml file");
+    // Validate required parameters
+    if (iso_path.empty() && golden_image.empty()) {
+        respond(workload_id, workload_status::error, "ISO path is required");
         return;
     }
-    autounattend_file << autounattend_content;
-    autounattend_file.close();
 
-    // Create autounattend ISO using genisoimage
-    std::string iso_cmd =
-        "genisoimage -o " + autounattend_iso_path + " -V AUTOUNATTEND -J -r " + autounattend_dir;
-    if (system(iso_cmd.c_str()) != 0) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to create autounattend ISO");
+    if (admin_password.empty()) {
+        respond(workload_id, workload_status::error, "Admin password is required");
         return;
     }
 
-    // Create VM configuration
+    std::string backing_path;
+    if (!golden_image.empty()) {
+        backing_path = vm_manager::golden_image_path(golden_image);
+        if (backing_path.empty()) {
+            respond(workload_id, workload_status::error,
+                    "Golden image '" + golden_image + "' not found");
+            return;
+        }
+        if (offline) {
+            respond(workload_id, workload_status::error,
+                    "A linked clone cannot be provisioned by offline apply");
+            return;
+        }
+        std::cout << "[Worker] Cloning golden image " << backing_path << std::endl;
+    }
+
+    // The ISO may still be on a web server ("iso_url"); it is then downloaded to iso_path while
+    // the steps that do not read it (disk, network, edition lookup) run
+    std::string iso_url = params.value("iso_url", "");
+    bool download =
+        !iso_url.empty() && backing_path.empty() && !std::filesystem::exists(iso_path);
+
+    // Setup selects the edition by image index, which differs from one medium to the next.
+    // Clients that scanned the ISO pass it directly; otherwise look the edition up by name.
+    uint32_t image_index = params.value("image_index", 0u);
+    if (image_index != 0 && backing_path.empty()) {
+        std::cout << "[Worker] Installing image index " << image_index << " ("
+                  << windows_edition << ")" << std::endl;
+    }
+    // Optionally install from media holding only this edition; built once, reused by every VM
+    // installed with the same options
+    bool use_slim = params.contains("slim_media") && params["slim_media"].is_object();
+
+    // Use application singleton's VM manager
+    vm_manager& vm_mgr = application::instance().get_vm_manager();
+
+    // Create VM configuration; iso_path is filled in once the install media is settled
     vm_config vm_config_obj;
     vm_config_obj.name = vm_name;
-    vm_config_obj.iso_path = iso_path; // Use the original ISO
+    vm_config_obj.iso_path = iso_path;
     vm_config_obj.windows_edition = windows_edition;
     vm_config_obj.admin_username = admin_username;
     vm_config_obj.admin_password = admin_password;
     vm_config_obj.memory_gb = memory_gb;
     vm_config_obj.cpu_cores = cpu_cores;
     vm_config_obj.disk_gb = disk_gb;
+    vm_config_obj.disk_format = disk_format;
+    vm_config_obj.disk_preallocation = disk_preallocation;
+    vm_config_obj.disk_cluster_kib = disk_cluster_kib;
+    vm_config_obj.disk_extended_l2 = disk_extended_l2;
+    vm_config_obj.disk_lazy_refcounts = disk_lazy_refcounts;
     vm_config_obj.hardware_acceleration = hardware_acceleration;
     vm_config_obj.use_autounattend = true; // We'll mount the autounattend ISO separately
-    vm_config_obj.autounattend_iso_path = autounattend_iso_path; // Pass the autounattend ISO path
-    vm_config_obj.virtio_iso_path =
-        "/usr/share/virtio-win/virtio-win.iso"; // VirtIO guest tools ISO
+    vm_config_obj.virtio_iso_path = slim_media::DEFAULT_VIRTIO_ISO; // VirtIO guest tools ISO
+    vm_config_obj.backing_path = backing_path;
+    // An offline-applied disk falls through to Windows PE until the boot script has run
+    vm_config_obj.boot_disk_first = offline;
+
+    // Fail before downloading or building anything
+    if (!vm_mgr.validate_config(vm_config_obj, !download)) {
+        respond(workload_id, workload_status::error,
+                "Invalid VM configuration: " + vm_mgr.get_last_error());
+        return;
+    }
 
-    // Send progress update
-    m_ipc.send_workload_response(workload_id, workload_status::in_progress,
-                                 "Creating VM '" + vm_name + "' with " + std::to_string(memory_gb) +
-                                     "GB RAM and " + std::to_string(cpu_cores) + " CPU cores...");
+    // Written by the autounattend step, into the images directory under a key of its contents,
+    // so a retry with the same configuration reuses it
+    std::string autounattend_iso_path;
 
-    // Create the VM
-    if (!vm_mgr.create_vm(vm_config_obj)) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to create VM: " + vm_mgr.get_last_error());
-        return;
+    // Boot media for offline apply are extracted to disk before going into the ISO, in a
+    // directory of this workload's own: the daemon runs several installs at once
+    std::string temp_dir;
+    DEFER({
+        if (!temp_dir.empty()) {
+            std::error_code ignored;
+            std::filesystem::remove_all(temp_dir, ignored);
+        }
+    });
+
+    // The disk is only needed by the VM; drop it if we never get that far
+    bool vm_created = false;
+    bool disk_created = false;
+    std::string disk_path = vm_manager::disk_image_path(vm_name, disk_format);
+    DEFER({
+        if (!vm_created && disk_created) {
+            std::error_code ignored;
+            std::filesystem::remove(disk_path, ignored);
+        }
+    });
+
+    // Each step starts as soon as the steps it depends on are done. State shared between steps
+    // (iso_path, image_index, ...) is written by one step and only read by the steps after it.
+    task_graph graph;
+    auto report = [this, workload_id](const std::string& message) {
+        respond(workload_id, workload_status::in_progress, message);
+    };
+
+    task_graph::task_id libvirt = graph.add("connect", [&](std::string& error) {
+        report("Connecting to libvirt daemon...");
+        if (!vm_mgr.connect()) {
+            error = "Failed to connect to libvirt: " + vm_mgr.get_last_error();
+            return false;
+        }
+        if (vm_mgr.vm_exists(vm_name)) {
+            error = "VM '" + vm_name + "' already exists";
+            return false;
+        }
+        return true;
+    });
+
+    task_graph::task_id network = graph.add(
+        "network",
+        [&](std::string& error) {
+            report("Ensuring network connectivity...");
+            if (!vm_mgr.ensure_network_available("default")) {
+                // Include detailed diagnostics
+                error = "Failed to ensure network availability: " + vm_mgr.get_last_error() +
+                        "\n\n" + vm_mgr.get_network_diagnostics("default");
+                return false;
+            }
+            return true;
+        },
+        {libvirt});
+
+    // Steps that read the install media, and steps that need the edition's final image index;
+    // slim media replaces both
+    std::vector<task_graph::task_id> media_ready;
+    std::vector<task_graph::task_id> edition_ready;
+    // Shared with the edition lookup, which reads the ISO's metadata out of the running download
+    multipart_transfer transfer;
+    if (download) {
+        media_ready.push_back(graph.add("download", [&](std::string& error) {
+            report("Downloading Windows ISO...");
+            return download_media(workload_id, iso_url, iso_path, transfer, token, error);
+        }));
     }
 
-    // Send progress update
-    m_ipc.send_workload_response(workload_id, workload_status::in_progress,
-                                 "Starting VM '" + vm_name + "' for Windows installation...");
+    if (image_index == 0 && backing_path.empty()) {
+        edition_ready.push_back(graph.add("image_index", [&](std::string& error) {
+            std::optional<nlohmann::json> images;
+            if (download) {
+                images = read_downloading_images(transfer, iso_url, token, error);
+            } else {
+                images = read_media_images(iso_path, error);
+            }
+            if (!images) {
+                return false;
+            }
+            image_index = find_image_index(*images, windows_edition);
+            if (image_index == 0) {
+                error = "Windows edition '" + windows_edition + "' not found on the ISO";
+                return false;
+            }
+            std::cout << "[Worker] Installing image index " << image_index << " ("
+                      << windows_edition << ")" << std::endl;
+            return true;
+        }));
+    }
 
-    // Start the VM
-    if (!vm_mgr.start_vm(vm_name)) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to start VM: " + vm_mgr.get_last_error());
+    // The transfer holds the whole ISO in memory until it is released, once on disk and no
+    // longer read by the edition lookup
+    if (download) {
+        std::vector<task_graph::task_id> release_dependencies = media_ready;
+        release_dependencies.insert(release_dependencies.end(), edition_ready.begin(),
+                                    edition_ready.end());
+        graph.add(
+            "release_download",
+            [&](std::string&) {
+                transfer.release();
+                return true;
+            },
+            release_dependencies);
+    }
+
+    std::string driver_path;
+    if (use_slim && backing_path.empty()) {
+        std::vector<task_graph::task_id> slim_dependencies = media_ready;
+        slim_dependencies.insert(slim_dependencies.end(), edition_ready.begin(),
+                                 edition_ready.end());
+        task_graph::task_id slim_step = graph.add(
+            "slim_media",
+            [&](std::string& error) {
+                report("Preparing slim install media...");
+                std::optional<slim_media::result> slim = prepare_slim_media(
+                    workload_id, iso_path, image_index, params["slim_media"], token, error);
+                if (!slim) {
+                    error = "Failed to build slim media: " + error;
+                    return false;
+                }
+                iso_path = slim->iso_path;
+                image_index = slim_media::IMAGE_INDEX;
+                driver_path = slim->driver_path;
+                return true;
+            },
+            slim_dependencies);
+        media_ready = {slim_step};
+        edition_ready = {slim_step};
+    }
+
+    // Boot media for offline apply is extracted from the ISO; Setup only needs the answer file
+    std::vector<task_graph::task_id> unattend_dependencies = edition_ready;
+    if (offline) {
+        unattend_dependencies.insert(unattend_dependencies.end(), media_ready.begin(),
+                                     media_ready.end());
+    }
+    std::string autounattend_content;
+    task_graph::task_id autounattend_iso = graph.add(
+        "autounattend_iso",
+        [&](std::string& error) {
+            report("Creating autounattend ISO...");
+
+            // Create autounattend configuration
+            autounattend_manager::configuration autounattend_config;
+            autounattend_config.windows_edition_index = static_cast<int>(image_index);
+            autounattend_config.computer_name = vm_name;
+            autounattend_config.username = admin_username;
+            autounattend_config.display_name = admin_username;
+            autounattend_config.password = admin_password;
+            autounattend_config.driver_path = driver_path;
+            autounattend_config.generalize = generalize;
+
+            // Generate autounattend.xml content using application singleton
+            autounattend_manager& autounattend_mgr =
+                application::instance().get_autounattend_manager();
+            autounattend_content = autounattend_mgr.generate_autounattend(autounattend_config);
+
+            iso_builder media("AUTOUNATTEND");
+            if (offline) {
+                // The full unattend goes into the applied image; the ISO only carries what
+                // Windows PE needs to make it bootable
+                char temp_pattern[] = "/tmp/lsw_autounattend_XXXXXX";
+                if (!mkdtemp(temp_pattern)) {
+                    error = "Failed to create temporary directory: " +
+                            std::string(strerror(errno));
+                    return false;
+                }
+                temp_dir = temp_pattern;
+                std::string autounattend_dir = temp_dir + "/autounattend";
+                std::error_code ec;
+                std::filesystem::create_directories(autounattend_dir, ec);
+                if (ec) {
+                    error = "Failed to create temporary directory: " + ec.message();
+                    return false;
+                }
+                if (!offline_apply::write_boot_media(autounattend_dir, iso_path, image_index,
+                                                     offline_opts, token, error)) {
+                    error = "Failed to prepare boot media: " + error;
+                    return false;
+                }
+                if (!media.add_directory(autounattend_dir, "", error)) {
+                    return false;
+                }
+            } else if (!media.add_file("autounattend.xml", autounattend_content, error)) {
+                return false;
+            }
+
+            // Named after its contents: an identical ISO from an earlier attempt is reused as is
+            std::optional<std::string> key = media.fingerprint(error);
+            if (!key) {
+                return false;
+            }
+            autounattend_iso_path = vm_manager::autounattend_iso_path(vm_name, *key);
+            if (std::filesystem::exists(autounattend_iso_path)) {
+                std::cout << "[Worker] Reusing " << autounattend_iso_path << std::endl;
+                return true;
+            }
+            if (!media.write(autounattend_iso_path, token, nullptr, error)) {
+                error = "Failed to create autounattend ISO: " + error;
+                return false;
+            }
+            return true;
+        },
+        unattend_dependencies);
+
+    task_graph::task_id disk = graph.add(
+        "disk",
+        [&](std::string& error) {
+            report("Creating disk image...");
+            if (vm_mgr.create_disk_image(vm_config_obj).empty()) {
+                error = "Failed to create disk image: " + vm_mgr.get_last_error();
+                return false;
+            }
+            disk_created = true;
+            return true;
+        },
+        {libvirt});
+
+    // The disk is created as for Setup, then filled from the host
+    task_graph::task_id disk_ready = disk;
+    std::optional<offline_apply::result> applied;
+    if (offline) {
+        std::vector<task_graph::task_id> apply_dependencies = media_ready;
+        apply_dependencies.insert(apply_dependencies.end(), edition_ready.begin(),
+                                  edition_ready.end());
+        apply_dependencies.push_back(disk);
+        apply_dependencies.push_back(autounattend_iso);
+        disk_ready = graph.add(
+            "apply_image",
+            [&](std::string& error) {
+                report("Applying Windows image to the disk...");
+                applied = apply_offline_image(workload_id, iso_path, image_index, disk_path,
+                                              disk_format, autounattend_content, offline_opts,
+                                              token, error);
+                if (!applied) {
+                    error = "Failed to apply image: " + error;
+                    return false;
+                }
+                return true;
+            },
+            apply_dependencies);
+    }
+
+    // After the autounattend ISO, and so after slim media: the XML names both
+    std::string domain_xml;
+    task_graph::task_id domain = graph.add(
+        "domain_xml",
+        [&](std::string& error) {
+            vm_config config = vm_config_obj;
+            config.iso_path = iso_path;
+            config.autounattend_iso_path = autounattend_iso_path;
+            domain_xml = vm_mgr.generate_vm_xml(config);
+            if (domain_xml.empty()) {
+                error = "Failed to generate VM XML: " + vm_mgr.get_last_error();
+                return false;
+            }
+            return true;
+        },
+        {autounattend_iso});
+
+    task_graph::task_id define = graph.add(
+        "define",
+        [&](std::string& error) {
+            report("Creating VM '" + vm_name + "' with " + std::to_string(memory_gb) +
+                   "GB RAM and " + std::to_string(cpu_cores) + " CPU cores...");
+            if (!vm_mgr.define_vm(vm_name, domain_xml)) {
+                error = "Failed to create VM: " + vm_mgr.get_last_error();
+                return false;
+            }
+            vm_created = true;
+            return true;
+        },
+        {network, disk_ready, domain, autounattend_iso});
+
+    // Only lifecycle events after the VM starts tell us about the installation
+    uint64_t events_seq = 0;
+    std::vector<task_graph::task_id> start_dependencies = media_ready;
+    start_dependencies.push_back(define);
+    graph.add(
+        "start",
+        [&](std::string& error) {
+            report("Starting VM '" + vm_name + "' for Windows installation...");
+            events_seq = m_vm_events.lifecycle_seq();
+            if (!vm_mgr.start_vm(vm_name)) {
+                error = "Failed to start VM: " + vm_mgr.get_last_error();
+                return false;
+            }
+            return true;
+        },
+        start_dependencies);
+
+    std::string error;
+    bool provisioned = graph.run(
+        token, error,
+        [this, workload_id](const task_graph::timing& step, size_t finished, size_t total) {
+            std::cout << "[Worker] Install step " << step.name << " " << step.status << " after "
+                      << step.seconds << "s" << std::endl;
+            publish_progress(workload_id, 5.0 * finished / total, INSTALL_STEPS);
+        });
+
+    nlohmann::json steps = nlohmann::json::array();
+    for (const task_graph::timing& step : graph.timings()) {
+        steps.push_back({{"name", step.name},
+                         {"start_seconds", step.start_seconds},
+                         {"seconds", step.seconds},
+                         {"status", step.status}});
+    }
+    std::cout << "[Worker] Install steps: " << steps.dump() << std::endl;
+
+    if (!provisioned) {
+        if (!check_cancelled(workload_id, token)) {
+            respond(workload_id, workload_status::error, error);
+        }
+        return;
+    }
+
+    // A clone only has specialize and OOBE left, which it runs on its own from the
+    // autounattend ISO; it stays attached, as it does after a Setup install
+    if (!backing_path.empty()) {
+        std::chrono::duration<double> clone_elapsed =
+            std::chrono::steady_clock::now() - install_start;
+        std::cout << "[Worker] Linked clone " << vm_name << " of " << golden_image
+                  << " started in " << clone_elapsed.count() << "s" << std::endl;
+        publish_progress(workload_id, INSTALL_STEPS, INSTALL_STEPS);
+
+        nlohmann::json result = {{"vm_name", vm_name},
+                                 {"golden_image", golden_image},
+                                 {"backing_path", backing_path},
+                                 {"admin_username", admin_username},
+                                 {"memory_gb", memory_gb},
+                                 {"cpu_cores", cpu_cores},
+                                 {"disk_gb", disk_gb},
+                                 {"hardware_acceleration", hardware_acceleration},
+                                 {"status", "cloned_and_running"},
+                                 {"vm_id", vm_name},
+                                 {"provisioning", "linked_clone"},
+                                 {"installation_seconds", clone_elapsed.count()},
+                                 {"steps", steps}};
+        respond(workload_id, workload_status::completed, result.dump());
         return;
     }
 
     // Send progress update
-    m_ipc.send_workload_response(
-        workload_id, workload_status::in_progress,
-        "Windows installation in progress... This may take 30-60 minutes.");
+    respond(workload_id, workload_status::in_progress,
+            offline ? "Preparing boot files and running first-boot setup..."
+                    : "Windows installation in progress... This may take 30-60 minutes.");
+    publish_progress(workload_id, 5, INSTALL_STEPS);
+
+    // Estimate Setup's progress from what the guest writes, calibrated on the edition's size.
+    // Without the image size only the elapsed time is reported.
+    uint64_t image_bytes = 0;
+    {
+        std::string error;
+        std::optional<nlohmann::json> images = read_media_images(iso_path, error);
+        for (const auto& image : images ? *images : nlohmann::json::array()) {
+            if (image.value("index", 0u) == image_index) {
+                image_bytes = image.value("total_bytes", uint64_t(0));
+            }
+        }
+    }
+    std::shared_ptr<install_progress> progress;
+    vm_event_monitor::listener_id stats_listener = 0;
+    if (image_bytes > 0) {
+        progress = std::make_shared<install_progress>(image_bytes, offline);
+        auto last_message = std::make_shared<std::string>();
+        // Runs on the monitor thread, possibly once more after it is removed
+        stats_listener = m_vm_events.add_listener(
+            [this, workload_id, vm_name, progress,
+             last_message](const vm_event_monitor::vm_event& event) {
+                if (event.type != "stats" || event.vm_name != vm_name) {
+                    return;
+                }
+                install_progress::estimate estimate = progress->update(event.data);
+                publish_progress(workload_id, 5 + estimate.percent / 100.0, INSTALL_STEPS,
+                                 estimate.write_rate, estimate.eta_seconds);
+                std::string message =
+                    "Windows installation: " + install_progress::describe(estimate);
+                if (message != *last_message) {
+                    *last_message = message;
+                    respond(workload_id, workload_status::in_progress, message);
+                }
+            });
+        set_stats_interval(workload_id, INSTALL_STATS_INTERVAL);
+    }
+    DEFER({
+        if (stats_listener != 0) {
+            m_vm_events.remove_listener(stats_listener);
+            set_stats_interval(workload_id, std::chrono::milliseconds(0));
+        }
+    });
 
-    // Monitor VM status during installation
-    bool installation_complete = false;
-    int check_count = 0;
-    const int max_checks = 120; // Check for up to 2 hours (120 * 1 minute)
+    // Setup (or the first boot of an applied image) ends by shutting the VM down, which wakes
+    // this wait right away
+    auto monitor_start = std::chrono::steady_clock::now();
+    auto install_deadline = monitor_start + std::chrono::minutes(install_timeout_minutes);
+    auto next_report = monitor_start + INSTALL_REPORT_INTERVAL;
+    while (true) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= install_deadline) {
+            respond(workload_id, workload_status::error,
+                    "Windows installation timed out after " +
+                        std::to_string(install_timeout_minutes) + " minutes");
+            return;
+        }
+        if (now >= next_report) {
+            // The progress estimate, when there is one, already keeps the client informed
+            auto elapsed = std::chrono::duration_cast<std::chrono::minutes>(now - monitor_start);
+            if (!progress) {
+                respond(workload_id, workload_status::in_progress,
+                        "Windows installation still in progress... (" +
+                            std::to_string(elapsed.count()) + " minutes elapsed)");
+            }
+            next_report += INSTALL_REPORT_INTERVAL;
+        }
 
-    while (!installation_complete && check_count < max_checks) {
-        std::this_thread::sleep_for(std::chrono::minutes(10));
-        check_count++;
+        std::optional<vm_event_monitor::lifecycle_change> change = m_vm_events.wait_for_state(
+            vm_name, {"shutoff", "crashed"}, events_seq,
+            std::min({install_deadline, next_report, now + INSTALL_POLL_INTERVAL}), token);
+        if (token.is_cancelled()) {
+            // Leave the VM defined so the user can inspect or resume it, but stop the installer
+            vm_mgr.stop_vm(vm_name);
+            check_cancelled(workload_id, token);
+            return;
+        }
+        if (change) {
+            if (change->crashed || change->state == "crashed") {
+                respond(workload_id, workload_status::error,
+                        "VM installation failed - the VM crashed");
+                return;
+            }
+            break;
+        }
 
-        // Get VM status
+        // No event: check directly in case the monitor missed it
         nlohmann::json vm_info = vm_mgr.get_vm_info(vm_name);
         if (vm_info.contains("error")) {
-            m_ipc.send_workload_response(workload_id, workload_status::error,
-                                         "Failed to monitor VM: " +
-                                             vm_info["error"].get<std::string>());
+            respond(workload_id, workload_status::error,
+                    "Failed to monitor VM: " + vm_info["error"].get<std::string>());
             return;
         }
 
         std::string vm_state = vm_info.value("state", "unknown");
-
-        // Send periodic progress updates
-        if (check_count % 10 == 0) { // Every 10 minutes
-            m_ipc.send_workload_response(workload_id, workload_status::in_progress,
-                                         "Windows installation still in progress... (" +
-                                             std::to_string(check_count) + " minutes elapsed)");
+        if (vm_state == "shutoff") {
+            break; // VM has shut down, installation is complete
         }
-
-        // Check if VM is still running (installation in progress)
-        if (vm_state == "running") {
-            continue; // Still installing
-        } else if (vm_state == "shutoff") {
-            // VM has shut down, installation might be complete
-            installation_complete = true;
-        } else {
+        if (vm_state != "running") {
             // VM crashed or in unexpected state
-            m_ipc.send_workload_response(workload_id, workload_status::error,
-                                         "VM installation failed - VM is in state: " + vm_state);
+            respond(workload_id, workload_status::error,
+                    "VM installation failed - VM is in state: " + vm_state);
             return;
         }
     }
-
-    if (check_count >= max_checks) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Windows installation timed out after 2 hours");
-        return;
-    }
+    auto installation_minutes = std::chrono::duration_cast<std::chrono::minutes>(
+        std::chrono::steady_clock::now() - monitor_start);
 
     // Send progress update
-    m_ipc.send_workload_response(workload_id, workload_status::in_progress,
-                                 "Windows installation completed! Starting VM...");
-
-    // Start the VM again after installation
-    if (!vm_mgr.start_vm(vm_name)) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to start VM after installation: " +
-                                         vm_mgr.get_last_error());
+    respond(workload_id, workload_status::in_progress,
+            generalize ? "Windows installation completed and generalized"
+                       : "Windows installation completed! Starting VM...");
+
+    // Start the VM again after installation. A generalized system stays off: booting it would
+    // specialize it, and it is meant to become a golden image.
+    if (!generalize && !vm_mgr.start_vm(vm_name)) {
+        respond(workload_id, workload_status::error,
+                "Failed to start VM after installation: " + vm_mgr.get_last_error());
         return;
     }
 
     std::cout << "[Worker] VM installation completed (ID: " << workload_id << ")" << std::endl;
+    publish_progress(workload_id, INSTALL_STEPS, INSTALL_STEPS);
 
-    // Clean up temporary files now that installation is complete
-    m_ipc.send_workload_response(workload_id, workload_status::in_progress,
-                                 "Cleaning up temporary files...");
-
-    std::cout << "[Worker] Cleaning up autounattend ISO file..." << std::endl;
-    system(("rm -f " + autounattend_iso_path + " 2>/dev/null || true").c_str());
-    std::cout << "[Worker] Autounattend ISO cleanup completed" << std::endl;
-
-    // Note: VirtIO ISO is typically a system file, so we don't remove it
-    // The VM will continue to use it for driver access if needed
-    std::cout << "[Worker] VirtIO drivers ISO preserved (system file)" << std::endl;
+    // The autounattend ISO stays: the domain still has it attached, a reinstall with the same
+    // configuration reuses it, and delete_vm removes it with the VM
 
     // Send completion status with result data
     nlohmann::json result = {{"vm_name", vm_name},
@@ -525,14 +2158,28 @@ void worker::install_vm(uint64_t workload_id, const nlohmann::json& params) {
                              {"cpu_cores", cpu_cores},
                              {"disk_gb", disk_gb},
                              {"hardware_acceleration", hardware_acceleration},
-                             {"status", "installed_and_running"},
+                             {"status", generalize ? "generalized" : "installed_and_running"},
                              {"vm_id", vm_name},
-                             {"installation_time_minutes", check_count}};
+                             {"installation_time_minutes", installation_minutes.count()}};
+    // End to end, so Setup and offline apply can be compared
+    std::chrono::duration<double> install_elapsed =
+        std::chrono::steady_clock::now() - install_start;
+    std::string provisioning = offline ? "offline_apply" : "setup";
+    result["provisioning"] = provisioning;
+    result["installation_seconds"] = install_elapsed.count();
+    result["steps"] = steps;
+    if (applied) {
+        result["offline_apply"] = applied->to_json();
+        result["offline_apply"]["experimental"] = true;
+    }
+    std::cout << "[Worker] Provisioned " << vm_name << " via " << provisioning << " in "
+              << install_elapsed.count() << "s" << std::endl;
 
-    m_ipc.send_workload_response(workload_id, workload_status::completed, result.dump());
+    respond(workload_id, workload_status::completed, result.dump());
 }
 
-void worker::get_vm_status(uint64_t workload_id, const nlohmann::json& params) {
+void worker::get_vm_status(uint64_t workload_id, const nlohmann::json& params,
+                           const cancellation_token& token) {
     std::cout << "[Worker] Getting VM status (ID: " << workload_id << ")..." << std::endl;
     std::cout << "[Worker] Parameters: " << params.dump() << std::endl;
 
@@ -540,19 +2187,19 @@ void worker::get_vm_status(uint64_t workload_id, const nlohmann::json& params) {
     std::string vm_name = params.value("vm_name", "");
 
     if (vm_name.empty()) {
-        m_ipc.send_workload_response(workload_id, workload_status::error, "VM name is required");
+        respond(workload_id, workload_status::error, "VM name is required");
         return;
     }
 
     // Send progress update
-    m_ipc.send_workload_response(workload_id, workload_status::in_progress,
-                                 "Getting status for VM '" + vm_name + "'...");
+    respond(workload_id, workload_status::in_progress,
+            "Getting status for VM '" + vm_name + "'...");
 
     // Use application singleton's VM manager
     vm_manager& vm_mgr = application::instance().get_vm_manager();
     if (!vm_mgr.connect()) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to connect to libvirt: " + vm_mgr.get_last_error());
+        respond(workload_id, workload_status::error,
+                "Failed to connect to libvirt: " + vm_mgr.get_last_error());
         return;
     }
 
@@ -560,16 +2207,16 @@ void worker::get_vm_status(uint64_t workload_id, const nlohmann::json& params) {
     nlohmann::json vm_info = vm_mgr.get_vm_info(vm_name);
 
     if (vm_info.contains("error")) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     vm_info["error"].get<std::string>());
+        respond(workload_id, workload_status::error, vm_info["error"].get<std::string>());
         return;
     }
 
     std::cout << "[Worker] VM status retrieved (ID: " << workload_id << ")" << std::endl;
-    m_ipc.send_workload_response(workload_id, workload_status::completed, vm_info.dump());
+    respond(workload_id, workload_status::completed, vm_info.dump());
 }
 
-void worker::start_vm(uint64_t workload_id, const nlohmann::json& params) {
+void worker::start_vm(uint64_t workload_id, const nlohmann::json& params,
+                      const cancellation_token& token) {
     std::cout << "[Worker] Starting VM (ID: " << workload_id << ")..." << std::endl;
     std::cout << "[Worker] Parameters: " << params.dump() << std::endl;
 
@@ -577,36 +2224,36 @@ void worker::start_vm(uint64_t workload_id, const nlohmann::json& params) {
     std::string vm_name = params.value("vm_name", "");
 
     if (vm_name.empty()) {
-        m_ipc.send_workload_response(workload_id, workload_status::error, "VM name is required");
+        respond(workload_id, workload_status::error, "VM name is required");
         return;
     }
 
     // Send progress update
-    m_ipc.send_workload_response(workload_id, workload_status::in_progress,
-                                 "Starting VM '" + vm_name + "'...");
+    respond(workload_id, workload_status::in_progress, "Starting VM '" + vm_name + "'...");
 
     // Use application singleton's VM manager
     vm_manager& vm_mgr = application::instance().get_vm_manager();
     if (!vm_mgr.connect()) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to connect to libvirt: " + vm_mgr.get_last_error());
+        respond(workload_id, workload_status::error,
+                "Failed to connect to libvirt: " + vm_mgr.get_last_error());
         return;
     }
 
     // Start the VM
     if (!vm_mgr.start_vm(vm_name)) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to start VM: " + vm_mgr.get_last_error());
+        respond(workload_id, workload_status::error,
+                "Failed to start VM: " + vm_mgr.get_last_error());
         return;
     }
 
     std::cout << "[Worker] VM started successfully (ID: " << workload_id << ")" << std::endl;
 
     nlohmann::json result = {{"vm_name", vm_name}, {"status", "running"}};
-    m_ipc.send_workload_response(workload_id, workload_status::completed, result.dump());
+    respond(workload_id, workload_status::completed, result.dump());
 }
 
-void worker::stop_vm(uint64_t workload_id, const nlohmann::json& params) {
+void worker::stop_vm(uint64_t workload_id, const nlohmann::json& params,
+                     const cancellation_token& token) {
     std::cout << "[Worker] Stopping VM (ID: " << workload_id << ")..." << std::endl;
     std::cout << "[Worker] Parameters: " << params.dump() << std::endl;
 
@@ -614,36 +2261,36 @@ void worker::stop_vm(uint64_t workload_id, const nlohmann::json& params) {
     std::string vm_name = params.value("vm_name", "");
 
     if (vm_name.empty()) {
-        m_ipc.send_workload_response(workload_id, workload_status::error, "VM name is required");
+        respond(workload_id, workload_status::error, "VM name is required");
         return;
     }
 
     // Send progress update
-    m_ipc.send_workload_response(workload_id, workload_status::in_progress,
-                                 "Stopping VM '" + vm_name + "'...");
+    respond(workload_id, workload_status::in_progress, "Stopping VM '" + vm_name + "'...");
 
     // Use application singleton's VM manager
     vm_manager& vm_mgr = application::instance().get_vm_manager();
     if (!vm_mgr.connect()) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to connect to libvirt: " + vm_mgr.get_last_error());
+        respond(workload_id, workload_status::error,
+                "Failed to connect to libvirt: " + vm_mgr.get_last_error());
         return;
     }
 
     // Stop the VM
     if (!vm_mgr.stop_vm(vm_name)) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to stop VM: " + vm_mgr.get_last_error());
+        respond(workload_id, workload_status::error,
+                "Failed to stop VM: " + vm_mgr.get_last_error());
         return;
     }
 
     std::cout << "[Worker] VM stopped successfully (ID: " << workload_id << ")" << std::endl;
 
     nlohmann::json result = {{"vm_name", vm_name}, {"status", "stopped"}};
-    m_ipc.send_workload_response(workload_id, workload_status::completed, result.dump());
+    respond(workload_id, workload_status::completed, result.dump());
 }
 
-void worker::remove_vm(uint64_t workload_id, const nlohmann::json& params) {
+void worker::remove_vm(uint64_t workload_id, const nlohmann::json& params,
+                       const cancellation_token& token) {
     std::cout << "[Worker] Removing VM (ID: " << workload_id << ")..." << std::endl;
     std::cout << "[Worker] Parameters: " << params.dump() << std::endl;
 
@@ -651,31 +2298,105 @@ void worker::remove_vm(uint64_t workload_id, const nlohmann::json& params) {
     std::string vm_name = params.value("vm_name", "");
 
     if (vm_name.empty()) {
-        m_ipc.send_workload_response(workload_id, workload_status::error, "VM name is required");
+        respond(workload_id, workload_status::error, "VM name is required");
         return;
     }
 
     // Send progress update
-    m_ipc.send_workload_response(workload_id, workload_status::in_progress,
-                                 "Removing VM '" + vm_name + "'...");
+    respond(workload_id, workload_status::in_progress, "Removing VM '" + vm_name + "'...");
 
     // Use application singleton's VM manager
     vm_manager& vm_mgr = application::instance().get_vm_manager();
     if (!vm_mgr.connect()) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to connect to libvirt: " + vm_mgr.get_last_error());
+        respond(workload_id, workload_status::error,
+                "Failed to connect to libvirt: " + vm_mgr.get_last_error());
         return;
     }
 
     // Remove the VM
     if (!vm_mgr.delete_vm(vm_name)) {
-        m_ipc.send_workload_response(workload_id, workload_status::error,
-                                     "Failed to remove VM: " + vm_mgr.get_last_error());
+        respond(workload_id, workload_status::error,
+                "Failed to remove VM: " + vm_mgr.get_last_error());
         return;
     }
 
     std::cout << "[Worker] VM removed successfully (ID: " << workload_id << ")" << std::endl;
 
     nlohmann::json result = {{"vm_name", vm_name}, {"status", "removed"}};
-    m_ipc.send_workload_response(workload_id, workload_status::completed, result.dump());
+    respond(workload_id, workload_status::completed, result.dump());
+}
+
+void worker::create_golden_image(uint64_t workload_id, const nlohmann::json& params,
+                                 const cancellation_token& token) {
+    std::cout << "[Worker] Creating golden image (ID: " << workload_id << ")..." << std::endl;
+    std::cout << "[Worker] Parameters: " << params.dump() << std::endl;
+
+    std::string vm_name = params.value("vm_name", "");
+    std::string image_name = params.value("image_name", vm_name);
+    if (vm_name.empty()) {
+        respond(workload_id, workload_status::error, "VM name is required");
+        return;
+    }
+
+    respond(workload_id, workload_status::in_progress,
+            "Turning VM '" + vm_name + "' into golden image '" + image_name + "'...");
+
+    vm_manager& vm_mgr = application::instance().get_vm_manager();
+    if (!vm_mgr.connect()) {
+        respond(workload_id, workload_status::error,
+                "Failed to connect to libvirt: " + vm_mgr.get_last_error());
+        return;
+    }
+
+    std::string path = vm_mgr.create_golden_image(vm_name, image_name);
+    if (path.empty()) {
+        respond(workload_id, workload_status::error,
+                "Failed to create golden image: " + vm_mgr.get_last_error());
+        return;
+    }
+
+    nlohmann::json result = {{"vm_name", vm_name}, {"image_name", image_name}, {"path", path}};
+    respond(workload_id, workload_status::completed, result.dump());
+}
+
+void worker::flatten_vm(uint64_t workload_id, const nlohmann::json& params,
+                        const cancellation_token& token) {
+    std::cout << "[Worker] Flattening VM disk (ID: " << workload_id << ")..." << std::endl;
+    std::cout << "[Worker] Parameters: " << params.dump() << std::endl;
+
+    std::string vm_name = params.value("vm_name", "");
+    if (vm_name.empty()) {
+        respond(workload_id, workload_status::error, "VM name is required");
+        return;
+    }
+
+    respond(workload_id, workload_status::in_progress,
+            "Copying golden image data into the disk of VM '" + vm_name + "'...");
+
+    vm_manager& vm_mgr = application::instance().get_vm_manager();
+    if (!vm_mgr.connect()) {
+        respond(workload_id, workload_status::error,
+                "Failed to connect to libvirt: " + vm_mgr.get_last_error());
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bool flattened = vm_mgr.flatten_vm(vm_name, token, [&](uint64_t done, uint64_t total) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double rate = elapsed.count() > 0 ? done / elapsed.count() : 0.0;
+        publish_progress(workload_id, static_cast<double>(done), static_cast<double>(total), rate);
+    });
+    if (check_cancelled(workload_id, token)) {
+        return;
+    }
+    if (!flattened) {
+        respond(workload_id, workload_status::error,
+                "Failed to flatten VM disk: " + vm_mgr.get_last_error());
+        return;
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    nlohmann::json result = {
+        {"vm_name", vm_name}, {"status", "flattened"}, {"seconds", elapsed.count()}};
+    respond(workload_id, workload_status::completed, result.dump());
 }
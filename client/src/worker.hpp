@@ -1,29 +1,197 @@
 #pragma once
 
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include "ipc.hpp"
+#include "media/iso_library.hpp"
+#include "media/metadata_cache.hpp"
+#include "media/offline_apply.hpp"
+#include "media/slim_media.hpp"
+#include "net/multipart_transfer.hpp"
+#include "telemetry_ring.hpp"
+#include "util/cancellation.hpp"
+#include "util/thread_pool.hpp"
+#include "vm_event_monitor.hpp"
+#include "worker_session.hpp"
+
+struct worker_options {
+    // Threads for quick, latency-sensitive workloads (status queries, start/stop)
+    size_t interactive_threads = 4;
+    // Threads for long-running workloads (WIM scans, installs)
+    size_t bulk_threads = 2;
+};
 
 class worker {
 public:
-    worker();
+    explicit worker(const worker_options& options = {});
     ~worker();
 
+    // Per-session worker: connect to the client that launched us and exit when it goes away
     int run(const std::string& socket_path);
+    // Long-lived worker: accept any number of clients on socket_path (or a systemd-activated
+    // socket) and keep workloads running across client restarts
+    int run_daemon(const std::string& socket_path);
+
+    // Send an event to every workload subscribed to topic (see workload_type::subscribe_events)
+    void publish_event(const std::string& topic, const nlohmann::json& event);
 
 private:
-    ipc m_ipc;
+    ipc m_listener; // daemon mode only
+    worker_options m_options;
+    bool m_daemon = false;
+
+    // Priority lanes, so a burst of status queries cannot queue behind installs and vice versa
+    thread_pool m_interactive_pool{"interactive"};
+    thread_pool m_bulk_pool{"bulk"};
+
+    // Feeds the "vm" and "vm_stats" topics from libvirt domain events
+    vm_event_monitor m_vm_events;
+
+    // Remembers WIM image lists of ISOs scanned before
+    metadata_cache m_media_cache;
+
+    // Verification results of media checked before
+    metadata_cache m_verify_cache{"/var/cache/lsw/verify-index.json"};
+
+    // Windows images on every ISO in the directories clients asked to index
+    iso_library m_iso_library;
+
+    // Workloads are identified by a worker-wide ID; each one remembers which session (and which
+    // ID within that session) its responses are routed to
+    struct running_workload {
+        workload_type type;
+        std::shared_ptr<cancellation_token> token;
+        uint64_t session_id = 0;
+        std::weak_ptr<worker_session> session;
+        uint64_t client_workload_id = 0;
+        // Batch members report to their batch instead of a client
+        std::function<void(workload_status status, const std::string& message)> sink;
+        // Subscriptions only
+        std::vector<std::string> topics;
+        nlohmann::json filter; // event fields that must match, e.g. vm_name
+        // Requested VM stats sampling interval ("vm_stats" subscribers, installs tracking Setup)
+        std::chrono::milliseconds stats_interval{0};
+    };
+
+    // Workloads currently queued or running, by worker-wide ID
+    std::mutex m_tokens_mutex;
+    std::unordered_map<uint64_t, running_workload> m_workloads;
+    uint64_t m_next_workload_id = 0;
+
+    // Attached clients. Sessions whose client went away wait in m_closed_sessions until they are
+    // joined, since they report the disconnect from their own reader thread.
+    std::mutex m_sessions_mutex;
+    std::unordered_map<uint64_t, std::shared_ptr<worker_session>> m_sessions;
+    std::vector<std::shared_ptr<worker_session>> m_closed_sessions;
+    uint64_t m_next_session_id = 0;
 
     bool check_root_privileges();
+    int get_activated_socket();
+    void start_services();
+    void stop_services();
+    std::shared_ptr<worker_session> attach_session(int socket_fd);
+    void on_session_closed(worker_session& session);
+    void reap_closed_sessions();
+    void handle_request(worker_session& session, uint64_t client_workload_id,
+                        workload_type workload, const nlohmann::json& params,
+                        uint64_t timeout_ms);
+    void subscribe(worker_session& session, uint64_t client_workload_id,
+                   const nlohmann::json& params);
+    void attach_workload(worker_session& session, uint64_t client_workload_id,
+                         const nlohmann::json& params);
+    void run_batch(worker_session& session, uint64_t client_workload_id,
+                   const nlohmann::json& params, uint64_t timeout_ms);
+    bool submit_workload(uint64_t workload_id, workload_type workload, const nlohmann::json& params,
+                         const std::shared_ptr<cancellation_token>& token);
+    void on_vm_event(const vm_event_monitor::vm_event& event);
+    // Sample stats as often as the most demanding "vm_stats" subscriber asks, or not at all
+    void update_vm_stats_interval();
+    // Ask for VM stats on behalf of a workload; 0 withdraws the request
+    void set_stats_interval(uint64_t workload_id, std::chrono::milliseconds interval);
+
+    // Route a response to whichever client the workload currently belongs to
+    bool respond(uint64_t workload_id, workload_status status, const std::string& message);
+    void publish_queue_stats();
+    void publish_progress(uint64_t workload_id, double done, double total, double rate = 0.0,
+                          double eta_seconds = -1.0);
     void handle_workload_request(const std::string& request);
+    void dispatch_workload(uint64_t workload_id, workload_type workload,
+                           const nlohmann::json& params, const cancellation_token& token);
+
+    // Returns the worker-wide ID of the new workload
+    uint64_t register_workload(worker_session& session, uint64_t client_workload_id,
+                               workload_type workload, uint64_t timeout_ms,
+                               std::shared_ptr<cancellation_token>& token);
+    void unregister_workload(uint64_t workload_id);
+    void cancel_workload(uint64_t session_id, uint64_t client_workload_id);
+    void cancel_all_workloads();
+    // Sends the cancelled status and returns true if the token was cancelled or expired
+    bool check_cancelled(uint64_t workload_id, const cancellation_token& token);
+
+    // WIM image list (as JSON) of an ISO or a .wim/.esd/.swm file, from the cache if possible.
+    // hash, if given, receives the media fingerprint.
+    std::optional<nlohmann::json> read_media_images(const std::string& media_path,
+                                                    std::string& error,
+                                                    std::string* hash = nullptr);
+    // Build (or reuse) slim media for one edition of iso_path, reporting progress on workload_id.
+    // spec holds the slim_media options: {"compression", "remove_paths", "threads"}.
+    std::optional<slim_media::result> prepare_slim_media(uint64_t workload_id,
+                                                         const std::string& iso_path,
+                                                         uint32_t image_index,
+                                                         const nlohmann::json& spec,
+                                                         const cancellation_token& token,
+                                                         std::string& error);
+
+    // Lay out disk_path and apply image image_index of iso_path to it, reporting progress on
+    // workload_id
+    std::optional<offline_apply::result> apply_offline_image(
+        uint64_t workload_id, const std::string& iso_path, uint32_t image_index,
+        const std::string& disk_path, const std::string& disk_format,
+        const std::string& unattend_xml, const offline_apply::options& opts,
+        const cancellation_token& token, std::string& error);
+
+    // Download url to path with transfer, reporting progress on workload_id. The file only
+    // appears at path once it is complete; until then other steps can read parts of it through
+    // transfer's priority ranges.
+    bool download_media(uint64_t workload_id, const std::string& url, const std::string& path,
+                        multipart_transfer& transfer, const cancellation_token& token,
+                        std::string& error);
 
     // Workload functions
-    void setup_vm(uint64_t workload_id, const nlohmann::json& params);
-    void check_installed_apps(uint64_t workload_id, const nlohmann::json& params);
-    void scan_wim_versions(uint64_t workload_id, const nlohmann::json& params);
-    void install_vm(uint64_t workload_id, const nlohmann::json& params);
-    void get_vm_status(uint64_t workload_id, const nlohmann::json& params);
-    void start_vm(uint64_t workload_id, const nlohmann::json& params);
-    void stop_vm(uint64_t workload_id, const nlohmann::json& params);
-    void remove_vm(uint64_t workload_id, const nlohmann::json& params);
+    void setup_vm(uint64_t workload_id, const nlohmann::json& params,
+                  const cancellation_token& token);
+    void check_installed_apps(uint64_t workload_id, const nlohmann::json& params,
+                              const cancellation_token& token);
+    void scan_wim_versions(uint64_t workload_id, const nlohmann::json& params,
+                           const cancellation_token& token);
+    void install_vm(uint64_t workload_id, const nlohmann::json& params,
+                    const cancellation_token& token);
+    void index_iso_library(uint64_t workload_id, const nlohmann::json& params,
+                           const cancellation_token& token);
+    void search_iso_library(uint64_t workload_id, const nlohmann::json& params,
+                            const cancellation_token& token);
+    void verify_iso(uint64_t workload_id, const nlohmann::json& params,
+                    const cancellation_token& token);
+    void build_slim_media(uint64_t workload_id, const nlohmann::json& params,
+                          const cancellation_token& token);
+    void get_vm_status(uint64_t workload_id, const nlohmann::json& params,
+                       const cancellation_token& token);
+    void start_vm(uint64_t workload_id, const nlohmann::json& params,
+                  const cancellation_token& token);
+    void stop_vm(uint64_t workload_id, const nlohmann::json& params,
+                 const cancellation_token& token);
+    void remove_vm(uint64_t workload_id, const nlohmann::json& params,
+                   const cancellation_token& token);
+    void create_golden_image(uint64_t workload_id, const nlohmann::json& params,
+                             const cancellation_token& token);
+    void flatten_vm(uint64_t workload_id, const nlohmann::json& params,
+                    const cancellation_token& token);
 };
@@ -0,0 +1,176 @@
+#include "worker_session.hpp"
+
+#include <iostream>
+#include <vector>
+#include <sys/socket.h>
+
+namespace {
+bool is_terminal(workload_status status) {
+    return status != workload_status::in_progress;
+}
+} // namespace
+
+worker_session::worker_session(uint64_t session_id, int socket_fd, size_t max_queued_frames)
+    : m_session_id(session_id), m_max_queued_frames(max_queued_frames) {
+    m_ipc.set_socket(socket_fd);
+}
+
+worker_session::~worker_session() {
+    close();
+}
+
+bool worker_session::start(const nlohmann::json& hello, request_callback on_request,
+                           closed_callback on_closed) {
+    // Readiness handshake: the client waits for this instead of guessing when we are up
+    if (!m_ipc.send_hello(hello)) {
+        return false;
+    }
+
+    // The ring is optional: if it cannot be created the client simply receives no descriptors
+    // and telemetry is dropped, while control messages keep flowing over the socket
+    std::vector<int> fds;
+    if (m_telemetry.create()) {
+        fds = {m_telemetry.get_memory_fd(), m_telemetry.get_event_fd()};
+    } else {
+        std::cerr << "[Session " << m_session_id << "] Telemetry ring unavailable" << std::endl;
+    }
+    if (!m_ipc.send_fds(fds)) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_open = true;
+    }
+    m_writer = std::thread(&worker_session::writer_main, this);
+    m_reader = std::thread(&worker_session::reader_main, this, std::move(on_request),
+                           std::move(on_closed));
+    return true;
+}
+
+void worker_session::close() {
+    mark_closed();
+
+    // Unblocks the reader's recv; the descriptor itself is closed with m_ipc
+    int socket_fd = m_ipc.get_socket_fd();
+    if (socket_fd != -1) {
+        shutdown(socket_fd, SHUT_RDWR);
+    }
+
+    if (m_reader.joinable()) {
+        m_reader.join();
+    }
+    if (m_writer.joinable()) {
+        m_writer.join();
+    }
+}
+
+void worker_session::wait_closed() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]() { return !m_open; });
+}
+
+bool worker_session::enqueue_response(uint64_t client_workload_id, workload_status status,
+                                      std::string message) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_open) {
+            return false;
+        }
+
+        if (m_queue.size() >= m_max_queued_frames) {
+            // Make room by dropping the oldest frame that only reports progress
+            auto droppable = m_queue.begin();
+            while (droppable != m_queue.end() && is_terminal(droppable->status)) {
+                ++droppable;
+            }
+
+            if (droppable != m_queue.end()) {
+                m_queue.erase(droppable);
+                ++m_dropped;
+            } else if (!is_terminal(status)) {
+                ++m_dropped;
+                return false;
+            }
+
+            // Log on the first drop and then every 100th, to keep a stuck client from flooding
+            if (m_dropped % 100 == 1) {
+                std::cerr << "[Session " << m_session_id << "] Client is falling behind, "
+                          << m_dropped << " frame(s) dropped" << std::endl;
+            }
+        }
+
+        m_queue.push_back({client_workload_id, status, std::move(message)});
+    }
+    m_condition.notify_all();
+    return true;
+}
+
+void worker_session::publish_telemetry(const telemetry_record& record) {
+    if (m_telemetry.is_open()) {
+        m_telemetry.push(record);
+    }
+}
+
+bool worker_session::is_open() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_open;
+}
+
+uint64_t worker_session::get_dropped_count() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+void worker_session::reader_main(request_callback on_request, closed_callback on_closed) {
+    while (true) {
+        auto [workload_id, workload, params, timeout_ms] = m_ipc.receive_workload_request();
+        if (workload_id == 0) {
+            break;
+        }
+
+        try {
+            on_request(*this, workload_id, workload, std::move(params), timeout_ms);
+        } catch (const std::exception& e) {
+            std::cerr << "[Session " << m_session_id << "] Exception handling request: "
+                      << e.what() << std::endl;
+        }
+    }
+
+    std::cout << "[Session " << m_session_id << "] Client disconnected" << std::endl;
+    mark_closed();
+    if (on_closed) {
+        on_closed(*this);
+    }
+}
+
+void worker_session::writer_main() {
+    while (true) {
+        outgoing_frame frame;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return !m_open || !m_queue.empty(); });
+            if (!m_open) {
+                return;
+            }
+            frame = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        if (!m_ipc.send_workload_response(frame.workload_id, frame.status, frame.message)) {
+            // Also wakes the reader, which then reports the disconnect
+            mark_closed();
+            shutdown(m_ipc.get_socket_fd(), SHUT_RDWR);
+            return;
+        }
+    }
+}
+
+void worker_session::mark_closed() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_open = false;
+        m_queue.clear();
+    }
+    m_condition.notify_all();
+}
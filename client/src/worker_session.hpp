@@ -0,0 +1,79 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "ipc.hpp"
+#include "telemetry_ring.hpp"
+
+// One attached client of the worker. Requests are read on a dedicated thread and handed to the
+// worker; responses are queued and written by a second thread, so a slow client never blocks
+// the workloads reporting to it. The queue is bounded: when a client falls behind, the oldest
+// progress/event frames are dropped, while terminal frames (completed, error, cancelled) are
+// always kept. Each session also gets its own telemetry ring, since a ring has one consumer.
+class worker_session : public std::enable_shared_from_this<worker_session> {
+public:
+    using request_callback =
+        std::function<void(worker_session& session, uint64_t client_workload_id,
+                           workload_type workload, nlohmann::json params, uint64_t timeout_ms)>;
+    using closed_callback = std::function<void(worker_session& session)>;
+
+    worker_session(uint64_t session_id, int socket_fd, size_t max_queued_frames = 256);
+    ~worker_session();
+
+    worker_session(const worker_session&) = delete;
+    worker_session& operator=(const worker_session&) = delete;
+
+    worker_session(worker_session&&) = delete;
+    worker_session& operator=(worker_session&&) = delete;
+
+    // Send the hello and the telemetry ring descriptors, then start serving requests.
+    // on_closed runs on the session's reader thread once the client has gone away.
+    bool start(const nlohmann::json& hello, request_callback on_request,
+               closed_callback on_closed);
+
+    // Shut the connection down and join both threads. Must not be called from the callbacks.
+    void close();
+    void wait_closed();
+
+    // Queue a response frame. Returns false if the frame was dropped.
+    bool enqueue_response(uint64_t client_workload_id, workload_status status,
+                          std::string message);
+    void publish_telemetry(const telemetry_record& record);
+
+    uint64_t get_id() const {
+        return m_session_id;
+    }
+    bool is_open() const;
+    uint64_t get_dropped_count() const;
+
+private:
+    struct outgoing_frame {
+        uint64_t workload_id;
+        workload_status status;
+        std::string message;
+    };
+
+    uint64_t m_session_id;
+    size_t m_max_queued_frames;
+    ipc m_ipc;
+    telemetry_ring m_telemetry;
+
+    std::thread m_reader;
+    std::thread m_writer;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<outgoing_frame> m_queue;
+    uint64_t m_dropped = 0;
+    bool m_open = false;
+
+    void reader_main(request_callback on_request, closed_callback on_closed);
+    void writer_main();
+    void mark_closed();
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+// Checks for the tests: a failed CHECK prints the condition, counts a failure and returns from
+// the test function, so the remaining tests still run
+
+#include <iostream>
+
+inline int failures = 0;
+
+#define CHECK(condition)                                                                        \
+    do {                                                                                        \
+        if (!(condition)) {                                                                     \
+            std::cerr << "[Test] " << __FILE__ << ":" << __LINE__ << ": check failed: "         \
+                      << #condition << std::endl;                                               \
+            failures++;                                                                         \
+            return;                                                                             \
+        }                                                                                       \
+    } while (0)
@@ -0,0 +1,162 @@
+// Tests for http_random_access_file against a small HTTP server running in the test process. The
+// server serves a synthetic ISO from memory and can misbehave on request: cut range responses
+// short, or ignore ranges and answer 200 with the whole file.
+//
+// Usage: http_random_access_file_test (exits non-zero if a check fails)
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "check.hpp"
+#include "net/http_random_access_file.hpp"
+#include "range_server.hpp"
+
+namespace {
+constexpr size_t SECTOR_SIZE = 2048;
+constexpr size_t BLOCK_SIZE = 4096; // the smallest block size the file accepts
+
+// Pseudo-random content with an ISO9660 primary volume descriptor at sector 16. The odd size
+// leaves a partial last block.
+std::string make_synthetic_iso() {
+    std::string data(300 * SECTOR_SIZE + 1234, '\0');
+    uint32_t state = 0x12345678;
+    for (char& byte : data) {
+        state = state * 1664525 + 1013904223;
+        byte = static_cast<char>(state >> 24);
+    }
+    const char descriptor[] = {1, 'C', 'D', '0', '0', '1', 1};
+    std::memcpy(&data[16 * SECTOR_SIZE], descriptor, sizeof(descriptor));
+    return data;
+}
+
+http_random_access_file::options small_blocks(size_t cache_blocks) {
+    http_random_access_file::options opts;
+    opts.block_size = BLOCK_SIZE;
+    opts.cache_blocks = cache_blocks;
+    opts.per_request_timeout_seconds = 5;
+    return opts;
+}
+
+// Read and compare with the source, at the given offset and length
+bool read_matches(http_random_access_file& file, const std::string& iso, uint64_t offset,
+                  size_t length) {
+    std::vector<char> buffer(length);
+    return file.read(offset, buffer.data(), length) &&
+           std::equal(buffer.begin(), buffer.end(), iso.begin() + static_cast<long>(offset));
+}
+
+void test_open_reports_size(range_server& server, const std::string& iso) {
+    http_random_access_file file(server.url(), small_blocks(16));
+    CHECK(file.open());
+    CHECK(file.size() == iso.size());
+
+    char descriptor[6];
+    CHECK(file.read(16 * SECTOR_SIZE, descriptor, sizeof(descriptor)));
+    CHECK(std::memcmp(descriptor, "\1CD001", sizeof(descriptor)) == 0);
+}
+
+void test_reads_across_block_boundaries(range_server& server, const std::string& iso) {
+    // Room for everything read here plus the read-ahead, so the second pass hits the cache
+    http_random_access_file file(server.url(), small_blocks(256));
+    CHECK(file.open());
+
+    CHECK(read_matches(file, iso, BLOCK_SIZE - 6, 12));                 // straddles one boundary
+    CHECK(read_matches(file, iso, 10 * BLOCK_SIZE + 1, 3 * BLOCK_SIZE)); // spans four blocks
+    CHECK(read_matches(file, iso, 20 * BLOCK_SIZE, BLOCK_SIZE));         // exactly one block
+    CHECK(read_matches(file, iso, iso.size() - BLOCK_SIZE - 100, BLOCK_SIZE + 100)); // the tail
+    CHECK(read_matches(file, iso, iso.size() - 1, 1));
+    CHECK(read_matches(file, iso, 0, 0));
+
+    // Everything just read is cached: reading it again costs no request
+    http_random_access_file::statistics before = file.get_statistics();
+    CHECK(read_matches(file, iso, BLOCK_SIZE - 6, 12));
+    CHECK(read_matches(file, iso, 10 * BLOCK_SIZE + 1, 3 * BLOCK_SIZE));
+    CHECK(file.get_statistics().requests == before.requests);
+
+    char byte;
+    CHECK(!file.read(iso.size(), &byte, 1));
+    CHECK(!file.read(iso.size() - 1, &byte, 2));
+}
+
+void test_sequential_reads_with_small_cache(range_server& server, const std::string& iso) {
+    // Fewer cached blocks than one read spans, so blocks are evicted while the read runs
+    http_random_access_file file(server.url(), small_blocks(2));
+    CHECK(file.open());
+
+    for (uint64_t offset = 0; offset < iso.size(); offset += 5 * BLOCK_SIZE + 17) {
+        uint64_t length = std::min<uint64_t>(5 * BLOCK_SIZE, iso.size() - offset);
+        CHECK(read_matches(file, iso, offset, static_cast<size_t>(length)));
+    }
+    CHECK(read_matches(file, iso, 0, iso.size()));
+}
+
+void test_short_response_is_retried(range_server& server, const std::string& iso) {
+    http_random_access_file file(server.url(), small_blocks(16));
+    CHECK(file.open());
+
+    server.cut_short(1);
+    CHECK(read_matches(file, iso, 3 * BLOCK_SIZE + 5, 2 * BLOCK_SIZE));
+    CHECK(file.get_statistics().requests == 3); // the probe, the short response and the retry
+}
+
+void test_short_responses_fail_the_read(range_server& server, const std::string& iso) {
+    http_random_access_file file(server.url(), small_blocks(16));
+    CHECK(file.open());
+
+    server.cut_short(1000);
+    std::vector<char> buffer(BLOCK_SIZE);
+    bool read = file.read(7 * BLOCK_SIZE, buffer.data(), buffer.size());
+    server.cut_short(0);
+    CHECK(!read);
+    CHECK(file.get_last_error() == "Short range response");
+
+    // Nothing from the short responses was cached
+    CHECK(read_matches(file, iso, 7 * BLOCK_SIZE, BLOCK_SIZE));
+}
+
+void test_server_without_ranges(range_server& server, const std::string& iso) {
+    server.ignore_ranges(true);
+    http_random_access_file refused(server.url(), small_blocks(16));
+    bool opened = refused.open();
+    server.ignore_ranges(false);
+    CHECK(!opened);
+    CHECK(refused.get_last_error() == "Server does not support range requests");
+
+    // A server that stops honouring ranges after the probe fails the read instead of handing
+    // out the start of the file as if it were the requested range
+    http_random_access_file file(server.url(), small_blocks(16));
+    CHECK(file.open());
+    server.ignore_ranges(true);
+    std::vector<char> buffer(BLOCK_SIZE);
+    bool read = file.read(9 * BLOCK_SIZE, buffer.data(), buffer.size());
+    server.ignore_ranges(false);
+    CHECK(!read);
+    CHECK(file.get_last_error() == "HTTP status 200");
+    CHECK(read_matches(file, iso, 9 * BLOCK_SIZE, BLOCK_SIZE));
+}
+} // namespace
+
+int main() {
+    std::string iso = make_synthetic_iso();
+    range_server server(iso);
+
+    const std::pair<const char*, std::function<void(range_server&, const std::string&)>> tests[] =
+        {{"open reports size", test_open_reports_size},
+         {"reads across block boundaries", test_reads_across_block_boundaries},
+         {"sequential reads with small cache", test_sequential_reads_with_small_cache},
+         {"short response is retried", test_short_response_is_retried},
+         {"short responses fail the read", test_short_responses_fail_the_read},
+         {"server without ranges", test_server_without_ranges}};
+
+    for (const auto& [name, test] : tests) {
+        int before = failures;
+        test(server, iso);
+        std::cout << "[Test] " << name << ": " << (failures == before ? "ok" : "FAILED")
+                  << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
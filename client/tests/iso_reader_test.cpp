@@ -0,0 +1,338 @@
+// Tests for iso_reader on ISO9660 and UDF images built in memory and served through a
+// read_function: finding and reading a file, listing the tree, and refusing images whose
+// directories loop back on themselves, nest too deeply or point outside the image.
+//
+// Usage: iso_reader_test (exits non-zero if a check fails)
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+#include "check.hpp"
+#include "media/iso_reader.hpp"
+
+namespace {
+constexpr uint32_t SECTOR_SIZE = 2048;
+const std::string FILE_CONTENTS = "install image bytes";
+
+void put_le16(uint8_t* data, uint16_t value) {
+    data[0] = static_cast<uint8_t>(value);
+    data[1] = static_cast<uint8_t>(value >> 8);
+}
+
+void put_le32(uint8_t* data, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        data[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+void put_le64(uint8_t* data, uint64_t value) {
+    put_le32(data, static_cast<uint32_t>(value));
+    put_le32(data + 4, static_cast<uint32_t>(value >> 32));
+}
+
+// An image as a run of zeroed sectors
+class image {
+public:
+    explicit image(uint32_t sectors) : m_data(static_cast<size_t>(sectors) * SECTOR_SIZE, 0) {}
+
+    uint8_t* sector(uint32_t number) {
+        return m_data.data() + static_cast<size_t>(number) * SECTOR_SIZE;
+    }
+
+    bool open(iso_reader& reader) {
+        return reader.open(m_data.size(), [this](uint64_t offset, void* buffer, size_t length) {
+            if (offset > m_data.size() || length > m_data.size() - offset) {
+                return false;
+            }
+            memcpy(buffer, m_data.data() + offset, length);
+            return true;
+        }, "test image");
+    }
+
+private:
+    std::vector<uint8_t> m_data;
+};
+
+// --- ISO9660 ---
+
+constexpr uint8_t ISO9660_DIRECTORY = 0x02;
+
+// Appends a directory record; names are stored as given (e.g. "INSTALL.WIM;1")
+void put_iso9660_record(uint8_t* directory, size_t& position, const std::string& name,
+                        uint32_t sector, uint32_t size, uint8_t flags) {
+    uint8_t* record = directory + position;
+    size_t length = (33 + name.size() + 1) & ~static_cast<size_t>(1);
+    record[0] = static_cast<uint8_t>(length);
+    put_le32(record + 2, sector);
+    put_le32(record + 10, size);
+    record[25] = flags;
+    record[32] = static_cast<uint8_t>(name.size());
+    memcpy(record + 33, name.data(), name.size());
+    position += length;
+}
+
+// "." and ".." come first in every directory and are skipped by the reader
+void put_iso9660_dot_entries(uint8_t* directory, size_t& position, uint32_t self) {
+    put_iso9660_record(directory, position, std::string(1, '\0'), self, SECTOR_SIZE,
+                       ISO9660_DIRECTORY);
+    put_iso9660_record(directory, position, std::string(1, '\1'), self, SECTOR_SIZE,
+                       ISO9660_DIRECTORY);
+}
+
+// Primary volume descriptor at sector 16 with its root directory at root_sector, then the
+// set terminator
+void put_iso9660_volume(image& iso, uint32_t root_sector) {
+    uint8_t* descriptor = iso.sector(16);
+    descriptor[0] = 1;
+    memcpy(descriptor + 1, "CD001", 5);
+    size_t position = 156;
+    put_iso9660_record(descriptor, position, std::string(1, '\0'), root_sector, SECTOR_SIZE,
+                       ISO9660_DIRECTORY);
+
+    uint8_t* terminator = iso.sector(17);
+    terminator[0] = 255;
+    memcpy(terminator + 1, "CD001", 5);
+}
+
+// / -> SOURCES/ -> INSTALL.WIM, plus SOURCES/LOOP/ pointing back at the root
+image make_iso9660_image(bool with_loop) {
+    image iso(24);
+    put_iso9660_volume(iso, 20);
+
+    size_t position = 0;
+    put_iso9660_dot_entries(iso.sector(20), position, 20);
+    put_iso9660_record(iso.sector(20), position, "SOURCES", 21, SECTOR_SIZE, ISO9660_DIRECTORY);
+
+    position = 0;
+    put_iso9660_dot_entries(iso.sector(21), position, 21);
+    put_iso9660_record(iso.sector(21), position, "INSTALL.WIM;1", 22,
+                       static_cast<uint32_t>(FILE_CONTENTS.size()), 0);
+    if (with_loop) {
+        put_iso9660_record(iso.sector(21), position, "LOOP", 20, SECTOR_SIZE, ISO9660_DIRECTORY);
+    }
+    memcpy(iso.sector(22), FILE_CONTENTS.data(), FILE_CONTENTS.size());
+    return iso;
+}
+
+std::vector<std::string> listed_paths(iso_reader& reader) {
+    std::vector<std::string> paths;
+    std::optional<std::vector<iso_reader::directory_entry>> entries = reader.list_files();
+    if (entries) {
+        for (const iso_reader::directory_entry& entry : *entries) {
+            paths.push_back(entry.path + (entry.is_directory ? "/" : ""));
+        }
+    }
+    return paths;
+}
+
+void test_iso9660_find_and_read() {
+    image iso = make_iso9660_image(false);
+    iso_reader reader;
+    CHECK(iso.open(reader));
+
+    std::optional<iso_reader::file> file = reader.find_file("sources/install.wim");
+    CHECK(file);
+    CHECK(file->size == FILE_CONTENTS.size());
+    std::string contents(FILE_CONTENTS.size(), '\0');
+    CHECK(reader.read_file(*file, 0, &contents[0], contents.size()));
+    CHECK(contents == FILE_CONTENTS);
+
+    CHECK(!reader.read_file(*file, 1, &contents[0], contents.size()));
+    CHECK(!reader.find_file("sources/boot.wim"));
+    CHECK(reader.get_last_error() == "Not found: boot.wim");
+}
+
+void test_iso9660_listing() {
+    image iso = make_iso9660_image(false);
+    iso_reader reader;
+    CHECK(iso.open(reader));
+    CHECK(listed_paths(reader) == std::vector<std::string>({"SOURCES/", "SOURCES/INSTALL.WIM"}));
+}
+
+void test_iso9660_loop_listed_once() {
+    image iso = make_iso9660_image(true);
+    iso_reader reader;
+    CHECK(iso.open(reader));
+    // LOOP is the root again, so it is not walked a second time
+    CHECK(listed_paths(reader) == std::vector<std::string>({"SOURCES/", "SOURCES/INSTALL.WIM"}));
+}
+
+void test_iso9660_too_deep() {
+    // A chain of directories, one per sector, deeper than any real medium
+    constexpr uint32_t FIRST = 20;
+    constexpr uint32_t LEVELS = 80;
+    image iso(FIRST + LEVELS + 1);
+    put_iso9660_volume(iso, FIRST);
+    for (uint32_t level = 0; level < LEVELS; level++) {
+        size_t position = 0;
+        put_iso9660_dot_entries(iso.sector(FIRST + level), position, FIRST + level);
+        put_iso9660_record(iso.sector(FIRST + level), position, "D", FIRST + level + 1,
+                           SECTOR_SIZE, ISO9660_DIRECTORY);
+    }
+
+    iso_reader reader;
+    CHECK(iso.open(reader));
+    CHECK(!reader.list_files());
+    CHECK(reader.get_last_error().find("nested too deeply") != std::string::npos);
+}
+
+void test_iso9660_outside_the_image() {
+    image iso(24);
+    put_iso9660_volume(iso, 20);
+    size_t position = 0;
+    put_iso9660_dot_entries(iso.sector(20), position, 20);
+    put_iso9660_record(iso.sector(20), position, "FAR", 1000, SECTOR_SIZE, ISO9660_DIRECTORY);
+
+    iso_reader reader;
+    CHECK(iso.open(reader));
+    CHECK(!reader.list_files());
+    CHECK(reader.get_last_error() == "Read past end of image");
+    CHECK(!reader.find_file("far/file"));
+}
+
+// --- UDF ---
+
+constexpr uint32_t UDF_PARTITION_START = 260;
+constexpr uint8_t UDF_DIRECTORY = 0x02;
+
+void put_udf_tag(uint8_t* descriptor, uint16_t tag) {
+    put_le16(descriptor, tag);
+}
+
+// Anchor, main volume descriptor sequence (partition, logical volume, terminator) and the file
+// set descriptor at partition block 0, naming root_block as the root directory's file entry
+void put_udf_volume(image& udf, uint32_t root_block) {
+    uint8_t* anchor = udf.sector(256);
+    put_udf_tag(anchor, 2);
+    put_le32(anchor + 16, 3 * SECTOR_SIZE);
+    put_le32(anchor + 20, 257);
+
+    uint8_t* partition = udf.sector(257);
+    put_udf_tag(partition, 5);
+    put_le32(partition + 188, UDF_PARTITION_START);
+
+    uint8_t* logical_volume = udf.sector(258);
+    put_udf_tag(logical_volume, 6);
+    put_le32(logical_volume + 212, SECTOR_SIZE);
+    put_le32(logical_volume + 252, 0);
+    put_le32(logical_volume + 268, 1);
+    logical_volume[440] = 1;
+
+    put_udf_tag(udf.sector(259), 8);
+
+    uint8_t* file_set = udf.sector(UDF_PARTITION_START);
+    put_udf_tag(file_set, 256);
+    put_le32(file_set + 404, root_block);
+}
+
+// File entry at block whose data is one extent at data_block
+void put_udf_file_entry(image& udf, uint32_t block, uint32_t data_block, uint32_t size) {
+    uint8_t* entry = udf.sector(UDF_PARTITION_START + block);
+    put_udf_tag(entry, 261);
+    put_le16(entry + 34, 0); // short allocation descriptors
+    put_le64(entry + 56, size);
+    put_le32(entry + 168, 0);
+    put_le32(entry + 172, 8);
+    put_le32(entry + 176, size);
+    put_le32(entry + 180, data_block);
+}
+
+// Appends a file identifier descriptor with an 8-bit dstring name
+void put_udf_identifier(image& udf, uint32_t directory_block, size_t& position,
+                        const std::string& name, uint32_t icb_block, uint8_t characteristics) {
+    uint8_t* identifier = udf.sector(UDF_PARTITION_START + directory_block) + position;
+    put_udf_tag(identifier, 257);
+    identifier[18] = characteristics;
+    identifier[19] = static_cast<uint8_t>(name.size() + 1);
+    put_le32(identifier + 24, icb_block);
+    identifier[38] = 8;
+    memcpy(identifier + 39, name.data(), name.size());
+    position = (position + 39 + name.size() + 3) & ~static_cast<size_t>(3);
+}
+
+// Blocks: 1 root entry, 2 root data, 3 sources entry, 4 sources data, 5 file entry, 6 file data.
+// With a loop, sources/back names the root's file entry.
+image make_udf_image(bool with_loop) {
+    image udf(UDF_PARTITION_START + 8);
+    put_udf_volume(udf, 1);
+
+    size_t position = 0;
+    put_udf_identifier(udf, 2, position, "", 1, 0x08); // parent link, skipped
+    put_udf_identifier(udf, 2, position, "sources", 3, UDF_DIRECTORY);
+    put_udf_file_entry(udf, 1, 2, static_cast<uint32_t>(position));
+
+    position = 0;
+    put_udf_identifier(udf, 4, position, "install.wim", 5, 0);
+    if (with_loop) {
+        put_udf_identifier(udf, 4, position, "back", 1, UDF_DIRECTORY);
+    }
+    put_udf_file_entry(udf, 3, 4, static_cast<uint32_t>(position));
+
+    put_udf_file_entry(udf, 5, 6, static_cast<uint32_t>(FILE_CONTENTS.size()));
+    memcpy(udf.sector(UDF_PARTITION_START + 6), FILE_CONTENTS.data(), FILE_CONTENTS.size());
+    return udf;
+}
+
+void test_udf_find_and_read() {
+    image udf = make_udf_image(false);
+    iso_reader reader;
+    CHECK(udf.open(reader));
+
+    std::optional<iso_reader::file> file = reader.find_file("SOURCES/INSTALL.WIM");
+    CHECK(file);
+    CHECK(file->size == FILE_CONTENTS.size());
+    std::string contents(FILE_CONTENTS.size() - 8, '\0');
+    CHECK(reader.read_file(*file, 8, &contents[0], contents.size()));
+    CHECK(contents == FILE_CONTENTS.substr(8));
+}
+
+void test_udf_listing() {
+    image udf = make_udf_image(false);
+    iso_reader reader;
+    CHECK(udf.open(reader));
+    CHECK(listed_paths(reader) == std::vector<std::string>({"sources/", "sources/install.wim"}));
+}
+
+void test_udf_loop_listed_once() {
+    image udf = make_udf_image(true);
+    iso_reader reader;
+    CHECK(udf.open(reader));
+    CHECK(listed_paths(reader) == std::vector<std::string>({"sources/", "sources/install.wim"}));
+}
+
+void test_udf_malformed_entry() {
+    image udf = make_udf_image(false);
+    // The file's entry is not a file entry
+    memset(udf.sector(UDF_PARTITION_START + 5), 0, SECTOR_SIZE);
+
+    iso_reader reader;
+    CHECK(udf.open(reader));
+    CHECK(!reader.list_files());
+    CHECK(reader.get_last_error() == "Not a UDF file entry");
+}
+} // namespace
+
+int main() {
+    const std::pair<const char*, std::function<void()>> tests[] = {
+        {"ISO9660 find and read", test_iso9660_find_and_read},
+        {"ISO9660 listing", test_iso9660_listing},
+        {"ISO9660 loop listed once", test_iso9660_loop_listed_once},
+        {"ISO9660 too deep", test_iso9660_too_deep},
+        {"ISO9660 outside the image", test_iso9660_outside_the_image},
+        {"UDF find and read", test_udf_find_and_read},
+        {"UDF listing", test_udf_listing},
+        {"UDF loop listed once", test_udf_loop_listed_once},
+        {"UDF malformed entry", test_udf_malformed_entry}};
+
+    for (const auto& [name, test] : tests) {
+        int before = failures;
+        test();
+        std::cout << "[Test] " << name << ": " << (failures == before ? "ok" : "FAILED")
+                  << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
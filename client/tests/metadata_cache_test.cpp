@@ -0,0 +1,141 @@
+// Tests for metadata_cache::compute_fingerprint on files written by the test: the same file keeps
+// its fingerprint, and a changed byte or modification time gives a new one.
+//
+// Usage: metadata_cache_test (exits non-zero if a check fails)
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "check.hpp"
+#include "media/metadata_cache.hpp"
+
+namespace {
+// Larger than what is hashed whole, so the sampled blocks are what the fingerprint covers
+constexpr size_t FILE_SIZE = 1024 * 1024;
+
+std::string make_contents() {
+    std::string data(FILE_SIZE, '\0');
+    uint32_t state = 0x2545f491;
+    for (char& byte : data) {
+        state = state * 1664525 + 1013904223;
+        byte = static_cast<char>(state >> 24);
+    }
+    return data;
+}
+
+// A file under the temporary directory, removed when the test is done
+class temporary_file {
+public:
+    explicit temporary_file(const std::string& contents) {
+        const char* directory = getenv("TMPDIR");
+        m_path = std::string(directory ? directory : "/tmp") + "/metadata_cache_test.XXXXXX";
+        int fd = mkstemp(&m_path[0]);
+        if (fd != -1) {
+            ::close(fd);
+        }
+        write(contents);
+    }
+
+    ~temporary_file() {
+        unlink(m_path.c_str());
+    }
+
+    void write(const std::string& contents) {
+        std::ofstream out(m_path, std::ios::binary | std::ios::trunc);
+        out.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    }
+
+    void set_mtime(time_t seconds) {
+        struct timespec times[2] = {{seconds, 0}, {seconds, 0}};
+        utimensat(AT_FDCWD, m_path.c_str(), times, 0);
+    }
+
+    const std::string& path() const {
+        return m_path;
+    }
+
+private:
+    std::string m_path;
+};
+
+std::optional<metadata_cache::fingerprint> fingerprint_of(const temporary_file& file) {
+    std::string error;
+    std::optional<metadata_cache::fingerprint> result =
+        metadata_cache::compute_fingerprint(file.path(), error);
+    if (!result) {
+        std::cerr << "[Test] " << error << std::endl;
+    }
+    return result;
+}
+
+void test_same_file_same_fingerprint() {
+    temporary_file file(make_contents());
+    std::optional<metadata_cache::fingerprint> first = fingerprint_of(file);
+    std::optional<metadata_cache::fingerprint> second = fingerprint_of(file);
+    CHECK(first && second);
+    CHECK(first->size == FILE_SIZE);
+    CHECK(first->to_string() == second->to_string());
+}
+
+void test_changed_byte_changes_fingerprint() {
+    std::string contents = make_contents();
+    temporary_file file(contents);
+    file.set_mtime(1700000000);
+    std::optional<metadata_cache::fingerprint> before = fingerprint_of(file);
+
+    // Inside the first 64 KiB, which is always sampled; the mtime is put back so only the
+    // content differs
+    contents[100] = static_cast<char>(contents[100] ^ 0x01);
+    file.write(contents);
+    file.set_mtime(1700000000);
+    std::optional<metadata_cache::fingerprint> after = fingerprint_of(file);
+
+    CHECK(before && after);
+    CHECK(before->size == after->size && before->mtime_ns == after->mtime_ns);
+    CHECK(before->sample_hash != after->sample_hash);
+    CHECK(before->to_string() != after->to_string());
+}
+
+void test_changed_mtime_changes_fingerprint() {
+    temporary_file file(make_contents());
+    file.set_mtime(1700000000);
+    std::optional<metadata_cache::fingerprint> before = fingerprint_of(file);
+    file.set_mtime(1700000001);
+    std::optional<metadata_cache::fingerprint> after = fingerprint_of(file);
+
+    CHECK(before && after);
+    CHECK(before->sample_hash == after->sample_hash);
+    CHECK(before->mtime_ns != after->mtime_ns);
+    CHECK(before->to_string() != after->to_string());
+}
+
+void test_missing_file() {
+    std::string error;
+    CHECK(!metadata_cache::compute_fingerprint("/nonexistent/metadata_cache_test", error));
+    CHECK(error.find("Failed to open") == 0);
+}
+} // namespace
+
+int main() {
+    const std::pair<const char*, std::function<void()>> tests[] = {
+        {"same file, same fingerprint", test_same_file_same_fingerprint},
+        {"changed byte changes fingerprint", test_changed_byte_changes_fingerprint},
+        {"changed mtime changes fingerprint", test_changed_mtime_changes_fingerprint},
+        {"missing file", test_missing_file}};
+
+    for (const auto& [name, test] : tests) {
+        int before = failures;
+        test();
+        std::cout << "[Test] " << name << ": " << (failures == before ? "ok" : "FAILED")
+                  << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+// Tests for multipart_transfer's priority ranges against a small HTTP server running in the test
+// process: the order ranges are fetched in, the bytes they deliver, and which thread delivers
+// them once the download has finished or failed.
+//
+// Usage: multipart_transfer_test (exits non-zero if a check fails)
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "check.hpp"
+#include "net/multipart_transfer.hpp"
+#include "range_server.hpp"
+
+namespace {
+constexpr uint64_t CHUNK_SIZE = 4096;
+
+std::string make_contents() {
+    std::string data(150 * CHUNK_SIZE + 321, '\0');
+    uint32_t state = 0x9e3779b9;
+    for (char& byte : data) {
+        state = state * 1664525 + 1013904223;
+        byte = static_cast<char>(state >> 24);
+    }
+    return data;
+}
+
+// One part and one thread, so chunks are fetched strictly one after another
+multipart_transfer::options single_thread() {
+    multipart_transfer::options opts;
+    opts.max_threads = 1;
+    opts.chunk_size_bytes = CHUNK_SIZE;
+    opts.per_request_timeout_seconds = 5;
+    return opts;
+}
+
+// What a range callback saw
+struct delivery {
+    uint64_t offset = 0;
+    std::string data;
+    bool failed = false;
+    int chunks_before = 0; // chunks downloaded by the time it arrived
+    std::thread::id thread;
+};
+
+class recorder {
+public:
+    multipart_transfer::range_callback_t callback() {
+        return [this](uint64_t offset, const uint8_t* data, uint64_t length) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            delivery received;
+            received.offset = offset;
+            received.failed = data == nullptr;
+            if (data) {
+                received.data.assign(reinterpret_cast<const char*>(data), length);
+            }
+            received.chunks_before = m_chunks;
+            received.thread = std::this_thread::get_id();
+            m_deliveries.push_back(std::move(received));
+        };
+    }
+
+    multipart_transfer::progress_callback_t progress() {
+        return [this](const multipart_transfer::progress_info&) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_chunks++;
+        };
+    }
+
+    std::vector<delivery> deliveries() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_deliveries;
+    }
+
+private:
+    std::mutex m_mutex;
+    int m_chunks = 0;
+    std::vector<delivery> m_deliveries;
+};
+
+bool download(multipart_transfer& transfer, range_server& server, recorder& events) {
+    bool succeeded = false;
+    transfer.download(server.url(), single_thread(), events.progress(),
+                      [&](bool success, const std::string&) { succeeded = success; });
+    return succeeded;
+}
+
+void test_ranges_come_first_in_order(range_server& server, const std::string& contents) {
+    multipart_transfer transfer;
+    recorder events;
+    // Near the end, then the middle, across a chunk boundary
+    transfer.add_priority_range(140 * CHUNK_SIZE + 10, 100, events.callback());
+    transfer.add_priority_range(70 * CHUNK_SIZE - 50, 100, events.callback());
+    CHECK(download(transfer, server, events));
+
+    std::vector<delivery> received = events.deliveries();
+    CHECK(received.size() == 2);
+    CHECK(received[0].offset == 140 * CHUNK_SIZE + 10);
+    CHECK(received[0].data == contents.substr(140 * CHUNK_SIZE + 10, 100));
+    CHECK(received[0].chunks_before == 1); // the first chunk fetched
+    CHECK(received[1].offset == 70 * CHUNK_SIZE - 50);
+    CHECK(received[1].data == contents.substr(70 * CHUNK_SIZE - 50, 100));
+    CHECK(received[1].chunks_before == 3); // the two chunks it straddles came next
+    CHECK(transfer.size() == contents.size());
+}
+
+void test_range_added_from_a_callback(range_server& server, const std::string& contents) {
+    // As a reader does when it follows an offset it just parsed
+    multipart_transfer transfer;
+    recorder events;
+    auto follow = events.callback();
+    transfer.add_priority_range(100 * CHUNK_SIZE, 8, [&](uint64_t offset, const uint8_t* data,
+                                                         uint64_t length) {
+        follow(offset, data, length);
+        transfer.add_priority_range(120 * CHUNK_SIZE, 16, events.callback());
+    });
+    CHECK(download(transfer, server, events));
+
+    std::vector<delivery> received = events.deliveries();
+    CHECK(received.size() == 2);
+    CHECK(received[1].offset == 120 * CHUNK_SIZE);
+    CHECK(received[1].data == contents.substr(120 * CHUNK_SIZE, 16));
+    CHECK(received[1].chunks_before == 2);
+}
+
+void test_ranges_after_the_download(range_server& server, const std::string& contents) {
+    multipart_transfer transfer;
+    recorder events;
+    CHECK(download(transfer, server, events));
+
+    // Already there: delivered before add_priority_range returns, on this thread
+    transfer.add_priority_range(contents.size() - 5, 50, events.callback());
+    std::vector<delivery> received = events.deliveries();
+    CHECK(received.size() == 1);
+    CHECK(received[0].thread == std::this_thread::get_id());
+    CHECK(received[0].data == contents.substr(contents.size() - 5)); // trimmed to the file
+
+    transfer.add_priority_range(contents.size(), 10, events.callback());
+    transfer.release();
+    transfer.add_priority_range(0, 10, events.callback());
+    received = events.deliveries();
+    CHECK(received.size() == 3);
+    CHECK(received[1].failed); // past the end of the file
+    CHECK(received[2].failed); // the bytes were released
+}
+
+void test_failed_download_fails_ranges(range_server& server, const std::string&) {
+    multipart_transfer transfer;
+    recorder events;
+    transfer.add_priority_range(50 * CHUNK_SIZE, 10, events.callback());
+    server.cut_short(1000);
+    bool succeeded = download(transfer, server, events);
+    server.cut_short(0);
+    CHECK(!succeeded);
+
+    std::vector<delivery> received = events.deliveries();
+    CHECK(received.size() == 1);
+    CHECK(received[0].failed);
+
+    // Later ranges of a failed download fail right away
+    transfer.add_priority_range(0, 10, events.callback());
+    received = events.deliveries();
+    CHECK(received.size() == 2);
+    CHECK(received[1].failed);
+    CHECK(received[1].thread == std::this_thread::get_id());
+}
+} // namespace
+
+int main() {
+    std::string contents = make_contents();
+    range_server server(contents);
+
+    const std::pair<const char*, std::function<void(range_server&, const std::string&)>> tests[] =
+        {{"ranges come first, in order", test_ranges_come_first_in_order},
+         {"range added from a callback", test_range_added_from_a_callback},
+         {"ranges after the download", test_ranges_after_the_download},
+         {"failed download fails ranges", test_failed_download_fails_ranges}};
+
+    for (const auto& [name, test] : tests) {
+        int before = failures;
+        test(server, contents);
+        std::cout << "[Test] " << name << ": " << (failures == before ? "ok" : "FAILED")
+                  << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+// Small HTTP server for the tests, running in the test process on a loopback port
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Serves one file over HTTP/1.1 with keep-alive, one thread per connection
+class range_server {
+public:
+    explicit range_server(std::string contents) : m_contents(std::move(contents)) {
+        m_listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (m_listen_fd == -1 ||
+            bind(m_listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1 ||
+            listen(m_listen_fd, 8) == -1 ||
+            getsockname(m_listen_fd, reinterpret_cast<sockaddr*>(&address), &length) == -1) {
+            perror("[Test] Failed to start the HTTP server");
+            return;
+        }
+        m_port = ntohs(address.sin_port);
+        m_accept_thread = std::thread([this]() { accept_loop(); });
+    }
+
+    ~range_server() {
+        m_stopping = true;
+        shutdown(m_listen_fd, SHUT_RDWR);
+        if (m_accept_thread.joinable()) {
+            m_accept_thread.join();
+        }
+        close(m_listen_fd);
+    }
+
+    std::string url() const {
+        return "http://127.0.0.1:" + std::to_string(m_port) + "/synthetic.iso";
+    }
+
+    // The next count range requests get half the requested bytes
+    void cut_short(int count) {
+        m_short_responses = count;
+    }
+    // Answer every request with 200 and the whole file, as servers without range support do
+    void ignore_ranges(bool ignore) {
+        m_ignore_ranges = ignore;
+    }
+
+private:
+    std::string m_contents;
+    int m_listen_fd = -1;
+    uint16_t m_port = 0;
+    std::thread m_accept_thread;
+    std::vector<std::thread> m_connection_threads;
+    std::atomic<bool> m_stopping{false};
+    std::atomic<int> m_short_responses{0};
+    std::atomic<bool> m_ignore_ranges{false};
+
+    void accept_loop() {
+        std::vector<int> connections;
+        while (!m_stopping) {
+            int fd = accept4(m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd == -1) {
+                break;
+            }
+            connections.push_back(fd);
+            m_connection_threads.emplace_back([this, fd]() { serve(fd); });
+        }
+        for (int fd : connections) {
+            shutdown(fd, SHUT_RDWR);
+        }
+        for (auto& thread : m_connection_threads) {
+            thread.join();
+        }
+        for (int fd : connections) {
+            close(fd);
+        }
+    }
+
+    static bool send_all(int fd, const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t result = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (result <= 0) {
+                return false;
+            }
+            sent += static_cast<size_t>(result);
+        }
+        return true;
+    }
+
+    void serve(int fd) {
+        std::string pending;
+        char buffer[4096];
+        while (true) {
+            size_t end = pending.find("\r\n\r\n");
+            if (end == std::string::npos) {
+                ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+                if (received <= 0) {
+                    return;
+                }
+                pending.append(buffer, static_cast<size_t>(received));
+                continue;
+            }
+            std::string head = pending.substr(0, end);
+            pending.erase(0, end + 4);
+            if (!send_all(fd, respond(head))) {
+                return;
+            }
+        }
+    }
+
+    std::string respond(std::string head) {
+        std::transform(head.begin(), head.end(), head.begin(), ::tolower);
+        size_t range = head.find("\r\nrange: bytes=");
+        uint64_t size = m_contents.size();
+
+        if (range == std::string::npos || m_ignore_ranges) {
+            return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(size) + "\r\n\r\n" +
+                   m_contents;
+        }
+
+        uint64_t first = 0;
+        uint64_t last = 0;
+        const char* format = "\r\nrange: bytes=%" SCNu64 "-%" SCNu64;
+        if (sscanf(head.c_str() + range, format, &first, &last) != 2 || first > last ||
+            last >= size) {
+            return "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" +
+                   std::to_string(size) + "\r\nContent-Length: 0\r\n\r\n";
+        }
+
+        std::string body = m_contents.substr(first, last - first + 1);
+        if (m_short_responses > 0) {
+            m_short_responses--;
+            body.resize(body.size() / 2);
+        }
+        // A short response still claims the full range, as a truncating proxy would
+        return "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + std::to_string(first) +
+               "-" + std::to_string(last) + "/" + std::to_string(size) +
+               "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    }
+};
@@ -0,0 +1,131 @@
+// Tests for task_graph: dependencies run in order, a failed, throwing or cancelled task stops the
+// graph with its error, and whatever never ran is reported as skipped.
+//
+// Usage: task_graph_test (exits non-zero if a check fails)
+
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "check.hpp"
+#include "util/task_graph.hpp"
+
+namespace {
+std::vector<std::string> statuses(const task_graph& graph) {
+    std::vector<std::string> result;
+    for (const task_graph::timing& task : graph.timings()) {
+        result.push_back(task.status);
+    }
+    return result;
+}
+
+void test_dependencies_run_first() {
+    task_graph graph;
+    std::atomic<int> order{0};
+    int first_at = -1;
+    int second_at = -1;
+    int third_at = -1;
+    task_graph::task_id first = graph.add("first", [&](std::string&) {
+        first_at = order++;
+        return true;
+    });
+    task_graph::task_id second = graph.add("second", [&](std::string&) {
+        second_at = order++;
+        return true;
+    }, {first});
+    graph.add("third", [&](std::string&) {
+        third_at = order++;
+        return true;
+    }, {first, second});
+
+    cancellation_token token;
+    std::string error;
+    std::atomic<size_t> finished_calls{0};
+    CHECK(graph.run(token, error, [&](const task_graph::timing&, size_t finished, size_t total) {
+        finished_calls++;
+        CHECK(finished <= total && total == 3);
+    }));
+    CHECK(error.empty());
+    CHECK(first_at == 0 && second_at == 1 && third_at == 2);
+    CHECK(finished_calls == 3);
+    CHECK(statuses(graph) == std::vector<std::string>({"completed", "completed", "completed"}));
+}
+
+void test_failure_skips_dependents() {
+    task_graph graph;
+    bool dependent_ran = false;
+    task_graph::task_id download = graph.add("download", [](std::string& error) {
+        error = "Connection reset";
+        return false;
+    });
+    graph.add("verify", [&](std::string&) {
+        dependent_ran = true;
+        return true;
+    }, {download});
+
+    cancellation_token token;
+    std::string error;
+    CHECK(!graph.run(token, error));
+    CHECK(error == "Connection reset");
+    CHECK(!dependent_ran);
+    CHECK(statuses(graph) == std::vector<std::string>({"failed", "skipped"}));
+}
+
+void test_failure_without_message() {
+    task_graph graph;
+    graph.add("create disk", [](std::string&) { return false; });
+
+    cancellation_token token;
+    std::string error;
+    CHECK(!graph.run(token, error));
+    CHECK(error == "create disk failed");
+}
+
+void test_exception_fails_the_task() {
+    task_graph graph;
+    task_graph::task_id thrower = graph.add("thrower", [](std::string&) -> bool {
+        throw std::runtime_error("Out of disk space");
+    });
+    graph.add("after", [](std::string&) { return true; }, {thrower});
+
+    cancellation_token token;
+    std::string error;
+    CHECK(!graph.run(token, error));
+    CHECK(error == "Out of disk space");
+    CHECK(statuses(graph) == std::vector<std::string>({"failed", "skipped"}));
+}
+
+void test_cancellation_stops_new_tasks() {
+    task_graph graph;
+    cancellation_token token;
+    task_graph::task_id first = graph.add("first", [&](std::string&) {
+        token.cancel("Cancelled by client");
+        return true;
+    });
+    graph.add("second", [](std::string&) { return true; }, {first});
+
+    std::string error;
+    CHECK(!graph.run(token, error));
+    CHECK(error == "Cancelled by client");
+    CHECK(statuses(graph) == std::vector<std::string>({"completed", "skipped"}));
+}
+} // namespace
+
+int main() {
+    const std::pair<const char*, std::function<void()>> tests[] = {
+        {"dependencies run first", test_dependencies_run_first},
+        {"failure skips dependents", test_failure_skips_dependents},
+        {"failure without message", test_failure_without_message},
+        {"exception fails the task", test_exception_fails_the_task},
+        {"cancellation stops new tasks", test_cancellation_stops_new_tasks}};
+
+    for (const auto& [name, test] : tests) {
+        int before = failures;
+        test();
+        std::cout << "[Test] " << name << ": " << (failures == before ? "ok" : "FAILED")
+                  << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,241 @@
+// Tests for wim_metadata on WIM files built in memory: a header with its XML resource and
+// integrity table, read through a read_function, plus headers that point outside the file or
+// disagree with their XML.
+//
+// Usage: wim_metadata_test (exits non-zero if a check fails)
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+#include "check.hpp"
+#include "media/wim_metadata.hpp"
+
+namespace {
+const char* const TWO_IMAGES_XML =
+    "<WIM><TOTALBYTES>4096</TOTALBYTES>"
+    "<IMAGE INDEX=\"2\"><NAME>Windows 11 Pro</NAME><TOTALBYTES>0x10</TOTALBYTES>"
+    "<WINDOWS><ARCH>9</ARCH><EDITIONID>Professional</EDITIONID>"
+    "<LANGUAGES><LANGUAGE>en-US</LANGUAGE><LANGUAGE>de-DE</LANGUAGE>"
+    "<DEFAULT>en-US</DEFAULT></LANGUAGES>"
+    "<VERSION><BUILD>22621</BUILD><SPBUILD>1</SPBUILD></VERSION></WINDOWS></IMAGE>"
+    "<IMAGE INDEX=\"1\"><NAME>Windows 11 Home &amp; more</NAME><FILECOUNT>1234</FILECOUNT>"
+    "<WINDOWS><ARCH>12</ARCH><EDITIONID>Core</EDITIONID>"
+    "<VERSION><BUILD>22621</BUILD></VERSION></WINDOWS></IMAGE>"
+    "</WIM>";
+
+void put_le16(std::vector<uint8_t>& data, size_t offset, uint16_t value) {
+    data[offset] = static_cast<uint8_t>(value);
+    data[offset + 1] = static_cast<uint8_t>(value >> 8);
+}
+
+void put_le32(std::vector<uint8_t>& data, size_t offset, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        data[offset + i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+void put_le64(std::vector<uint8_t>& data, size_t offset, uint64_t value) {
+    put_le32(data, offset, static_cast<uint32_t>(value));
+    put_le32(data, offset + 4, static_cast<uint32_t>(value >> 32));
+}
+
+// Resource header: 7-byte stored size, flags byte, offset, original size
+void put_resource(std::vector<uint8_t>& data, size_t offset, uint64_t resource_offset,
+                  uint64_t size, uint8_t flags = 0) {
+    put_le64(data, offset, size | (static_cast<uint64_t>(flags) << 56));
+    put_le64(data, offset + 8, resource_offset);
+    put_le64(data, offset + 16, size);
+}
+
+// UTF-16LE with a byte order mark, as WIM files store it
+std::string to_utf16le(const std::string& ascii) {
+    std::string result = "\xFF\xFE";
+    for (char c : ascii) {
+        result.push_back(c);
+        result.push_back('\0');
+    }
+    return result;
+}
+
+struct wim_layout {
+    std::string xml = TWO_IMAGES_XML;
+    uint32_t image_count = 2;
+    uint8_t xml_flags = 0;
+    uint64_t blob_table_size = 1000; // right after the header
+    uint32_t chunk_size = 256;
+    bool integrity = true;
+    int32_t integrity_entry_adjust = 0; // a wrong entry count makes the table malformed
+};
+
+// Header, blob table (filler bytes), integrity table, then the XML
+std::vector<uint8_t> make_wim(const wim_layout& layout) {
+    std::vector<uint8_t> data(wim_metadata::HEADER_SIZE, 0);
+    memcpy(data.data(), "MSWIM\0\0\0", 8);
+    put_le32(data, 8, wim_metadata::HEADER_SIZE);
+    put_le32(data, 12, 0x10d00);
+    put_le16(data, 40, 1);
+    put_le16(data, 42, 1);
+    put_le32(data, 44, layout.image_count);
+
+    uint64_t blob_table_offset = data.size();
+    put_resource(data, 48, blob_table_offset, layout.blob_table_size);
+    data.resize(data.size() + layout.blob_table_size, 0xAB);
+
+    if (layout.integrity) {
+        uint64_t covered = blob_table_offset + layout.blob_table_size - wim_metadata::HEADER_SIZE;
+        uint32_t entries = static_cast<uint32_t>(
+            (covered + layout.chunk_size - 1) / layout.chunk_size + layout.integrity_entry_adjust);
+        uint64_t integrity_offset = data.size();
+        uint64_t integrity_size = 12 + uint64_t(entries) * 20;
+        put_resource(data, 124, integrity_offset, integrity_size);
+        data.resize(data.size() + integrity_size, 0);
+        put_le32(data, integrity_offset, static_cast<uint32_t>(integrity_size));
+        put_le32(data, integrity_offset + 4, entries);
+        put_le32(data, integrity_offset + 8, layout.chunk_size);
+        for (uint32_t i = 0; i < entries; i++) {
+            data[integrity_offset + 12 + i * 20] = static_cast<uint8_t>(i + 1);
+        }
+    }
+
+    std::string xml = to_utf16le(layout.xml);
+    put_resource(data, 72, data.size(), xml.size(), layout.xml_flags);
+    data.insert(data.end(), xml.begin(), xml.end());
+    return data;
+}
+
+wim_metadata::read_function reader(const std::vector<uint8_t>& data) {
+    return [&data](uint64_t offset, void* buffer, size_t length) {
+        if (offset > data.size() || length > data.size() - offset) {
+            return false;
+        }
+        memcpy(buffer, data.data() + offset, length);
+        return true;
+    };
+}
+
+void test_header_fields() {
+    std::vector<uint8_t> data = make_wim({});
+    std::string error;
+    std::optional<wim_metadata::header> header =
+        wim_metadata::parse_header(data.data(), data.size(), error);
+    CHECK(header);
+    CHECK(header->image_count == 2);
+    CHECK(header->part_number == 1 && header->total_parts == 1);
+    CHECK(header->blob_table_offset == wim_metadata::HEADER_SIZE);
+    CHECK(header->blob_table_size == 1000);
+    CHECK(header->xml_size == to_utf16le(TWO_IMAGES_XML).size());
+    CHECK(header->xml_offset + header->xml_size == data.size());
+    CHECK(header->integrity_size > 0);
+}
+
+void test_images_from_xml() {
+    std::vector<uint8_t> data = make_wim({});
+    std::string error;
+    std::optional<std::vector<wim_metadata::image>> images =
+        wim_metadata::read_images(reader(data), data.size(), error);
+    CHECK(images);
+    CHECK(images->size() == 2);
+
+    // Ordered by index, whatever the XML order
+    const wim_metadata::image& home = (*images)[0];
+    CHECK(home.index == 1);
+    CHECK(home.name == "Windows 11 Home & more");
+    CHECK(home.edition_id == "Core");
+    CHECK(home.architecture == "arm64");
+    CHECK(home.build == "22621");
+    CHECK(home.file_count == 1234);
+
+    const wim_metadata::image& pro = (*images)[1];
+    CHECK(pro.index == 2);
+    CHECK(pro.architecture == "x64");
+    CHECK(pro.build == "22621.1");
+    CHECK(pro.languages == std::vector<std::string>({"en-US", "de-DE"}));
+    CHECK(pro.default_language == "en-US");
+    CHECK(pro.total_bytes == 16);
+}
+
+void test_rejected_headers() {
+    std::string error;
+    std::vector<uint8_t> data = make_wim({});
+    data[0] = 'X';
+    CHECK(!wim_metadata::read_images(reader(data), data.size(), error));
+    CHECK(error == "Not a WIM file");
+
+    data = make_wim({});
+    CHECK(!wim_metadata::parse_header(data.data(), wim_metadata::HEADER_SIZE - 1, error));
+    CHECK(error == "File too small for a WIM header");
+
+    wim_layout compressed;
+    compressed.xml_flags = 0x04;
+    data = make_wim(compressed);
+    CHECK(!wim_metadata::read_images(reader(data), data.size(), error));
+    CHECK(error == "Compressed WIM XML data is not supported");
+
+    // XML past the end of a truncated file
+    data = make_wim({});
+    data.resize(data.size() - 10);
+    CHECK(!wim_metadata::read_images(reader(data), data.size(), error));
+    CHECK(error == "Invalid WIM XML location");
+
+    wim_layout miscounted;
+    miscounted.image_count = 3;
+    data = make_wim(miscounted);
+    CHECK(!wim_metadata::read_images(reader(data), data.size(), error));
+    CHECK(error == "WIM XML lists 2 images, header says 3");
+}
+
+void test_integrity_table() {
+    std::vector<uint8_t> data = make_wim({});
+    std::string error;
+    std::optional<wim_metadata::integrity_table> table =
+        wim_metadata::read_integrity_table(reader(data), data.size(), error);
+    CHECK(table);
+    CHECK(table->start == wim_metadata::HEADER_SIZE);
+    CHECK(table->end == wim_metadata::HEADER_SIZE + 1000);
+    CHECK(table->chunk_size == 256);
+    CHECK(table->chunk_digests.size() == 4); // 1000 bytes in 256-byte chunks
+    CHECK(table->chunk_digests[0][0] == 1 && table->chunk_digests[3][0] == 4);
+
+    wim_layout without;
+    without.integrity = false;
+    data = make_wim(without);
+    table = wim_metadata::read_integrity_table(reader(data), data.size(), error);
+    CHECK(table);
+    CHECK(table->chunk_digests.empty());
+
+    wim_layout malformed;
+    malformed.integrity_entry_adjust = 1;
+    data = make_wim(malformed);
+    CHECK(!wim_metadata::read_integrity_table(reader(data), data.size(), error));
+    CHECK(error == "Malformed WIM integrity table");
+}
+
+void test_failed_read() {
+    std::vector<uint8_t> data = make_wim({});
+    std::string error;
+    auto failing = [](uint64_t, void*, size_t) { return false; };
+    CHECK(!wim_metadata::read_images(failing, data.size(), error));
+    CHECK(error == "Failed to read WIM header");
+}
+} // namespace
+
+int main() {
+    const std::pair<const char*, std::function<void()>> tests[] = {
+        {"header fields", test_header_fields},
+        {"images from XML", test_images_from_xml},
+        {"rejected headers", test_rejected_headers},
+        {"integrity table", test_integrity_table},
+        {"failed read", test_failed_read}};
+
+    for (const auto& [name, test] : tests) {
+        int before = failures;
+        test();
+        std::cout << "[Test] " << name << ": " << (failures == before ? "ok" : "FAILED")
+                  << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}